@@ -0,0 +1,428 @@
+#include <internal/bcache/bcache.h>
+#include <internal/debug/debug.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+
+// max iovec count accepted by single preadv/pwritev on linux
+#define BCACHE_IOV_MAX 1024
+
+
+// =========== [ IMAGE IO ] ===========
+
+static void read_image(Filesystem *fs, void *data, uint32_t size, uint64_t offset) {
+    struct iovec iov = {.iov_base = data, .iov_len = size};
+    minifs_read_vector(fs->fd, &iov, 1, offset);
+}
+
+
+// =========== [ BUFFERS ] ===========
+
+static uint64_t body_offset(Filesystem *fs, uint32_t block) {
+    return minifs_block_body_offset(fs, block);
+}
+
+
+static bool is_dirty(Buffer *buffer) {
+    return buffer->dirty_end > buffer->dirty_begin;
+}
+
+
+static uint32_t bucket(BufferCache *cache, uint32_t block) {
+    return (block * 2654435761u) & cache->bucket_mask;
+}
+
+
+static int32_t find(BufferCache *cache, uint32_t block) {
+    int32_t index = cache->buckets[bucket(cache, block)];
+    while (index >= 0 && cache->buffers[index].block != block) {
+        index = cache->buffers[index].next;
+    }
+    return index;
+}
+
+
+static void unhash(BufferCache *cache, int32_t index) {
+    int32_t *link = &cache->buckets[bucket(cache, cache->buffers[index].block)];
+    while (*link != index) {
+        link = &cache->buffers[*link].next;
+    }
+    *link = cache->buffers[index].next;
+    cache->buffers[index].block = BCACHE_NONE;
+}
+
+
+// range of buffer which can be written to image: loaded buffers
+// are written whole, so they can be merged with neighbours
+static void writable_range(Filesystem *fs, Buffer *buffer, uint32_t *begin, uint32_t *end) {
+    *begin = buffer->loaded ? 0 : buffer->dirty_begin;
+    *end = buffer->loaded ? fs->sblock.block_size : buffer->dirty_end;
+}
+
+
+// dirty buffer of block which continues "left" on disk or -1
+static int32_t next_in_run(Filesystem *fs, int32_t left, uint32_t block) {
+    BufferCache *cache = fs->bcache;
+    int32_t right = find(cache, block);
+    if (right < 0 || !is_dirty(&cache->buffers[right])) {
+        return -1;
+    }
+    uint32_t begin, end, next_begin, next_end;
+    writable_range(fs, &cache->buffers[left], &begin, &end);
+    writable_range(fs, &cache->buffers[right], &next_begin, &next_end);
+    uint32_t block_size = fs->sblock.block_size;
+    if (end != block_size || next_begin != 0 ||
+        body_offset(fs, block) != body_offset(fs, cache->buffers[left].block) + block_size) {
+        return -1;
+    }
+    return right;
+}
+
+
+// writes dirty buffer together with dirty buffers of adjacent blocks,
+// write is queued to batch if it is not NULL
+static void writeback_run(Filesystem *fs, int32_t index, UringBatch *batch) {
+    BufferCache *cache = fs->bcache;
+    // walk to first buffer of run
+    while (cache->buffers[index].block > 0) {
+        int32_t left = find(cache, cache->buffers[index].block - 1);
+        if (left < 0 || !is_dirty(&cache->buffers[left]) || next_in_run(fs, left, cache->buffers[index].block) != index) {
+            break;
+        }
+        index = left;
+    }
+
+    struct iovec iov[BCACHE_IOV_MAX];
+    int32_t members[BCACHE_IOV_MAX];
+    int count = 0;
+    uint32_t begin, end;
+    writable_range(fs, &cache->buffers[index], &begin, &end);
+    uint64_t offset = body_offset(fs, cache->buffers[index].block) + begin;
+    while (index >= 0 && count < BCACHE_IOV_MAX) {
+        Buffer *buffer = &cache->buffers[index];
+        writable_range(fs, buffer, &begin, &end);
+        iov[count].iov_base = buffer->data + begin;
+        iov[count].iov_len = end - begin;
+        members[count++] = index;
+        index = next_in_run(fs, index, buffer->block + 1);
+    }
+
+    if (batch != NULL) {
+        minifs_queue_write(fs, batch, iov, count, offset);
+    } else {
+        minifs_write_vector(fs->fd, iov, count, offset);
+    }
+    cache->writebacks++;
+    for (int member = 0; member < count; ++member) {
+        cache->buffers[members[member]].dirty_begin = 0;
+        cache->buffers[members[member]].dirty_end = 0;
+    }
+}
+
+
+// reads body of buffer, modified bytes are kept
+static void load(Filesystem *fs, int32_t index) {
+    BufferCache *cache = fs->bcache;
+    Buffer *buffer = &cache->buffers[index];
+    uint32_t block_size = fs->sblock.block_size;
+    if (!is_dirty(buffer)) {
+        read_image(fs, buffer->data, block_size, body_offset(fs, buffer->block));
+    } else {
+        unsigned char *body = (unsigned char*) malloc(block_size);
+        read_image(fs, body, block_size, body_offset(fs, buffer->block));
+        memcpy(body + buffer->dirty_begin, buffer->data + buffer->dirty_begin, buffer->dirty_end - buffer->dirty_begin);
+        memcpy(buffer->data, body, block_size);
+        free(body);
+    }
+    buffer->loaded = true;
+}
+
+
+// returns buffer of block, free buffer or CLOCK victim is used on miss
+static int32_t get(Filesystem *fs, uint32_t block) {
+    BufferCache *cache = fs->bcache;
+    int32_t index = find(cache, block);
+    if (index >= 0) {
+        cache->buffers[index].referenced = true;
+        return index;
+    }
+
+    if (cache->count < cache->capacity) {
+        index = cache->count++;
+    } else {
+        while (true) {
+            Buffer *buffer = &cache->buffers[cache->hand];
+            index = cache->hand;
+            cache->hand = (cache->hand + 1) % cache->capacity;
+            if (buffer->pinned) {
+                continue;
+            }
+            if (buffer->referenced) {  // second chance
+                buffer->referenced = false;
+                continue;
+            }
+            break;
+        }
+        if (is_dirty(&cache->buffers[index])) {
+            writeback_run(fs, index, NULL);
+        }
+        unhash(cache, index);
+    }
+
+    Buffer *buffer = &cache->buffers[index];
+    buffer->block = block;
+    buffer->loaded = false;
+    buffer->referenced = true;
+    buffer->pinned = false;
+    buffer->dirty_begin = 0;
+    buffer->dirty_end = 0;
+    buffer->next = cache->buckets[bucket(cache, block)];
+    cache->buckets[bucket(cache, block)] = index;
+    return index;
+}
+
+
+// =========== [ CACHE ] ===========
+
+void bcache_init(BufferCache *cache, uint32_t block_size, uint32_t size) {
+    cache->capacity = size / block_size;
+    cache->count = 0;
+    cache->hand = 0;
+    cache->hits = 0;
+    cache->misses = 0;
+    cache->writebacks = 0;
+
+    uint32_t buckets = 1;
+    while (buckets < cache->capacity * 2) {
+        buckets *= 2;
+    }
+    cache->bucket_mask = buckets - 1;
+    cache->buckets = (int32_t*) malloc(buckets * sizeof(int32_t));
+    memset(cache->buckets, 0xFF, buckets * sizeof(int32_t));
+
+    cache->buffers = (Buffer*) calloc(cache->capacity > 0 ? cache->capacity : 1, sizeof(Buffer));
+    cache->memory = (unsigned char*) malloc((uint64_t) cache->capacity * block_size + 1);
+    for (uint32_t index = 0; index < cache->capacity; ++index) {
+        cache->buffers[index].block = BCACHE_NONE;
+        cache->buffers[index].data = cache->memory + (uint64_t) index * block_size;
+    }
+}
+
+
+void bcache_free(BufferCache *cache) {
+    free(cache->buffers);
+    free(cache->memory);
+    free(cache->buckets);
+    cache->buffers = NULL;
+    cache->memory = NULL;
+    cache->buckets = NULL;
+    cache->capacity = 0;
+}
+
+
+// requests larger than half of cache bypass it, so streaming
+// through big file does not evict whole cache
+static bool bypass(BufferCache *cache, uint32_t blocks) {
+    return blocks > cache->capacity / 2;
+}
+
+
+static void read_blocks(Filesystem *fs, UringBatch *batch, uint32_t block, void *data, uint32_t size, uint32_t offset) {
+    BufferCache *cache = fs->bcache;
+    uint32_t block_size = fs->sblock.block_size;
+    block += offset / block_size;
+    offset %= block_size;
+    uint32_t blocks = (offset + size + block_size - 1) / block_size;
+
+    if (bypass(cache, blocks)) {
+        // dirty buffers of range go to image first, then image is read
+        // without cache lock, so big reads of many threads overlap
+        if (cache->capacity > 0) {
+            pthread_mutex_lock(&fs->locks->bcache);
+            cache->misses += blocks;
+            for (uint32_t number = 0; number < blocks && cache->count > 0; ++number) {
+                int32_t index = find(cache, block + number);
+                if (index >= 0 && is_dirty(&cache->buffers[index])) {
+                    writeback_run(fs, index, NULL);
+                }
+            }
+            pthread_mutex_unlock(&fs->locks->bcache);
+        }
+        if (batch != NULL) {
+            struct iovec iov = {.iov_base = data, .iov_len = size};
+            minifs_queue_read(fs, batch, &iov, 1, body_offset(fs, block) + offset);
+        } else {
+            read_image(fs, data, size, body_offset(fs, block) + offset);
+        }
+        return;
+    }
+
+    pthread_mutex_lock(&fs->locks->bcache);
+    // take buffers of all blocks first, so missing ones are read together
+    int32_t *indexes = (int32_t*) malloc(blocks * sizeof(int32_t));
+    for (uint32_t number = 0; number < blocks; ++number) {
+        int32_t index = find(cache, block + number);
+        if (index >= 0 && cache->buffers[index].loaded) {
+            cache->hits++;
+        } else {
+            cache->misses++;
+        }
+        indexes[number] = get(fs, block + number);
+        cache->buffers[indexes[number]].pinned = true;
+    }
+
+    struct iovec *iov = (struct iovec*) malloc(blocks * sizeof(struct iovec));
+    uint32_t number = 0;
+    while (number < blocks) {
+        Buffer *buffer = &cache->buffers[indexes[number]];
+        if (buffer->loaded) {
+            ++number;
+            continue;
+        }
+        if (is_dirty(buffer)) {
+            load(fs, indexes[number++]);
+            continue;
+        }
+
+        // run of clean blocks which are adjacent on disk
+        uint32_t first = number;
+        int count = 0;
+        do {
+            iov[count].iov_base = cache->buffers[indexes[number]].data;
+            iov[count++].iov_len = block_size;
+            cache->buffers[indexes[number]].loaded = true;
+            ++number;
+        } while (number < blocks && !cache->buffers[indexes[number]].loaded &&
+                 !is_dirty(&cache->buffers[indexes[number]]) &&
+                 body_offset(fs, block + number) == body_offset(fs, block + number - 1) + block_size);
+        minifs_read_vector(fs->fd, iov, count, body_offset(fs, block + first));
+    }
+
+    uint32_t copied = 0;
+    for (number = 0; number < blocks; ++number) {
+        uint32_t begin = (number == 0) ? offset : 0;
+        uint32_t length = block_size - begin < size - copied ? block_size - begin : size - copied;
+        memcpy((unsigned char*) data + copied, cache->buffers[indexes[number]].data + begin, length);
+        cache->buffers[indexes[number]].pinned = false;
+        copied += length;
+    }
+    pthread_mutex_unlock(&fs->locks->bcache);
+    free(indexes);
+    free(iov);
+}
+
+
+void bcache_read(Filesystem *fs, uint32_t block, void *data, uint32_t size, uint32_t offset) {
+    read_blocks(fs, NULL, block, data, size, offset);
+}
+
+
+void bcache_queue_read(Filesystem *fs, UringBatch *batch, uint32_t block, void *data, uint32_t size, uint32_t offset) {
+    read_blocks(fs, batch, block, data, size, offset);
+}
+
+
+void bcache_write(Filesystem *fs, uint32_t block, const void *data, uint32_t size, uint32_t offset) {
+    BufferCache *cache = fs->bcache;
+    uint32_t block_size = fs->sblock.block_size;
+    block += offset / block_size;
+    offset %= block_size;
+    uint32_t blocks = (offset + size + block_size - 1) / block_size;
+
+    pthread_mutex_lock(&fs->locks->bcache);
+    if (bypass(cache, blocks)) {
+        minifs_write_block(fs->fd, (void*) data, size, body_offset(fs, block) + offset);
+
+        // keep cached copies in sync with image
+        for (uint32_t number = 0; number < blocks && cache->count > 0; ++number) {
+            int32_t index = find(cache, block + number);
+            if (index < 0) {
+                continue;
+            }
+            Buffer *buffer = &cache->buffers[index];
+            int64_t shift = (int64_t) number * block_size - offset;
+            int64_t begin = shift > 0 ? shift : 0;
+            int64_t end = shift + block_size < size ? shift + block_size : size;
+            memcpy(buffer->data + (begin - shift), (const unsigned char*) data + begin, end - begin);
+        }
+        pthread_mutex_unlock(&fs->locks->bcache);
+        return;
+    }
+
+    uint32_t copied = 0;
+    for (uint32_t number = 0; number < blocks; ++number) {
+        int32_t index = get(fs, block + number);
+        Buffer *buffer = &cache->buffers[index];
+        uint32_t begin = (number == 0) ? offset : 0;
+        uint32_t length = block_size - begin < size - copied ? block_size - begin : size - copied;
+        uint32_t end = begin + length;
+
+        // unknown bytes between two modified ranges must be read first
+        if (!buffer->loaded && is_dirty(buffer) && (end < buffer->dirty_begin || begin > buffer->dirty_end)) {
+            load(fs, index);
+        }
+        memcpy(buffer->data + begin, (const unsigned char*) data + copied, length);
+        if (!is_dirty(buffer)) {
+            buffer->dirty_begin = begin;
+            buffer->dirty_end = end;
+        } else {
+            buffer->dirty_begin = begin < buffer->dirty_begin ? begin : buffer->dirty_begin;
+            buffer->dirty_end = end > buffer->dirty_end ? end : buffer->dirty_end;
+        }
+        copied += length;
+    }
+    pthread_mutex_unlock(&fs->locks->bcache);
+}
+
+
+static int compare_blocks(const void *lhs, const void *rhs) {
+    const Buffer *left = *(const Buffer**) lhs;
+    const Buffer *right = *(const Buffer**) rhs;
+    return (left->block > right->block) - (left->block < right->block);
+}
+
+
+static void flush(Filesystem *fs) {
+    BufferCache *cache = fs->bcache;
+    uint32_t count = 0;
+    Buffer **dirty = (Buffer**) malloc((cache->count > 0 ? cache->count : 1) * sizeof(Buffer*));
+    for (uint32_t index = 0; index < cache->count; ++index) {
+        if (cache->buffers[index].block != BCACHE_NONE && is_dirty(&cache->buffers[index])) {
+            dirty[count++] = &cache->buffers[index];
+        }
+    }
+
+    // runs are written from their first block, so sorted order
+    // writes every run with one call
+    qsort(dirty, count, sizeof(Buffer*), compare_blocks);
+    UringBatch batch = {0};
+    for (uint32_t index = 0; index < count; ++index) {
+        if (is_dirty(dirty[index])) {
+            writeback_run(fs, dirty[index] - cache->buffers, &batch);
+        }
+    }
+    minifs_wait_batch(fs, &batch);  // buffers stay untouched under cache lock
+    free(dirty);
+}
+
+
+void bcache_flush(Filesystem *fs) {
+    pthread_mutex_lock(&fs->locks->bcache);
+    flush(fs);
+    pthread_mutex_unlock(&fs->locks->bcache);
+}
+
+
+void bcache_invalidate(Filesystem *fs) {
+    BufferCache *cache = fs->bcache;
+    pthread_mutex_lock(&fs->locks->bcache);
+    flush(fs);
+    for (uint32_t index = 0; index < cache->capacity; ++index) {
+        cache->buffers[index].block = BCACHE_NONE;
+    }
+    memset(cache->buckets, 0xFF, (cache->bucket_mask + 1) * sizeof(int32_t));
+    cache->count = 0;
+    cache->hand = 0;
+    pthread_mutex_unlock(&fs->locks->bcache);
+}
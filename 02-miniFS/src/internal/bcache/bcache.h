@@ -0,0 +1,72 @@
+#ifndef BCACHE_H
+#define BCACHE_H
+
+#include <internal/fs/fs.h>
+
+/*
+	Buffer cache of block bodies for fd backend. Buffers are
+	evicted with CLOCK algorithm, modified buffers are written
+	back on eviction and flush, dirty buffers of adjacent blocks
+	go to image with single pwritev. Cache is guarded by
+	fs->locks->bcache, requests which bypass it read image
+	without the lock.
+*/
+
+#define BCACHE_DEFAULT_SIZE (256 * 1024)
+#define BCACHE_NONE         0xFFFFFFFF
+
+
+typedef struct Buffer {
+    uint32_t block;         // BCACHE_NONE if buffer is free
+    int32_t next;           // next buffer in hash chain
+    bool loaded;            // whole body is read from image
+    bool referenced;        // used since last pass of clock hand
+    bool pinned;            // taken by current request, never evicted
+    uint32_t dirty_begin;   // modified range of body
+    uint32_t dirty_end;
+    unsigned char *data;
+} Buffer;
+
+
+typedef struct BufferCache {
+    uint32_t capacity;      // count of buffers, 0 disables cache
+    uint32_t count;         // buffers taken at least once
+    uint32_t hand;
+    Buffer *buffers;
+    unsigned char *memory;
+    int32_t *buckets;
+    uint32_t bucket_mask;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t writebacks;    // pwritev calls issued by cache
+} BufferCache;
+
+
+// function allocates cache which uses at most "size" bytes for bodies
+void bcache_init(BufferCache *cache, uint32_t block_size, uint32_t size);
+
+
+// function frees cache, dirty buffers must be flushed before
+void bcache_free(BufferCache *cache);
+
+
+// fs, first block, data, size, offset inside first block body:
+// size can span several consecutive blocks, callers writing
+// the same blocks must be serialized by inode lock
+void bcache_read(Filesystem *fs, uint32_t block, void *data, uint32_t size, uint32_t offset);
+void bcache_write(Filesystem *fs, uint32_t block, const void *data, uint32_t size, uint32_t offset);
+
+
+// same as bcache_read, but read of image by request which bypasses
+// cache is queued to batch, data is valid after minifs_wait_batch
+void bcache_queue_read(Filesystem *fs, UringBatch *batch, uint32_t block, void *data, uint32_t size, uint32_t offset);
+
+
+// function writes all dirty buffers of fs cache to image
+void bcache_flush(Filesystem *fs);
+
+
+// function drops all buffers, dirty ones are written back
+void bcache_invalidate(Filesystem *fs);
+
+#endif
@@ -0,0 +1,217 @@
+#include <internal/bitmap/bitmap.h>
+#include <stdio.h>
+#include <stdbool.h>
+
+
+bool test_find_zero();
+bool test_count();
+bool test_resize();
+bool test_find_run();
+
+
+int main() {
+    bool global = true;
+    global &= test_find_zero();
+    global &= test_count();
+    global &= test_resize();
+    global &= test_find_run();
+
+    if (global) {
+        printf("[GLOBAL OK]\n");
+    }
+
+    return 0;
+}
+
+
+// =========== [ TESTS ] ===========
+
+bool test_find_zero() {
+    Bitmap bitmap;
+    bool status = true;
+
+    bitmap_init(&bitmap, 200);
+    if (bitmap_find_zero(&bitmap) != 0) {
+        status = false;
+        printf("[BAD] 1 test_find_zero\n");
+    }
+
+    for (uint32_t index = 0; index < 130; ++index) {
+        bitmap_set(&bitmap, index);
+    }
+    if (bitmap_find_zero(&bitmap) != 130) {
+        status = false;
+        printf("[BAD] 2 test_find_zero\n");
+    }
+
+    // next-fit: search starts from hint and wraps around
+    bitmap_clear(&bitmap, 5);
+    bitmap.hint = 131;
+    if (bitmap_find_zero(&bitmap) != 131) {
+        status = false;
+        printf("[BAD] 3 test_find_zero\n");
+    }
+    for (uint32_t index = 130; index < 200; ++index) {
+        bitmap_set(&bitmap, index);
+    }
+    if (bitmap_find_zero(&bitmap) != 5) {
+        status = false;
+        printf("[BAD] 4 test_find_zero\n");
+    }
+
+    // padding bits are never returned
+    bitmap_set(&bitmap, 5);
+    if (bitmap_find_zero(&bitmap) != -1) {
+        status = false;
+        printf("[BAD] 5 test_find_zero\n");
+    }
+    bitmap_free(&bitmap);
+
+    // long runs of full words
+    bitmap_init(&bitmap, 1 << 20);
+    for (uint32_t index = 0; index < (1 << 20); ++index) {
+        bitmap_set(&bitmap, index);
+    }
+    bitmap_clear(&bitmap, 777777);
+    if (bitmap_find_zero(&bitmap) != 777777) {
+        status = false;
+        printf("[BAD] 6 test_find_zero\n");
+    }
+    bitmap.hint = 777778;
+    if (bitmap_find_zero(&bitmap) != 777777) {
+        status = false;
+        printf("[BAD] 7 test_find_zero\n");
+    }
+    bitmap_free(&bitmap);
+
+    if (status) {
+        printf("[OK] test_find_zero\n");
+    } else {
+        printf("[BAD] test_find_zero\n");
+    }
+
+    return status;
+}
+
+
+bool test_count() {
+    Bitmap bitmap;
+    bool status = true;
+
+    bitmap_init(&bitmap, 100);
+    if (bitmap_count(&bitmap) != 0) {
+        status = false;
+        printf("[BAD] 1 test_count\n");
+    }
+    bitmap_set(&bitmap, 0);
+    bitmap_set(&bitmap, 63);
+    bitmap_set(&bitmap, 64);
+    bitmap_set(&bitmap, 99);
+    if (bitmap_count(&bitmap) != 4 || !bitmap_test(&bitmap, 63) || bitmap_test(&bitmap, 62)) {
+        status = false;
+        printf("[BAD] 2 test_count\n");
+    }
+    bitmap_clear(&bitmap, 63);
+    if (bitmap_count(&bitmap) != 3) {
+        status = false;
+        printf("[BAD] 3 test_count\n");
+    }
+    bitmap_free(&bitmap);
+
+    if (status) {
+        printf("[OK] test_count\n");
+    } else {
+        printf("[BAD] test_count\n");
+    }
+
+    return status;
+}
+
+
+bool test_resize() {
+    Bitmap bitmap;
+    bool status = true;
+
+    bitmap_init(&bitmap, 100);
+    for (uint32_t index = 0; index < 100; ++index) {
+        bitmap_set(&bitmap, index);
+    }
+    bitmap_resize(&bitmap, 300);
+    if (bitmap_count(&bitmap) != 100 || bitmap_find_zero(&bitmap) != 100 || bitmap_test(&bitmap, 150)) {
+        status = false;
+        printf("[BAD] 1 test_resize\n");
+    }
+
+    // padding of new last word stays set
+    for (uint32_t index = 100; index < 300; ++index) {
+        bitmap_set(&bitmap, index);
+    }
+    if (bitmap_find_zero(&bitmap) != -1 || bitmap_count(&bitmap) != 300) {
+        status = false;
+        printf("[BAD] 2 test_resize\n");
+    }
+    bitmap_free(&bitmap);
+
+    if (status) {
+        printf("[OK] test_resize\n");
+    } else {
+        printf("[BAD] test_resize\n");
+    }
+
+    return status;
+}
+
+
+bool test_find_run() {
+    Bitmap bitmap;
+    Bitmap mask;
+    bool status = true;
+
+    // holes shorter than run are skipped
+    bitmap_init(&bitmap, 300);
+    bitmap_init(&mask, 300);
+    for (uint32_t index = 0; index < 300; index += 4) {
+        bitmap_set(&bitmap, index);
+    }
+    for (uint32_t index = 100; index < 120; ++index) {
+        bitmap_clear(&bitmap, index);
+    }
+    if (bitmap_find_run(&bitmap, NULL, 3) != 1 || bitmap_find_run(&bitmap, NULL, 10) != 97 ||
+        bitmap_find_run(&bitmap, NULL, 30) != -1) {
+        status = false;
+        printf("[BAD] 1 test_find_run\n");
+    }
+
+    // blocks set in mask are used too
+    bitmap_set(&mask, 105);
+    if (bitmap_find_run(&bitmap, &mask, 10) != 106 || bitmap_find_run(&bitmap, &mask, 8) != 97) {
+        status = false;
+        printf("[BAD] 2 test_find_run\n");
+    }
+
+    // search starts from hint, wraps around and never passes the end
+    bitmap.hint = 110;
+    if (bitmap_find_run(&bitmap, &mask, 8) != 110 || bitmap_find_run(&bitmap, &mask, 11) != 106 ||
+        bitmap_find_run(&bitmap, &mask, 15) != -1) {
+        status = false;
+        printf("[BAD] 3 test_find_run\n");
+    }
+    for (uint32_t index = 0; index < 297; ++index) {
+        bitmap_set(&bitmap, index);
+    }
+    bitmap.hint = 0;
+    if (bitmap_find_run(&bitmap, NULL, 3) != 297 || bitmap_find_run(&bitmap, NULL, 4) != -1) {
+        status = false;
+        printf("[BAD] 4 test_find_run\n");
+    }
+    bitmap_free(&bitmap);
+    bitmap_free(&mask);
+
+    if (status) {
+        printf("[OK] test_find_run\n");
+    } else {
+        printf("[BAD] test_find_run\n");
+    }
+
+    return status;
+}
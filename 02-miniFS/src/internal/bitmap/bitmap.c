@@ -0,0 +1,172 @@
+#include <internal/bitmap/bitmap.h>
+#include <stdlib.h>
+
+
+#define FULL_WORD (~0ull)
+
+
+uint32_t bitmap_words(uint32_t size) {
+    return (size + 63) / 64;
+}
+
+
+void bitmap_init(Bitmap *bitmap, uint32_t size) {
+    uint32_t count = bitmap_words(size);
+    bitmap->words = (uint64_t*) calloc(count > 0 ? count : 1, sizeof(uint64_t));
+    bitmap->size = size;
+    bitmap->hint = 0;
+
+    // bits past the end are always set, so search never returns them
+    if (size % 64 != 0) {
+        bitmap->words[count - 1] = FULL_WORD << (size % 64);
+    }
+}
+
+
+void bitmap_free(Bitmap *bitmap) {
+    free(bitmap->words);
+    bitmap->words = NULL;
+}
+
+
+void bitmap_resize(Bitmap *bitmap, uint32_t size) {
+    uint32_t old = bitmap_words(bitmap->size);
+    uint32_t count = bitmap_words(size);
+    bitmap->words = (uint64_t*) realloc(bitmap->words, (count > 0 ? count : 1) * sizeof(uint64_t));
+    for (uint32_t index = old; index < count; ++index) {
+        bitmap->words[index] = 0;
+    }
+    if (bitmap->size % 64 != 0) {  // old padding bits become real ones
+        bitmap->words[old - 1] &= ~(FULL_WORD << (bitmap->size % 64));
+    }
+    bitmap->size = size;
+    if (size % 64 != 0) {
+        bitmap->words[count - 1] |= FULL_WORD << (size % 64);
+    }
+}
+
+
+void bitmap_set(Bitmap *bitmap, uint32_t index) {
+    bitmap->words[index / 64] |= 1ull << (index % 64);
+}
+
+
+void bitmap_clear(Bitmap *bitmap, uint32_t index) {
+    bitmap->words[index / 64] &= ~(1ull << (index % 64));
+}
+
+
+bool bitmap_test(const Bitmap *bitmap, uint32_t index) {
+    return (bitmap->words[index / 64] >> (index % 64)) & 1;
+}
+
+
+// first word with cleared bit in [begin, end), full words are skipped
+// four at a time so loop can be vectorized by compiler
+static int64_t scan_words(const uint64_t *words, uint32_t begin, uint32_t end) {
+    uint32_t index = begin;
+    while (index + 4 <= end) {
+        if ((words[index] & words[index + 1] & words[index + 2] & words[index + 3]) != FULL_WORD) {
+            break;
+        }
+        index += 4;
+    }
+    for (; index < end; ++index) {
+        if (words[index] != FULL_WORD) {
+            return (int64_t) index * 64 + __builtin_ctzll(~words[index]);
+        }
+    }
+    return -1;
+}
+
+
+int64_t bitmap_find_zero(const Bitmap *bitmap) {
+    uint32_t count = bitmap_words(bitmap->size);
+    if (count == 0) {
+        return -1;
+    }
+    uint32_t hint = bitmap->hint < bitmap->size ? bitmap->hint : 0;
+    uint32_t start = hint / 64;
+
+    // bits of first word before hint are treated as used
+    uint64_t first = bitmap->words[start] | ((1ull << (hint % 64)) - 1);
+    if (first != FULL_WORD) {
+        return (int64_t) start * 64 + __builtin_ctzll(~first);
+    }
+
+    int64_t result = scan_words(bitmap->words, start + 1, count);
+    if (result < 0) {  // wrap around
+        result = scan_words(bitmap->words, 0, start + 1);
+    }
+    return result;
+}
+
+
+static uint64_t word_at(const Bitmap *bitmap, const Bitmap *mask, uint32_t index) {
+    return bitmap->words[index] | (mask != NULL ? mask->words[index] : 0);
+}
+
+
+// first position in [begin, end) free in both bitmaps or end
+static uint32_t next_zero(const Bitmap *bitmap, const Bitmap *mask, uint32_t begin, uint32_t end) {
+    while (begin < end) {
+        uint64_t word = ~word_at(bitmap, mask, begin / 64) >> (begin % 64);
+        if (word != 0) {
+            uint32_t result = begin + __builtin_ctzll(word);
+            return result < end ? result : end;
+        }
+        begin = (begin / 64 + 1) * 64;
+    }
+    return end;
+}
+
+
+// first position in [begin, end) used in any bitmap or end
+static uint32_t next_one(const Bitmap *bitmap, const Bitmap *mask, uint32_t begin, uint32_t end) {
+    while (begin < end) {
+        uint64_t word = word_at(bitmap, mask, begin / 64) >> (begin % 64);
+        if (word != 0) {
+            uint32_t result = begin + __builtin_ctzll(word);
+            return result < end ? result : end;
+        }
+        begin = (begin / 64 + 1) * 64;
+    }
+    return end;
+}
+
+
+int64_t bitmap_find_run(const Bitmap *bitmap, const Bitmap *mask, uint32_t length) {
+    uint32_t size = bitmap->size;
+    uint32_t hint = bitmap->hint < size ? bitmap->hint : 0;
+    length = (length > 0) ? length : 1;
+
+    // runs starting after hint, then runs starting before it
+    uint32_t position = hint;
+    uint32_t limit = size;
+    for (int pass = 0; pass < 2; ++pass) {
+        while (true) {
+            uint32_t start = next_zero(bitmap, mask, position, limit);
+            if (start >= limit) {
+                break;
+            }
+            uint32_t end = next_one(bitmap, mask, start, (size - start < length) ? size : start + length);
+            if (end - start >= length) {
+                return start;
+            }
+            position = end;
+        }
+        position = 0;
+        limit = hint;
+    }
+    return -1;
+}
+
+
+uint32_t bitmap_count(const Bitmap *bitmap) {
+    uint32_t count = bitmap_words(bitmap->size);
+    uint32_t result = 0;
+    for (uint32_t index = 0; index < count; ++index) {
+        result += __builtin_popcountll(bitmap->words[index]);
+    }
+    return result - (count * 64 - bitmap->size);  // padding bits
+}
@@ -0,0 +1,54 @@
+#ifndef BITMAP_H
+#define BITMAP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+	Free space bitmaps: bit is set if object is used
+*/
+
+
+typedef struct Bitmap {
+    uint64_t *words;
+    uint32_t size;      // count of bits
+    uint32_t hint;      // next-fit search starts here
+} Bitmap;
+
+
+// word count needed to store "size" bits
+uint32_t bitmap_words(uint32_t size);
+
+
+// function allocates bitmap with all bits cleared
+void bitmap_init(Bitmap *bitmap, uint32_t size);
+
+
+// function frees bitmap words
+void bitmap_free(Bitmap *bitmap);
+
+
+// function extends bitmap to "size" bits, new bits are cleared
+void bitmap_resize(Bitmap *bitmap, uint32_t size);
+
+
+void bitmap_set(Bitmap *bitmap, uint32_t index);
+void bitmap_clear(Bitmap *bitmap, uint32_t index);
+bool bitmap_test(const Bitmap *bitmap, uint32_t index);
+
+
+// function returns first cleared bit at or after hint
+// (wrapping around the end) or -1 if all bits are set
+int64_t bitmap_find_zero(const Bitmap *bitmap);
+
+
+// function returns start of first run of "length" bits cleared in bitmap
+// and in mask (NULL or bitmap of same size) which starts at or after hint,
+// wrapping around the end, or -1 if there is no such run
+int64_t bitmap_find_run(const Bitmap *bitmap, const Bitmap *mask, uint32_t length);
+
+
+// function returns count of set bits
+uint32_t bitmap_count(const Bitmap *bitmap);
+
+#endif
@@ -1,12 +1,17 @@
 #include <internal/commands/execute.h>
 #include <internal/debug/debug.h>
 #include <internal/fs/fs.h>
+#include <internal/dcache/dcache.h>
+#include <internal/bcache/bcache.h>
+#include <internal/journal/journal.h>
 
 #include <stdio.h>
 #include <string.h>
 #include <fcntl.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <errno.h>
+#include <sys/stat.h>
 
 #include <readline/readline.h>
 #include <readline/history.h>
@@ -53,19 +58,44 @@ static struct Command {
     },
     {
         .name = "write",
-        .description = "write to file",
+        .description = "write to file at end or offset",
         .func = minifs_write
     },
     {
         .name = "read",
-        .description = "read from file",
+        .description = "read file or its range",
         .func = minifs_read
     },
+    {
+        .name = "truncate",
+        .description = "cut or extend file to size",
+        .func = minifs_truncate_command
+    },
+    {
+        .name = "import",
+        .description = "copy host file into minifs",
+        .func = minifs_import
+    },
+    {
+        .name = "export",
+        .description = "copy minifs file to host",
+        .func = minifs_export
+    },
     {
         .name = "help",
         .description = "print help menu",
         .func = minifs_help
     },
+    {
+        .name = "sync",
+        .description = "write cached data to image",
+        .func = minifs_sync_command
+    },
+    {
+        .name = "grow",
+        .description = "add inodes and blocks to image",
+        .func = minifs_grow_command
+    },
     {
         .name = "exit",
         .description = "quit minifs",
@@ -81,26 +111,33 @@ static struct Command {
 
 void minifs_ls(Filesystem* fs, const char **data, int count) {
     debug(MINIFS_INFO "ls command");
-    DirectoryMap *content = minifs_read_dir(fs, fs->current_dir);
+    int32_t dir = (count < 2) ? fs->current_dir : minifs_resolve(fs, data[1]);
+    if (dir < 0 || fs->sblock.inode_map[dir].type != MINIFS_INODE_DIRECTORY) {
+        fprintf(stderr, "directory not found\n");
+        return;
+    }
+
+    DirIterator it;
+    minifs_lock_inode(fs, dir, false);
+    minifs_dir_open(fs, dir, &it);
     printf("\e[34m.\e[0m \e[34m..\e[0m ");
-    for (uint32_t index = 0; index < content->size; ++index) {
-        Inode inode = fs->sblock.inode_map[content->inodes[index]];
-        if (content->used[index] == 0) {
-            continue;
-        }
+    const DirEntry *entry;
+    while ((entry = minifs_dir_next(&it)) != NULL) {
+        Inode inode = fs->sblock.inode_map[entry->inode];
         switch (inode.type) {
             case MINIFS_INODE_DIRECTORY:
-                printf("\e[34m%s\e[0m ", content->names[index]);
+                printf("\e[34m%.*s\e[0m ", MAX_FILENAME_SIZE, entry->name);
                 break;
             case MINIFS_INODE_FILE:
-                printf("%s ", content->names[index]);
+                printf("%.*s ", MAX_FILENAME_SIZE, entry->name);
                 break;
             default:
                 break;
         }
     }
     printf("\n");
-    minifs_clear_dirmap(content);
+    minifs_dir_close(&it);
+    minifs_unlock_inode(fs, dir);
 }
 
 
@@ -111,30 +148,12 @@ void minifs_cd(Filesystem* fs, const char **data, int count) {
         return;
     }
 
-    if (strcmp(data[1], ".") == 0) {
-        return;
-    }
-
-    if (strcmp(data[1], "..") == 0) {
-        Inode c_inode = fs->sblock.inode_map[fs->current_dir];
-        fs->current_dir = c_inode.parent;
+    int32_t target_inode = minifs_resolve(fs, data[1]);
+    if (target_inode < 0 || fs->sblock.inode_map[target_inode].type != MINIFS_INODE_DIRECTORY) {
+        fprintf(stderr, "directory not found\n");
         return;
     }
-
-    DirectoryMap *content = minifs_read_dir(fs, fs->current_dir);
-    for (uint32_t index = 0; index < content->size; ++index) {
-        Inode inode = fs->sblock.inode_map[content->inodes[index]];
-        if (inode.type == MINIFS_INODE_DIRECTORY) {
-            if (strcmp(content->names[index], data[1]) == 0) {
-                fs->current_dir = content->inodes[index];
-                minifs_clear_dirmap(content);
-                return;
-            }
-        }
-    }
-
-    fprintf(stderr, "directory not found\n");
-    minifs_clear_dirmap(content);
+    fs->current_dir = target_inode;
 }
 
 
@@ -144,41 +163,30 @@ void minifs_mkdir(Filesystem* fs, const char **data, int count) {
         fprintf(stderr, "format: %s <dirname>\n", data[0]);
         return;
     }
-    if (strlen(data[1]) > MAX_FILENAME_SIZE) {
+    const char *name;
+    int32_t parent = minifs_resolve_parent(fs, data[1], &name);
+    if (parent < 0) {
+        fprintf(stderr, "no such directory\n");
+        return;
+    }
+    if (strlen(name) >= MAX_FILENAME_SIZE) {
         fprintf(stderr, "filename is too long\n");
         return;
     }
-    int32_t inode_index = minifs_find_free_inode(fs);
-    int32_t block_index = minifs_find_free_block(fs);
-    if (inode_index < 0) {
-        fprintf(stderr, "Ran out of free inodes\n");
+    minifs_lock_inode(fs, parent, true);
+    if (minifs_lookup(fs, parent, name, NULL) >= 0) {
+        minifs_unlock_inode(fs, parent);
+        fprintf(stderr, "file exists\n");
         return;
     }
-    if (block_index < 0) {
-        fprintf(stderr, "Ran out of free blocks\n");
+    int32_t inode_index = minifs_create_inode(fs, MINIFS_INODE_DIRECTORY, 0, parent);
+    if (inode_index < 0) {
+        minifs_unlock_inode(fs, parent);
         return;
     }
 
-    fs->sblock.inode_map[inode_index].type = MINIFS_INODE_DIRECTORY;
-    fs->sblock.inode_map[inode_index].root_block = block_index;
-    fs->sblock.inode_map[inode_index].parent = fs->current_dir;
-    fs->sblock.inode_map[inode_index].size = 0;
-    
-    fs->sblock.block_map[block_index].size = 0;
-    fs->sblock.block_map[block_index].next_block = -1;
-    fs->sblock.block_map[block_index].type = MINIFS_BLOCK_USED;
-
-    fs->sblock.used_inode_count++;
-    fs->sblock.used_block_count++;
-    fs->sblock.inode_map[fs->current_dir].size++;
-
-    char buffer[MAX_FILENAME_SIZE];
-    memset(buffer, 0, MAX_FILENAME_SIZE);
-    snprintf(buffer, MAX_FILENAME_SIZE, "%s", data[1]);
-    char used = 1;
-    minifs_append_data(fs, fs->current_dir, (const unsigned char*) &used, sizeof(char));
-    minifs_append_data(fs, fs->current_dir, (const unsigned char*) buffer, MAX_FILENAME_SIZE);
-    minifs_append_data(fs, fs->current_dir, (const unsigned char*) &inode_index, sizeof(uint32_t));
+    minifs_add_to_dir(fs, parent, name, inode_index);
+    minifs_unlock_inode(fs, parent);
     minifs_update_superblock(fs);
 }
 
@@ -190,39 +198,39 @@ void minifs_rmdir(Filesystem* fs, const char **data, int count) {
         return;
     }
 
-    DirectoryMap *content = minifs_read_dir(fs, fs->current_dir);
-    int32_t target_inode = -1;
-
-    for (int index = 0; index < content->size; ++index) {
-        if (fs->sblock.inode_map[content->inodes[index]].type == MINIFS_INODE_DIRECTORY) {
-            if (strcmp(data[1], content->names[index]) == 0) {
-                target_inode = content->inodes[index];
-                minifs_remove_from_dir(fs, fs->current_dir, index);
-            }
-        }
+    const char *name;
+    int32_t entry;
+    int32_t parent = minifs_resolve_parent(fs, data[1], &name);
+    if (parent < 0) {
+        fprintf(stderr, "no such directory\n");
+        return;
     }
-    minifs_clear_dirmap(content);
 
-    if (target_inode == -1) {
+    minifs_lock_inode(fs, parent, true);
+    int32_t target_inode = minifs_lookup(fs, parent, name, &entry);
+    if (target_inode < 0 || fs->sblock.inode_map[target_inode].type != MINIFS_INODE_DIRECTORY) {
+        minifs_unlock_inode(fs, parent);
         fprintf(stderr, "no such directory\n");
         return;
     }
 
-    int32_t current_block = fs->sblock.inode_map[target_inode].root_block;
-    while (current_block > 0) {
-        int32_t next_block = fs->sblock.block_map[current_block].next_block;
-        fs->sblock.block_map[current_block].type = MINIFS_BLOCK_EMPTY;
-        fs->sblock.block_map[current_block].size = 0;
-        fs->sblock.block_map[current_block].next_block = 0;
-        fs->sblock.used_block_count--;
-        current_block = next_block;
+    // current directory and its ancestors stay in place
+    for (uint32_t dir = fs->current_dir; ; dir = fs->sblock.inode_map[dir].parent) {
+        if (dir == target_inode) {
+            minifs_unlock_inode(fs, parent);
+            fprintf(stderr, "directory is busy\n");
+            return;
+        }
+        if (dir == 0) {
+            break;
+        }
     }
 
-    fs->sblock.inode_map[target_inode].type = MINIFS_INODE_EMPTY;
-    fs->sblock.inode_map[target_inode].size = 0;
-    fs->sblock.inode_map[target_inode].parent = 0;
-    fs->sblock.inode_map[target_inode].root_block = 0;
-    fs->sblock.used_inode_count--;
+    minifs_lock_inode(fs, target_inode, true);
+    minifs_remove_from_dir(fs, parent, entry);
+    minifs_destroy_inode(fs, target_inode);
+    minifs_unlock_inode(fs, target_inode);
+    minifs_unlock_inode(fs, parent);
     minifs_update_superblock(fs);
 }
 
@@ -234,41 +242,35 @@ void minifs_touch(Filesystem* fs, const char **data, int count) {
         fprintf(stderr, "format: %s <filename>\n", data[0]);
         return;
     }
-    if (strlen(data[1]) > MAX_FILENAME_SIZE) {
+    const char *name;
+    int32_t parent = minifs_resolve_parent(fs, data[1], &name);
+    if (parent < 0) {
+        fprintf(stderr, "no such directory\n");
+        return;
+    }
+    if (strlen(name) >= MAX_FILENAME_SIZE) {
         fprintf(stderr, "filename is too long\n");
         return;
     }
-    int32_t inode_index = minifs_find_free_inode(fs);
-    int32_t block_index = minifs_find_free_block(fs);
-    if (inode_index < 0) {
-        fprintf(stderr, "Ran out of free inodes\n");
+    minifs_lock_inode(fs, parent, true);
+    if (minifs_lookup(fs, parent, name, NULL) >= 0) {
+        minifs_unlock_inode(fs, parent);
+        fprintf(stderr, "file exists\n");
         return;
     }
-    if (block_index < 0) {
-        fprintf(stderr, "Ran out of free blocks\n");
+    // new file is empty, so it starts inline if inodes have room for data
+    uint16_t flags = (minifs_inline_capacity(fs) > 0) ? MINIFS_INODE_INLINE : MINIFS_INODE_EXTENTS;
+    if (fs->compress) {
+        flags = MINIFS_INODE_EXTENTS | MINIFS_INODE_COMPRESSED;
+    }
+    int32_t inode_index = minifs_create_inode(fs, MINIFS_INODE_FILE, flags, -1);
+    if (inode_index < 0) {
+        minifs_unlock_inode(fs, parent);
         return;
     }
 
-    fs->sblock.inode_map[inode_index].type = MINIFS_INODE_FILE;
-    fs->sblock.inode_map[inode_index].root_block = block_index;
-    fs->sblock.inode_map[inode_index].parent = -1;
-    fs->sblock.inode_map[inode_index].size = 0;
-
-    fs->sblock.block_map[block_index].size = 0;
-    fs->sblock.block_map[block_index].next_block = -1;
-    fs->sblock.block_map[block_index].type = MINIFS_BLOCK_USED;
-
-    fs->sblock.used_inode_count++;
-    fs->sblock.used_block_count++;
-    fs->sblock.inode_map[fs->current_dir].size++;
-
-    char used = 1;
-    char buffer[MAX_FILENAME_SIZE];
-    memset(buffer, 0, MAX_FILENAME_SIZE);
-    snprintf(buffer, MAX_FILENAME_SIZE, "%s", data[1]);
-    minifs_append_data(fs, fs->current_dir, (const unsigned char*) &used, sizeof(char));
-    minifs_append_data(fs, fs->current_dir, (const unsigned char*) buffer, MAX_FILENAME_SIZE);
-    minifs_append_data(fs, fs->current_dir, (const unsigned char*) &inode_index, sizeof(uint32_t));
+    minifs_add_to_dir(fs, parent, name, inode_index);
+    minifs_unlock_inode(fs, parent);
     minifs_update_superblock(fs);
 }
 
@@ -280,113 +282,320 @@ void minifs_rm(Filesystem* fs, const char **data, int count) {
         return;
     }
 
-    DirectoryMap *content = minifs_read_dir(fs, fs->current_dir);
-    int32_t target_inode = -1;
-
-    for (int index = 0; index < content->size; ++index) {
-        if (fs->sblock.inode_map[content->inodes[index]].type == MINIFS_INODE_FILE) {
-            if (strcmp(data[1], content->names[index]) == 0) {
-                target_inode = content->inodes[index];
-                minifs_remove_from_dir(fs, fs->current_dir, index);
-            }
-        }
+    const char *name;
+    int32_t entry;
+    int32_t parent = minifs_resolve_parent(fs, data[1], &name);
+    if (parent < 0) {
+        fprintf(stderr, "no such file\n");
+        return;
     }
 
-    minifs_clear_dirmap(content);
-
-    if (target_inode == -1) {
+    minifs_lock_inode(fs, parent, true);
+    int32_t target_inode = minifs_lookup(fs, parent, name, &entry);
+    if (target_inode < 0 || fs->sblock.inode_map[target_inode].type != MINIFS_INODE_FILE) {
+        minifs_unlock_inode(fs, parent);
         fprintf(stderr, "no such file\n");
         return;
     }
 
-    minifs_remove_from_dir(fs, fs->current_dir, target_inode);
+    minifs_lock_inode(fs, target_inode, true);
+    minifs_remove_from_dir(fs, parent, entry);
+    minifs_destroy_inode(fs, target_inode);
+    minifs_unlock_inode(fs, target_inode);
+    minifs_unlock_inode(fs, parent);
+    minifs_update_superblock(fs);
+}
+
 
-    int32_t current_block = fs->sblock.inode_map[target_inode].root_block;
-    while (current_block > 0) {
-        int32_t next_block = fs->sblock.block_map[current_block].next_block;
-        fs->sblock.block_map[current_block].type = MINIFS_BLOCK_EMPTY;
-        fs->sblock.block_map[current_block].size = 0;
-        fs->sblock.block_map[current_block].next_block = 0;
-        fs->sblock.used_block_count--;
-        current_block = next_block;
+// parses decimal argument, returns false if it is not a number or does not fit
+static bool parse_number(const char *text, uint32_t *value) {
+    char *end;
+    errno = 0;
+    unsigned long long result = strtoull(text, &end, 10);
+    if (*text == '\0' || *text == '-' || *end != '\0' || errno != 0 || result > UINT32_MAX) {
+        return false;
     }
-
-    fs->sblock.inode_map[target_inode].type = MINIFS_INODE_EMPTY;
-    fs->sblock.inode_map[target_inode].size = 0;
-    fs->sblock.inode_map[target_inode].parent = 0;
-    fs->sblock.inode_map[target_inode].root_block = 0;
-    fs->sblock.used_inode_count--;
-    minifs_update_superblock(fs);
+    *value = (uint32_t) result;
+    return true;
 }
 
 
 void minifs_write(Filesystem* fs, const char **data, int count) {
     debug(MINIFS_INFO "write command");
-    if (count < 2) {
-        fprintf(stderr, "format: %s <filename>", data[0]);
+    uint32_t offset = 0;
+    if (count < 2 || (count > 2 && !parse_number(data[2], &offset))) {
+        fprintf(stderr, "format: %s <filename> [offset]\n", data[0]);
         return;
     }
 
-    DirectoryMap *content = minifs_read_dir(fs, fs->current_dir);
-    int32_t target_inode = -1;
-
-    for (int index = 0; index < content->size; ++index) {
-        if (fs->sblock.inode_map[content->inodes[index]].type == MINIFS_INODE_FILE) {
-            if (strcmp(data[1], content->names[index]) == 0) {
-                target_inode = content->inodes[index];
-            }
-        }
+    int32_t target_inode = minifs_resolve(fs, data[1]);
+    if (target_inode < 0 || fs->sblock.inode_map[target_inode].type != MINIFS_INODE_FILE) {
+        fprintf(stderr, "No such file\n");
+        return;
     }
 
-    minifs_clear_dirmap(content);
-
-    if (target_inode == -1) {
-        fprintf(stderr, "No such file\n");
+    if (!minifs_file_readable(fs, target_inode)) {
+        fprintf(stderr, "file is damaged\n");
         return;
     }
 
     const char *input = readline("Enter data: ");
-    minifs_append_data(fs, target_inode, (const unsigned char *) input, strlen(input));
+    uint32_t size = strlen(input);
+    minifs_lock_inode(fs, target_inode, true);
+    uint32_t file_size = fs->sblock.inode_map[target_inode].size;
+    if (count < 3) {  // without offset data goes to the end
+        offset = file_size;
+    }
+
+    uint32_t block_size = fs->sblock.block_size;
+    uint32_t free_blocks = minifs_free_block_count(fs);
+    uint64_t end = (uint64_t) offset + size;
+    if (end > UINT32_MAX) {
+        fprintf(stderr, "offset is too large\n");
+    } else if (end > file_size && (end - file_size) / block_size + 2 > free_blocks) {
+        fprintf(stderr, "not enough free blocks\n");
+    } else {
+        minifs_file_pwrite(fs, target_inode, input, size, offset);
+    }
+    minifs_unlock_inode(fs, target_inode);
     free((void*) input);
-
-    fs->sblock.inode_map[target_inode].size += strlen(input);
     minifs_update_superblock(fs);
 }
 
 
+// writes stream piece to fd from context
+static bool write_output(void *context, const void *data, uint32_t size) {
+    int fd = *(int*) context;
+    while (size > 0) {
+        ssize_t status = write(fd, data, size);
+        if (status <= 0) {
+            fprintf(stderr, "output error\n");
+            return false;
+        }
+        data = (const char*) data + status;
+        size -= status;
+    }
+    return true;
+}
+
+
 void minifs_read(Filesystem* fs, const char **data, int count) {
     debug(MINIFS_INFO "read command");
-    if (count < 2) {
-        fprintf(stderr, "format: %s <filename>", data[0]);
+    uint32_t offset = 0;
+    uint32_t length = 0;
+    if (count < 2 || count == 3 || (count > 3 && (!parse_number(data[2], &offset) ||
+                                                  !parse_number(data[3], &length)))) {
+        fprintf(stderr, "format: %s <filename> [offset length]\n", data[0]);
         return;
     }
 
-    DirectoryMap *content = minifs_read_dir(fs, fs->current_dir);
-    int32_t target_inode = -1;
+    int32_t target_inode = minifs_resolve(fs, data[1]);
+    if (target_inode < 0 || fs->sblock.inode_map[target_inode].type != MINIFS_INODE_FILE) {
+        fprintf(stderr, "No such file\n");
+        return;
+    }
 
-    for (int index = 0; index < content->size; ++index) {
-        if (fs->sblock.inode_map[content->inodes[index]].type == MINIFS_INODE_FILE) {
-            if (strcmp(data[1], content->names[index]) == 0) {
-                target_inode = content->inodes[index];
-            }
+    if (!minifs_file_readable(fs, target_inode)) {
+        fprintf(stderr, "file is damaged\n");
+        return;
+    }
+
+    // file goes to stdout by big writes through fixed buffer,
+    // range is read by pieces of buffer size
+    fflush(stdout);
+    void *buffer = malloc(STREAM_BUFFER_SIZE);
+    int output = STDOUT_FILENO;
+    minifs_lock_inode(fs, target_inode, false);
+    if (count < 4) {
+        minifs_stream_data(fs, target_inode, buffer, STREAM_BUFFER_SIZE, write_output, &output);
+    }
+    while (length > 0) {
+        uint32_t piece = (length < STREAM_BUFFER_SIZE) ? length : STREAM_BUFFER_SIZE;
+        uint32_t done = minifs_file_pread(fs, target_inode, buffer, piece, offset);
+        if (done == 0 || !write_output(&output, buffer, done)) {
+            break;
         }
+        offset += done;
+        length -= done;
     }
+    minifs_unlock_inode(fs, target_inode);
+    free(buffer);
+
+    printf("\n");
+}
 
-    minifs_clear_dirmap(content);
 
-    if (target_inode == -1) {
+void minifs_truncate_command(Filesystem* fs, const char **data, int count) {
+    debug(MINIFS_INFO "truncate command");
+    uint32_t size;
+    if (count < 3 || !parse_number(data[2], &size)) {
+        fprintf(stderr, "format: %s <filename> <size>\n", data[0]);
+        return;
+    }
+
+    int32_t target_inode = minifs_resolve(fs, data[1]);
+    if (target_inode < 0 || fs->sblock.inode_map[target_inode].type != MINIFS_INODE_FILE) {
         fprintf(stderr, "No such file\n");
         return;
     }
 
-    int32_t dsize = 0;
-    const char *file_content = minifs_read_data(fs, target_inode, &dsize);
-    for (int index = 0; index < dsize; ++index) {
-        printf("%c", file_content[index]);
+    if (!minifs_file_readable(fs, target_inode)) {
+        fprintf(stderr, "file is damaged\n");
+        return;
     }
-    free((void*) file_content);
 
-    printf("\n");
+    minifs_lock_inode(fs, target_inode, true);
+    uint32_t file_size = fs->sblock.inode_map[target_inode].size;
+    uint32_t free_blocks = minifs_free_block_count(fs);
+    if (size > file_size && (size - file_size) / fs->sblock.block_size + 2 > free_blocks) {
+        fprintf(stderr, "not enough free blocks\n");
+    } else {
+        minifs_truncate(fs, target_inode, size);
+    }
+    minifs_unlock_inode(fs, target_inode);
+    minifs_update_superblock(fs);
+}
+
+
+// appends host file to inode by chunks of IMPORT_CHUNK_SIZE
+static bool import_chunks(Filesystem *fs, uint32_t inode, int host, uint32_t size) {
+    unsigned char *buffer = (unsigned char*) malloc(IMPORT_CHUNK_SIZE);
+    uint32_t done = 0;
+    while (done < size) {
+        ssize_t status = read(host, buffer, (size - done < IMPORT_CHUNK_SIZE) ? size - done : IMPORT_CHUNK_SIZE);
+        if (status <= 0) {
+            break;
+        }
+        minifs_append_data(fs, inode, buffer, status);
+        done += status;
+    }
+    free(buffer);
+    return done == size;
+}
+
+
+void minifs_import(Filesystem* fs, const char **data, int count) {
+    debug(MINIFS_INFO "import command");
+    if (count < 3) {
+        fprintf(stderr, "format: %s <hostpath> <filename>\n", data[0]);
+        return;
+    }
+
+    int host = open(data[1], O_RDONLY);
+    struct stat info;
+    if (host < 0 || fstat(host, &info) < 0 || !S_ISREG(info.st_mode)) {
+        fprintf(stderr, "cannot open host file\n");
+        if (host >= 0) {
+            close(host);
+        }
+        return;
+    }
+
+    // size is known up front, so free space is checked before anything is created
+    uint32_t block_size = fs->sblock.block_size;
+    uint64_t blocks = (info.st_size + block_size - 1) / block_size;
+    if (info.st_size > UINT32_MAX) {
+        fprintf(stderr, "file is too large\n");
+        close(host);
+        return;
+    }
+    if (blocks + 1 > minifs_free_block_count(fs)) {
+        fprintf(stderr, "not enough free blocks\n");
+        close(host);
+        return;
+    }
+
+    const char *name;
+    int32_t parent = minifs_resolve_parent(fs, data[2], &name);
+    if (parent < 0) {
+        fprintf(stderr, "no such directory\n");
+        close(host);
+        return;
+    }
+    if (strlen(name) >= MAX_FILENAME_SIZE) {
+        fprintf(stderr, "filename is too long\n");
+        close(host);
+        return;
+    }
+    minifs_lock_inode(fs, parent, true);
+    if (minifs_lookup(fs, parent, name, NULL) >= 0) {
+        minifs_unlock_inode(fs, parent);
+        fprintf(stderr, "file exists\n");
+        close(host);
+        return;
+    }
+    uint32_t capacity = minifs_inline_capacity(fs);
+    uint16_t flags = (capacity > 0 && info.st_size <= capacity) ? MINIFS_INODE_INLINE : MINIFS_INODE_EXTENTS;
+    if (fs->compress) {
+        flags = MINIFS_INODE_EXTENTS | MINIFS_INODE_COMPRESSED;
+    }
+    int32_t inode_index = minifs_create_inode(fs, MINIFS_INODE_FILE, flags, -1);
+    if (inode_index < 0) {
+        minifs_unlock_inode(fs, parent);
+        close(host);
+        return;
+    }
+
+    // all blocks are taken in one pass, then filled by large sequential writes;
+    // inline file takes no blocks, compressed file gets data by chunks
+    // which are coded as they come
+    minifs_lock_inode(fs, inode_index, true);
+    bool done;
+    if (flags & MINIFS_INODE_INLINE) {
+        done = minifs_fill_blocks(fs, inode_index, 0, host, info.st_size);
+    } else if (flags & MINIFS_INODE_COMPRESSED) {
+        done = import_chunks(fs, inode_index, host, info.st_size);
+    } else {
+        done = minifs_reserve_blocks(fs, inode_index, blocks) == blocks &&
+               minifs_fill_blocks(fs, inode_index, 0, host, info.st_size);
+    }
+    close(host);
+    if (!done) {
+        fprintf(stderr, "import failed\n");
+        minifs_destroy_inode(fs, inode_index);
+        minifs_unlock_inode(fs, inode_index);
+        minifs_unlock_inode(fs, parent);
+        minifs_update_superblock(fs);
+        return;
+    }
+    fs->sblock.inode_map[inode_index].size = info.st_size;
+    minifs_mark_inode(fs, inode_index);
+    minifs_unlock_inode(fs, inode_index);
+
+    minifs_add_to_dir(fs, parent, name, inode_index);
+    minifs_unlock_inode(fs, parent);
+    minifs_update_superblock(fs);
+}
+
+
+void minifs_export(Filesystem* fs, const char **data, int count) {
+    debug(MINIFS_INFO "export command");
+    if (count < 3) {
+        fprintf(stderr, "format: %s <filename> <hostpath>\n", data[0]);
+        return;
+    }
+
+    int32_t target_inode = minifs_resolve(fs, data[1]);
+    if (target_inode < 0 || fs->sblock.inode_map[target_inode].type != MINIFS_INODE_FILE) {
+        fprintf(stderr, "No such file\n");
+        return;
+    }
+    if (!minifs_file_readable(fs, target_inode)) {
+        fprintf(stderr, "file is damaged\n");
+        return;
+    }
+    int host = open(data[2], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (host < 0) {
+        fprintf(stderr, "cannot create host file\n");
+        return;
+    }
+
+    minifs_lock_inode(fs, target_inode, false);
+    bool done = minifs_export_data(fs, target_inode, host);
+    minifs_unlock_inode(fs, target_inode);
+    if (close(host) < 0 || !done) {
+        fprintf(stderr, "export failed\n");
+    }
 }
 
 
@@ -400,9 +609,28 @@ void minifs_help(Filesystem* fs, const char **data, int count) {
 }
 
 
+void minifs_sync_command(Filesystem* fs, const char **data, int count) {
+    debug(MINIFS_INFO "sync command");
+    minifs_sync(fs);
+}
+
+
+void minifs_grow_command(Filesystem* fs, const char **data, int count) {
+    debug(MINIFS_INFO "grow command");
+    uint32_t inodes, blocks;
+    if (count < 3 || !parse_number(data[1], &inodes) || !parse_number(data[2], &blocks)) {
+        fprintf(stderr, "format: %s <inodes> <blocks>\n", data[0]);
+        return;
+    }
+    if (!minifs_grow(fs, inodes, blocks)) {
+        fprintf(stderr, "cannot grow image\n");
+    }
+}
+
+
 void minifs_exit(Filesystem* fs, const char **data, int count) {
     debug(MINIFS_INFO "exit command");
-    close(fs->fd);
+    minifs_close(fs);
     exit(0);
 }
 
@@ -415,9 +643,55 @@ void minifs_debug(Filesystem *fs, const char **data, int count) {
     printf("used_inode_count: %u\n", fs->sblock.used_inode_count);
     printf("used_block_count: %u\n", fs->sblock.used_block_count);
     printf("block_size: %u\n", fs->sblock.block_size);
+    printf("version: %u\n", fs->sblock.version);
+    printf("inode_size: %u\n", fs->sblock.inode_size);
+    printf("backend: %s\n", fs->image != NULL ? "mmap" : "fd");
+    printf("===== [IO stats] ======\n");
+    printf("reads: %lu, writes: %lu, syncs: %lu, copies: %lu\n",
+           minifs_io_stats.reads, minifs_io_stats.writes, minifs_io_stats.syncs, minifs_io_stats.copies);
+    if (fs->uring != NULL) {
+        printf("io_uring enters: %lu\n", fs->uring->enters);
+    }
+    if (fs->journal != NULL) {
+        printf("journal transactions: %lu, commits: %lu, checkpoints: %lu, log: %u bytes\n",
+               fs->journal->transactions, fs->journal->commits, fs->journal->checkpoints, fs->journal->head);
+    }
+    printf("===== [Dentry cache] ======\n");
+    printf("dentries: %u/%u, hits: %lu, misses: %lu\n",
+           fs->dcache->count, fs->dcache->capacity, fs->dcache->hits, fs->dcache->misses);
+    printf("===== [Buffer cache] ======\n");
+    BufferCache *cache = fs->bcache;
+    uint64_t lookups = cache->hits + cache->misses;
+    printf("buffers: %u/%u, hits: %lu, misses: %lu, hit rate: %.1f%%, writebacks: %lu\n",
+           cache->count, cache->capacity, cache->hits, cache->misses,
+           lookups > 0 ? 100.0 * cache->hits / lookups : 0.0, cache->writebacks);
+    printf("===== [Fragmentation] ======\n");
+    // statistics cover blocks files have now, debug never flushes delayed appends
+    uint32_t files = 0, blocks = 0, fragments = 0, compressed = 0, damaged = 0;
+    uint64_t data_bytes = 0, stored_bytes = 0, delayed_bytes = 0;
+    for (uint32_t index = 0; index < fs->sblock.inode_count; ++index) {
+        uint32_t delayed = __atomic_load_n(&fs->delayed[index].size, __ATOMIC_ACQUIRE);
+        if (fs->sblock.inode_map[index].type == MINIFS_INODE_FILE) {
+            ++files;
+            blocks += minifs_file_blocks(fs, index);
+            fragments += minifs_file_fragments(fs, index);
+            damaged += !minifs_file_readable(fs, index);
+            delayed_bytes += delayed;
+        }
+        if (fs->sblock.inode_map[index].flags & MINIFS_INODE_COMPRESSED) {
+            ++compressed;
+            data_bytes += fs->sblock.inode_map[index].size - delayed;
+            stored_bytes += minifs_stored_size(fs, index);
+        }
+    }
+    printf("files: %u, blocks: %u, fragments: %u, per file: %.2f, delayed: %lu bytes, damaged: %u\n",
+           files, blocks, fragments, files > 0 ? (double) fragments / files : 0.0, delayed_bytes, damaged);
+    printf("===== [Compression] ======\n");
+    printf("compressed files: %u, data: %lu bytes, stored: %lu bytes, ratio: %.2f\n",
+           compressed, data_bytes, stored_bytes, stored_bytes > 0 ? (double) data_bytes / stored_bytes : 0.0);
     printf("===== [Inode map] ======\n");
     for (int index = 0; index < fs->sblock.inode_count; ++index) {
-        char symbols[] = {'.', 'f', 'd'};
+        char symbols[] = {'.', 'f', 'd', 'h'};
         printf("%c", symbols[fs->sblock.inode_map[index].type]);
     }
     printf("\n");
@@ -431,7 +705,7 @@ void minifs_debug(Filesystem *fs, const char **data, int count) {
     for (int index = 0; index < fs->sblock.inode_count; ++index) {
         Inode inode = fs->sblock.inode_map[index];
         if (inode.type != MINIFS_INODE_EMPTY) {
-            printf("Inode {size: %u, root_block %d, type: %d}\n", inode.size, inode.root_block, inode.type);
+            printf("Inode {size: %u, root_block %d, type: %d, flags: %d}\n", inode.size, inode.root_block, inode.type, inode.flags);
         }
     }
     printf("===== [Blocks] ====== \n");
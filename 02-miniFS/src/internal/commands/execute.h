@@ -12,7 +12,12 @@ void minifs_touch(Filesystem*, const char **, int);
 void minifs_rm(Filesystem*, const char **, int);
 void minifs_write(Filesystem*, const char **, int);
 void minifs_read(Filesystem*, const char **, int);
+void minifs_truncate_command(Filesystem*, const char **, int);
+void minifs_import(Filesystem*, const char **, int);
+void minifs_export(Filesystem*, const char **, int);
 void minifs_help(Filesystem*, const char **, int);
+void minifs_sync_command(Filesystem*, const char **, int);
+void minifs_grow_command(Filesystem*, const char **, int);
 void minifs_exit(Filesystem*, const char **, int);
 void minifs_debug(Filesystem*, const char **, int);
 
@@ -0,0 +1,162 @@
+#include <internal/dcache/dcache.h>
+#include <stdio.h>
+#include <stdbool.h>
+
+
+bool test_find();
+bool test_eviction();
+bool test_remove_dir();
+
+
+int main() {
+    bool global = true;
+    global &= test_find();
+    global &= test_eviction();
+    global &= test_remove_dir();
+
+    if (global) {
+        printf("[GLOBAL OK]\n");
+    }
+
+    return 0;
+}
+
+
+// =========== [ TESTS ] ===========
+
+bool test_find() {
+    DentryCache cache;
+    bool status = true;
+    dcache_init(&cache, 16);
+
+    if (dcache_find(&cache, 0, "file") != NULL) {
+        status = false;
+        printf("[BAD] 1 test_find\n");
+    }
+
+    // same name in different directories
+    dcache_insert(&cache, 0, "file", 5, 1);
+    dcache_insert(&cache, 3, "file", 7, 2);
+    Dentry *first = dcache_find(&cache, 0, "file");
+    Dentry *second = dcache_find(&cache, 3, "file");
+    if (first == NULL || first->inode != 5 || first->entry != 1 ||
+        second == NULL || second->inode != 7 || second->entry != 2) {
+        status = false;
+        printf("[BAD] 2 test_find\n");
+    }
+
+    // negative dentry is replaced by positive one
+    dcache_insert(&cache, 0, "missing", -1, 0);
+    Dentry *negative = dcache_find(&cache, 0, "missing");
+    if (negative == NULL || negative->inode != -1) {
+        status = false;
+        printf("[BAD] 3 test_find\n");
+    }
+    dcache_insert(&cache, 0, "missing", 9, 4);
+    if (dcache_find(&cache, 0, "missing")->inode != 9 || cache.count != 3) {
+        status = false;
+        printf("[BAD] 4 test_find\n");
+    }
+
+    dcache_remove(&cache, 0, "file");
+    if (dcache_find(&cache, 0, "file") != NULL || dcache_find(&cache, 3, "file") == NULL) {
+        status = false;
+        printf("[BAD] 5 test_find\n");
+    }
+    if (cache.hits != 5 || cache.misses != 2) {
+        status = false;
+        printf("[BAD] 6 test_find\n");
+    }
+    dcache_free(&cache);
+
+    if (status) {
+        printf("[OK] test_find\n");
+    } else {
+        printf("[BAD] test_find\n");
+    }
+
+    return status;
+}
+
+
+bool test_eviction() {
+    DentryCache cache;
+    bool status = true;
+    dcache_init(&cache, 4);
+
+    char name[MAX_FILENAME_SIZE];
+    for (int index = 0; index < 4; ++index) {
+        snprintf(name, sizeof(name), "name%d", index);
+        dcache_insert(&cache, 0, name, index, index);
+    }
+
+    // name0 is used, so name1 is least recently used one
+    dcache_find(&cache, 0, "name0");
+    dcache_insert(&cache, 0, "name4", 4, 4);
+    if (cache.count != 4 || dcache_find(&cache, 0, "name1") != NULL ||
+        dcache_find(&cache, 0, "name0") == NULL || dcache_find(&cache, 0, "name4") == NULL) {
+        status = false;
+        printf("[BAD] 1 test_eviction\n");
+    }
+
+    // long names are not cached
+    dcache_insert(&cache, 0, "name_which_is_longer_than_limit", 5, 5);
+    if (cache.count != 4 || dcache_find(&cache, 0, "name2") == NULL) {
+        status = false;
+        printf("[BAD] 2 test_eviction\n");
+    }
+    dcache_free(&cache);
+
+    if (status) {
+        printf("[OK] test_eviction\n");
+    } else {
+        printf("[BAD] test_eviction\n");
+    }
+
+    return status;
+}
+
+
+bool test_remove_dir() {
+    DentryCache cache;
+    bool status = true;
+    dcache_init(&cache, 64);
+
+    char name[MAX_FILENAME_SIZE];
+    for (int index = 0; index < 30; ++index) {
+        snprintf(name, sizeof(name), "name%d", index);
+        dcache_insert(&cache, index % 3, name, index, index);
+    }
+    dcache_remove_dir(&cache, 1);
+    if (cache.count != 20) {
+        status = false;
+        printf("[BAD] 1 test_remove_dir\n");
+    }
+    for (int index = 0; index < 30; ++index) {
+        snprintf(name, sizeof(name), "name%d", index);
+        if ((dcache_find(&cache, index % 3, name) == NULL) != (index % 3 == 1)) {
+            status = false;
+            printf("[BAD] 2 test_remove_dir\n");
+            break;
+        }
+    }
+
+    // freed dentries are reused
+    for (int index = 0; index < 44; ++index) {
+        snprintf(name, sizeof(name), "other%d", index);
+        dcache_insert(&cache, 5, name, index, index);
+    }
+    if (cache.count != 64 || dcache_find(&cache, 0, "name0") == NULL) {
+        status = false;
+        printf("[BAD] 3 test_remove_dir\n");
+    }
+    dcache_free(&cache);
+
+    if (status) {
+        printf("[OK] test_remove_dir\n");
+    } else {
+        printf("[BAD] test_remove_dir\n");
+    }
+
+    return status;
+}
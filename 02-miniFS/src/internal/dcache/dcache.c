@@ -0,0 +1,174 @@
+#include <internal/dcache/dcache.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+// =========== [ HELPERS ] ===========
+
+static uint32_t dentry_hash(uint32_t parent, const char *name) {
+    uint32_t hash = 2166136261u ^ parent;  // FNV-1a seeded by parent
+    for (uint32_t index = 0; index < MAX_FILENAME_SIZE && name[index] != '\0'; ++index) {
+        hash ^= (unsigned char) name[index];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+
+static void lru_unlink(DentryCache *cache, int32_t index) {
+    Dentry *dentry = &cache->dentries[index];
+    if (dentry->lru_prev >= 0) {
+        cache->dentries[dentry->lru_prev].lru_next = dentry->lru_next;
+    } else {
+        cache->lru_head = dentry->lru_next;
+    }
+    if (dentry->lru_next >= 0) {
+        cache->dentries[dentry->lru_next].lru_prev = dentry->lru_prev;
+    } else {
+        cache->lru_tail = dentry->lru_prev;
+    }
+}
+
+
+static void lru_push(DentryCache *cache, int32_t index) {
+    Dentry *dentry = &cache->dentries[index];
+    dentry->lru_prev = -1;
+    dentry->lru_next = cache->lru_head;
+    if (cache->lru_head >= 0) {
+        cache->dentries[cache->lru_head].lru_prev = index;
+    } else {
+        cache->lru_tail = index;
+    }
+    cache->lru_head = index;
+}
+
+
+// returns index of dentry, "link" is set to pointer which refers to it
+static int32_t lookup(DentryCache *cache, uint32_t parent, const char *name, uint32_t hash, int32_t **link) {
+    int32_t *current = &cache->buckets[hash & cache->bucket_mask];
+    while (*current >= 0) {
+        Dentry *dentry = &cache->dentries[*current];
+        if (dentry->hash == hash && dentry->parent == parent &&
+            strncmp(dentry->name, name, MAX_FILENAME_SIZE) == 0) {
+            if (link != NULL) {
+                *link = current;
+            }
+            return *current;
+        }
+        current = &dentry->next;
+    }
+    return -1;
+}
+
+
+static void drop(DentryCache *cache, int32_t index) {
+    Dentry *dentry = &cache->dentries[index];
+    int32_t *link;
+    lookup(cache, dentry->parent, dentry->name, dentry->hash, &link);
+    *link = dentry->next;
+    lru_unlink(cache, index);
+    dentry->next = cache->free;
+    cache->free = index;
+    cache->count--;
+}
+
+
+// =========== [ CACHE ] ===========
+
+void dcache_init(DentryCache *cache, uint32_t capacity) {
+    uint32_t buckets = 1;
+    while (buckets < capacity * 2) {
+        buckets *= 2;
+    }
+    cache->capacity = capacity;
+    cache->bucket_mask = buckets - 1;
+    cache->dentries = (Dentry*) malloc((capacity > 0 ? capacity : 1) * sizeof(Dentry));
+    cache->buckets = (int32_t*) malloc(buckets * sizeof(int32_t));
+    cache->hits = 0;
+    cache->misses = 0;
+    dcache_clear(cache);
+}
+
+
+void dcache_free(DentryCache *cache) {
+    free(cache->dentries);
+    free(cache->buckets);
+    cache->dentries = NULL;
+    cache->buckets = NULL;
+}
+
+
+void dcache_clear(DentryCache *cache) {
+    memset(cache->buckets, 0xFF, (cache->bucket_mask + 1) * sizeof(int32_t));
+    for (uint32_t index = 0; index < cache->capacity; ++index) {
+        cache->dentries[index].next = (index + 1 < cache->capacity) ? index + 1 : -1;
+    }
+    cache->free = (cache->capacity > 0) ? 0 : -1;
+    cache->count = 0;
+    cache->lru_head = -1;
+    cache->lru_tail = -1;
+}
+
+
+Dentry *dcache_find(DentryCache *cache, uint32_t parent, const char *name) {
+    int32_t index = lookup(cache, parent, name, dentry_hash(parent, name), NULL);
+    if (index < 0) {
+        cache->misses++;
+        return NULL;
+    }
+    cache->hits++;
+    lru_unlink(cache, index);
+    lru_push(cache, index);
+    return &cache->dentries[index];
+}
+
+
+void dcache_insert(DentryCache *cache, uint32_t parent, const char *name, int32_t inode, int32_t entry) {
+    if (cache->capacity == 0 || strnlen(name, MAX_FILENAME_SIZE) >= MAX_FILENAME_SIZE) {
+        return;
+    }
+
+    uint32_t hash = dentry_hash(parent, name);
+    int32_t index = lookup(cache, parent, name, hash, NULL);
+    if (index >= 0) {
+        lru_unlink(cache, index);
+    } else {
+        if (cache->free < 0) {
+            drop(cache, cache->lru_tail);
+        }
+        index = cache->free;
+        cache->free = cache->dentries[index].next;
+        cache->count++;
+
+        Dentry *dentry = &cache->dentries[index];
+        dentry->parent = parent;
+        dentry->hash = hash;
+        strcpy(dentry->name, name);
+        dentry->next = cache->buckets[hash & cache->bucket_mask];
+        cache->buckets[hash & cache->bucket_mask] = index;
+    }
+
+    cache->dentries[index].inode = inode;
+    cache->dentries[index].entry = entry;
+    lru_push(cache, index);
+}
+
+
+void dcache_remove(DentryCache *cache, uint32_t parent, const char *name) {
+    int32_t index = lookup(cache, parent, name, dentry_hash(parent, name), NULL);
+    if (index >= 0) {
+        drop(cache, index);
+    }
+}
+
+
+void dcache_remove_dir(DentryCache *cache, uint32_t parent) {
+    int32_t index = cache->lru_head;
+    while (index >= 0) {
+        int32_t next = cache->dentries[index].lru_next;
+        if (cache->dentries[index].parent == parent) {
+            drop(cache, index);
+        }
+        index = next;
+    }
+}
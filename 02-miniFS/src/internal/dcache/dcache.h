@@ -0,0 +1,68 @@
+#ifndef DCACHE_H
+#define DCACHE_H
+
+#include <internal/fs/fs.h>
+
+/*
+	Dentry cache: in-memory map (parent inode, name) -> inode
+	with negative entries for missing names. Size is bounded,
+	least recently used dentry is evicted when cache is full.
+*/
+
+#define DCACHE_DEFAULT_CAPACITY 4096
+
+
+typedef struct Dentry {
+    uint32_t parent;
+    int32_t inode;          // -1 for negative dentry
+    int32_t entry;          // position of entry in parent directory
+    uint32_t hash;
+    int32_t next;           // next dentry in bucket or in free list
+    int32_t lru_prev;
+    int32_t lru_next;
+    char name[MAX_FILENAME_SIZE];
+} Dentry;
+
+
+typedef struct DentryCache {
+    Dentry *dentries;
+    int32_t *buckets;
+    uint32_t capacity;
+    uint32_t bucket_mask;
+    uint32_t count;
+    int32_t free;           // head of free list
+    int32_t lru_head;       // most recently used
+    int32_t lru_tail;
+    uint64_t hits;
+    uint64_t misses;
+} DentryCache;
+
+
+// function allocates empty cache for "capacity" dentries
+void dcache_init(DentryCache *cache, uint32_t capacity);
+
+
+// function frees cache memory
+void dcache_free(DentryCache *cache);
+
+
+// function drops all dentries
+void dcache_clear(DentryCache *cache);
+
+
+// function returns dentry of name or NULL if name is not cached
+Dentry *dcache_find(DentryCache *cache, uint32_t parent, const char *name);
+
+
+// function adds or replaces dentry, least recently used
+// dentry is evicted if cache is full
+void dcache_insert(DentryCache *cache, uint32_t parent, const char *name, int32_t inode, int32_t entry);
+
+
+void dcache_remove(DentryCache *cache, uint32_t parent, const char *name);
+
+
+// function drops all dentries of directory
+void dcache_remove_dir(DentryCache *cache, uint32_t parent);
+
+#endif
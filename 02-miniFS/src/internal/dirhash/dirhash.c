@@ -0,0 +1,271 @@
+#include <internal/dirhash/dirhash.h>
+#include <internal/dcache/dcache.h>
+#include <internal/debug/debug.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+// =========== [ HELPERS ] ===========
+
+uint32_t dirhash_name(const char *name) {
+    uint32_t hash = 2166136261u;  // FNV-1a
+    for (uint32_t index = 0; index < MAX_FILENAME_SIZE && name[index] != '\0'; ++index) {
+        hash ^= (unsigned char) name[index];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+
+static void read_header(Filesystem *fs, uint32_t dir, DirHashHeader *header) {
+    minifs_read_entry(fs, dir, 0, (DirEntry*) header);
+    if (memcmp(header->magic, DIRHASH_MAGIC, sizeof(header->magic)) != 0) {
+        debug(MINIFS_ERR "directory %u has no index header", dir);
+        exit(-1);
+    }
+}
+
+
+static void write_header(Filesystem *fs, uint32_t dir, DirHashHeader *header) {
+    minifs_write_entry(fs, dir, 0, (DirEntry*) header);
+}
+
+
+static uint32_t slots_per_block(Filesystem *fs) {
+    return fs->sblock.block_size / sizeof(DirHashSlot);
+}
+
+
+static void write_slot(Filesystem *fs, uint32_t index_inode, uint32_t position, DirHashSlot *slot) {
+    uint32_t per_block = slots_per_block(fs);
+    int32_t block = minifs_file_block(fs, index_inode, position / per_block);
+    minifs_write_body(fs, block, slot, sizeof(DirHashSlot), (position % per_block) * sizeof(DirHashSlot));
+}
+
+
+// puts slot to in-memory table
+static void place(DirHashSlot *table, uint32_t capacity, uint32_t hash, uint32_t entry) {
+    uint32_t position = hash & (capacity - 1);
+    while (table[position].entry != DIRHASH_EMPTY) {
+        position = (position + 1) & (capacity - 1);
+    }
+    table[position].hash = hash;
+    table[position].entry = entry;
+}
+
+
+static uint32_t table_capacity(uint32_t live) {
+    uint32_t capacity = DIRHASH_MIN_SLOTS;
+    while (capacity < live * 3) {
+        capacity *= 2;
+    }
+    return capacity;
+}
+
+
+// writes table to new index inode, returns its id or -1
+static int32_t store_table(Filesystem *fs, uint32_t dir, DirHashSlot *table, uint32_t capacity) {
+    int32_t index_inode = minifs_create_inode(fs, MINIFS_INODE_INDEX, MINIFS_INODE_EXTENTS, dir);
+    if (index_inode < 0) {
+        return -1;
+    }
+    minifs_append_data(fs, index_inode, (const unsigned char*) table, capacity * sizeof(DirHashSlot));
+    fs->sblock.inode_map[index_inode].size = capacity * sizeof(DirHashSlot);
+    minifs_mark_inode(fs, index_inode);
+    return index_inode;
+}
+
+
+// moves live slots to new table sized for current entry count
+static void rebuild(Filesystem *fs, uint32_t dir, DirHashHeader *header) {
+    int32_t size;
+    DirHashSlot *old = (DirHashSlot*) minifs_read_data(fs, header->index_inode, &size);
+
+    uint32_t capacity = table_capacity(header->live + 1);
+    DirHashSlot *table = (DirHashSlot*) malloc(capacity * sizeof(DirHashSlot));
+    memset(table, 0xFF, capacity * sizeof(DirHashSlot));
+    for (uint32_t index = 0; index < header->capacity; ++index) {
+        if (old[index].entry < DIRHASH_DELETED) {
+            place(table, capacity, old[index].hash, old[index].entry);
+        }
+    }
+    free(old);
+
+    int32_t index_inode = store_table(fs, dir, table, capacity);
+    free(table);
+    if (index_inode < 0) {
+        fprintf(stderr, "Ran out of space for directory index\n");
+        exit(-1);
+    }
+    minifs_destroy_inode(fs, header->index_inode);
+
+    header->index_inode = index_inode;
+    header->capacity = capacity;
+    header->filled = header->live;
+}
+
+
+// =========== [ INDEX ] ===========
+
+void dirhash_build(Filesystem *fs, uint32_t dir) {
+    // entry 0 will hold header, its copy goes to the end
+    DirEntry first;
+    minifs_read_entry(fs, dir, 0, &first);
+
+    uint32_t size = fs->sblock.inode_map[dir].size;
+    uint32_t capacity = table_capacity(size);
+    DirHashSlot *table = (DirHashSlot*) malloc(capacity * sizeof(DirHashSlot));
+    memset(table, 0xFF, capacity * sizeof(DirHashSlot));
+
+    uint32_t live = 0;
+    DirIterator it;
+    minifs_dir_open(fs, dir, &it);
+    const DirEntry *entry;
+    while ((entry = minifs_dir_next(&it)) != NULL) {
+        uint32_t position = (it.position == 0) ? size : it.position;
+        place(table, capacity, dirhash_name(entry->name), position);
+        live++;
+    }
+    minifs_dir_close(&it);
+
+    int32_t index_inode = store_table(fs, dir, table, capacity);
+    free(table);
+    if (index_inode < 0) {  // directory stays linear
+        return;
+    }
+    if (first.used) {
+        minifs_append_entry(fs, dir, &first);
+        pthread_mutex_lock(&fs->locks->dcache);
+        dcache_remove(fs->dcache, dir, first.name);  // entry has moved
+        pthread_mutex_unlock(&fs->locks->dcache);
+    }
+
+    DirHashHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, DIRHASH_MAGIC, sizeof(header.magic));
+    header.capacity = capacity;
+    header.filled = live;
+    header.live = live;
+    header.index_inode = index_inode;
+    write_header(fs, dir, &header);
+
+    fs->sblock.inode_map[dir].flags |= MINIFS_INODE_HASHED;
+    minifs_mark_inode(fs, dir);
+}
+
+
+int32_t dirhash_lookup(Filesystem *fs, uint32_t dir, const char *name, int32_t *entry) {
+    DirHashHeader header;
+    read_header(fs, dir, &header);
+
+    uint32_t per_block = slots_per_block(fs);
+    DirHashSlot *slots = (DirHashSlot*) malloc(fs->sblock.block_size);
+    int32_t loaded = -1;
+
+    uint32_t hash = dirhash_name(name);
+    uint32_t position = hash & (header.capacity - 1);
+    int32_t result = -1;
+    for (uint32_t probe = 0; probe < header.capacity; ++probe) {
+        if (position / per_block != loaded) {  // probes mostly stay in one block
+            loaded = position / per_block;
+            int32_t block = minifs_file_block(fs, header.index_inode, loaded);
+            minifs_read_body(fs, block, slots, fs->sblock.block_size, 0);
+        }
+
+        DirHashSlot slot = slots[position % per_block];
+        if (slot.entry == DIRHASH_EMPTY) {
+            break;
+        }
+        if (slot.entry != DIRHASH_DELETED && slot.hash == hash) {
+            DirEntry candidate;
+            minifs_read_entry(fs, dir, slot.entry, &candidate);
+            if (candidate.used && strncmp(candidate.name, name, MAX_FILENAME_SIZE) == 0) {
+                if (entry != NULL) {
+                    *entry = slot.entry;
+                }
+                result = candidate.inode;
+                break;
+            }
+        }
+        position = (position + 1) & (header.capacity - 1);
+    }
+
+    free(slots);
+    return result;
+}
+
+
+void dirhash_insert(Filesystem *fs, uint32_t dir, const char *name, uint32_t entry) {
+    DirHashHeader header;
+    read_header(fs, dir, &header);
+    if ((header.filled + 1) * 2 > header.capacity) {  // keep load factor under 1/2
+        rebuild(fs, dir, &header);
+    }
+
+    uint32_t per_block = slots_per_block(fs);
+    DirHashSlot *slots = (DirHashSlot*) malloc(fs->sblock.block_size);
+    int32_t loaded = -1;
+
+    DirHashSlot slot = {.hash = dirhash_name(name), .entry = entry};
+    uint32_t position = slot.hash & (header.capacity - 1);
+    while (true) {
+        if (position / per_block != loaded) {
+            loaded = position / per_block;
+            int32_t block = minifs_file_block(fs, header.index_inode, loaded);
+            minifs_read_body(fs, block, slots, fs->sblock.block_size, 0);
+        }
+        uint32_t current = slots[position % per_block].entry;
+        if (current == DIRHASH_EMPTY || current == DIRHASH_DELETED) {
+            header.filled += (current == DIRHASH_EMPTY) ? 1 : 0;
+            break;
+        }
+        position = (position + 1) & (header.capacity - 1);
+    }
+    free(slots);
+
+    write_slot(fs, header.index_inode, position, &slot);
+    header.live++;
+    write_header(fs, dir, &header);
+}
+
+
+void dirhash_remove(Filesystem *fs, uint32_t dir, const char *name, uint32_t entry) {
+    DirHashHeader header;
+    read_header(fs, dir, &header);
+
+    uint32_t per_block = slots_per_block(fs);
+    DirHashSlot *slots = (DirHashSlot*) malloc(fs->sblock.block_size);
+    int32_t loaded = -1;
+
+    uint32_t position = dirhash_name(name) & (header.capacity - 1);
+    for (uint32_t probe = 0; probe < header.capacity; ++probe) {
+        if (position / per_block != loaded) {
+            loaded = position / per_block;
+            int32_t block = minifs_file_block(fs, header.index_inode, loaded);
+            minifs_read_body(fs, block, slots, fs->sblock.block_size, 0);
+        }
+        DirHashSlot slot = slots[position % per_block];
+        if (slot.entry == DIRHASH_EMPTY) {
+            break;
+        }
+        if (slot.entry == entry) {
+            slot.entry = DIRHASH_DELETED;
+            write_slot(fs, header.index_inode, position, &slot);
+            header.live--;
+            write_header(fs, dir, &header);
+            break;
+        }
+        position = (position + 1) & (header.capacity - 1);
+    }
+    free(slots);
+}
+
+
+void dirhash_free(Filesystem *fs, uint32_t dir) {
+    DirHashHeader header;
+    read_header(fs, dir, &header);
+    minifs_destroy_inode(fs, header.index_inode);
+    fs->sblock.inode_map[dir].flags &= ~MINIFS_INODE_HASHED;
+    minifs_mark_inode(fs, dir);
+}
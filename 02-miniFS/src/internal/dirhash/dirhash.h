@@ -0,0 +1,58 @@
+#ifndef DIRHASH_H
+#define DIRHASH_H
+
+#include <internal/fs/fs.h>
+
+/*
+	Hashed name index of large directories. Index is open
+	addressing table of (name hash, entry position) slots,
+	stored in hidden extent mapped inode. First entry of
+	indexed directory is header, which linear readers see
+	as deleted entry.
+*/
+
+#define DIRHASH_MAGIC       "HIDX"
+#define DIRHASH_EMPTY       0xFFFFFFFF
+#define DIRHASH_DELETED     0xFFFFFFFE
+#define DIRHASH_MIN_SLOTS   256
+
+
+typedef struct __attribute__((packed)) DirHashHeader {
+    char used;              // always 0
+    char zero;              // empty name never matches lookup
+    char magic[4];
+    uint32_t capacity;      // slots in table, power of two
+    uint32_t filled;        // slots taken by entries and tombstones
+    uint32_t live;
+    char reserved[MAX_FILENAME_SIZE - 17];
+    uint32_t index_inode;   // in place of entry inode id
+} DirHashHeader;
+
+
+typedef struct DirHashSlot {
+    uint32_t hash;
+    uint32_t entry;         // position of entry in directory
+} DirHashSlot;
+
+
+// hash of entry name
+uint32_t dirhash_name(const char *name);
+
+
+// function converts directory to indexed one
+void dirhash_build(Filesystem *fs, uint32_t dir);
+
+
+// function returns inode of entry with given name or -1,
+// position of entry is stored to "entry" if it is not NULL
+int32_t dirhash_lookup(Filesystem *fs, uint32_t dir, const char *name, int32_t *entry);
+
+
+void dirhash_insert(Filesystem *fs, uint32_t dir, const char *name, uint32_t entry);
+void dirhash_remove(Filesystem *fs, uint32_t dir, const char *name, uint32_t entry);
+
+
+// function releases index of directory
+void dirhash_free(Filesystem *fs, uint32_t dir);
+
+#endif
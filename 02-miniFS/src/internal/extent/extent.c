@@ -0,0 +1,400 @@
+#include <internal/extent/extent.h>
+#include <internal/debug/debug.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_DEPTH 8
+
+
+// =========== [ NODES ] ===========
+
+static Extent *node_entries(ExtentHeader *node) {
+    return (Extent*) (node + 1);
+}
+
+
+// returns NULL if block does not hold extent node: tree of damaged
+// image is reported to caller instead of stopping process
+static ExtentHeader *read_node(Filesystem *fs, int32_t block) {
+    ExtentHeader *node = (ExtentHeader*) malloc(fs->sblock.block_size);
+    minifs_read_body(fs, block, node, fs->sblock.block_size, 0);
+    if (node->magic != EXTENT_MAGIC) {
+        debug(MINIFS_ERR "block %d is not extent node", block);
+        free(node);
+        return NULL;
+    }
+    return node;
+}
+
+
+static void write_node(Filesystem *fs, int32_t block, ExtentHeader *node) {
+    uint32_t size = sizeof(ExtentHeader) + node->count * sizeof(Extent);
+    minifs_write_body(fs, block, node, size, 0);
+    fs->sblock.block_map[block].size = size;
+    minifs_mark_block(fs, block);
+}
+
+
+static void reset_node(Filesystem *fs, ExtentHeader *node, uint16_t depth) {
+    node->magic = EXTENT_MAGIC;
+    node->count = 0;
+    node->depth = depth;
+    node->capacity = (fs->sblock.block_size - sizeof(ExtentHeader)) / sizeof(Extent);
+}
+
+
+static int32_t alloc_node(Filesystem *fs) {
+    minifs_lock_alloc(fs);
+    int32_t block = minifs_find_free_block(fs);
+    if (block < 0) {
+        fprintf(stderr, "Ran out of free blocks\n");
+        exit(-1);
+    }
+    fs->sblock.block_map[block].type = MINIFS_BLOCK_USED;
+    fs->sblock.block_map[block].next_block = -1;
+    fs->sblock.block_map[block].size = 0;
+    minifs_take_block(fs, block);
+    minifs_unlock_alloc(fs);
+    return block;
+}
+
+
+// index of last entry with logical <= target or -1
+static int32_t search_node(ExtentHeader *node, uint32_t logical) {
+    Extent *entries = node_entries(node);
+    int32_t left = 0;
+    int32_t right = node->count - 1;
+    int32_t result = -1;
+    while (left <= right) {
+        int32_t middle = (left + right) / 2;
+        if (entries[middle].logical <= logical) {
+            result = middle;
+            left = middle + 1;
+        } else {
+            right = middle - 1;
+        }
+    }
+    return result;
+}
+
+
+// =========== [ TREE ] ===========
+
+void extent_init(Filesystem *fs, int32_t block) {
+    ExtentHeader node;
+    reset_node(fs, &node, 0);
+    write_node(fs, block, &node);
+}
+
+
+int32_t extent_map(Filesystem *fs, uint32_t inode, uint32_t logical) {
+    minifs_flush_delayed(fs, inode);
+    int32_t block = fs->sblock.inode_map[inode].root_block;
+    while (true) {
+        ExtentHeader *node = read_node(fs, block);
+        if (node == NULL) {
+            return -1;
+        }
+        int32_t index = search_node(node, logical);
+        if (index < 0) {
+            free(node);
+            return -1;
+        }
+        Extent entry = node_entries(node)[index];
+        uint16_t depth = node->depth;
+        free(node);
+
+        if (depth == 0) {
+            if (logical >= entry.logical + entry.length) {
+                return -1;
+            }
+            return entry.start + (logical - entry.logical);
+        }
+        block = entry.start;
+    }
+}
+
+
+bool extent_append(Filesystem *fs, uint32_t inode, uint32_t logical, int32_t start, uint32_t length) {
+    // load rightmost path from root to leaf
+    int32_t path[MAX_DEPTH];
+    ExtentHeader *nodes[MAX_DEPTH];
+    int depth = 0;
+    path[0] = fs->sblock.inode_map[inode].root_block;
+    nodes[0] = read_node(fs, path[0]);
+    if (nodes[0] == NULL) {
+        return false;
+    }
+    while (nodes[depth]->depth > 0) {
+        Extent *entries = node_entries(nodes[depth]);
+        path[depth + 1] = entries[nodes[depth]->count - 1].start;
+        nodes[depth + 1] = read_node(fs, path[depth + 1]);
+        if (nodes[depth + 1] == NULL) {
+            for (int level = 0; level <= depth; ++level) {
+                free(nodes[level]);
+            }
+            return false;
+        }
+        ++depth;
+    }
+
+    ExtentHeader *leaf = nodes[depth];
+    Extent *entries = node_entries(leaf);
+    Extent entry = {.logical = logical, .start = start, .length = length};
+
+    if (leaf->count > 0) {  // contiguous with last extent
+        Extent *last = &entries[leaf->count - 1];
+        if (last->logical + last->length == logical && last->start + last->length == start) {
+            last->length += length;
+            write_node(fs, path[depth], leaf);
+            goto cleanup;
+        }
+    }
+
+    // put entry to first node on path which has free space, full
+    // nodes below it get new right siblings
+    for (int level = depth; level >= 0; --level) {
+        ExtentHeader *node = nodes[level];
+        if (node->count < node->capacity) {
+            node_entries(node)[node->count++] = entry;
+            write_node(fs, path[level], node);
+            goto cleanup;
+        }
+
+        int32_t sibling = alloc_node(fs);
+        ExtentHeader *fresh = (ExtentHeader*) malloc(fs->sblock.block_size);
+        reset_node(fs, fresh, node->depth);
+        node_entries(fresh)[fresh->count++] = entry;
+        write_node(fs, sibling, fresh);
+        free(fresh);
+
+        entry.start = sibling;
+        entry.length = 0;
+    }
+
+    // root is full: move its entries to new child, tree grows by one level
+    ExtentHeader *root = nodes[0];
+    int32_t child = alloc_node(fs);
+    write_node(fs, child, root);
+
+    Extent first = {.logical = node_entries(root)[0].logical, .start = child, .length = 0};
+    reset_node(fs, root, root->depth + 1);
+    node_entries(root)[root->count++] = first;
+    node_entries(root)[root->count++] = entry;
+    write_node(fs, path[0], root);
+
+cleanup:
+    for (int level = 0; level <= depth; ++level) {
+        free(nodes[level]);
+    }
+    return true;
+}
+
+
+// puts entry into subtree in logical order; node which overflows is split
+// in halves and entry for its new right half is returned in split,
+// damaged is set when some node of path cannot be read
+static bool insert_subtree(Filesystem *fs, int32_t block, Extent entry, Extent *split, bool *damaged) {
+    ExtentHeader *node = read_node(fs, block);
+    if (node == NULL) {
+        *damaged = true;
+        return false;
+    }
+    node = (ExtentHeader*) realloc(node, fs->sblock.block_size + sizeof(Extent));  // room for overflow
+    Extent *entries = node_entries(node);
+    int32_t index = search_node(node, entry.logical);
+
+    if (node->depth > 0) {
+        if (index < 0) {  // entry goes before everything, first child covers it
+            index = 0;
+            entries[0].logical = entry.logical;
+        }
+        Extent child;
+        if (!insert_subtree(fs, entries[index].start, entry, &child, damaged)) {
+            if (!*damaged) {
+                write_node(fs, block, node);
+            }
+            free(node);
+            return false;
+        }
+        entry = child;
+    } else if (index >= 0 && entries[index].logical + entries[index].length == entry.logical &&
+               entries[index].start + entries[index].length == entry.start) {
+        entries[index].length += entry.length;  // contiguous with previous extent
+        write_node(fs, block, node);
+        free(node);
+        return false;
+    }
+
+    memmove(&entries[index + 2], &entries[index + 1], (node->count - index - 1) * sizeof(Extent));
+    entries[index + 1] = entry;
+    node->count++;
+    if (node->count <= node->capacity) {
+        write_node(fs, block, node);
+        free(node);
+        return false;
+    }
+
+    int32_t sibling = alloc_node(fs);
+    ExtentHeader *fresh = (ExtentHeader*) malloc(fs->sblock.block_size);
+    reset_node(fs, fresh, node->depth);
+    fresh->count = node->count / 2;
+    node->count -= fresh->count;
+    memcpy(node_entries(fresh), &entries[node->count], fresh->count * sizeof(Extent));
+    write_node(fs, block, node);
+    write_node(fs, sibling, fresh);
+    *split = (Extent) {.logical = node_entries(fresh)[0].logical, .start = sibling, .length = 0};
+    free(fresh);
+    free(node);
+    return true;
+}
+
+
+bool extent_insert(Filesystem *fs, uint32_t inode, uint32_t logical, int32_t start, uint32_t length) {
+    int32_t root_block = fs->sblock.inode_map[inode].root_block;
+    Extent entry = {.logical = logical, .start = start, .length = length};
+    Extent split;
+    bool damaged = false;
+    if (!insert_subtree(fs, root_block, entry, &split, &damaged)) {
+        return !damaged;
+    }
+
+    // root was split: its left half moves to new child, tree grows by one level
+    ExtentHeader *root = read_node(fs, root_block);
+    int32_t child = alloc_node(fs);
+    write_node(fs, child, root);
+    Extent first = {.logical = node_entries(root)[0].logical, .start = child, .length = 0};
+    reset_node(fs, root, root->depth + 1);
+    node_entries(root)[root->count++] = first;
+    node_entries(root)[root->count++] = split;
+    write_node(fs, root_block, root);
+    free(root);
+    return true;
+}
+
+
+// appends leaf entries of subtree to list, returns false if some node cannot be read
+static bool collect(Filesystem *fs, int32_t block, Extent **list, uint32_t *count, uint32_t *capacity) {
+    ExtentHeader *node = read_node(fs, block);
+    if (node == NULL) {
+        return false;
+    }
+    Extent *entries = node_entries(node);
+    for (uint32_t index = 0; index < node->count; ++index) {
+        if (node->depth > 0) {
+            if (!collect(fs, entries[index].start, list, count, capacity)) {
+                free(node);
+                return false;
+            }
+            continue;
+        }
+        if (*count == *capacity) {
+            *capacity *= 2;
+            *list = (Extent*) realloc(*list, *capacity * sizeof(Extent));
+        }
+        (*list)[(*count)++] = entries[index];
+    }
+    free(node);
+    return true;
+}
+
+
+Extent *extent_list(Filesystem *fs, uint32_t inode, uint32_t *count) {
+    minifs_flush_delayed(fs, inode);
+    return extent_list_stored(fs, inode, count);
+}
+
+
+Extent *extent_list_stored(Filesystem *fs, uint32_t inode, uint32_t *count) {
+    uint32_t capacity = 16;
+    Extent *result = (Extent*) malloc(capacity * sizeof(Extent));
+    *count = 0;
+    if (!collect(fs, fs->sblock.inode_map[inode].root_block, &result, count, &capacity)) {
+        free(result);
+        *count = 0;
+        return NULL;
+    }
+    return result;
+}
+
+
+static void release(Filesystem *fs, int32_t block, int32_t length) {
+    for (int32_t index = block; index < block + length; ++index) {
+        fs->sblock.block_map[index].type = MINIFS_BLOCK_EMPTY;
+        fs->sblock.block_map[index].size = 0;
+        fs->sblock.block_map[index].next_block = 0;
+        minifs_release_block(fs, index);
+    }
+}
+
+
+// node which cannot be read is released alone, blocks under it stay used
+static void free_subtree(Filesystem *fs, int32_t block) {
+    ExtentHeader *node = read_node(fs, block);
+    if (node == NULL) {
+        release(fs, block, 1);
+        return;
+    }
+    Extent *entries = node_entries(node);
+    for (uint32_t index = 0; index < node->count; ++index) {
+        if (node->depth > 0) {
+            free_subtree(fs, entries[index].start);
+        } else {
+            release(fs, entries[index].start, entries[index].length);
+        }
+    }
+    free(node);
+    release(fs, block, 1);
+}
+
+
+void extent_free(Filesystem *fs, uint32_t inode) {
+    free_subtree(fs, fs->sblock.inode_map[inode].root_block);
+}
+
+
+// drops entries of subtree which cover file blocks from logical on
+static void truncate_subtree(Filesystem *fs, int32_t block, uint32_t logical) {
+    ExtentHeader *node = read_node(fs, block);
+    if (node == NULL) {  // damaged subtree is left as it is
+        return;
+    }
+    Extent *entries = node_entries(node);
+    uint16_t count = node->count;
+    while (count > 0 && entries[count - 1].logical >= logical) {
+        --count;
+        if (node->depth > 0) {
+            free_subtree(fs, entries[count].start);
+        } else {
+            release(fs, entries[count].start, entries[count].length);
+        }
+    }
+
+    bool changed = (count != node->count);
+    if (count > 0 && node->depth > 0) {  // last child may cover new end
+        truncate_subtree(fs, entries[count - 1].start, logical);
+    } else if (count > 0) {
+        Extent *last = &entries[count - 1];
+        if (last->logical + last->length > logical) {
+            uint32_t keep = logical - last->logical;
+            release(fs, last->start + keep, last->length - keep);
+            last->length = keep;
+            changed = true;
+        }
+    }
+
+    node->count = count;
+    if (count == 0 && node->depth > 0) {  // only root can lose all entries
+        reset_node(fs, node, 0);
+    }
+    if (changed) {
+        write_node(fs, block, node);
+    }
+    free(node);
+}
+
+
+void extent_truncate(Filesystem *fs, uint32_t inode, uint32_t logical) {
+    truncate_subtree(fs, fs->sblock.inode_map[inode].root_block, logical);
+}
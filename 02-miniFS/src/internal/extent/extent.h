@@ -0,0 +1,72 @@
+#ifndef EXTENT_H
+#define EXTENT_H
+
+#include <internal/fs/fs.h>
+
+/*
+	Extent tree of file: maps file blocks to runs of physical
+	blocks. Root node is stored in inode root_block, nodes
+	are sorted by logical block, leafs have depth 0. File
+	blocks which no extent covers are holes.
+*/
+
+#define EXTENT_MAGIC 0xE47E
+
+
+typedef struct ExtentHeader {
+    uint16_t magic;
+    uint16_t count;     // entries in node
+    uint16_t depth;     // 0 for leaf
+    uint16_t capacity;
+} ExtentHeader;
+
+
+// leaf entry: run of blocks, index entry: start is child node block
+typedef struct Extent {
+    uint32_t logical;   // first file block covered by entry
+    int32_t start;
+    uint32_t length;
+} Extent;
+
+
+// function writes empty root node to block
+void extent_init(Filesystem *fs, int32_t block);
+
+
+// function returns physical block which stores file block
+// or -1 if file has no such block, delayed appends get blocks first
+int32_t extent_map(Filesystem *fs, uint32_t inode, uint32_t logical);
+
+
+// function adds run of blocks to the end of file, run is merged with
+// last extent if they are contiguous, returns false if tree is damaged
+bool extent_append(Filesystem *fs, uint32_t inode, uint32_t logical, int32_t start, uint32_t length);
+
+
+// function adds run of blocks which covers hole of file at any position,
+// run is merged with previous extent if they are contiguous,
+// returns false if tree is damaged
+bool extent_insert(Filesystem *fs, uint32_t inode, uint32_t logical, int32_t start, uint32_t length);
+
+
+// function returns all extents of file ordered by logical block
+// after delayed appends get blocks, result must be freed by caller,
+// returns NULL with zero count if some node of tree cannot be read
+Extent *extent_list(Filesystem *fs, uint32_t inode, uint32_t *count);
+
+
+// function returns extents which file has now, delayed appends
+// stay in their buffer, NULL if tree is damaged
+Extent *extent_list_stored(Filesystem *fs, uint32_t inode, uint32_t *count);
+
+
+// function releases data blocks and all nodes of tree,
+// blocks under damaged nodes are kept used
+void extent_free(Filesystem *fs, uint32_t inode);
+
+
+// function releases data blocks from file block "logical" to the end
+// together with nodes which become empty, root node is kept
+void extent_truncate(Filesystem *fs, uint32_t inode, uint32_t logical);
+
+#endif
@@ -0,0 +1,1315 @@
+#include <internal/fs/fs.h>
+#include <internal/commands/execute.h>
+#include <internal/dcache/dcache.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <fcntl.h>
+
+#define BENCH_IMAGE "fs-bench.img"
+#define BENCH_HOST_FILE "fs-bench.host"
+
+/*
+	Benchmarks of minifs data path. Every benchmark prints
+	syscall count and latency of one round for each backend.
+*/
+
+
+void bench_backends(int rounds);
+void bench_metadata(int rounds);
+void bench_allocator(int rounds);
+void bench_dirhash(int rounds);
+void bench_dir_listing(int rounds);
+void bench_paths(int rounds);
+void bench_parallel_reads(int rounds);
+void bench_uring(int rounds);
+void bench_read_output(int rounds);
+void bench_import(int rounds);
+void bench_export(int rounds);
+void bench_random_reads(int rounds);
+void bench_rewrite(int rounds);
+void bench_journal(int rounds);
+void bench_grow(int rounds);
+void bench_dir_churn(int rounds);
+void bench_inline(int rounds);
+void bench_locality(int rounds);
+void bench_delayed(int rounds);
+void bench_sparse(int rounds);
+void bench_compressed(int rounds);
+
+
+int main(int argc, char **argv) {
+    int rounds = (argc > 1) ? atoi(argv[1]) : 1000;
+    bench_backends(rounds);
+    bench_metadata(rounds);
+    bench_allocator(rounds);
+    bench_dirhash(rounds);
+    bench_dir_listing(rounds);
+    bench_paths(rounds);
+    bench_parallel_reads(rounds);
+    bench_uring(rounds);
+    bench_read_output(rounds);
+    bench_import(rounds);
+    bench_export(rounds);
+    bench_random_reads(rounds);
+    bench_rewrite(rounds);
+    bench_journal(rounds);
+    bench_grow(rounds);
+    bench_dir_churn(rounds);
+    bench_inline(rounds);
+    bench_locality(rounds);
+    bench_delayed(rounds);
+    bench_sparse(rounds);
+    bench_compressed(rounds);
+    return 0;
+}
+
+
+// =========== [ HELPERS ] ===========
+
+uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+
+uint64_t syscall_count() {
+    return minifs_io_stats.reads + minifs_io_stats.writes + minifs_io_stats.syncs + minifs_io_stats.copies;
+}
+
+
+void touch_file(Filesystem *fs, const char *name) {
+    const char *args[] = {"touch", name};
+    minifs_touch(fs, args, 2);
+}
+
+
+// =========== [ BENCHMARKS ] ===========
+
+// read whole directory with 512 entries and 64 KB file on each round
+void bench_backends(int rounds) {
+    const uint32_t entries = 512;
+    const uint32_t file_size = 64 * 1024;
+
+    unlink(BENCH_IMAGE);
+    minifs_init(BENCH_IMAGE);
+    Filesystem fs = minifs_open(BENCH_IMAGE);
+    char name[MAX_FILENAME_SIZE];
+    for (uint32_t index = 0; index < entries; ++index) {
+        snprintf(name, sizeof(name), "file%u", index);
+        touch_file(&fs, name);
+    }
+    unsigned char *payload = (unsigned char*) malloc(file_size);
+    memset(payload, 'x', file_size);
+    uint32_t inode = 1;  // first created file
+    minifs_append_data(&fs, inode, payload, file_size);
+    fs.sblock.inode_map[inode].size += file_size;
+    minifs_mark_inode(&fs, inode);
+    minifs_update_superblock(&fs);
+    minifs_close(&fs);
+    free(payload);
+
+    printf("===== [backends: %u dir entries, %u byte file] =====\n", entries, file_size);
+    const char *labels[] = {"fd", "cache", "mmap"};
+    for (int backend = 0; backend < 3; ++backend) {
+        fs = minifs_open(BENCH_IMAGE);
+        if (backend == 0) {
+            minifs_set_cache_size(&fs, 0);
+        }
+        if (backend == 2 && !minifs_map_image(&fs)) {
+            printf("cannot map image\n");
+            break;
+        }
+
+        uint64_t calls = syscall_count();
+        uint64_t begin = now_ns();
+        for (int round = 0; round < rounds; ++round) {
+            DirectoryMap *content = minifs_read_dir(&fs, 0);
+            minifs_clear_dirmap(content);
+            int32_t size;
+            const char *data = minifs_read_data(&fs, inode, &size);
+            free((void*) data);
+        }
+        uint64_t elapsed = now_ns() - begin;
+        calls = syscall_count() - calls;
+
+        printf("%-5s syscalls/round: %8.1f  latency/round: %9.1f us\n",
+               labels[backend], (double) calls / rounds, (double) elapsed / rounds / 1000.0);
+        minifs_close(&fs);
+    }
+
+    unlink(BENCH_IMAGE);
+}
+
+
+// create and remove files, every command flushes metadata
+void bench_metadata(int rounds) {
+    unlink(BENCH_IMAGE);
+    minifs_init(BENCH_IMAGE);
+    Filesystem fs = minifs_open(BENCH_IMAGE);
+
+    printf("===== [metadata: touch + rm, %u inodes, %u blocks] =====\n",
+           fs.sblock.inode_count, fs.sblock.block_count);
+    uint64_t calls = syscall_count();
+    uint64_t writes = minifs_io_stats.writes;
+    uint64_t begin = now_ns();
+    for (int round = 0; round < rounds; ++round) {
+        char name[MAX_FILENAME_SIZE];
+        snprintf(name, sizeof(name), "file%d", round);
+        const char *touch[] = {"touch", name};
+        const char *rm[] = {"rm", name};
+        minifs_touch(&fs, touch, 2);
+        minifs_rm(&fs, rm, 2);
+    }
+    uint64_t elapsed = now_ns() - begin;
+    calls = syscall_count() - calls;
+    writes = minifs_io_stats.writes - writes;
+
+    printf("syscalls/op: %8.1f  writes/op: %6.1f  latency/op: %9.1f us\n",
+           (double) calls / rounds / 2, (double) writes / rounds / 2, (double) elapsed / rounds / 2 / 1000.0);
+    minifs_close(&fs);
+    unlink(BENCH_IMAGE);
+}
+
+
+// linear search over block map, as allocator worked before bitmaps
+int64_t find_free_linear(const Block *blocks, uint32_t count) {
+    for (uint32_t index = 0; index < count; ++index) {
+        if (blocks[index].type == MINIFS_BLOCK_EMPTY) {
+            return index;
+        }
+    }
+    return -1;
+}
+
+
+// allocate and free blocks on 99% full block table
+void bench_allocator(int rounds) {
+    const uint32_t sizes[] = {1 << 20, 4 << 20};
+    printf("===== [allocator: 99%% full table, alloc + free] =====\n");
+
+    for (int test = 0; test < sizeof(sizes) / sizeof(sizes[0]); ++test) {
+        uint32_t count = sizes[test];
+        Block *blocks = (Block*) calloc(count, sizeof(Block));
+        Bitmap bitmap;
+        bitmap_init(&bitmap, count);
+        for (uint32_t index = 0; index < count; ++index) {
+            blocks[index].type = MINIFS_BLOCK_USED;
+            bitmap_set(&bitmap, index);
+        }
+        srand(42);
+        for (uint32_t index = 0; index < count / 100; ++index) {
+            uint32_t victim = rand() % count;
+            blocks[victim].type = MINIFS_BLOCK_EMPTY;
+            bitmap_clear(&bitmap, victim);
+        }
+
+        // same sequence of frees for both allocators
+        uint32_t *victims = (uint32_t*) malloc(rounds * sizeof(uint32_t));
+        for (int round = 0; round < rounds; ++round) {
+            victims[round] = rand() % count;
+        }
+
+        uint64_t begin = now_ns();
+        for (int round = 0; round < rounds; ++round) {
+            int64_t index = find_free_linear(blocks, count);
+            blocks[index].type = MINIFS_BLOCK_USED;
+            blocks[victims[round]].type = MINIFS_BLOCK_EMPTY;
+        }
+        uint64_t linear = now_ns() - begin;
+
+        begin = now_ns();
+        for (int round = 0; round < rounds; ++round) {
+            int64_t index = bitmap_find_zero(&bitmap);
+            bitmap_set(&bitmap, index);
+            bitmap.hint = index + 1;
+            bitmap_clear(&bitmap, victims[round]);
+        }
+        uint64_t bitmap_time = now_ns() - begin;
+
+        printf("%8u blocks  linear: %10.0f allocs/s  bitmap: %12.0f allocs/s\n", count,
+               rounds / (linear / 1e9), rounds / (bitmap_time / 1e9));
+        bitmap_free(&bitmap);
+        free(blocks);
+        free(victims);
+    }
+}
+
+
+// linear lookup, as commands worked before name index
+int32_t lookup_linear(Filesystem *fs, uint32_t dir, const char *name) {
+    int32_t result = -1;
+    DirectoryMap *content = minifs_read_dir(fs, dir);
+    for (uint32_t index = 0; index < content->size; ++index) {
+        if (content->used[index] && strcmp(content->names[index], name) == 0) {
+            result = content->inodes[index];
+            break;
+        }
+    }
+    minifs_clear_dirmap(content);
+    return result;
+}
+
+
+// lookup of random existing names in directories of growing size
+void bench_dirhash(int rounds) {
+    const uint32_t sizes[] = {256, 1024, 4096, 8192};
+    const int linear_rounds = rounds / 10 + 1;
+    printf("===== [directory lookup: hashed index vs linear scan] =====\n");
+
+    for (int test = 0; test < sizeof(sizes) / sizeof(sizes[0]); ++test) {
+        unlink(BENCH_IMAGE);
+        minifs_init(BENCH_IMAGE);
+        Filesystem fs = minifs_open(BENCH_IMAGE);
+        char name[MAX_FILENAME_SIZE];
+        for (uint32_t index = 0; index < sizes[test]; ++index) {
+            snprintf(name, sizeof(name), "entry%u", index);
+            minifs_add_to_dir(&fs, 0, name, 0);
+        }
+        minifs_update_superblock(&fs);
+
+        srand(42);
+        uint64_t calls = syscall_count();
+        uint64_t begin = now_ns();
+        for (int round = 0; round < rounds; ++round) {
+            snprintf(name, sizeof(name), "entry%u", rand() % sizes[test]);
+            minifs_lookup(&fs, 0, name, NULL);
+        }
+        uint64_t hashed = now_ns() - begin;
+        calls = syscall_count() - calls;
+
+        begin = now_ns();
+        for (int round = 0; round < linear_rounds; ++round) {
+            snprintf(name, sizeof(name), "entry%u", rand() % sizes[test]);
+            lookup_linear(&fs, 0, name);
+        }
+        uint64_t linear = now_ns() - begin;
+
+        printf("%6u entries  hashed: %8.2f us (%4.1f syscalls)  linear: %10.2f us\n", sizes[test],
+               (double) hashed / rounds / 1000.0, (double) calls / rounds,
+               (double) linear / linear_rounds / 1000.0);
+        minifs_close(&fs);
+    }
+    unlink(BENCH_IMAGE);
+}
+
+
+// reads directory field by field, as read_dir worked before iterator
+uint32_t list_per_entry(Filesystem *fs, uint32_t dir) {
+    uint32_t count = 0;
+    uint32_t per_block = fs->sblock.block_size / sizeof(DirEntry);
+    for (uint32_t position = 0; position < fs->sblock.inode_map[dir].size; ++position) {
+        int32_t block = minifs_file_block(fs, dir, position / per_block);
+        uint32_t offset = (position % per_block) * sizeof(DirEntry);
+        char used;
+        uint32_t inode;
+        char *name = (char*) malloc(MAX_FILENAME_SIZE);
+        minifs_read_body(fs, block, &used, sizeof(char), offset);
+        minifs_read_body(fs, block, name, MAX_FILENAME_SIZE, offset + sizeof(char));
+        minifs_read_body(fs, block, &inode, sizeof(uint32_t), offset + sizeof(char) + MAX_FILENAME_SIZE);
+        count += used ? 1 : 0;
+        free(name);
+    }
+    return count;
+}
+
+
+uint32_t list_iterator(Filesystem *fs, uint32_t dir) {
+    uint32_t count = 0;
+    DirIterator it;
+    minifs_dir_open(fs, dir, &it);
+    while (minifs_dir_next(&it) != NULL) {
+        ++count;
+    }
+    minifs_dir_close(&it);
+    return count;
+}
+
+
+// full listing of 10k entry directory
+void bench_dir_listing(int rounds) {
+    const uint32_t entries = 10000;
+    const int listing_rounds = rounds / 100 + 1;
+
+    unlink(BENCH_IMAGE);
+    minifs_init(BENCH_IMAGE);
+    Filesystem fs = minifs_open(BENCH_IMAGE);
+    char name[MAX_FILENAME_SIZE];
+    for (uint32_t index = 0; index < entries; ++index) {
+        snprintf(name, sizeof(name), "entry%u", index);
+        minifs_add_to_dir(&fs, 0, name, 0);
+    }
+    minifs_update_superblock(&fs);
+    minifs_set_cache_size(&fs, 0);  // every listing goes to image
+
+    printf("===== [directory listing: %u entries] =====\n", entries);
+    uint32_t (*listers[])(Filesystem*, uint32_t) = {list_per_entry, list_iterator};
+    const char *labels[] = {"per entry", "iterator"};
+    for (int test = 0; test < 2; ++test) {
+        uint64_t calls = syscall_count();
+        uint64_t begin = now_ns();
+        for (int round = 0; round < listing_rounds; ++round) {
+            listers[test](&fs, 0);
+        }
+        uint64_t elapsed = now_ns() - begin;
+        calls = syscall_count() - calls;
+        printf("%-9s  syscalls/listing: %8.1f  latency/listing: %9.1f us\n", labels[test],
+               (double) calls / listing_rounds, (double) elapsed / listing_rounds / 1000.0);
+    }
+    minifs_close(&fs);
+    unlink(BENCH_IMAGE);
+}
+
+
+// resolution of 8 level deep path, every directory on path has 64 entries
+void bench_paths(int rounds) {
+    const uint32_t depth = 8;
+    const uint32_t siblings = 64;
+
+    unlink(BENCH_IMAGE);
+    minifs_init(BENCH_IMAGE);
+    Filesystem fs = minifs_open(BENCH_IMAGE);
+    char path[depth * 8 + 16];
+    char name[MAX_FILENAME_SIZE];
+    path[0] = '\0';
+    for (uint32_t level = 0; level < depth; ++level) {
+        for (uint32_t index = 0; index < siblings; ++index) {
+            snprintf(name, sizeof(name), "sibling%u", index);
+            minifs_add_to_dir(&fs, fs.current_dir, name, 0);
+        }
+        snprintf(name, sizeof(name), "dir%u", level);
+        const char *mkdir[] = {"mkdir", name};
+        const char *cd[] = {"cd", name};
+        minifs_mkdir(&fs, mkdir, 2);
+        minifs_cd(&fs, cd, 2);
+        strcat(path, "/");
+        strcat(path, name);
+    }
+    touch_file(&fs, "file");
+    strcat(path, "/file");
+
+    printf("===== [path resolution: %s] =====\n", path);
+    for (int cached = 0; cached <= 1; ++cached) {
+        uint64_t calls = syscall_count();
+        uint64_t begin = now_ns();
+        for (int round = 0; round < rounds; ++round) {
+            if (!cached) {
+                dcache_clear(fs.dcache);
+            }
+            minifs_resolve(&fs, path);
+        }
+        uint64_t elapsed = now_ns() - begin;
+        calls = syscall_count() - calls;
+        printf("%-8s  syscalls/resolve: %6.1f  latency/resolve: %8.2f us\n", cached ? "dcache" : "no cache",
+               (double) calls / rounds, (double) elapsed / rounds / 1000.0);
+    }
+    minifs_close(&fs);
+    unlink(BENCH_IMAGE);
+}
+
+
+typedef struct ReadWorker {
+    Filesystem *fs;
+    uint32_t first;     // index of first file read by worker
+    uint32_t files;
+    int reads;
+} ReadWorker;
+
+
+void *read_worker(void *arg) {
+    ReadWorker *worker = (ReadWorker*) arg;
+    char path[MAX_FILENAME_SIZE + 1];
+    for (int round = 0; round < worker->reads; ++round) {
+        snprintf(path, sizeof(path), "/file%u", (worker->first + round) % worker->files);
+        int32_t inode = minifs_resolve(worker->fs, path);
+        int32_t size;
+        minifs_lock_inode(worker->fs, inode, false);
+        const char *data = minifs_read_data(worker->fs, inode, &size);
+        minifs_unlock_inode(worker->fs, inode);
+        free((void*) data);
+    }
+    return NULL;
+}
+
+
+// whole file reads of 8 files shared by 1..8 threads, total work is fixed
+void bench_parallel_reads(int rounds) {
+    const uint32_t files = 8;
+    const uint32_t file_size = 64 * 1024;
+    const int thread_counts[] = {1, 2, 4, 8};
+
+    unlink(BENCH_IMAGE);
+    minifs_init(BENCH_IMAGE);
+    Filesystem fs = minifs_open(BENCH_IMAGE);
+    unsigned char *payload = (unsigned char*) malloc(file_size);
+    memset(payload, 'x', file_size);
+    char name[MAX_FILENAME_SIZE];
+    for (uint32_t index = 0; index < files; ++index) {
+        snprintf(name, sizeof(name), "file%u", index);
+        touch_file(&fs, name);
+        int32_t inode = minifs_resolve(&fs, name);
+        minifs_append_data(&fs, inode, payload, file_size);
+        fs.sblock.inode_map[inode].size += file_size;
+        minifs_mark_inode(&fs, inode);
+    }
+    minifs_update_superblock(&fs);
+    minifs_close(&fs);
+    free(payload);
+
+    printf("===== [parallel reads: %u files of %u bytes, %ld cpus] =====\n",
+           files, file_size, sysconf(_SC_NPROCESSORS_ONLN));
+    const char *labels[] = {"pread", "cache", "mmap"};
+    for (int backend = 0; backend < 3; ++backend) {
+        fs = minifs_open(BENCH_IMAGE);
+        if (backend == 0) {
+            minifs_set_cache_size(&fs, 0);
+        }
+        if (backend == 2 && !minifs_map_image(&fs)) {
+            printf("cannot map image\n");
+            break;
+        }
+
+        printf("%-5s", labels[backend]);
+        for (int test = 0; test < sizeof(thread_counts) / sizeof(thread_counts[0]); ++test) {
+            int count = thread_counts[test];
+            pthread_t threads[8];
+            ReadWorker workers[8];
+            uint64_t begin = now_ns();
+            for (int thread = 0; thread < count; ++thread) {
+                workers[thread].fs = &fs;
+                workers[thread].first = thread;
+                workers[thread].files = files;
+                workers[thread].reads = rounds / count;
+                pthread_create(&threads[thread], NULL, read_worker, &workers[thread]);
+            }
+            for (int thread = 0; thread < count; ++thread) {
+                pthread_join(threads[thread], NULL);
+            }
+            uint64_t elapsed = now_ns() - begin;
+            double bytes = (double) (rounds / count) * count * file_size;
+            printf("  %d threads: %8.1f MB/s", count, bytes / (1 << 20) / (elapsed / 1e9));
+        }
+        printf("\n");
+        minifs_close(&fs);
+    }
+    unlink(BENCH_IMAGE);
+}
+
+
+// whole read of file made of many extents with cache disabled,
+// extents are read one by one or submitted as one io_uring batch
+void bench_uring(int rounds) {
+    const uint32_t file_size = 400 * 1024;
+    const uint32_t piece = 4 * 1024;
+
+    unlink(BENCH_IMAGE);
+    minifs_init(BENCH_IMAGE);
+    Filesystem fs = minifs_open(BENCH_IMAGE);
+    touch_file(&fs, "file");
+    touch_file(&fs, "other");
+    int32_t inode = minifs_resolve(&fs, "file");
+    int32_t other = minifs_resolve(&fs, "other");
+    unsigned char *payload = (unsigned char*) malloc(piece);
+    memset(payload, 'x', piece);
+    for (uint32_t offset = 0; offset < file_size; offset += piece) {  // interleaved extents
+        minifs_append_data(&fs, inode, payload, piece);
+        minifs_append_data(&fs, other, payload, piece);
+    }
+    fs.sblock.inode_map[inode].size = file_size;
+    fs.sblock.inode_map[other].size = file_size;
+    minifs_mark_inode(&fs, inode);
+    minifs_mark_inode(&fs, other);
+    minifs_update_superblock(&fs);
+    minifs_close(&fs);
+    free(payload);
+
+    printf("===== [io_uring: %u byte file of %u byte extents] =====\n", file_size, piece);
+    const char *labels[] = {"sync", "uring"};
+    for (int backend = 0; backend < 2; ++backend) {
+        fs = minifs_open(BENCH_IMAGE);
+        minifs_set_cache_size(&fs, 0);
+        if (backend == 1 && !minifs_enable_uring(&fs)) {
+            printf("io_uring is unavailable\n");
+            minifs_close(&fs);
+            break;
+        }
+
+        uint64_t calls = syscall_count() + (fs.uring != NULL ? fs.uring->enters : 0);
+        uint64_t begin = now_ns();
+        for (int round = 0; round < rounds; ++round) {
+            int32_t size;
+            const char *data = minifs_read_data(&fs, inode, &size);
+            free((void*) data);
+        }
+        uint64_t elapsed = now_ns() - begin;
+        calls = syscall_count() + (fs.uring != NULL ? fs.uring->enters : 0) - calls;
+
+        printf("%-5s syscalls/read: %8.1f  throughput: %9.1f MB/s\n", labels[backend],
+               (double) calls / rounds, (double) file_size * rounds / (1 << 20) / (elapsed / 1e9));
+        minifs_close(&fs);
+    }
+    unlink(BENCH_IMAGE);
+}
+
+
+bool write_piece(void *context, const void *data, uint32_t size) {
+    return write(*(int*) context, data, size) == size;
+}
+
+
+// output of 800 KB file by read command: whole file buffer printed
+// byte by byte, as command worked before streaming, vs streamed writes
+void bench_read_output(int rounds) {
+    const uint32_t file_size = 800 * 1024;
+    const int output_rounds = rounds / 10 + 1;
+
+    unlink(BENCH_IMAGE);
+    minifs_init(BENCH_IMAGE);
+    Filesystem fs = minifs_open(BENCH_IMAGE);
+    touch_file(&fs, "file");
+    int32_t inode = minifs_resolve(&fs, "file");
+    unsigned char *payload = (unsigned char*) malloc(file_size);
+    memset(payload, 'x', file_size);
+    minifs_append_data(&fs, inode, payload, file_size);
+    fs.sblock.inode_map[inode].size = file_size;
+    minifs_mark_inode(&fs, inode);
+    free(payload);
+
+    printf("===== [read output: %u byte file to /dev/null] =====\n", file_size);
+    FILE *null_file = fopen("/dev/null", "w");
+    int null_fd = open("/dev/null", O_WRONLY);
+
+    uint64_t begin = now_ns();
+    for (int round = 0; round < output_rounds; ++round) {
+        int32_t size;
+        const char *data = minifs_read_data(&fs, inode, &size);
+        for (int32_t index = 0; index < size; ++index) {
+            fprintf(null_file, "%c", data[index]);
+        }
+        free((void*) data);
+    }
+    uint64_t bytewise = now_ns() - begin;
+
+    void *buffer = malloc(STREAM_BUFFER_SIZE);
+    begin = now_ns();
+    for (int round = 0; round < output_rounds; ++round) {
+        minifs_stream_data(&fs, inode, buffer, STREAM_BUFFER_SIZE, write_piece, &null_fd);
+    }
+    uint64_t streamed = now_ns() - begin;
+    free(buffer);
+
+    printf("per byte  latency/read: %9.1f us  buffer: %8u bytes\n",
+           (double) bytewise / output_rounds / 1000.0, file_size);
+    printf("streamed  latency/read: %9.1f us  buffer: %8u bytes\n",
+           (double) streamed / output_rounds / 1000.0, STREAM_BUFFER_SIZE);
+    fclose(null_file);
+    close(null_fd);
+    minifs_close(&fs);
+    unlink(BENCH_IMAGE);
+}
+
+
+// loading 800 KB host file: 4 KB appends with metadata flush after each,
+// as write command works, vs import command
+void bench_import(int rounds) {
+    const uint32_t file_size = 800 * 1024;
+    const uint32_t piece = 4 * 1024;
+    const int import_rounds = rounds / 50 + 1;
+
+    unsigned char *payload = (unsigned char*) malloc(file_size);
+    memset(payload, 'x', file_size);
+    FILE *host = fopen(BENCH_HOST_FILE, "wb");
+    fwrite(payload, 1, file_size, host);
+    fclose(host);
+
+    printf("===== [import: %u byte host file] =====\n", file_size);
+    const char *labels[] = {"appends", "import"};
+    for (int method = 0; method < 2; ++method) {
+        uint64_t calls = 0;
+        uint64_t elapsed = 0;
+        for (int round = 0; round < import_rounds; ++round) {
+            unlink(BENCH_IMAGE);
+            minifs_init(BENCH_IMAGE);
+            Filesystem fs = minifs_open(BENCH_IMAGE);
+            uint64_t start_calls = syscall_count();
+            uint64_t begin = now_ns();
+            if (method == 0) {
+                touch_file(&fs, "file");
+                int32_t inode = minifs_resolve(&fs, "file");
+                for (uint32_t offset = 0; offset < file_size; offset += piece) {
+                    minifs_append_data(&fs, inode, payload + offset, piece);
+                    fs.sblock.inode_map[inode].size += piece;
+                    minifs_mark_inode(&fs, inode);
+                    minifs_update_superblock(&fs);
+                }
+            } else {
+                const char *args[] = {"import", BENCH_HOST_FILE, "file"};
+                minifs_import(&fs, args, 3);
+            }
+            minifs_sync(&fs);
+            elapsed += now_ns() - begin;
+            calls += syscall_count() - start_calls;
+            minifs_close(&fs);
+        }
+        printf("%-7s  syscalls/file: %8.1f  throughput: %8.1f MB/s\n", labels[method],
+               (double) calls / import_rounds, (double) file_size * import_rounds / (1 << 20) / (elapsed / 1e9));
+    }
+    free(payload);
+    unlink(BENCH_HOST_FILE);
+    unlink(BENCH_IMAGE);
+}
+
+
+// saving 800 KB file to host: whole file read and written by
+// userspace vs export command copying runs inside kernel
+void bench_export(int rounds) {
+    const uint32_t file_size = 800 * 1024;
+    const int export_rounds = rounds / 50 + 1;
+
+    unlink(BENCH_IMAGE);
+    minifs_init(BENCH_IMAGE);
+    Filesystem fs = minifs_open(BENCH_IMAGE);
+    touch_file(&fs, "file");
+    int32_t inode = minifs_resolve(&fs, "file");
+    unsigned char *payload = (unsigned char*) malloc(file_size);
+    memset(payload, 'x', file_size);
+    minifs_append_data(&fs, inode, payload, file_size);
+    fs.sblock.inode_map[inode].size = file_size;
+    minifs_mark_inode(&fs, inode);
+    free(payload);
+    minifs_sync(&fs);
+
+    printf("===== [export: %u byte file to host] =====\n", file_size);
+    const char *labels[] = {"read", "export"};
+    for (int method = 0; method < 2; ++method) {
+        uint64_t calls = 0;
+        uint64_t elapsed = 0;
+        for (int round = 0; round < export_rounds; ++round) {
+            unlink(BENCH_HOST_FILE);  // truncate of written file starts its writeback
+            uint64_t start_calls = syscall_count();
+            uint64_t begin = now_ns();
+            if (method == 0) {
+                int32_t size;
+                const char *data = minifs_read_data(&fs, inode, &size);
+                int host = open(BENCH_HOST_FILE, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+                for (int32_t done = 0; done < size; calls++) {  // host writes are not in io stats
+                    done += write(host, data + done, size - done);
+                }
+                close(host);
+                free((void*) data);
+            } else {
+                const char *args[] = {"export", "file", BENCH_HOST_FILE};
+                minifs_export(&fs, args, 3);
+            }
+            elapsed += now_ns() - begin;
+            calls += syscall_count() - start_calls;
+        }
+        printf("%-7s  syscalls/file: %8.1f  throughput: %8.1f MB/s\n", labels[method],
+               (double) calls / export_rounds, (double) file_size * export_rounds / (1 << 20) / (elapsed / 1e9));
+    }
+    minifs_close(&fs);
+    unlink(BENCH_HOST_FILE);
+    unlink(BENCH_IMAGE);
+}
+
+
+// 4 KB reads at random offsets of 900 KB file: whole file
+// read to get the range vs read of covering blocks only
+void bench_random_reads(int rounds) {
+    const uint32_t file_size = 900 * 1024;
+    const uint32_t length = 4 * 1024;
+
+    unlink(BENCH_IMAGE);
+    minifs_init(BENCH_IMAGE);
+    Filesystem fs = minifs_open(BENCH_IMAGE);
+    touch_file(&fs, "file");
+    int32_t inode = minifs_resolve(&fs, "file");
+    unsigned char *payload = (unsigned char*) malloc(file_size);
+    memset(payload, 'x', file_size);
+    minifs_append_data(&fs, inode, payload, file_size);
+    fs.sblock.inode_map[inode].size = file_size;
+    minifs_mark_inode(&fs, inode);
+    minifs_update_superblock(&fs);
+    minifs_close(&fs);
+    free(payload);
+
+    printf("===== [random reads: %u bytes from %u byte file] =====\n", length, file_size);
+    const char *labels[] = {"fd", "cache", "mmap"};
+    unsigned char buffer[4 * 1024];
+    for (int backend = 0; backend < 3; ++backend) {
+        fs = minifs_open(BENCH_IMAGE);
+        if (backend == 0) {
+            minifs_set_cache_size(&fs, 0);
+        }
+        if (backend == 2 && !minifs_map_image(&fs)) {
+            printf("cannot map image\n");
+            break;
+        }
+
+        for (int method = 0; method < 2; ++method) {
+            const int read_rounds = (method == 0) ? rounds / 10 + 1 : rounds;
+            srand(1);
+            uint64_t calls = syscall_count();
+            uint64_t begin = now_ns();
+            for (int round = 0; round < read_rounds; ++round) {
+                uint32_t offset = rand() % (file_size - length);
+                if (method == 0) {
+                    int32_t size;
+                    const char *data = minifs_read_data(&fs, inode, &size);
+                    memcpy(buffer, data + offset, length);
+                    free((void*) data);
+                } else {
+                    minifs_file_pread(&fs, inode, buffer, length, offset);
+                }
+            }
+            uint64_t elapsed = now_ns() - begin;
+            calls = syscall_count() - calls;
+
+            printf("%-5s %-5s syscalls/read: %8.1f  latency/read: %9.1f us\n", labels[backend],
+                   method == 0 ? "whole" : "range", (double) calls / read_rounds,
+                   (double) elapsed / read_rounds / 1000.0);
+        }
+        minifs_close(&fs);
+    }
+
+    unlink(BENCH_IMAGE);
+}
+
+
+// state file of 64 KB where 1 KB changes on every round: file is
+// recreated as rm + touch + write do vs overwrite in place
+void bench_rewrite(int rounds) {
+    const uint32_t file_size = 64 * 1024;
+    const uint32_t change = 1024;
+
+    unsigned char *payload = (unsigned char*) malloc(file_size);
+    memset(payload, 'x', file_size);
+    printf("===== [rewrite: %u bytes of %u byte file] =====\n", change, file_size);
+    const char *labels[] = {"recreate", "in place"};
+    for (int method = 0; method < 2; ++method) {
+        unlink(BENCH_IMAGE);
+        minifs_init(BENCH_IMAGE);
+        Filesystem fs = minifs_open(BENCH_IMAGE);
+        touch_file(&fs, "state");
+        int32_t inode = minifs_resolve(&fs, "state");
+        minifs_append_data(&fs, inode, payload, file_size);
+        fs.sblock.inode_map[inode].size = file_size;
+        minifs_mark_inode(&fs, inode);
+        minifs_sync(&fs);
+
+        uint64_t calls = syscall_count();
+        uint64_t begin = now_ns();
+        for (int round = 0; round < rounds; ++round) {
+            uint32_t offset = (round * change) % file_size;
+            payload[offset] = 'a' + round % 26;
+            if (method == 0) {
+                const char *args[] = {"rm", "state"};
+                minifs_rm(&fs, args, 2);
+                touch_file(&fs, "state");
+                inode = minifs_resolve(&fs, "state");
+                minifs_append_data(&fs, inode, payload, file_size);
+                fs.sblock.inode_map[inode].size = file_size;
+                minifs_mark_inode(&fs, inode);
+            } else {
+                minifs_file_pwrite(&fs, inode, payload + offset, change, offset);
+            }
+            minifs_update_superblock(&fs);
+        }
+        minifs_sync(&fs);
+        uint64_t elapsed = now_ns() - begin;
+        calls = syscall_count() - calls;
+
+        printf("%-8s  syscalls/round: %8.1f  latency/round: %9.1f us\n", labels[method],
+               (double) calls / rounds, (double) elapsed / rounds / 1000.0);
+        minifs_close(&fs);
+    }
+    free(payload);
+    unlink(BENCH_IMAGE);
+}
+
+
+typedef struct Committer {
+    Filesystem *fs;
+    int id;
+    int files;
+} Committer;
+
+
+// creates files with small content, every one must be durable before next
+void *commit_files(void *arg) {
+    Committer *self = (Committer*) arg;
+    char name[MAX_FILENAME_SIZE];
+    unsigned char line[100];
+    memset(line, 'l', sizeof(line));
+    for (int file = 0; file < self->files; ++file) {
+        snprintf(name, sizeof(name), "f%d_%d", self->id, file);
+        touch_file(self->fs, name);
+        int32_t inode = minifs_resolve(self->fs, name);
+        minifs_lock_inode(self->fs, inode, true);
+        minifs_file_pwrite(self->fs, inode, line, sizeof(line), 0);
+        minifs_unlock_inode(self->fs, inode);
+        minifs_update_superblock(self->fs);
+        minifs_commit(self->fs);
+    }
+    return NULL;
+}
+
+
+// durable file creations: tables written in place and fsync after
+// every command vs journal commit shared by 1 and 4 threads
+void bench_journal(int rounds) {
+    const int files = 200;
+
+    printf("===== [journal: %d durable creates of 100 byte files] =====\n", files);
+    const char *labels[] = {"in place", "journal", "journal 4 threads"};
+    for (int method = 0; method < 3; ++method) {
+        unlink(BENCH_IMAGE);
+        minifs_init(BENCH_IMAGE);
+        Filesystem fs = minifs_open(BENCH_IMAGE);
+        if (method > 0) {
+            minifs_enable_journal(&fs);
+        }
+
+        int threads = (method == 2) ? 4 : 1;
+        pthread_t workers[4];
+        Committer committers[4];
+        uint64_t calls = syscall_count();
+        uint64_t syncs = minifs_io_stats.syncs;
+        uint64_t begin = now_ns();
+        for (int index = 0; index < threads; ++index) {
+            committers[index] = (Committer) {.fs = &fs, .id = index, .files = files / threads};
+            pthread_create(&workers[index], NULL, commit_files, &committers[index]);
+        }
+        for (int index = 0; index < threads; ++index) {
+            pthread_join(workers[index], NULL);
+        }
+        uint64_t elapsed = now_ns() - begin;
+        calls = syscall_count() - calls;
+        syncs = minifs_io_stats.syncs - syncs;
+
+        printf("%-17s  syscalls/file: %6.1f  syncs/file: %5.2f  files/s: %9.1f\n", labels[method],
+               (double) calls / files, (double) syncs / files, files / (elapsed / 1e9));
+        minifs_close(&fs);
+    }
+    unlink(BENCH_IMAGE);
+}
+
+
+// add 1024 blocks to image holding one file: copy of file to new larger
+// image against online grow, rounds are capped since copy moves all data
+void bench_grow(int rounds) {
+    const uint32_t sizes[] = {1024 * 1024, 16 * 1024 * 1024};
+    const uint32_t extra = 1024;
+    rounds = rounds < 20 ? rounds : 20;
+
+    const char *labels[] = {"copy", "grow"};
+    for (uint32_t item = 0; item < sizeof(sizes) / sizeof(sizes[0]); ++item) {
+        uint32_t size = sizes[item];
+        unsigned char *payload = (unsigned char*) malloc(size);
+        memset(payload, 'g', size);
+        printf("===== [grow: image with %u KB file by %u blocks] =====\n", size / 1024, extra);
+        for (int method = 0; method < 2; ++method) {
+            Geometry geometry = {
+                .inode_count = DEFAULT_INODE_COUNT,
+                .block_count = size / DEFAULT_BLOCK_SIZE + extra,
+                .block_size = DEFAULT_BLOCK_SIZE,
+            };
+            unlink(BENCH_IMAGE);
+            minifs_format(BENCH_IMAGE, &geometry);
+            Filesystem fs = minifs_open(BENCH_IMAGE);
+            touch_file(&fs, "data");
+            int32_t inode = minifs_resolve(&fs, "data");
+            minifs_append_data(&fs, inode, payload, size);
+            fs.sblock.inode_map[inode].size = size;
+            minifs_mark_inode(&fs, inode);
+            minifs_sync(&fs);
+
+            uint64_t calls = syscall_count();
+            uint64_t begin = now_ns();
+            for (int round = 0; round < rounds; ++round) {
+                if (method == 1) {
+                    minifs_grow(&fs, 0, extra);
+                    continue;
+                }
+                int32_t read_size;
+                const char *data = minifs_read_data(&fs, inode, &read_size);
+                minifs_close(&fs);
+                geometry.block_count += extra;
+                minifs_format(BENCH_IMAGE, &geometry);
+                fs = minifs_open(BENCH_IMAGE);
+                touch_file(&fs, "data");
+                inode = minifs_resolve(&fs, "data");
+                minifs_append_data(&fs, inode, (const unsigned char*) data, read_size);
+                fs.sblock.inode_map[inode].size = read_size;
+                minifs_mark_inode(&fs, inode);
+                minifs_sync(&fs);
+                free((void*) data);
+            }
+            uint64_t elapsed = now_ns() - begin;
+            calls = syscall_count() - calls;
+
+            printf("%-4s  syscalls/round: %8.1f  latency/round: %9.1f us\n", labels[method],
+                   (double) calls / rounds, (double) elapsed / rounds / 1000.0);
+            minifs_close(&fs);
+        }
+        free(payload);
+    }
+    unlink(BENCH_IMAGE);
+}
+
+
+// clears used byte only, as entries were removed before compaction
+void remove_in_place(Filesystem *fs, uint32_t dir, uint32_t position) {
+    DirEntry entry;
+    minifs_read_entry(fs, dir, position, &entry);
+    entry.used = 0;
+    minifs_write_entry(fs, dir, position, &entry);
+}
+
+
+// listing of directory which had 10k entries and keeps 1 of 100
+void bench_dir_churn(int rounds) {
+    const uint32_t entries = 10000;
+    const int listing_rounds = rounds / 100 + 1;
+    printf("===== [directory listing after removal of 99%% of %u entries] =====\n", entries);
+
+    const char *labels[] = {"in place", "compacted"};
+    for (int method = 0; method < 2; ++method) {
+        unlink(BENCH_IMAGE);
+        minifs_init(BENCH_IMAGE);
+        Filesystem fs = minifs_open(BENCH_IMAGE);
+        char name[MAX_FILENAME_SIZE];
+        for (uint32_t index = 0; index < entries; ++index) {
+            snprintf(name, sizeof(name), "entry%u", index);
+            minifs_add_to_dir(&fs, 0, name, 0);
+        }
+        for (uint32_t index = 0; index < entries; ++index) {
+            if (index % 100 == 0) {
+                continue;
+            }
+            snprintf(name, sizeof(name), "entry%u", index);
+            int32_t position;
+            minifs_lookup(&fs, 0, name, &position);
+            if (method == 0) {
+                remove_in_place(&fs, 0, position);
+            } else {
+                minifs_remove_from_dir(&fs, 0, position);
+            }
+        }
+        minifs_update_superblock(&fs);
+        minifs_set_cache_size(&fs, 0);  // every listing goes to image
+
+        uint64_t calls = syscall_count();
+        uint64_t begin = now_ns();
+        for (int round = 0; round < listing_rounds; ++round) {
+            list_iterator(&fs, 0);
+        }
+        uint64_t elapsed = now_ns() - begin;
+        calls = syscall_count() - calls;
+        printf("%-9s  %5u slots  syscalls/listing: %8.1f  latency/listing: %9.1f us\n", labels[method],
+               fs.sblock.inode_map[0].size, (double) calls / listing_rounds,
+               (double) elapsed / listing_rounds / 1000.0);
+        minifs_close(&fs);
+    }
+    unlink(BENCH_IMAGE);
+}
+
+
+// 300 files of 50 bytes, written once and read on each round
+void bench_inline(int rounds) {
+    const uint32_t files = 300;
+    const char payload[] = "option = enabled, level = 3, path = /var/lib/x\n";
+    printf("===== [%u small files: plain inodes vs inline data] =====\n", files);
+
+    const uint32_t sizes[] = {0, 128};
+    const char *labels[] = {"plain", "inline"};
+    for (int method = 0; method < 2; ++method) {
+        Geometry geometry = {
+            .inode_count = DEFAULT_INODE_COUNT,
+            .block_count = DEFAULT_BLOCK_COUNT,
+            .block_size = DEFAULT_BLOCK_SIZE,
+            .inode_size = sizes[method],
+        };
+        unlink(BENCH_IMAGE);
+        minifs_format(BENCH_IMAGE, &geometry);
+        Filesystem fs = minifs_open(BENCH_IMAGE);
+        uint32_t used_blocks = fs.sblock.used_block_count;
+        char name[MAX_FILENAME_SIZE];
+        int32_t *inodes = (int32_t*) malloc(files * sizeof(int32_t));
+        for (uint32_t index = 0; index < files; ++index) {
+            snprintf(name, sizeof(name), "file%u", index);
+            touch_file(&fs, name);
+            inodes[index] = minifs_resolve(&fs, name);
+            minifs_file_pwrite(&fs, inodes[index], payload, sizeof(payload) - 1, 0);
+        }
+        minifs_sync(&fs);
+        minifs_set_cache_size(&fs, 0);  // every block read goes to image
+
+        char buffer[sizeof(payload)];
+        uint64_t calls = syscall_count();
+        uint64_t begin = now_ns();
+        for (int round = 0; round < rounds; ++round) {
+            for (uint32_t index = 0; index < files; ++index) {
+                minifs_file_pread(&fs, inodes[index], buffer, sizeof(buffer), 0);
+            }
+        }
+        uint64_t elapsed = now_ns() - begin;
+        calls = syscall_count() - calls;
+        printf("%-6s  blocks: %5u  syscalls/read: %6.2f  latency/read: %7.2f us\n", labels[method],
+               fs.sblock.used_block_count - used_blocks, (double) calls / rounds / files,
+               (double) elapsed / rounds / files / 1000.0);
+        free(inodes);
+        minifs_close(&fs);
+    }
+    unlink(BENCH_IMAGE);
+}
+
+
+// 8 files grown by interleaved one block appends, then read whole from image
+void bench_locality(int rounds) {
+    const uint32_t files = 8;
+    const uint32_t blocks = 256;
+    const int read_rounds = rounds / 10 + 1;
+    printf("===== [%u files of %u interleaved blocks: lowest free vs tail preallocation] =====\n", files, blocks);
+
+    const uint32_t windows[] = {0, PREALLOC_BLOCKS};
+    const char *labels[] = {"lowest", "prealloc"};
+    for (int method = 0; method < 2; ++method) {
+        Geometry geometry = {
+            .inode_count = DEFAULT_INODE_COUNT,
+            .block_count = 4096,
+            .block_size = DEFAULT_BLOCK_SIZE,
+        };
+        unlink(BENCH_IMAGE);
+        minifs_format(BENCH_IMAGE, &geometry);
+        Filesystem fs = minifs_open(BENCH_IMAGE);
+        fs.prealloc_blocks = windows[method];
+        unsigned char *payload = (unsigned char*) malloc(fs.sblock.block_size);
+        memset(payload, 'x', fs.sblock.block_size);
+        char name[MAX_FILENAME_SIZE];
+        int32_t inodes[8];
+        for (uint32_t index = 0; index < files; ++index) {
+            snprintf(name, sizeof(name), "stream%u", index);
+            touch_file(&fs, name);
+            inodes[index] = minifs_resolve(&fs, name);
+        }
+        for (uint32_t block = 0; block < blocks; ++block) {
+            for (uint32_t index = 0; index < files; ++index) {
+                minifs_append_data(&fs, inodes[index], payload, fs.sblock.block_size);
+                fs.sblock.inode_map[inodes[index]].size += fs.sblock.block_size;
+                minifs_mark_inode(&fs, inodes[index]);
+            }
+        }
+        minifs_update_superblock(&fs);
+        minifs_sync(&fs);
+        minifs_set_cache_size(&fs, 0);  // every block read goes to image
+
+        uint32_t fragments = 0;
+        for (uint32_t index = 0; index < files; ++index) {
+            fragments += minifs_file_fragments(&fs, inodes[index]);
+        }
+        uint64_t calls = syscall_count();
+        uint64_t begin = now_ns();
+        for (int round = 0; round < read_rounds; ++round) {
+            for (uint32_t index = 0; index < files; ++index) {
+                int32_t size;
+                free((void*) minifs_read_data(&fs, inodes[index], &size));
+            }
+        }
+        uint64_t elapsed = now_ns() - begin;
+        calls = syscall_count() - calls;
+        printf("%-8s  fragments/file: %6.1f  syscalls/file: %7.1f  latency/file: %8.2f us\n", labels[method],
+               (double) fragments / files, (double) calls / read_rounds / files,
+               (double) elapsed / read_rounds / files / 1000.0);
+        free(payload);
+        minifs_close(&fs);
+    }
+    unlink(BENCH_IMAGE);
+}
+
+
+// 64 byte appends to end of 4 files in turn, like repeated write commands
+void bench_delayed(int rounds) {
+    const uint32_t files = 4;
+    const uint32_t piece = 64;
+    const uint32_t appends = 4096;
+    const char line[] = "2026-10-18 12:00:00 worker finished job, status ok, time 12 ms\n";
+    printf("===== [%u appends of %u bytes to %u files: immediate vs delayed allocation] =====\n",
+           appends, piece, files);
+
+    const uint32_t limits[] = {0, DELAYED_BUFFER_SIZE};
+    const char *labels[] = {"immediate", "delayed"};
+    for (int method = 0; method < 2; ++method) {
+        uint64_t elapsed = 0, calls = 0;
+        uint32_t fragments = 0;
+        int bench_rounds = rounds / 100 + 1;
+        for (int round = 0; round < bench_rounds; ++round) {
+            unlink(BENCH_IMAGE);
+            minifs_init(BENCH_IMAGE);
+            Filesystem fs = minifs_open(BENCH_IMAGE);
+            fs.delayed_limit = limits[method];
+            char name[MAX_FILENAME_SIZE];
+            int32_t inodes[4];
+            for (uint32_t index = 0; index < files; ++index) {
+                snprintf(name, sizeof(name), "log%u", index);
+                touch_file(&fs, name);
+                inodes[index] = minifs_resolve(&fs, name);
+            }
+
+            uint64_t start_calls = syscall_count();
+            uint64_t begin = now_ns();
+            for (uint32_t index = 0; index < appends; ++index) {
+                int32_t inode = inodes[index % files];
+                minifs_file_pwrite(&fs, inode, line, piece, fs.sblock.inode_map[inode].size);
+                minifs_update_superblock(&fs);
+            }
+            minifs_sync(&fs);
+            elapsed += now_ns() - begin;
+            calls += syscall_count() - start_calls;
+            fragments = 0;
+            for (uint32_t index = 0; index < files; ++index) {
+                fragments += minifs_file_fragments(&fs, inodes[index]);
+            }
+            minifs_close(&fs);
+        }
+        printf("%-9s  appends/s: %9.0f  syscalls/append: %5.2f  fragments/file: %5.1f\n", labels[method],
+               (double) appends * bench_rounds / (elapsed / 1e9), (double) calls / appends / bench_rounds,
+               (double) fragments / files);
+    }
+    unlink(BENCH_IMAGE);
+}
+
+
+// 64 records of one block at random offsets of 16 MB file, then export of file
+void bench_sparse(int rounds) {
+    const uint32_t records = 64;
+    const uint32_t file_size = 16 * 1024 * 1024;
+    const uint32_t piece = 1024 * 1024;
+    printf("===== [%u records in %u MB file: zero filled vs sparse] =====\n", records, file_size >> 20);
+
+    const char *labels[] = {"filled", "sparse"};
+    for (int method = 0; method < 2; ++method) {
+        uint64_t write_elapsed = 0, write_calls = 0, export_elapsed = 0, export_calls = 0;
+        uint32_t blocks = 0;
+        int bench_rounds = rounds / 100 + 1;
+        for (int round = 0; round < bench_rounds; ++round) {
+            Geometry geometry = {
+                .inode_count = DEFAULT_INODE_COUNT,
+                .block_count = 24 * 1024,
+                .block_size = DEFAULT_BLOCK_SIZE,
+            };
+            unlink(BENCH_IMAGE);
+            minifs_format(BENCH_IMAGE, &geometry);
+            Filesystem fs = minifs_open(BENCH_IMAGE);
+            touch_file(&fs, "table");
+            int32_t inode = minifs_resolve(&fs, "table");
+            uint32_t block_size = fs.sblock.block_size;
+            unsigned char *record = (unsigned char*) malloc(block_size);
+            memset(record, 'r', block_size);
+            uint32_t used_blocks = fs.sblock.used_block_count;
+            srand(round + 1);
+
+            uint64_t start_calls = syscall_count();
+            uint64_t begin = now_ns();
+            if (method == 0) {  // what writes past end did before holes
+                unsigned char *zeros = (unsigned char*) calloc(piece, 1);
+                for (uint32_t offset = 0; offset < file_size; offset += piece) {
+                    minifs_file_pwrite(&fs, inode, zeros, piece, offset);
+                }
+                free(zeros);
+            }
+            for (uint32_t index = 0; index < records; ++index) {
+                uint32_t offset = (uint32_t) rand() % (file_size / block_size) * block_size;
+                minifs_file_pwrite(&fs, inode, record, block_size, offset);
+            }
+            minifs_file_pwrite(&fs, inode, record, 1, file_size - 1);
+            minifs_update_superblock(&fs);
+            minifs_sync(&fs);
+            write_elapsed += now_ns() - begin;
+            write_calls += syscall_count() - start_calls;
+            blocks = fs.sblock.used_block_count - used_blocks;
+
+            start_calls = syscall_count();
+            begin = now_ns();
+            const char *args[] = {"export", "table", BENCH_HOST_FILE};
+            minifs_export(&fs, args, 3);
+            export_elapsed += now_ns() - begin;
+            export_calls += syscall_count() - start_calls;
+            unlink(BENCH_HOST_FILE);
+            free(record);
+            minifs_close(&fs);
+        }
+        printf("%-6s  blocks: %6u  write: %8.2f ms %6lu syscalls  export: %8.2f ms %6lu syscalls\n",
+               labels[method], blocks, (double) write_elapsed / bench_rounds / 1e6, write_calls / bench_rounds,
+               (double) export_elapsed / bench_rounds / 1e6, export_calls / bench_rounds);
+    }
+    unlink(BENCH_IMAGE);
+}
+
+
+// 4 MB of log lines written by 64 KB pieces, synced, then read whole from image
+void bench_compressed(int rounds) {
+    const uint32_t file_size = 4 * 1024 * 1024;
+    const uint32_t piece = 64 * 1024;
+    printf("===== [%u MB log file: plain vs compressed] =====\n", file_size >> 20);
+
+    unsigned char *payload = (unsigned char*) malloc(file_size);
+    uint32_t filled = 0;
+    for (uint32_t line = 0; filled < file_size; ++line) {
+        char buffer[128];
+        int length = snprintf(buffer, sizeof(buffer), "2026-10-18 12:%02u:%02u worker %u finished job %u, status ok\n",
+                              line / 60 % 60, line % 60, line % 7, line * 13);
+        uint32_t bytes = (file_size - filled < (uint32_t) length) ? file_size - filled : (uint32_t) length;
+        memcpy(payload + filled, buffer, bytes);
+        filled += bytes;
+    }
+
+    const char *labels[] = {"plain", "compressed"};
+    for (int method = 0; method < 2; ++method) {
+        uint64_t write_elapsed = 0, read_elapsed = 0, read_calls = 0;
+        uint32_t stored = 0;
+        int bench_rounds = rounds / 100 + 1;
+        for (int round = 0; round < bench_rounds; ++round) {
+            Geometry geometry = {
+                .inode_count = DEFAULT_INODE_COUNT,
+                .block_count = 8 * 1024,
+                .block_size = DEFAULT_BLOCK_SIZE,
+            };
+            unlink(BENCH_IMAGE);
+            minifs_format(BENCH_IMAGE, &geometry);
+            Filesystem fs = minifs_open(BENCH_IMAGE);
+            fs.compress = (method == 1);
+            touch_file(&fs, "log");
+            int32_t inode = minifs_resolve(&fs, "log");
+
+            uint64_t begin = now_ns();
+            for (uint32_t offset = 0; offset < file_size; offset += piece) {
+                minifs_file_pwrite(&fs, inode, payload + offset, piece, offset);
+                minifs_update_superblock(&fs);
+            }
+            minifs_sync(&fs);
+            write_elapsed += now_ns() - begin;
+            stored = minifs_stored_size(&fs, inode);
+
+            minifs_set_cache_size(&fs, 0);  // every block read goes to image
+            uint64_t start_calls = syscall_count();
+            begin = now_ns();
+            int32_t size;
+            free((void*) minifs_read_data(&fs, inode, &size));
+            read_elapsed += now_ns() - begin;
+            read_calls += syscall_count() - start_calls;
+            minifs_close(&fs);
+        }
+        printf("%-10s  stored: %7.2f MB  write: %7.1f MB/s  read: %7.1f MB/s  read syscalls: %5lu\n",
+               labels[method], stored / 1048576.0,
+               (double) file_size * bench_rounds / 1048576.0 / (write_elapsed / 1e9),
+               (double) file_size * bench_rounds / 1048576.0 / (read_elapsed / 1e9), read_calls / bench_rounds);
+    }
+    free(payload);
+    unlink(BENCH_IMAGE);
+}
@@ -0,0 +1,2739 @@
+#include <internal/fs/fs.h>
+#include <internal/commands/execute.h>
+#include <internal/extent/extent.h>
+#include <internal/dcache/dcache.h>
+#include <internal/bcache/bcache.h>
+#include <internal/journal/journal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
+
+#define TEST_IMAGE "fs-test.img"
+#define TEST_HOST_FILE "fs-test.host"
+
+
+bool test_mmap_backend();
+bool test_dirty_flush();
+bool test_bitmap_allocator();
+bool test_extents();
+bool test_block_index();
+bool test_dirhash();
+bool test_dir_iterator();
+bool test_paths();
+bool test_buffer_cache();
+bool test_threads();
+bool test_uring();
+bool test_stream();
+bool test_import();
+bool test_export();
+bool test_file_ranges();
+bool test_truncate();
+bool test_journal();
+bool test_group_commit();
+bool test_geometry();
+bool test_grow();
+bool test_dir_reuse();
+bool test_inline();
+bool test_locality();
+bool test_delayed();
+bool test_sparse();
+bool test_compressed();
+
+
+int main() {
+    bool global = true;
+    global &= test_mmap_backend();
+    global &= test_dirty_flush();
+    global &= test_bitmap_allocator();
+    global &= test_extents();
+    global &= test_block_index();
+    global &= test_dirhash();
+    global &= test_dir_iterator();
+    global &= test_paths();
+    global &= test_buffer_cache();
+    global &= test_threads();
+    global &= test_uring();
+    global &= test_stream();
+    global &= test_import();
+    global &= test_export();
+    global &= test_file_ranges();
+    global &= test_truncate();
+    global &= test_journal();
+    global &= test_group_commit();
+    global &= test_geometry();
+    global &= test_grow();
+    global &= test_dir_reuse();
+    global &= test_inline();
+    global &= test_locality();
+    global &= test_delayed();
+    global &= test_sparse();
+    global &= test_compressed();
+
+    if (global) {
+        printf("[GLOBAL OK]\n");
+    }
+
+    return 0;
+}
+
+
+// =========== [ HELPERS ] ===========
+
+Filesystem open_clean_image() {
+    unlink(TEST_IMAGE);
+    minifs_init(TEST_IMAGE);
+    return minifs_open(TEST_IMAGE);
+}
+
+
+int32_t find_entry(Filesystem *fs, const char *name) {
+    int32_t result = -1;
+    DirectoryMap *content = minifs_read_dir(fs, fs->current_dir);
+    for (uint32_t index = 0; index < content->size; ++index) {
+        if (content->used[index] && strcmp(content->names[index], name) == 0) {
+            result = content->inodes[index];
+        }
+    }
+    minifs_clear_dirmap(content);
+    return result;
+}
+
+
+void touch_file(Filesystem *fs, const char *name) {
+    const char *args[] = {"touch", name};
+    minifs_touch(fs, args, 2);
+}
+
+
+void remove_file(Filesystem *fs, const char *name) {
+    const char *args[] = {"rm", name};
+    minifs_rm(fs, args, 2);
+}
+
+
+uint64_t write_count() {
+    return minifs_io_stats.writes;
+}
+
+
+void append_file(Filesystem *fs, uint32_t inode, const unsigned char *data, uint32_t size) {
+    minifs_append_data(fs, inode, data, size);
+    fs->sblock.inode_map[inode].size += size;
+    minifs_mark_inode(fs, inode);
+    minifs_update_superblock(fs);
+}
+
+
+bool check_content(Filesystem *fs, uint32_t inode, const unsigned char *expected, int32_t size) {
+    int32_t dsize = 0;
+    const char *data = minifs_read_data(fs, inode, &dsize);
+    bool result = (dsize == size) && memcmp(data, expected, size) == 0;
+    free((void*) data);
+    return result;
+}
+
+
+// =========== [ TESTS ] ===========
+
+bool test_mmap_backend() {
+    bool status = true;
+    unsigned char payload[3000];
+    for (int index = 0; index < sizeof(payload); ++index) {
+        payload[index] = index % 251;
+    }
+
+    // write through mapped image
+    Filesystem fs = open_clean_image();
+    if (!minifs_map_image(&fs)) {
+        printf("[BAD] 1 test_mmap_backend\n");
+        return false;
+    }
+    touch_file(&fs, "first");
+    touch_file(&fs, "second");
+    int32_t inode = find_entry(&fs, "first");
+    if (inode < 0 || find_entry(&fs, "second") < 0) {
+        status = false;
+        printf("[BAD] 2 test_mmap_backend\n");
+    }
+    append_file(&fs, inode, payload, sizeof(payload));
+    if (!check_content(&fs, inode, payload, sizeof(payload))) {
+        status = false;
+        printf("[BAD] 3 test_mmap_backend\n");
+    }
+    minifs_close(&fs);
+
+    // same content must be visible through fd backend
+    fs = minifs_open(TEST_IMAGE);
+    if (find_entry(&fs, "first") != inode || find_entry(&fs, "second") < 0) {
+        status = false;
+        printf("[BAD] 4 test_mmap_backend\n");
+    }
+    if (!check_content(&fs, inode, payload, sizeof(payload))) {
+        status = false;
+        printf("[BAD] 5 test_mmap_backend\n");
+    }
+
+    // and data written through fd backend through mapping
+    append_file(&fs, inode, payload, 100);
+    minifs_close(&fs);
+    fs = minifs_open(TEST_IMAGE);
+    minifs_map_image(&fs);
+    unsigned char expected[3100];
+    memcpy(expected, payload, 3000);
+    memcpy(expected + 3000, payload, 100);
+    if (!check_content(&fs, inode, expected, sizeof(expected))) {
+        status = false;
+        printf("[BAD] 6 test_mmap_backend\n");
+    }
+    minifs_close(&fs);
+    unlink(TEST_IMAGE);
+
+    if (status) {
+        printf("[OK] test_mmap_backend\n");
+    } else {
+        printf("[BAD] test_mmap_backend\n");
+    }
+
+    return status;
+}
+
+
+bool test_dirty_flush() {
+    bool status = true;
+    Filesystem fs = open_clean_image();
+
+    // one touch changes superblock, two inodes, two blocks and bitmap
+    // words, it must not rewrite whole tables
+    touch_file(&fs, "first");
+    uint64_t writes = write_count();
+    touch_file(&fs, "second");
+    touch_file(&fs, "third");
+    if (write_count() - writes > 2 * 10) {
+        status = false;
+        printf("[BAD] 1 test_dirty_flush\n");
+    }
+    if (fs.dirty_inodes.count != 0 || fs.dirty_blocks.count != 0) {
+        status = false;
+        printf("[BAD] 2 test_dirty_flush\n");
+    }
+    remove_file(&fs, "second");
+    uint32_t used_inodes = fs.sblock.used_inode_count;
+    uint32_t used_blocks = fs.sblock.used_block_count;
+    minifs_close(&fs);
+
+    // everything must survive reopen
+    fs = minifs_open(TEST_IMAGE);
+    if (fs.sblock.used_inode_count != used_inodes || fs.sblock.used_block_count != used_blocks) {
+        status = false;
+        printf("[BAD] 3 test_dirty_flush\n");
+    }
+    int32_t first = find_entry(&fs, "first");
+    int32_t third = find_entry(&fs, "third");
+    if (first < 0 || third < 0 || find_entry(&fs, "second") >= 0) {
+        status = false;
+        printf("[BAD] 4 test_dirty_flush\n");
+    }
+    if (first >= 0 && fs.sblock.inode_map[first].type != MINIFS_INODE_FILE) {
+        status = false;
+        printf("[BAD] 5 test_dirty_flush\n");
+    }
+    if (fs.sblock.inode_map[0].size != 3) {
+        status = false;
+        printf("[BAD] 6 test_dirty_flush\n");
+    }
+    minifs_close(&fs);
+    unlink(TEST_IMAGE);
+
+    if (status) {
+        printf("[OK] test_dirty_flush\n");
+    } else {
+        printf("[BAD] test_dirty_flush\n");
+    }
+
+    return status;
+}
+
+
+bool test_bitmap_allocator() {
+    bool status = true;
+    Filesystem fs = open_clean_image();
+    if (fs.sblock.used_inode_count != 1 || fs.sblock.used_block_count != 1) {
+        status = false;
+        printf("[BAD] 1 test_bitmap_allocator\n");
+    }
+
+    touch_file(&fs, "first");
+    touch_file(&fs, "second");
+    int32_t first = find_entry(&fs, "first");
+    int32_t second = find_entry(&fs, "second");
+    if (!bitmap_test(&fs.inode_bitmap, first) || !bitmap_test(&fs.inode_bitmap, second) ||
+        !bitmap_test(&fs.block_bitmap, fs.sblock.inode_map[second].root_block)) {
+        status = false;
+        printf("[BAD] 2 test_bitmap_allocator\n");
+    }
+    int32_t second_block = fs.sblock.inode_map[second].root_block;
+    remove_file(&fs, "second");
+    if (bitmap_test(&fs.inode_bitmap, second) || bitmap_test(&fs.block_bitmap, second_block) ||
+        bitmap_count(&fs.inode_bitmap) != fs.sblock.used_inode_count ||
+        bitmap_count(&fs.block_bitmap) != fs.sblock.used_block_count) {
+        status = false;
+        printf("[BAD] 3 test_bitmap_allocator\n");
+    }
+
+    // next-fit: freed inode is not reused until search wraps around
+    touch_file(&fs, "third");
+    if (find_entry(&fs, "third") == second) {
+        status = false;
+        printf("[BAD] 4 test_bitmap_allocator\n");
+    }
+    uint32_t used_inodes = fs.sblock.used_inode_count;
+    uint32_t used_blocks = fs.sblock.used_block_count;
+    uint64_t tail = minifs_inode_bitmap_offset(&fs);
+    minifs_close(&fs);
+
+    fs = minifs_open(TEST_IMAGE);
+    if (fs.sblock.used_inode_count != used_inodes || bitmap_count(&fs.inode_bitmap) != used_inodes ||
+        fs.dirty_inode_words.count != 0 || !bitmap_test(&fs.inode_bitmap, first)) {
+        status = false;
+        printf("[BAD] 5 test_bitmap_allocator\n");
+    }
+    minifs_close(&fs);
+
+    // image without bitmaps gets them rebuilt from inode and block maps
+    if (truncate(TEST_IMAGE, tail) < 0) {
+        status = false;
+        printf("[BAD] 6 test_bitmap_allocator\n");
+    }
+    fs = minifs_open(TEST_IMAGE);
+    if (fs.sblock.used_inode_count != used_inodes || fs.sblock.used_block_count != used_blocks ||
+        bitmap_count(&fs.block_bitmap) != used_blocks || bitmap_test(&fs.inode_bitmap, second)) {
+        status = false;
+        printf("[BAD] 7 test_bitmap_allocator\n");
+    }
+    minifs_close(&fs);
+    unlink(TEST_IMAGE);
+
+    if (status) {
+        printf("[OK] test_bitmap_allocator\n");
+    } else {
+        printf("[BAD] test_bitmap_allocator\n");
+    }
+
+    return status;
+}
+
+
+bool test_extents() {
+    bool status = true;
+    Filesystem fs = open_clean_image();
+    uint32_t block_size = fs.sblock.block_size;
+    uint32_t used_blocks = fs.sblock.used_block_count;
+
+    // contiguous appends of one file are one extent
+    unsigned char *payload = (unsigned char*) malloc(300 * block_size);
+    for (uint32_t index = 0; index < 300 * block_size; ++index) {
+        payload[index] = (index * 7) % 253;
+    }
+    touch_file(&fs, "first");
+    touch_file(&fs, "second");
+    int32_t first = find_entry(&fs, "first");
+    int32_t second = find_entry(&fs, "second");
+    append_file(&fs, first, payload, 100);
+    append_file(&fs, first, payload + 100, 4 * block_size);
+    uint32_t count;
+    Extent *extents = extent_list(&fs, first, &count);
+    if (count != 1 || extents[0].length != 5 || !check_content(&fs, first, payload, 100 + 4 * block_size)) {
+        status = false;
+        printf("[BAD] 1 test_extents\n");
+    }
+    free(extents);
+
+    // interleaved single block appends without preallocation and delay make tree grow over one node
+    fs.prealloc_blocks = 0;
+    fs.delayed_limit = 0;
+    for (uint32_t index = 0; index < 200; ++index) {
+        append_file(&fs, second, payload + index * block_size, block_size);
+        append_file(&fs, first, payload, block_size);
+    }
+    extents = extent_list(&fs, second, &count);
+    if (count < 100 || !check_content(&fs, second, payload, 200 * block_size)) {
+        status = false;
+        printf("[BAD] 2 test_extents\n");
+    }
+    for (uint32_t index = 0; index < count; ++index) {
+        if (extent_map(&fs, second, extents[index].logical) != extents[index].start) {
+            status = false;
+            printf("[BAD] 3 test_extents\n");
+            break;
+        }
+    }
+    free(extents);
+    if (extent_map(&fs, second, 200) != -1) {
+        status = false;
+        printf("[BAD] 4 test_extents\n");
+    }
+    minifs_close(&fs);
+
+    // everything is released by rm
+    fs = minifs_open(TEST_IMAGE);
+    if (!check_content(&fs, second, payload, 200 * block_size)) {
+        status = false;
+        printf("[BAD] 5 test_extents\n");
+    }
+    remove_file(&fs, "first");
+    remove_file(&fs, "second");
+    if (fs.sblock.used_block_count != used_blocks || bitmap_count(&fs.block_bitmap) != used_blocks) {
+        status = false;
+        printf("[BAD] 6 test_extents\n");
+    }
+
+    // files of older images use block chains
+    touch_file(&fs, "chained");
+    int32_t chained = find_entry(&fs, "chained");
+    fs.sblock.inode_map[chained].flags = 0;
+    fs.sblock.block_map[fs.sblock.inode_map[chained].root_block].size = 0;
+    append_file(&fs, chained, payload, 3 * block_size + 10);
+    if (!check_content(&fs, chained, payload, 3 * block_size + 10) ||
+        fs.sblock.block_map[fs.sblock.inode_map[chained].root_block].next_block < 0) {
+        status = false;
+        printf("[BAD] 7 test_extents\n");
+    }
+    remove_file(&fs, "chained");
+    if (fs.sblock.used_block_count != used_blocks) {
+        status = false;
+        printf("[BAD] 8 test_extents\n");
+    }
+
+    // zeroed root node is reported, commands skip file and rm still works
+    touch_file(&fs, "broken");
+    int32_t broken = find_entry(&fs, "broken");
+    append_file(&fs, broken, payload, 3 * block_size);
+    unsigned char *zeros = (unsigned char*) calloc(block_size, 1);
+    minifs_write_body(&fs, fs.sblock.inode_map[broken].root_block, zeros, block_size, 0);
+    free(zeros);
+    minifs_drop_index(&fs, broken);
+    extents = extent_list(&fs, broken, &count);
+    const char *args[] = {"truncate", "broken", "0"};
+    minifs_execute(&fs, args, 3);
+    if (minifs_file_readable(&fs, broken) || extents != NULL || count != 0 || extent_map(&fs, broken, 0) >= 0 ||
+        fs.sblock.inode_map[broken].size != 3 * block_size) {
+        status = false;
+        printf("[BAD] 9 test_extents\n");
+    }
+    remove_file(&fs, "broken");
+    if (find_entry(&fs, "broken") >= 0) {
+        status = false;
+        printf("[BAD] 10 test_extents\n");
+    }
+    minifs_close(&fs);
+    unlink(TEST_IMAGE);
+    free(payload);
+
+    if (status) {
+        printf("[OK] test_extents\n");
+    } else {
+        printf("[BAD] test_extents\n");
+    }
+
+    return status;
+}
+
+
+bool test_block_index() {
+    bool status = true;
+    Filesystem fs = open_clean_image();
+    uint32_t per_block = fs.sblock.block_size / (sizeof(char) + MAX_FILENAME_SIZE + sizeof(uint32_t));
+
+    // directory chain spans several blocks
+    char name[MAX_FILENAME_SIZE];
+    for (uint32_t index = 0; index < 3 * per_block + 5; ++index) {
+        snprintf(name, sizeof(name), "file%u", index);
+        touch_file(&fs, name);
+    }
+    BlockIndex *index = minifs_block_index(&fs, 0);
+    int32_t block = 0;
+    for (uint32_t number = 0; number < index->count; ++number) {
+        if (index->blocks[number] != block) {
+            status = false;
+            printf("[BAD] 1 test_block_index\n");
+            break;
+        }
+        block = fs.sblock.block_map[block].next_block;
+    }
+    if (index->count != 4 || block != -1) {
+        status = false;
+        printf("[BAD] 2 test_block_index\n");
+    }
+
+    // entries past first block are removed through index
+    snprintf(name, sizeof(name), "file%u", 2 * per_block + 1);
+    remove_file(&fs, name);
+    if (find_entry(&fs, name) >= 0 || find_entry(&fs, "file0") < 0) {
+        status = false;
+        printf("[BAD] 3 test_block_index\n");
+    }
+
+    // index of file follows appends and is dropped by rm
+    int32_t inode = find_entry(&fs, "file0");
+    unsigned char payload[2500];
+    memset(payload, 'a', sizeof(payload));
+    append_file(&fs, inode, payload, sizeof(payload));
+    append_file(&fs, inode, payload, 100);
+    if (minifs_block_index(&fs, inode)->count != 3 ||
+        minifs_file_block(&fs, inode, 2) != extent_map(&fs, inode, 2) ||
+        minifs_file_block(&fs, inode, 3) != -1) {
+        status = false;
+        printf("[BAD] 4 test_block_index\n");
+    }
+    remove_file(&fs, "file0");
+    if (fs.indexes[inode].blocks != NULL) {
+        status = false;
+        printf("[BAD] 5 test_block_index\n");
+    }
+    minifs_close(&fs);
+    unlink(TEST_IMAGE);
+
+    if (status) {
+        printf("[OK] test_block_index\n");
+    } else {
+        printf("[BAD] test_block_index\n");
+    }
+
+    return status;
+}
+
+
+bool test_dirhash() {
+    bool status = true;
+    const uint32_t files = 300;
+    Filesystem fs = open_clean_image();
+
+    // directory is indexed once it outgrows first block
+    char name[MAX_FILENAME_SIZE];
+    for (uint32_t index = 0; index < files; ++index) {
+        snprintf(name, sizeof(name), "file%u", index);
+        touch_file(&fs, name);
+    }
+    if (!(fs.sblock.inode_map[0].flags & MINIFS_INODE_HASHED)) {
+        status = false;
+        printf("[BAD] 1 test_dirhash\n");
+    }
+    for (uint32_t index = 0; index < files; ++index) {
+        snprintf(name, sizeof(name), "file%u", index);
+        int32_t inode = minifs_lookup(&fs, 0, name, NULL);
+        if (inode < 0 || inode != find_entry(&fs, name)) {
+            status = false;
+            printf("[BAD] 2 test_dirhash\n");
+            break;
+        }
+    }
+
+    // names stay unique
+    uint32_t used_inodes = fs.sblock.used_inode_count;
+    touch_file(&fs, "file7");
+    if (fs.sblock.used_inode_count != used_inodes) {
+        status = false;
+        printf("[BAD] 3 test_dirhash\n");
+    }
+
+    // removed entries disappear from index, others survive reopen
+    for (uint32_t index = 0; index < files; index += 3) {
+        snprintf(name, sizeof(name), "file%u", index);
+        remove_file(&fs, name);
+    }
+    minifs_close(&fs);
+    fs = minifs_open(TEST_IMAGE);
+    for (uint32_t index = 0; index < files; ++index) {
+        snprintf(name, sizeof(name), "file%u", index);
+        int32_t inode = minifs_lookup(&fs, 0, name, NULL);
+        if ((index % 3 == 0) != (inode < 0) || (inode >= 0 && inode != find_entry(&fs, name))) {
+            status = false;
+            printf("[BAD] 4 test_dirhash\n");
+            break;
+        }
+    }
+    if (minifs_lookup(&fs, 0, "", NULL) >= 0 || find_entry(&fs, "") >= 0) {
+        status = false;
+        printf("[BAD] 5 test_dirhash\n");
+    }
+
+    // index of removed directory is released with it
+    const char *mkdir[] = {"mkdir", "sub"};
+    const char *cd[] = {"cd", "sub"};
+    const char *up[] = {"cd", ".."};
+    const char *rmdir[] = {"rmdir", "sub"};
+    minifs_mkdir(&fs, mkdir, 2);
+    used_inodes = fs.sblock.used_inode_count - 1;
+    uint32_t used_blocks = fs.sblock.used_block_count - 1;
+    minifs_cd(&fs, cd, 2);
+    for (uint32_t index = 0; index < 100; ++index) {
+        snprintf(name, sizeof(name), "inner%u", index);
+        minifs_add_to_dir(&fs, fs.current_dir, name, 0);
+    }
+    if (!(fs.sblock.inode_map[fs.current_dir].flags & MINIFS_INODE_HASHED) ||
+        minifs_lookup(&fs, fs.current_dir, "inner42", NULL) != 0) {
+        status = false;
+        printf("[BAD] 6 test_dirhash\n");
+    }
+    minifs_cd(&fs, up, 2);
+    minifs_rmdir(&fs, rmdir, 2);
+    if (fs.sblock.used_inode_count != used_inodes || fs.sblock.used_block_count != used_blocks) {
+        status = false;
+        printf("[BAD] 7 test_dirhash\n");
+    }
+    minifs_close(&fs);
+    unlink(TEST_IMAGE);
+
+    if (status) {
+        printf("[OK] test_dirhash\n");
+    } else {
+        printf("[BAD] test_dirhash\n");
+    }
+
+    return status;
+}
+
+
+// counts live entries of directory, checks that positions match index
+uint32_t iterate_dir(Filesystem *fs, uint32_t dir, bool check_positions) {
+    uint32_t count = 0;
+    DirIterator it;
+    minifs_dir_open(fs, dir, &it);
+    const DirEntry *entry;
+    while ((entry = minifs_dir_next(&it)) != NULL) {
+        int32_t position = -1;
+        if (check_positions && (minifs_lookup(fs, dir, entry->name, &position) != entry->inode ||
+                                position != it.position)) {
+            break;
+        }
+        ++count;
+    }
+    minifs_dir_close(&it);
+    return count;
+}
+
+
+bool test_dir_iterator() {
+    bool status = true;
+    const uint32_t entries = 2000;
+    Filesystem fs = open_clean_image();
+
+    char name[MAX_FILENAME_SIZE];
+    for (uint32_t index = 0; index < entries; ++index) {
+        snprintf(name, sizeof(name), "entry%u", index);
+        minifs_add_to_dir(&fs, 0, name, index % fs.sblock.inode_count);
+    }
+    for (uint32_t index = 0; index < entries; index += 5) {
+        snprintf(name, sizeof(name), "entry%u", index);
+        int32_t position;
+        minifs_lookup(&fs, 0, name, &position);
+        minifs_remove_from_dir(&fs, 0, position);
+    }
+    minifs_update_superblock(&fs);
+
+    // every entry is returned once with its position, deleted ones are skipped
+    if (iterate_dir(&fs, 0, true) != entries - entries / 5) {
+        status = false;
+        printf("[BAD] 1 test_dir_iterator\n");
+    }
+
+    // one read per directory block
+    uint64_t reads = minifs_io_stats.reads;
+    iterate_dir(&fs, 0, false);
+    reads = minifs_io_stats.reads - reads;
+    if (reads > minifs_block_index(&fs, 0)->count) {
+        status = false;
+        printf("[BAD] 2 test_dir_iterator\n");
+    }
+
+    // mapped image is read in place
+    minifs_map_image(&fs);
+    reads = minifs_io_stats.reads;
+    if (iterate_dir(&fs, 0, false) != entries - entries / 5 || minifs_io_stats.reads != reads) {
+        status = false;
+        printf("[BAD] 3 test_dir_iterator\n");
+    }
+
+    // empty directory
+    const char *mkdir[] = {"mkdir", "empty"};
+    minifs_mkdir(&fs, mkdir, 2);
+    if (iterate_dir(&fs, minifs_lookup(&fs, 0, "empty", NULL), false) != 0) {
+        status = false;
+        printf("[BAD] 4 test_dir_iterator\n");
+    }
+    minifs_close(&fs);
+    unlink(TEST_IMAGE);
+
+    if (status) {
+        printf("[OK] test_dir_iterator\n");
+    } else {
+        printf("[BAD] test_dir_iterator\n");
+    }
+
+    return status;
+}
+
+
+void run(Filesystem *fs, const char *command, const char *argument) {
+    const char *args[] = {command, argument};
+    minifs_execute(fs, args, 2);
+}
+
+
+bool test_paths() {
+    bool status = true;
+    Filesystem fs = open_clean_image();
+
+    run(&fs, "mkdir", "a");
+    run(&fs, "mkdir", "/a/b");
+    run(&fs, "mkdir", "a/b/c");
+    run(&fs, "touch", "/a/b/c/file");
+    int32_t a = minifs_lookup(&fs, 0, "a", NULL);
+    int32_t b = minifs_lookup(&fs, a, "b", NULL);
+    int32_t c = minifs_lookup(&fs, b, "c", NULL);
+    int32_t file = minifs_lookup(&fs, c, "file", NULL);
+    if (a < 0 || b < 0 || c < 0 || file < 0 || fs.sblock.inode_map[c].parent != b) {
+        status = false;
+        printf("[BAD] 1 test_paths\n");
+    }
+
+    // absolute, relative and dotted paths
+    run(&fs, "cd", "a/b");
+    if (fs.current_dir != b || minifs_resolve(&fs, "c/file") != file ||
+        minifs_resolve(&fs, "../b/./c//file") != file || minifs_resolve(&fs, "/a/b/c/file") != file ||
+        minifs_resolve(&fs, "/..") != 0 || minifs_resolve(&fs, "c/file/x") != -1 ||
+        minifs_resolve(&fs, "c/missing") != -1) {
+        status = false;
+        printf("[BAD] 2 test_paths\n");
+    }
+
+    // repeated resolution is served from dentry cache
+    uint64_t reads = minifs_io_stats.reads;
+    uint64_t misses = fs.dcache->misses;
+    for (int round = 0; round < 100; ++round) {
+        minifs_resolve(&fs, "/a/b/c/file");
+        minifs_resolve(&fs, "/a/b/c/missing");
+    }
+    if (minifs_io_stats.reads != reads || fs.dcache->misses != misses) {
+        status = false;
+        printf("[BAD] 3 test_paths\n");
+    }
+
+    // commands keep cache in sync, including negative dentries
+    run(&fs, "touch", "c/missing");
+    if (minifs_resolve(&fs, "/a/b/c/missing") < 0) {
+        status = false;
+        printf("[BAD] 4 test_paths\n");
+    }
+    run(&fs, "rm", "/a/b/c/file");
+    run(&fs, "rmdir", "../b");
+    if (minifs_resolve(&fs, "c/file") != -1 || fs.current_dir != b) {
+        status = false;
+        printf("[BAD] 5 test_paths\n");
+    }
+    run(&fs, "cd", "/");
+    run(&fs, "rm", "a/b/c/missing");
+    run(&fs, "rmdir", "a/b/c");
+    if (minifs_resolve(&fs, "a/b/c") != -1 || minifs_resolve(&fs, "a/b") != b ||
+        dcache_find(fs.dcache, c, "missing") != NULL) {
+        status = false;
+        printf("[BAD] 6 test_paths\n");
+    }
+
+    run(&fs, "mkdir", "/a/b/d");
+    if (minifs_resolve(&fs, "/a/b/d") < 0 || minifs_resolve(&fs, "/a/b/d/missing") != -1) {
+        status = false;
+        printf("[BAD] 7 test_paths\n");
+    }
+    run(&fs, "touch", "/a/b/d/missing");
+    minifs_close(&fs);
+
+    // fresh cache sees same tree
+    fs = minifs_open(TEST_IMAGE);
+    if (minifs_resolve(&fs, "/a/b/d/missing") < 0 || minifs_resolve(&fs, "a/b/c") != -1) {
+        status = false;
+        printf("[BAD] 8 test_paths\n");
+    }
+    minifs_close(&fs);
+    unlink(TEST_IMAGE);
+
+    if (status) {
+        printf("[OK] test_paths\n");
+    } else {
+        printf("[BAD] test_paths\n");
+    }
+
+    return status;
+}
+
+
+bool test_buffer_cache() {
+    bool status = true;
+    Filesystem fs = open_clean_image();
+    uint32_t block_size = fs.sblock.block_size;
+    unsigned char payload[8 * 1024];
+    for (int index = 0; index < sizeof(payload); ++index) {
+        payload[index] = index % 253;
+    }
+
+    // hot file is read without syscalls
+    touch_file(&fs, "hot");
+    int32_t hot = find_entry(&fs, "hot");
+    append_file(&fs, hot, payload, 3000);
+    check_content(&fs, hot, payload, 3000);
+    uint64_t reads = minifs_io_stats.reads;
+    uint64_t hits = fs.bcache->hits;
+    if (!check_content(&fs, hot, payload, 3000) || minifs_io_stats.reads != reads || fs.bcache->hits == hits) {
+        status = false;
+        printf("[BAD] 1 test_buffer_cache\n");
+    }
+
+    // adjacent dirty blocks are written with one call
+    minifs_sync(&fs);
+    uint64_t writebacks = fs.bcache->writebacks;
+    append_file(&fs, hot, payload, 4 * block_size);
+    minifs_sync(&fs);
+    if (fs.bcache->writebacks - writebacks > 3) {
+        status = false;
+        printf("[BAD] 2 test_buffer_cache\n");
+    }
+
+    // tiny cache evicts dirty buffers, data survives reopen
+    minifs_set_cache_size(&fs, 4 * block_size);
+    char name[MAX_FILENAME_SIZE];
+    for (int file = 0; file < 8; ++file) {
+        snprintf(name, sizeof(name), "small%d", file);
+        touch_file(&fs, name);
+    }
+    for (int round = 0; round < 2000; ++round) {
+        snprintf(name, sizeof(name), "small%d", round % 8);
+        append_file(&fs, find_entry(&fs, name), payload + round / 8, 1);
+    }
+    append_file(&fs, hot, payload, sizeof(payload));
+    minifs_close(&fs);
+
+    fs = minifs_open(TEST_IMAGE);
+    unsigned char expected[250];
+    for (int file = 0; file < 8; ++file) {
+        for (int index = 0; index < 250; ++index) {
+            expected[index] = payload[(index * 8 + file) / 8];
+        }
+        snprintf(name, sizeof(name), "small%d", file);
+        if (!check_content(&fs, find_entry(&fs, name), expected, 250)) {
+            status = false;
+            printf("[BAD] 3 test_buffer_cache\n");
+            break;
+        }
+    }
+
+    // partial write to uncached block is merged with image on read
+    int32_t block = minifs_file_block(&fs, hot, 0);
+    minifs_write_body(&fs, block, "XYZ", 3, 100);
+    unsigned char body[1024];
+    minifs_read_body(&fs, block, body, block_size, 0);
+    if (memcmp(body, payload, 100) != 0 || memcmp(body + 100, "XYZ", 3) != 0 ||
+        memcmp(body + 103, payload + 103, block_size - 103) != 0) {
+        status = false;
+        printf("[BAD] 4 test_buffer_cache\n");
+    }
+
+    // cache disabled: direct io sees same data
+    minifs_set_cache_size(&fs, 0);
+    minifs_read_body(&fs, block, body, block_size, 0);
+    if (memcmp(body + 100, "XYZ", 3) != 0 || memcmp(body + 103, payload + 103, block_size - 103) != 0) {
+        status = false;
+        printf("[BAD] 5 test_buffer_cache\n");
+    }
+    minifs_close(&fs);
+    unlink(TEST_IMAGE);
+
+    if (status) {
+        printf("[OK] test_buffer_cache\n");
+    } else {
+        printf("[BAD] test_buffer_cache\n");
+    }
+
+    return status;
+}
+
+
+#define THREAD_COUNT 4
+#define THREAD_FILES 6
+#define THREAD_CHUNK 700
+
+
+typedef struct Worker {
+    Filesystem *fs;
+    int id;
+    const unsigned char *shared;
+    uint32_t shared_size;
+    bool status;
+} Worker;
+
+
+// worker fills own directory and rereads shared file in between
+void *thread_worker(void *arg) {
+    Worker *worker = (Worker*) arg;
+    Filesystem *fs = worker->fs;
+    char path[64];
+    snprintf(path, sizeof(path), "/dir%d", worker->id);
+    const char *mkdir[] = {"mkdir", path};
+    minifs_mkdir(fs, mkdir, 2);
+
+    unsigned char chunk[THREAD_CHUNK];
+    memset(chunk, 'a' + worker->id, sizeof(chunk));
+    for (int round = 0; round < 3; ++round) {
+        for (int file = 0; file < THREAD_FILES; ++file) {
+            snprintf(path, sizeof(path), "/dir%d/file%d", worker->id, file);
+            if (round == 0) {
+                touch_file(fs, path);
+            }
+            int32_t inode = minifs_resolve(fs, path);
+            if (inode < 0) {
+                worker->status = false;
+                return NULL;
+            }
+            minifs_lock_inode(fs, inode, true);
+            minifs_append_data(fs, inode, chunk, sizeof(chunk));
+            fs->sblock.inode_map[inode].size += sizeof(chunk);
+            minifs_mark_inode(fs, inode);
+            minifs_unlock_inode(fs, inode);
+        }
+
+        int32_t shared = minifs_resolve(fs, "/shared");
+        minifs_lock_inode(fs, shared, false);
+        worker->status &= check_content(fs, shared, worker->shared, worker->shared_size);
+        minifs_unlock_inode(fs, shared);
+    }
+    return NULL;
+}
+
+
+bool test_threads() {
+    bool status = true;
+    unsigned char payload[5000];
+    for (int index = 0; index < sizeof(payload); ++index) {
+        payload[index] = index % 239;
+    }
+
+    // small cache keeps eviction and writeback busy
+    Filesystem fs = open_clean_image();
+    minifs_set_cache_size(&fs, 8 * fs.sblock.block_size);
+    touch_file(&fs, "shared");
+    append_file(&fs, find_entry(&fs, "shared"), payload, sizeof(payload));
+
+    pthread_t threads[THREAD_COUNT];
+    Worker workers[THREAD_COUNT];
+    for (int index = 0; index < THREAD_COUNT; ++index) {
+        workers[index] = (Worker) {.fs = &fs, .id = index, .shared = payload,
+                                   .shared_size = sizeof(payload), .status = true};
+        pthread_create(&threads[index], NULL, thread_worker, &workers[index]);
+    }
+    for (int index = 0; index < THREAD_COUNT; ++index) {
+        pthread_join(threads[index], NULL);
+        if (!workers[index].status) {
+            status = false;
+            printf("[BAD] 1 test_threads\n");
+        }
+    }
+    minifs_update_superblock(&fs);
+
+    if (fs.sblock.used_inode_count != bitmap_count(&fs.inode_bitmap) ||
+        fs.sblock.used_block_count != bitmap_count(&fs.block_bitmap)) {
+        status = false;
+        printf("[BAD] 2 test_threads\n");
+    }
+    minifs_close(&fs);
+
+    // every file holds exactly its own chunks after reopen
+    fs = minifs_open(TEST_IMAGE);
+    unsigned char expected[3 * THREAD_CHUNK];
+    char path[64];
+    for (int worker = 0; worker < THREAD_COUNT; ++worker) {
+        memset(expected, 'a' + worker, sizeof(expected));
+        for (int file = 0; file < THREAD_FILES; ++file) {
+            snprintf(path, sizeof(path), "/dir%d/file%d", worker, file);
+            int32_t inode = minifs_resolve(&fs, path);
+            if (inode < 0 || !check_content(&fs, inode, expected, sizeof(expected))) {
+                status = false;
+                printf("[BAD] 3 test_threads\n");
+            }
+        }
+    }
+    minifs_close(&fs);
+    unlink(TEST_IMAGE);
+
+    if (status) {
+        printf("[OK] test_threads\n");
+    } else {
+        printf("[BAD] test_threads\n");
+    }
+
+    return status;
+}
+
+
+bool test_uring() {
+    bool status = true;
+    Filesystem fs = open_clean_image();
+    if (!minifs_enable_uring(&fs)) {  // synchronous path is covered by other tests
+        printf("io_uring is unavailable\n");
+        minifs_close(&fs);
+        unlink(TEST_IMAGE);
+        printf("[OK] test_uring\n");
+        return true;
+    }
+
+    // interleaved appends without preallocation and delay give both files many extents
+    fs.prealloc_blocks = 0;
+    fs.delayed_limit = 0;
+    unsigned char first[40 * 1024];
+    unsigned char second[40 * 1024];
+    for (int index = 0; index < sizeof(first); ++index) {
+        first[index] = index % 251;
+        second[index] = index % 241;
+    }
+    touch_file(&fs, "first");
+    touch_file(&fs, "second");
+    int32_t one = find_entry(&fs, "first");
+    int32_t two = find_entry(&fs, "second");
+    const uint32_t piece = 2048;
+    for (uint32_t offset = 0; offset < sizeof(first); offset += piece) {
+        append_file(&fs, one, first + offset, piece);
+        append_file(&fs, two, second + offset, piece);
+    }
+    minifs_sync(&fs);
+
+    // every extent is one queued read, all of them share few enters,
+    // only extent tree roots are read synchronously
+    minifs_set_cache_size(&fs, 0);
+    uint32_t extents;
+    free(extent_list(&fs, one, &extents));
+    uint64_t enters = fs.uring->enters;
+    uint64_t reads = minifs_io_stats.reads;
+    if (!check_content(&fs, one, first, sizeof(first)) || !check_content(&fs, two, second, sizeof(second))) {
+        status = false;
+        printf("[BAD] 1 test_uring\n");
+    }
+    if (extents < 10 || fs.uring->enters - enters > 4 || minifs_io_stats.reads - reads > 2) {
+        status = false;
+        printf("[BAD] 2 test_uring\n");
+    }
+    minifs_close(&fs);
+
+    // synchronous reopen sees data and metadata written through ring
+    fs = minifs_open(TEST_IMAGE);
+    if (!check_content(&fs, one, first, sizeof(first)) || !check_content(&fs, two, second, sizeof(second)) ||
+        fs.sblock.used_block_count != bitmap_count(&fs.block_bitmap)) {
+        status = false;
+        printf("[BAD] 3 test_uring\n");
+    }
+    minifs_close(&fs);
+    unlink(TEST_IMAGE);
+
+    if (status) {
+        printf("[OK] test_uring\n");
+    } else {
+        printf("[BAD] test_uring\n");
+    }
+
+    return status;
+}
+
+
+typedef struct Collector {
+    unsigned char *data;
+    uint32_t size;
+    uint32_t pieces;
+    uint32_t largest;
+    uint32_t limit;         // pieces to accept before stop
+} Collector;
+
+
+bool collect_piece(void *context, const void *data, uint32_t size) {
+    Collector *collector = (Collector*) context;
+    memcpy(collector->data + collector->size, data, size);
+    collector->size += size;
+    collector->pieces++;
+    collector->largest = size > collector->largest ? size : collector->largest;
+    return collector->pieces < collector->limit;
+}
+
+
+bool test_stream() {
+    bool status = true;
+    unsigned char payload[40 * 1024];
+    for (int index = 0; index < sizeof(payload); ++index) {
+        payload[index] = index % 247;
+    }
+
+    // half of file is fragmented by other file, rest is contiguous
+    Filesystem fs = open_clean_image();
+    touch_file(&fs, "file");
+    touch_file(&fs, "other");
+    int32_t inode = find_entry(&fs, "file");
+    int32_t other = find_entry(&fs, "other");
+    for (uint32_t offset = 0; offset < sizeof(payload) / 2; offset += 1500) {
+        uint32_t size = sizeof(payload) / 2 - offset < 1500 ? sizeof(payload) / 2 - offset : 1500;
+        append_file(&fs, inode, payload + offset, size);
+        append_file(&fs, other, payload, 700);
+    }
+    append_file(&fs, inode, payload + sizeof(payload) / 2, sizeof(payload) / 2);
+
+    unsigned char *buffer = (unsigned char*) malloc(4096);
+    Collector collector = {.data = (unsigned char*) malloc(sizeof(payload)), .limit = 1000};
+    if (!minifs_stream_data(&fs, inode, buffer, 4096, collect_piece, &collector) ||
+        collector.size != sizeof(payload) || memcmp(collector.data, payload, sizeof(payload)) != 0) {
+        status = false;
+        printf("[BAD] 1 test_stream\n");
+    }
+    if (collector.largest > 4096 || collector.pieces < sizeof(payload) / 4096) {
+        status = false;
+        printf("[BAD] 2 test_stream\n");
+    }
+
+    // function stops stream
+    collector = (Collector) {.data = collector.data, .limit = 2};
+    if (minifs_stream_data(&fs, inode, buffer, 4096, collect_piece, &collector) || collector.pieces != 2) {
+        status = false;
+        printf("[BAD] 3 test_stream\n");
+    }
+
+    // mapped image is passed in place by whole runs
+    if (!minifs_map_image(&fs)) {
+        status = false;
+        printf("[BAD] 4 test_stream\n");
+    }
+    collector = (Collector) {.data = collector.data, .limit = 1000};
+    if (!minifs_stream_data(&fs, inode, buffer, 4096, collect_piece, &collector) ||
+        collector.size != sizeof(payload) || memcmp(collector.data, payload, sizeof(payload)) != 0 ||
+        collector.largest <= 4096) {
+        status = false;
+        printf("[BAD] 5 test_stream\n");
+    }
+    free(collector.data);
+    free(buffer);
+    minifs_close(&fs);
+    unlink(TEST_IMAGE);
+
+    if (status) {
+        printf("[OK] test_stream\n");
+    } else {
+        printf("[BAD] test_stream\n");
+    }
+
+    return status;
+}
+
+
+void write_host_file(const unsigned char *data, uint32_t size) {
+    FILE *file = fopen(TEST_HOST_FILE, "wb");
+    fwrite(data, 1, size, file);
+    fclose(file);
+}
+
+
+bool test_import() {
+    bool status = true;
+    const uint32_t size = 300 * 1024 + 123;
+    unsigned char *payload = (unsigned char*) malloc(size);
+    for (uint32_t index = 0; index < size; ++index) {
+        payload[index] = (index * 7) % 253;
+    }
+    write_host_file(payload, size);
+
+    for (int backend = 0; backend < 2; ++backend) {
+        Filesystem fs = open_clean_image();
+        if (backend == 1 && !minifs_map_image(&fs)) {
+            status = false;
+            printf("[BAD] 1 test_import\n");
+        }
+        run(&fs, "mkdir", "data");
+
+        // whole file is one extent, metadata and entry bodies are written once
+        uint64_t writes = minifs_io_stats.writes;
+        const char *args[] = {"import", TEST_HOST_FILE, "data/file"};
+        minifs_import(&fs, args, 3);
+        int32_t inode = minifs_resolve(&fs, "/data/file");
+        uint32_t extents = 0;
+        if (inode >= 0) {
+            free(extent_list(&fs, inode, &extents));
+        }
+        if (inode < 0 || !check_content(&fs, inode, payload, size) || extents != 1) {
+            status = false;
+            printf("[BAD] 2 test_import\n");
+        }
+        if (backend == 0 && minifs_io_stats.writes - writes > 8) {
+            status = false;
+            printf("[BAD] 3 test_import\n");
+        }
+
+        // existing name and missing host file change nothing, copies
+        // are imported until free blocks run out
+        uint32_t used = fs.sblock.used_block_count;
+        uint32_t per_file = (size + fs.sblock.block_size - 1) / fs.sblock.block_size + 1;  // with tree root
+        minifs_import(&fs, args, 3);
+        const char *missing[] = {"import", "no-such-host-file", "data/other"};
+        minifs_import(&fs, missing, 3);
+        for (int copy = 0; copy < 3; ++copy) {
+            char name[32];
+            snprintf(name, sizeof(name), "data/copy%d", copy);
+            const char *copy_args[] = {"import", TEST_HOST_FILE, name};
+            minifs_import(&fs, copy_args, 3);
+        }
+        if (fs.sblock.used_block_count != used + 2 * per_file ||
+            minifs_resolve(&fs, "/data/other") >= 0 || minifs_resolve(&fs, "/data/copy2") >= 0) {
+            status = false;
+            printf("[BAD] 4 test_import\n");
+        }
+        minifs_close(&fs);
+
+        // content survives reopen
+        fs = minifs_open(TEST_IMAGE);
+        if (!check_content(&fs, inode, payload, size) ||
+            !check_content(&fs, minifs_resolve(&fs, "/data/copy1"), payload, size)) {
+            status = false;
+            printf("[BAD] 5 test_import\n");
+        }
+        minifs_close(&fs);
+    }
+    free(payload);
+    unlink(TEST_HOST_FILE);
+    unlink(TEST_IMAGE);
+
+    if (status) {
+        printf("[OK] test_import\n");
+    } else {
+        printf("[BAD] test_import\n");
+    }
+
+    return status;
+}
+
+
+bool check_host_file(const unsigned char *expected, uint32_t size) {
+    FILE *file = fopen(TEST_HOST_FILE, "rb");
+    if (file == NULL) {
+        return false;
+    }
+    unsigned char *data = (unsigned char*) malloc(size + 1);
+    size_t read = fread(data, 1, size + 1, file);
+    fclose(file);
+    bool result = (read == size) && memcmp(data, expected, size) == 0;
+    free(data);
+    return result;
+}
+
+
+bool test_export() {
+    bool status = true;
+    unsigned char payload[60 * 1024];
+    for (int index = 0; index < sizeof(payload); ++index) {
+        payload[index] = (index * 13) % 251;
+    }
+
+    for (int backend = 0; backend < 2; ++backend) {
+        // fragmented file, tail is still in buffer cache or mapped image
+        Filesystem fs = open_clean_image();
+        if (backend == 1 && !minifs_map_image(&fs)) {
+            status = false;
+            printf("[BAD] 1 test_export\n");
+        }
+        touch_file(&fs, "file");
+        touch_file(&fs, "other");
+        int32_t inode = find_entry(&fs, "file");
+        int32_t other = find_entry(&fs, "other");
+        for (uint32_t offset = 0; offset < sizeof(payload); offset += 3000) {
+            uint32_t size = sizeof(payload) - offset < 3000 ? sizeof(payload) - offset : 3000;
+            append_file(&fs, inode, payload + offset, size);
+            append_file(&fs, other, payload, 100);
+        }
+
+        uint64_t copies = minifs_io_stats.copies;
+        const char *args[] = {"export", "file", TEST_HOST_FILE};
+        minifs_export(&fs, args, 3);
+        if (!check_host_file(payload, sizeof(payload))) {
+            status = false;
+            printf("[BAD] 2 test_export\n");
+        }
+        if (minifs_io_stats.copies == copies) {  // kernel copy works for regular files
+            status = false;
+            printf("[BAD] 3 test_export\n");
+        }
+
+        // export to pipe goes through fallbacks
+        int pipes[2];
+        pipe(pipes);
+        if (!minifs_export_data(&fs, other, pipes[1])) {
+            status = false;
+            printf("[BAD] 4 test_export\n");
+        }
+        close(pipes[1]);
+        unsigned char piped[4096];
+        uint32_t total = 0;
+        ssize_t got;
+        bool same = true;
+        while ((got = read(pipes[0], piped, sizeof(piped))) > 0) {
+            for (ssize_t index = 0; index < got; ++index) {
+                same &= piped[index] == payload[(total + index) % 100];
+            }
+            total += got;
+        }
+        close(pipes[0]);
+        if (!same || total != fs.sblock.inode_map[other].size) {
+            status = false;
+            printf("[BAD] 5 test_export\n");
+        }
+        minifs_close(&fs);
+    }
+    unlink(TEST_HOST_FILE);
+    unlink(TEST_IMAGE);
+
+    if (status) {
+        printf("[OK] test_export\n");
+    } else {
+        printf("[BAD] test_export\n");
+    }
+
+    return status;
+}
+
+
+bool test_file_ranges() {
+    bool status = true;
+    const uint32_t size = 20000;
+    unsigned char model[24 * 1024];
+    unsigned char result[24 * 1024];
+    for (int index = 0; index < size; ++index) {
+        model[index] = (index * 7) % 253;
+    }
+
+    for (int backend = 0; backend < 3; ++backend) {
+        Filesystem fs = open_clean_image();
+        if (backend == 1) {
+            minifs_set_cache_size(&fs, 0);
+        }
+        if (backend == 2 && !minifs_map_image(&fs)) {
+            status = false;
+            printf("[BAD] 1 test_file_ranges\n");
+        }
+
+        // fragmented extent file and block chain file
+        touch_file(&fs, "file");
+        touch_file(&fs, "other");
+        uint32_t inodes[2];
+        inodes[0] = find_entry(&fs, "file");
+        inodes[1] = minifs_create_inode(&fs, MINIFS_INODE_FILE, 0, fs.current_dir);
+        uint32_t other = find_entry(&fs, "other");
+        for (uint32_t offset = 0; offset < size; offset += 2500) {
+            for (int file = 0; file < 2; ++file) {
+                append_file(&fs, inodes[file], model + offset, 2500);
+            }
+            append_file(&fs, other, model, 10);
+        }
+
+        for (int file = 0; file < 2; ++file) {
+            uint32_t inode = inodes[file];
+            unsigned char copy[24 * 1024];
+            memcpy(copy, model, size);
+
+            // ranges inside one block, across blocks, up to and past end of file
+            uint32_t ranges[][2] = {{0, 10}, {1000, 100}, {1020, 10}, {3000, 9000}, {size - 5, 5}, {size - 5, 100}, {size, 10}};
+            for (int range = 0; range < 7; ++range) {
+                uint32_t offset = ranges[range][0];
+                uint32_t length = ranges[range][1];
+                uint32_t expected = (offset + length <= size) ? length : size - offset;
+                if (minifs_file_pread(&fs, inode, result, length, offset) != expected ||
+                    memcmp(result, model + offset, expected) != 0) {
+                    status = false;
+                    printf("[BAD] 2 test_file_ranges\n");
+                }
+            }
+
+            // uncached read of small range touches only its block
+            if (backend == 1) {
+                uint64_t reads = minifs_io_stats.reads;
+                minifs_file_pread(&fs, inode, result, 100, 15000);
+                if (minifs_io_stats.reads - reads != 1) {
+                    status = false;
+                    printf("[BAD] 3 test_file_ranges\n");
+                }
+            }
+
+            // overwrite across blocks, overwrite with tail after end, write after gap
+            unsigned char patch[3000];
+            memset(patch, 'p', sizeof(patch));
+            minifs_file_pwrite(&fs, inode, patch, 3000, 500);
+            memcpy(copy + 500, patch, 3000);
+            minifs_file_pwrite(&fs, inode, patch, 1000, size - 300);
+            memcpy(copy + size - 300, patch, 1000);
+            minifs_file_pwrite(&fs, inode, patch, 100, size + 2000);
+            memset(copy + size + 700, 0, 1300);
+            memcpy(copy + size + 2000, patch, 100);
+            minifs_update_superblock(&fs);
+
+            if (fs.sblock.inode_map[inode].size != size + 2100 ||
+                !check_content(&fs, inode, copy, size + 2100)) {
+                status = false;
+                printf("[BAD] 4 test_file_ranges\n");
+            }
+            if (minifs_file_pread(&fs, inode, result, 3000, size - 900) != 3000 ||
+                memcmp(result, copy + size - 900, 3000) != 0) {
+                status = false;
+                printf("[BAD] 5 test_file_ranges\n");
+            }
+        }
+        minifs_close(&fs);
+
+        // changes survive reopen
+        fs = minifs_open(TEST_IMAGE);
+        for (int file = 0; file < 2; ++file) {
+            if (minifs_file_pread(&fs, inodes[file], result, 50, 480) != 50 ||
+                memcmp(result, model + 480, 20) != 0 || result[20] != 'p') {
+                status = false;
+                printf("[BAD] 6 test_file_ranges\n");
+            }
+        }
+        minifs_close(&fs);
+    }
+    unlink(TEST_IMAGE);
+
+    if (status) {
+        printf("[OK] test_file_ranges\n");
+    } else {
+        printf("[BAD] test_file_ranges\n");
+    }
+
+    return status;
+}
+
+
+bool test_truncate() {
+    bool status = true;
+    Filesystem fs = open_clean_image();
+    uint32_t block_size = fs.sblock.block_size;
+    unsigned char *payload = (unsigned char*) malloc(200 * block_size);
+    unsigned char *zeros = (unsigned char*) calloc(2 * block_size, 1);
+    for (uint32_t index = 0; index < 200 * block_size; ++index) {
+        payload[index] = (index * 11) % 251;
+    }
+
+    // interleaved appends without preallocation and delay give file with deep extent tree
+    fs.prealloc_blocks = 0;
+    fs.delayed_limit = 0;
+    touch_file(&fs, "file");
+    touch_file(&fs, "other");
+    int32_t inode = find_entry(&fs, "file");
+    int32_t other = find_entry(&fs, "other");
+    for (uint32_t block = 0; block < 200; ++block) {
+        append_file(&fs, inode, payload + block * block_size, block_size);
+        append_file(&fs, other, payload, block_size);
+    }
+    uint32_t other_used = fs.sblock.used_block_count;
+    ExtentHeader root;
+    minifs_read_body(&fs, fs.sblock.inode_map[inode].root_block, &root, sizeof(root), 0);
+    if (root.depth == 0) {
+        status = false;
+        printf("[BAD] 1 test_truncate\n");
+    }
+
+    // cut inside block: tail blocks and emptied nodes are freed at once
+    uint32_t size = 150 * block_size + 100;
+    minifs_truncate(&fs, inode, size);
+    minifs_update_superblock(&fs);
+    uint32_t count;
+    Extent *extents = extent_list(&fs, inode, &count);
+    uint32_t blocks = 0;
+    for (uint32_t index = 0; index < count; ++index) {
+        blocks += extents[index].length;
+    }
+    free(extents);
+    if (blocks != 151 || fs.sblock.used_block_count > other_used - 49 ||
+        !check_content(&fs, inode, payload, size)) {
+        status = false;
+        printf("[BAD] 2 test_truncate\n");
+    }
+
+    // appends and growth continue from new end
+    append_file(&fs, inode, payload + size, 2000);
+    bool appended = check_content(&fs, inode, payload, size + 2000);
+    minifs_truncate(&fs, inode, size + 2000 + block_size);
+    minifs_update_superblock(&fs);
+    unsigned char *result = (unsigned char*) malloc(block_size);
+    if (!appended || minifs_file_pread(&fs, inode, result, block_size, size + 2000) != block_size ||
+        memcmp(result, zeros, block_size) != 0) {
+        status = false;
+        printf("[BAD] 3 test_truncate\n");
+    }
+    minifs_close(&fs);
+
+    // empty file keeps only its root node, which becomes leaf again
+    fs = minifs_open(TEST_IMAGE);
+    minifs_read_body(&fs, fs.sblock.inode_map[inode].root_block, &root, sizeof(root), 0);
+    uint32_t owned = minifs_block_index(&fs, inode)->count + root.count;  // data and leaf nodes
+    uint32_t used = fs.sblock.used_block_count;
+    minifs_truncate(&fs, inode, 0);
+    minifs_update_superblock(&fs);
+    minifs_read_body(&fs, fs.sblock.inode_map[inode].root_block, &root, sizeof(root), 0);
+    if (fs.sblock.used_block_count != used - owned || root.depth != 0 || root.count != 0) {
+        status = false;
+        printf("[BAD] 4 test_truncate\n");
+    }
+    append_file(&fs, inode, payload, 3 * block_size);
+    if (!check_content(&fs, inode, payload, 3 * block_size)) {
+        status = false;
+        printf("[BAD] 5 test_truncate\n");
+    }
+
+    // block chain is cut after tail block and keeps root block
+    int32_t chain = minifs_create_inode(&fs, MINIFS_INODE_FILE, 0, fs.current_dir);
+    uint32_t chain_used = fs.sblock.used_block_count;
+    append_file(&fs, chain, payload, 10 * block_size);
+    minifs_truncate(&fs, chain, 3 * block_size - 1);
+    minifs_update_superblock(&fs);
+    if (fs.sblock.used_block_count != chain_used + 2 || !check_content(&fs, chain, payload, 3 * block_size - 1)) {
+        status = false;
+        printf("[BAD] 6 test_truncate\n");
+    }
+    minifs_truncate(&fs, chain, 0);
+    append_file(&fs, chain, payload, 100);
+    minifs_update_superblock(&fs);
+    if (fs.sblock.used_block_count != chain_used || !check_content(&fs, chain, payload, 100)) {
+        status = false;
+        printf("[BAD] 7 test_truncate\n");
+    }
+    minifs_close(&fs);
+
+    fs = minifs_open(TEST_IMAGE);
+    if (!check_content(&fs, inode, payload, 3 * block_size) || !check_content(&fs, chain, payload, 100)) {
+        status = false;
+        printf("[BAD] 8 test_truncate\n");
+    }
+    minifs_close(&fs);
+    unlink(TEST_IMAGE);
+    free(result);
+    free(zeros);
+    free(payload);
+
+    if (status) {
+        printf("[OK] test_truncate\n");
+    } else {
+        printf("[BAD] test_truncate\n");
+    }
+
+    return status;
+}
+
+
+// superblock stored in image tables, not touched by journal replay
+DiskSuperBlock read_stored_superblock() {
+    DiskSuperBlock sblock;
+    int fd = open(TEST_IMAGE, O_RDONLY);
+    pread(fd, &sblock, sizeof(sblock), 0);
+    close(fd);
+    return sblock;
+}
+
+
+// runs updates in child process which dies without close,
+// returns false if updates failed or child did not exit normally
+bool run_crashed(bool (*updates)(Filesystem*), bool journal) {
+    fflush(stdout);  // child would print pending output again
+    pid_t child = fork();
+    if (child == 0) {
+        Filesystem fs = minifs_open(TEST_IMAGE);
+        if (journal) {
+            minifs_enable_journal(&fs);
+        }
+        bool result = updates(&fs);
+        fflush(stdout);  // _exit drops buffered output
+        _exit(result ? 0 : 1);
+    }
+    int child_status;
+    return waitpid(child, &child_status, 0) == child && WIFEXITED(child_status) && WEXITSTATUS(child_status) == 0;
+}
+
+
+bool committed_files(Filesystem *fs) {
+    unsigned char payload[5000];
+    memset(payload, 'j', sizeof(payload));
+    touch_file(fs, "a");
+    touch_file(fs, "b");
+    append_file(fs, find_entry(fs, "a"), payload, sizeof(payload));
+    minifs_commit(fs);
+    touch_file(fs, "lost");  // logged, never committed
+    return true;
+}
+
+
+bool two_commits(Filesystem *fs) {
+    touch_file(fs, "x");
+    minifs_commit(fs);
+    touch_file(fs, "y");
+    minifs_commit(fs);
+    return true;
+}
+
+
+bool long_log(Filesystem *fs) {
+    fs->delayed_limit = 0;  // every append is logged
+    touch_file(fs, "log");
+    int32_t inode = find_entry(fs, "log");
+    for (int index = 0; index < 20000; ++index) {
+        unsigned char byte = index % 251;
+        append_file(fs, inode, &byte, 1);
+    }
+    minifs_commit(fs);
+    if (fs->journal->checkpoints == 0) {
+        printf("[BAD] log was never checkpointed\n");
+        return false;
+    }
+    return true;
+}
+
+
+bool idle_update(Filesystem *fs) {
+    fs->journal->commit_interval = 20 * 1000000ull;
+    touch_file(fs, "idle");
+    minifs_commit(fs);
+    touch_file(fs, "timed");  // nothing comes after it, timer commits it
+    usleep(200 * 1000);
+    return fs->journal->committed == fs->journal->sequence;
+}
+
+
+bool unjournaled_file(Filesystem *fs) {
+    unsigned char payload[3000];
+    memset(payload, 'u', sizeof(payload));
+    fs->delayed_limit = 0;  // data takes blocks, file gets extent root
+    touch_file(fs, "plain");
+    append_file(fs, find_entry(fs, "plain"), payload, sizeof(payload));
+    return true;
+}
+
+
+bool consistent(Filesystem *fs) {
+    return bitmap_count(&fs->inode_bitmap) == fs->sblock.used_inode_count &&
+           bitmap_count(&fs->block_bitmap) == fs->sblock.used_block_count;
+}
+
+
+bool test_journal() {
+    bool status = true;
+
+    // committed updates are in log only, replay brings them to tables
+    Filesystem fs = open_clean_image();
+    minifs_close(&fs);
+    bool crashed = run_crashed(committed_files, true);
+    if (!crashed || read_stored_superblock().used_inode_count != 1) {
+        status = false;
+        printf("[BAD] 1 test_journal\n");
+    }
+    fs = minifs_open(TEST_IMAGE);
+    unsigned char payload[5000];
+    memset(payload, 'j', sizeof(payload));
+    int32_t a = find_entry(&fs, "a");
+    if (a < 0 || find_entry(&fs, "b") < 0 || find_entry(&fs, "lost") >= 0 ||
+        !check_content(&fs, a, payload, sizeof(payload)) || !consistent(&fs) ||
+        fs.sblock.used_inode_count != 3) {
+        status = false;
+        printf("[BAD] 2 test_journal\n");
+    }
+    minifs_close(&fs);
+    if (read_stored_superblock().used_inode_count != 3) {
+        status = false;
+        printf("[BAD] 3 test_journal\n");
+    }
+
+    // torn transaction ends log
+    fs = open_clean_image();
+    uint64_t log = minifs_journal_offset(&fs) + sizeof(JournalHeader);
+    minifs_close(&fs);
+    crashed = run_crashed(two_commits, true);
+    int fd = open(TEST_IMAGE, O_RDWR);
+    JournalTxn txn;
+    pread(fd, &txn, sizeof(txn), log);
+    uint32_t second = log + sizeof(txn) + txn.size;
+    pread(fd, &txn, sizeof(txn), second);
+    unsigned char byte;
+    pread(fd, &byte, 1, second + sizeof(txn) + txn.size - 1);
+    byte ^= 0xFF;
+    pwrite(fd, &byte, 1, second + sizeof(txn) + txn.size - 1);
+    close(fd);
+    fs = minifs_open(TEST_IMAGE);
+    if (!crashed || find_entry(&fs, "x") < 0 || find_entry(&fs, "y") >= 0 || !consistent(&fs)) {
+        status = false;
+        printf("[BAD] 4 test_journal\n");
+    }
+    minifs_close(&fs);
+
+    // log longer than region is checkpointed on the way
+    fs = open_clean_image();
+    minifs_close(&fs);
+    crashed = run_crashed(long_log, true);
+    uint64_t reads = minifs_io_stats.reads;
+    fs = minifs_open(TEST_IMAGE);
+    reads = minifs_io_stats.reads - reads;
+    unsigned char expected[20000];
+    for (int index = 0; index < 20000; ++index) {
+        expected[index] = index % 251;
+    }
+    int32_t inode = find_entry(&fs, "log");
+    if (!crashed || inode < 0 || !check_content(&fs, inode, expected, sizeof(expected)) || !consistent(&fs)) {
+        status = false;
+        printf("[BAD] 5 test_journal\n");
+    }
+    minifs_close(&fs);
+
+    // replay reads only log tail: tables, header and first chunk of stale log
+    uint64_t clean = minifs_io_stats.reads;
+    fs = minifs_open(TEST_IMAGE);
+    clean = minifs_io_stats.reads - clean;
+    minifs_close(&fs);
+    if (reads > clean + JOURNAL_SIZE / JOURNAL_READ_SIZE || clean > 7) {
+        status = false;
+        printf("[BAD] 6 test_journal\n");
+    }
+
+    // last update before idle time is committed by timer
+    fs = open_clean_image();
+    minifs_close(&fs);
+    crashed = run_crashed(idle_update, true);
+    fs = minifs_open(TEST_IMAGE);
+    if (!crashed || find_entry(&fs, "idle") < 0 || find_entry(&fs, "timed") < 0 || !consistent(&fs)) {
+        status = false;
+        printf("[BAD] 7 test_journal\n");
+    }
+    minifs_close(&fs);
+
+    // without journal every update leaves its entries and extent nodes in image
+    fs = open_clean_image();
+    minifs_close(&fs);
+    crashed = run_crashed(unjournaled_file, false);
+    fs = minifs_open(TEST_IMAGE);
+    unsigned char plain[3000];
+    memset(plain, 'u', sizeof(plain));
+    inode = find_entry(&fs, "plain");
+    if (!crashed || inode < 0 || !check_content(&fs, inode, plain, sizeof(plain)) || !consistent(&fs)) {
+        status = false;
+        printf("[BAD] 8 test_journal\n");
+    }
+    minifs_close(&fs);
+    unlink(TEST_IMAGE);
+
+    if (status) {
+        printf("[OK] test_journal\n");
+    } else {
+        printf("[BAD] test_journal\n");
+    }
+
+    return status;
+}
+
+
+#define COMMIT_THREADS 4
+#define COMMIT_FILES 25
+
+
+void *commit_worker(void *arg) {
+    Filesystem *fs = (Filesystem*) arg;
+    static int next_id = 0;
+    int id = __atomic_fetch_add(&next_id, 1, __ATOMIC_RELAXED);
+    char name[MAX_FILENAME_SIZE];
+    for (int file = 0; file < COMMIT_FILES; ++file) {
+        snprintf(name, sizeof(name), "t%d_%d", id, file);
+        touch_file(fs, name);
+        minifs_commit(fs);
+    }
+    return NULL;
+}
+
+
+bool test_group_commit() {
+    bool status = true;
+    Filesystem fs = open_clean_image();
+    minifs_enable_journal(&fs);
+
+    // updates logged before commit share its fdatasync
+    uint64_t syncs = minifs_io_stats.syncs;
+    touch_file(&fs, "first");
+    touch_file(&fs, "second");
+    touch_file(&fs, "third");
+    minifs_commit(&fs);
+    if (minifs_io_stats.syncs - syncs != 1 || fs.journal->transactions != 3 || fs.journal->commits != 1) {
+        status = false;
+        printf("[BAD] 1 test_group_commit\n");
+    }
+
+    // every thread waits for its updates, commits are shared
+    uint64_t transactions = fs.journal->transactions;
+    uint64_t commits = fs.journal->commits;
+    syncs = minifs_io_stats.syncs;
+    pthread_t threads[COMMIT_THREADS];
+    for (int index = 0; index < COMMIT_THREADS; ++index) {
+        pthread_create(&threads[index], NULL, commit_worker, &fs);
+    }
+    for (int index = 0; index < COMMIT_THREADS; ++index) {
+        pthread_join(threads[index], NULL);
+    }
+    syncs = minifs_io_stats.syncs - syncs;
+    transactions = fs.journal->transactions - transactions;
+    commits = fs.journal->commits - commits;
+    if (transactions == 0 || commits > transactions || commits != syncs) {
+        status = false;
+        printf("[BAD] 2 test_group_commit\n");
+    }
+    minifs_close(&fs);
+
+    fs = minifs_open(TEST_IMAGE);
+    char name[MAX_FILENAME_SIZE];
+    for (int id = 0; id < COMMIT_THREADS; ++id) {
+        for (int file = 0; file < COMMIT_FILES; ++file) {
+            snprintf(name, sizeof(name), "t%d_%d", id, file);
+            status &= minifs_resolve(&fs, name) >= 0;
+        }
+    }
+    if (!status || !consistent(&fs)) {
+        status = false;
+        printf("[BAD] 3 test_group_commit\n");
+    }
+    minifs_close(&fs);
+    unlink(TEST_IMAGE);
+
+    if (status) {
+        printf("[OK] test_group_commit\n");
+    } else {
+        printf("[BAD] test_group_commit\n");
+    }
+
+    return status;
+}
+
+
+// update which dirties more entries than journal region holds
+bool huge_append(Filesystem *fs) {
+    uint32_t size = 70000 * MIN_BLOCK_SIZE;
+    unsigned char *payload = (unsigned char*) malloc(size);
+    memset(payload, 'h', size);
+    touch_file(fs, "huge");
+    append_file(fs, find_entry(fs, "huge"), payload, size);
+    free(payload);
+    return true;
+}
+
+
+// image of older minifs: in-memory superblock with pointers, tables, no bitmaps
+void write_legacy_image(uint32_t count) {
+    uint32_t header[10] = {count, count, 1, 1, DEFAULT_BLOCK_SIZE};
+    Inode *inodes = (Inode*) calloc(count, sizeof(Inode));
+    Block *blocks = (Block*) calloc(count, sizeof(Block));
+    inodes[0].type = MINIFS_INODE_DIRECTORY;
+    blocks[0].next_block = -1;
+    blocks[0].type = MINIFS_BLOCK_USED;
+
+    unlink(TEST_IMAGE);
+    int fd = open(TEST_IMAGE, O_CREAT | O_RDWR, S_IRUSR | S_IWUSR);
+    write(fd, header, sizeof(header));
+    write(fd, inodes, count * sizeof(Inode));
+    write(fd, blocks, count * sizeof(Block));
+    close(fd);
+    free(inodes);
+    free(blocks);
+}
+
+
+bool test_geometry() {
+    bool status = true;
+
+    // geometry out of limits creates nothing
+    Geometry wrong[] = {{64, 64, 1000}, {64, 64, 256}, {64, 64, 128 * 1024}, {0, 64, 1024}, {64, 0, 1024}};
+    for (uint32_t index = 0; index < sizeof(wrong) / sizeof(wrong[0]); ++index) {
+        unlink(TEST_IMAGE);
+        if (minifs_format(TEST_IMAGE, &wrong[index]) || check_exists(TEST_IMAGE)) {
+            status = false;
+            printf("[BAD] 1 test_geometry\n");
+        }
+    }
+
+    // small blocks, many of them: tables are sparse until used
+    Geometry small = {.inode_count = 5000, .block_count = 80000, .block_size = MIN_BLOCK_SIZE};
+    minifs_format(TEST_IMAGE, &small);
+    Filesystem fs = minifs_open(TEST_IMAGE);
+    struct stat info;
+    stat(TEST_IMAGE, &info);
+    if (fs.sblock.version != MINIFS_VERSION || fs.sblock.block_count != 80000 ||
+        fs.sblock.block_size != MIN_BLOCK_SIZE || fs.sblock.bodies % MIN_BLOCK_SIZE != 0 ||
+        info.st_size != minifs_journal_offset(&fs) + JOURNAL_SIZE || info.st_blocks * 512 > 256 * 1024) {
+        status = false;
+        printf("[BAD] 2 test_geometry\n");
+    }
+    unsigned char payload[3000];
+    for (uint32_t index = 0; index < sizeof(payload); ++index) {
+        payload[index] = index % 239;
+    }
+    for (int index = 0; index < 3000; ++index) {
+        char name[16];
+        sprintf(name, "f%d", index);
+        touch_file(&fs, name);
+    }
+    touch_file(&fs, "data");
+    append_file(&fs, find_entry(&fs, "data"), payload, sizeof(payload));
+    minifs_close(&fs);
+
+    fs = minifs_open(TEST_IMAGE);
+    int32_t data = minifs_resolve(&fs, "data");
+    if (data < 0 || !check_content(&fs, data, payload, sizeof(payload)) ||
+        minifs_resolve(&fs, "f0") < 0 || minifs_resolve(&fs, "f2999") < 0 || !consistent(&fs)) {
+        status = false;
+        printf("[BAD] 3 test_geometry\n");
+    }
+    minifs_close(&fs);
+
+    // update larger than journal region is written in place and survives crash
+    bool crashed = run_crashed(huge_append, true);
+    fs = minifs_open(TEST_IMAGE);
+    int32_t huge = minifs_resolve(&fs, "huge");
+    if (!crashed || huge < 0 || fs.sblock.inode_map[huge].size != 70000 * MIN_BLOCK_SIZE || !consistent(&fs)) {
+        status = false;
+        printf("[BAD] 4 test_geometry\n");
+    }
+    minifs_close(&fs);
+
+    // bodies of large blocks lie past 4 GB, both backends reach them
+    Geometry large = {.inode_count = 16, .block_count = 80000, .block_size = MAX_BLOCK_SIZE};
+    minifs_format(TEST_IMAGE, &large);
+    for (int backend = 0; backend < 2; ++backend) {
+        fs = minifs_open(TEST_IMAGE);
+        if (backend == 1 && !minifs_map_image(&fs)) {
+            printf("[BAD] cannot map image\n");
+            status = false;
+        }
+        uint32_t block = 79990 + backend;
+        uint32_t length = 0;
+        if (minifs_alloc_run(&fs, block, 1, &length) != block || length != 1 ||
+            minifs_block_body_offset(&fs, block) <= UINT32_MAX) {
+            status = false;
+            printf("[BAD] 5 test_geometry\n");
+        }
+        minifs_write_body(&fs, block, payload, sizeof(payload), 100);
+        minifs_sync(&fs);
+
+        unsigned char stored[sizeof(payload)];
+        int fd = open(TEST_IMAGE, O_RDONLY);
+        pread(fd, stored, sizeof(stored), minifs_block_body_offset(&fs, block) + 100);
+        close(fd);
+        if (memcmp(stored, payload, sizeof(payload)) != 0) {
+            status = false;
+            printf("[BAD] 6 test_geometry\n");
+        }
+        minifs_close(&fs);
+    }
+
+    // older image keeps its layout, header gets only new counters
+    write_legacy_image(64);
+    fs = minifs_open(TEST_IMAGE);
+    if (fs.sblock.version != 0 || minifs_inode_offset(&fs, 0) != 40) {
+        status = false;
+        printf("[BAD] 7 test_geometry\n");
+    }
+    touch_file(&fs, "old");
+    minifs_close(&fs);
+    fs = minifs_open(TEST_IMAGE);
+    if (fs.sblock.version != 0 || minifs_resolve(&fs, "old") < 0 ||
+        read_stored_superblock().used_inode_count != 2 || read_stored_superblock().magic == MINIFS_MAGIC) {
+        status = false;
+        printf("[BAD] 8 test_geometry\n");
+    }
+    minifs_close(&fs);
+    unlink(TEST_IMAGE);
+
+    if (status) {
+        printf("[OK] test_geometry\n");
+    } else {
+        printf("[BAD] test_geometry\n");
+    }
+
+    return status;
+}
+
+
+// no block of inode is guard block of grown group
+bool skips_block(Filesystem *fs, uint32_t inode, uint32_t guard) {
+    BlockIndex *index = minifs_block_index(fs, inode);
+    for (uint32_t number = 0; number < index->count; ++number) {
+        if (index->blocks[number] == guard) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+bool test_grow() {
+    bool status = true;
+    uint32_t size = 2000 * 1024;
+    unsigned char *payload = (unsigned char*) malloc(size);
+    for (uint32_t index = 0; index < size; ++index) {
+        payload[index] = (index * 7) % 253;
+    }
+
+    // image of default geometry filled by more than half
+    Filesystem fs = open_clean_image();
+    touch_file(&fs, "old");
+    int32_t old = find_entry(&fs, "old");
+    append_file(&fs, old, payload, 600 * 1024);
+    int32_t first = minifs_file_block(&fs, old, 0);
+    uint64_t body = minifs_block_body_offset(&fs, first);
+    uint64_t writes = write_count();
+    uint32_t used_blocks = fs.sblock.used_block_count;
+
+    // nothing is moved, data and tables of new group are holes
+    if (!minifs_grow(&fs, 1024, 2048) || write_count() - writes > 8) {
+        status = false;
+        printf("[BAD] 1 test_grow\n");
+    }
+    if (fs.sblock.inode_count != 2048 || fs.sblock.block_count != 3072 || fs.sblock.group_count != 2 ||
+        fs.sblock.used_block_count != used_blocks + 1 || minifs_block_body_offset(&fs, first) != body ||
+        minifs_block_body_offset(&fs, 1025) <= minifs_journal_offset(&fs) ||
+        !check_content(&fs, old, payload, 600 * 1024) || !consistent(&fs)) {
+        status = false;
+        printf("[BAD] 2 test_grow\n");
+    }
+
+    // file which does not fit first group continues in second one
+    touch_file(&fs, "big");
+    int32_t big = find_entry(&fs, "big");
+    append_file(&fs, big, payload, size);
+    if (!check_content(&fs, big, payload, size) || !skips_block(&fs, big, 1024) ||
+        minifs_file_block(&fs, big, 1999) < 1024) {
+        status = false;
+        printf("[BAD] 3 test_grow\n");
+    }
+    minifs_close(&fs);
+
+    fs = minifs_open(TEST_IMAGE);
+    old = minifs_resolve(&fs, "old");
+    big = minifs_resolve(&fs, "big");
+    if (fs.sblock.group_count != 2 || fs.sblock.block_count != 3072 || old < 0 || big < 0 ||
+        !check_content(&fs, old, payload, 600 * 1024) || !check_content(&fs, big, payload, size) ||
+        !consistent(&fs)) {
+        status = false;
+        printf("[BAD] 4 test_grow\n");
+    }
+
+    // mapped image with journal grows too, inodes are not required
+    if (!minifs_map_image(&fs)) {
+        status = false;
+        printf("[BAD] cannot map image\n");
+    }
+    minifs_enable_journal(&fs);
+    touch_file(&fs, "third");
+    if (!minifs_grow(&fs, 0, 512) || fs.image == NULL || fs.sblock.inode_count != 2048 ||
+        fs.sblock.group_count != 3) {
+        status = false;
+        printf("[BAD] 5 test_grow\n");
+    }
+    int32_t third = find_entry(&fs, "third");
+    append_file(&fs, third, payload, 500 * 1024);
+    if (!check_content(&fs, third, payload, 500 * 1024) || !skips_block(&fs, third, 3072)) {
+        status = false;
+        printf("[BAD] 6 test_grow\n");
+    }
+    minifs_close(&fs);
+
+    fs = minifs_open(TEST_IMAGE);
+    third = minifs_resolve(&fs, "third");
+    if (fs.sblock.group_count != 3 || third < 0 || !check_content(&fs, third, payload, 500 * 1024) ||
+        !check_content(&fs, minifs_resolve(&fs, "big"), payload, size) || !consistent(&fs)) {
+        status = false;
+        printf("[BAD] 7 test_grow\n");
+    }
+
+    // nothing to add
+    if (minifs_grow(&fs, 0, 0)) {
+        status = false;
+        printf("[BAD] 8 test_grow\n");
+    }
+    minifs_close(&fs);
+
+    // older image has no room for group table
+    write_legacy_image(64);
+    fs = minifs_open(TEST_IMAGE);
+    if (minifs_grow(&fs, 64, 64) || fs.sblock.block_count != 64) {
+        status = false;
+        printf("[BAD] 9 test_grow\n");
+    }
+    minifs_close(&fs);
+    unlink(TEST_IMAGE);
+    free(payload);
+
+    if (status) {
+        printf("[OK] test_grow\n");
+    } else {
+        printf("[BAD] test_grow\n");
+    }
+
+    return status;
+}
+
+
+bool test_dir_reuse() {
+    bool status = true;
+    Filesystem fs = open_clean_image();
+    uint32_t per_block = fs.sblock.block_size / sizeof(DirEntry);
+    char name[MAX_FILENAME_SIZE];
+
+    // churn of temporary files takes the same slots again
+    for (uint32_t index = 0; index < 10; ++index) {
+        snprintf(name, sizeof(name), "keep%u", index);
+        touch_file(&fs, name);
+    }
+    for (uint32_t round = 0; round < 500; ++round) {
+        snprintf(name, sizeof(name), "tmp%u", round);
+        touch_file(&fs, name);
+        remove_file(&fs, name);
+    }
+    if (fs.sblock.inode_map[0].size != 11) {
+        status = false;
+        printf("[BAD] 1 test_dir_reuse\n");
+    }
+
+    // hole in the middle is filled before appending
+    remove_file(&fs, "keep3");
+    touch_file(&fs, "new");
+    int32_t position = -1;
+    if (minifs_lookup(&fs, 0, "new", &position) < 0 || position != 3 ||
+        fs.sblock.inode_map[0].size != 11) {
+        status = false;
+        printf("[BAD] 2 test_dir_reuse\n");
+    }
+
+    // mass removal from indexed directory shrinks it and frees blocks
+    uint32_t used_blocks = fs.sblock.used_block_count;
+    for (uint32_t index = 0; index < 600; ++index) {
+        snprintf(name, sizeof(name), "file%u", index);
+        touch_file(&fs, name);
+    }
+    for (uint32_t index = 0; index < 600; ++index) {
+        if (index % 50 != 0) {
+            snprintf(name, sizeof(name), "file%u", index);
+            remove_file(&fs, name);
+        }
+    }
+    uint32_t size = fs.sblock.inode_map[0].size;
+    if (size > 2 * (22 + per_block) || fs.sblock.used_block_count > used_blocks + 12 + 4) {
+        status = false;
+        printf("[BAD] 3 test_dir_reuse\n");
+    }
+
+    // moved entries are found by name and by listing, also after reopen
+    minifs_close(&fs);
+    fs = minifs_open(TEST_IMAGE);
+    for (uint32_t index = 0; index < 600; ++index) {
+        snprintf(name, sizeof(name), "file%u", index);
+        int32_t inode = minifs_lookup(&fs, 0, name, NULL);
+        if ((index % 50 == 0) != (inode >= 0) || (inode >= 0 && inode != find_entry(&fs, name))) {
+            status = false;
+            printf("[BAD] 4 test_dir_reuse\n");
+            break;
+        }
+    }
+    if (iterate_dir(&fs, 0, true) != 22 || !consistent(&fs)) {
+        status = false;
+        printf("[BAD] 5 test_dir_reuse\n");
+    }
+
+    // explicit compaction of linear directory
+    const char *mkdir[] = {"mkdir", "sub"};
+    minifs_mkdir(&fs, mkdir, 2);
+    uint32_t sub = minifs_lookup(&fs, 0, "sub", NULL);
+    for (uint32_t index = 0; index < 20; ++index) {
+        snprintf(name, sizeof(name), "inner%u", index);
+        minifs_add_to_dir(&fs, sub, name, 0);
+    }
+    for (uint32_t index = 0; index < 20; index += 2) {
+        snprintf(name, sizeof(name), "inner%u", index);
+        minifs_lookup(&fs, sub, name, &position);
+        minifs_remove_from_dir(&fs, sub, position);
+    }
+    minifs_compact_dir(&fs, sub);
+    if (fs.sblock.inode_map[sub].size != 10 || iterate_dir(&fs, sub, true) != 10 ||
+        minifs_lookup(&fs, sub, "inner19", NULL) != 0 || minifs_lookup(&fs, sub, "inner18", NULL) >= 0) {
+        status = false;
+        printf("[BAD] 6 test_dir_reuse\n");
+    }
+    minifs_close(&fs);
+    unlink(TEST_IMAGE);
+
+    if (status) {
+        printf("[OK] test_dir_reuse\n");
+    } else {
+        printf("[BAD] test_dir_reuse\n");
+    }
+
+    return status;
+}
+
+
+bool inline_files(Filesystem *fs) {
+    touch_file(fs, "small");
+    minifs_file_pwrite(fs, find_entry(fs, "small"), "journaled", 9, 0);
+    minifs_update_superblock(fs);
+    minifs_commit(fs);
+    return true;
+}
+
+
+bool test_inline() {
+    bool status = true;
+    Geometry geometry = {.inode_count = 64, .block_count = 256, .block_size = 1024, .inode_size = 128};
+    Geometry wrong = geometry;
+    wrong.inode_size = 100;
+    unlink(TEST_IMAGE);
+    if (minifs_format(TEST_IMAGE, &wrong) || !minifs_format(TEST_IMAGE, &geometry)) {
+        status = false;
+        printf("[BAD] 1 test_inline\n");
+    }
+
+    // tiny file takes no blocks and is read without io
+    Filesystem fs = minifs_open(TEST_IMAGE);
+    uint32_t capacity = minifs_inline_capacity(&fs);
+    uint32_t used_blocks = fs.sblock.used_block_count;
+    touch_file(&fs, "config");
+    int32_t inode = find_entry(&fs, "config");
+    const char *text = "key=value\n";
+    minifs_file_pwrite(&fs, inode, text, strlen(text), 0);
+    minifs_file_pwrite(&fs, inode, "!", 1, 20);  // gap reads as zeros
+    uint64_t reads = minifs_io_stats.reads;
+    unsigned char expected[21] = {0};
+    memcpy(expected, text, strlen(text));
+    expected[20] = '!';
+    char range[5];
+    if (capacity != 112 || fs.sblock.used_block_count != used_blocks ||
+        !(fs.sblock.inode_map[inode].flags & MINIFS_INODE_INLINE) || !check_content(&fs, inode, expected, 21) ||
+        minifs_file_pread(&fs, inode, range, 5, 4) != 5 || memcmp(range, "value", 5) != 0 ||
+        minifs_io_stats.reads != reads) {
+        status = false;
+        printf("[BAD] 2 test_inline\n");
+    }
+
+    // truncate keeps area past end zero
+    minifs_truncate(&fs, inode, 3);
+    minifs_truncate(&fs, inode, 8);
+    unsigned char cut[8] = {'k', 'e', 'y', 0, 0, 0, 0, 0};
+    if (!check_content(&fs, inode, cut, 8) || fs.sblock.used_block_count != used_blocks) {
+        status = false;
+        printf("[BAD] 3 test_inline\n");
+    }
+
+    // file which outgrows inline area moves to blocks
+    touch_file(&fs, "growing");
+    int32_t growing = find_entry(&fs, "growing");
+    unsigned char payload[3000];
+    for (uint32_t index = 0; index < sizeof(payload); ++index) {
+        payload[index] = index % 253;
+    }
+    append_file(&fs, growing, payload, 100);
+    append_file(&fs, growing, payload + 100, sizeof(payload) - 100);
+    if ((fs.sblock.inode_map[growing].flags & MINIFS_INODE_INLINE) ||
+        !(fs.sblock.inode_map[growing].flags & MINIFS_INODE_EXTENTS) ||
+        !check_content(&fs, growing, payload, sizeof(payload)) || minifs_inline_data(&fs, growing)[0] != 0) {
+        status = false;
+        printf("[BAD] 4 test_inline\n");
+    }
+
+    // inline data survives reopen, also in inodes of grown group
+    minifs_close(&fs);
+    fs = minifs_open(TEST_IMAGE);
+    minifs_grow(&fs, 64, 0);
+    char name[MAX_FILENAME_SIZE];
+    for (uint32_t index = 0; index < 80; ++index) {
+        snprintf(name, sizeof(name), "f%u", index);
+        touch_file(&fs, name);
+        minifs_file_pwrite(&fs, find_entry(&fs, name), name, strlen(name), 0);
+    }
+    minifs_close(&fs);
+    fs = minifs_open(TEST_IMAGE);
+    if (!check_content(&fs, find_entry(&fs, "config"), cut, 8) ||
+        !check_content(&fs, find_entry(&fs, "growing"), payload, sizeof(payload))) {
+        status = false;
+        printf("[BAD] 5 test_inline\n");
+    }
+    for (uint32_t index = 0; index < 80; ++index) {
+        snprintf(name, sizeof(name), "f%u", index);
+        if (!check_content(&fs, find_entry(&fs, name), (unsigned char*) name, strlen(name))) {
+            status = false;
+            printf("[BAD] 6 test_inline\n");
+            break;
+        }
+    }
+    if (!consistent(&fs)) {
+        status = false;
+        printf("[BAD] 7 test_inline\n");
+    }
+    minifs_close(&fs);
+
+    // committed inline data is replayed from journal
+    minifs_format(TEST_IMAGE, &geometry);
+    bool crashed = run_crashed(inline_files, true);
+    fs = minifs_open(TEST_IMAGE);
+    if (!crashed || !check_content(&fs, find_entry(&fs, "small"), (unsigned char*) "journaled", 9)) {
+        status = false;
+        printf("[BAD] 8 test_inline\n");
+    }
+
+    // imported tiny file stays inline
+    used_blocks = fs.sblock.used_block_count;
+    write_host_file((const unsigned char*) "imported data", 13);
+    const char *args[] = {"import", TEST_HOST_FILE, "imported"};
+    minifs_import(&fs, args, 3);
+    inode = find_entry(&fs, "imported");
+    if (inode < 0 || !(fs.sblock.inode_map[inode].flags & MINIFS_INODE_INLINE) ||
+        fs.sblock.used_block_count != used_blocks ||
+        !check_content(&fs, inode, (const unsigned char*) "imported data", 13)) {
+        status = false;
+        printf("[BAD] 9 test_inline\n");
+    }
+    minifs_close(&fs);
+    unlink(TEST_HOST_FILE);
+    unlink(TEST_IMAGE);
+
+    if (status) {
+        printf("[OK] test_inline\n");
+    } else {
+        printf("[BAD] test_inline\n");
+    }
+
+    return status;
+}
+
+
+bool test_locality() {
+    bool status = true;
+    Filesystem fs = open_clean_image();
+    uint32_t block_size = fs.sblock.block_size;
+    unsigned char *payload = (unsigned char*) malloc(64 * block_size);
+    for (uint32_t index = 0; index < 64 * block_size; ++index) {
+        payload[index] = (index * 13) % 247;
+    }
+
+    // interleaved appends of several files still give long runs
+    const uint32_t files = 4, rounds = 64;
+    char name[MAX_FILENAME_SIZE];
+    int32_t inodes[4];
+    for (uint32_t file = 0; file < files; ++file) {
+        snprintf(name, sizeof(name), "stream%u", file);
+        touch_file(&fs, name);
+        inodes[file] = find_entry(&fs, name);
+    }
+    for (uint32_t round = 0; round < rounds; ++round) {
+        for (uint32_t file = 0; file < files; ++file) {
+            append_file(&fs, inodes[file], payload + round * block_size, block_size);
+        }
+    }
+    for (uint32_t file = 0; file < files; ++file) {
+        if (minifs_file_fragments(&fs, inodes[file]) > rounds / PREALLOC_BLOCKS + 2 ||
+            !check_content(&fs, inodes[file], payload, rounds * block_size)) {
+            status = false;
+            printf("[BAD] 1 test_locality\n");
+            break;
+        }
+    }
+
+    // block chain grows after its tail too
+    int32_t chain = minifs_create_inode(&fs, MINIFS_INODE_FILE, 0, fs.current_dir);
+    for (uint32_t round = 0; round < 32; ++round) {
+        append_file(&fs, chain, payload + round * block_size, block_size);
+        append_file(&fs, inodes[0], payload, block_size);
+    }
+    if (minifs_file_fragments(&fs, chain) > 32 / PREALLOC_BLOCKS + 2 ||
+        !check_content(&fs, chain, payload, 32 * block_size)) {
+        status = false;
+        printf("[BAD] 2 test_locality\n");
+    }
+
+    // removed file gives its window back
+    remove_file(&fs, "stream1");
+    if (fs.prealloc[inodes[1]].length != 0 || !consistent(&fs)) {
+        status = false;
+        printf("[BAD] 3 test_locality\n");
+    }
+
+    // windows give way when free blocks run out, image fills completely
+    int32_t filler = minifs_create_inode(&fs, MINIFS_INODE_FILE, 0, fs.current_dir);
+    fs.delayed_limit = 0;  // every append takes its block at once
+    while (fs.sblock.used_block_count < fs.sblock.block_count) {
+        append_file(&fs, filler, payload, block_size);
+    }
+    if (bitmap_count(&fs.reserved) != 0 || !consistent(&fs)) {
+        status = false;
+        printf("[BAD] 4 test_locality\n");
+    }
+    minifs_close(&fs);
+
+    fs = minifs_open(TEST_IMAGE);
+    if (!consistent(&fs) || fs.sblock.used_block_count != fs.sblock.block_count ||
+        !check_content(&fs, inodes[2], payload, rounds * block_size)) {
+        status = false;
+        printf("[BAD] 5 test_locality\n");
+    }
+    minifs_close(&fs);
+    unlink(TEST_IMAGE);
+    free(payload);
+
+    if (status) {
+        printf("[OK] test_locality\n");
+    } else {
+        printf("[BAD] test_locality\n");
+    }
+
+    return status;
+}
+
+
+bool delayed_appends(Filesystem *fs) {
+    touch_file(fs, "log");
+    minifs_commit(fs);
+    int32_t inode = find_entry(fs, "log");
+    for (uint32_t index = 0; index < 10; ++index) {
+        append_file(fs, inode, (const unsigned char*) "line of log\n", 12);
+    }
+    journal_commit(fs);  // appends are still in memory
+    return true;
+}
+
+
+bool test_delayed() {
+    bool status = true;
+    Filesystem fs = open_clean_image();
+    uint32_t block_size = fs.sblock.block_size;
+    unsigned char payload[10000];
+    for (int index = 0; index < sizeof(payload); ++index) {
+        payload[index] = (index * 17) % 239;
+    }
+
+    // small appends take no blocks until file is read, then take one run
+    touch_file(&fs, "file");
+    int32_t inode = find_entry(&fs, "file");
+    uint32_t used_blocks = fs.sblock.used_block_count;
+    uint64_t writes = write_count();
+    for (uint32_t offset = 0; offset < sizeof(payload); offset += 50) {
+        append_file(&fs, inode, payload + offset, 50);
+    }
+    // statistics see only blocks file has, so they do not flush it
+    if (minifs_file_fragments(&fs, inode) != 0 || minifs_file_blocks(&fs, inode) != 0 ||
+        minifs_stored_size(&fs, inode) != 0 ||
+        fs.sblock.used_block_count != used_blocks || write_count() - writes > 200 ||
+        minifs_free_block_count(&fs) >= fs.sblock.block_count - used_blocks) {
+        status = false;
+        printf("[BAD] 1 test_delayed\n");
+    }
+    if (!check_content(&fs, inode, payload, sizeof(payload)) || minifs_file_fragments(&fs, inode) != 1 ||
+        fs.sblock.used_block_count != used_blocks + (sizeof(payload) + block_size - 1) / block_size ||
+        minifs_free_block_count(&fs) != fs.sblock.block_count - fs.sblock.used_block_count) {
+        status = false;
+        printf("[BAD] 2 test_delayed\n");
+    }
+
+    // write inside delayed tail sees appended bytes
+    append_file(&fs, inode, payload, 100);
+    minifs_file_pwrite(&fs, inode, "xyz", 3, sizeof(payload) + 10);
+    unsigned char expected[sizeof(payload) + 100];
+    memcpy(expected, payload, sizeof(payload));
+    memcpy(expected + sizeof(payload), payload, 100);
+    memcpy(expected + sizeof(payload) + 10, "xyz", 3);
+    if (!check_content(&fs, inode, expected, sizeof(expected))) {
+        status = false;
+        printf("[BAD] 3 test_delayed\n");
+    }
+
+    // removed file drops its delayed appends and promised blocks
+    touch_file(&fs, "temp");
+    append_file(&fs, find_entry(&fs, "temp"), payload, 5000);
+    remove_file(&fs, "temp");
+    if (fs.delayed_blocks != 0 || !consistent(&fs)) {
+        status = false;
+        printf("[BAD] 4 test_delayed\n");
+    }
+
+    // appends reach image on close
+    append_file(&fs, inode, payload, 100);
+    minifs_close(&fs);
+    fs = minifs_open(TEST_IMAGE);
+    unsigned char longer[sizeof(expected) + 100];
+    memcpy(longer, expected, sizeof(expected));
+    memcpy(longer + sizeof(expected), payload, 100);
+    if (!check_content(&fs, find_entry(&fs, "file"), longer, sizeof(longer)) || !consistent(&fs)) {
+        status = false;
+        printf("[BAD] 5 test_delayed\n");
+    }
+    minifs_close(&fs);
+
+    // entry on disk keeps size of data which has blocks
+    bool crashed = run_crashed(delayed_appends, true);
+    fs = minifs_open(TEST_IMAGE);
+    inode = find_entry(&fs, "log");
+    if (!crashed || inode < 0 || fs.sblock.inode_map[inode].size != 0 || !consistent(&fs)) {
+        status = false;
+        printf("[BAD] 6 test_delayed\n");
+    }
+    minifs_close(&fs);
+    unlink(TEST_IMAGE);
+
+    if (status) {
+        printf("[OK] test_delayed\n");
+    } else {
+        printf("[BAD] test_delayed\n");
+    }
+
+    return status;
+}
+
+
+// writes data to file and to its model
+void write_both(Filesystem *fs, uint32_t inode, unsigned char *model, const char *data, uint32_t offset) {
+    minifs_file_pwrite(fs, inode, data, strlen(data), offset);
+    memcpy(model + offset, data, strlen(data));
+}
+
+
+bool test_sparse() {
+    bool status = true;
+    Filesystem fs = open_clean_image();
+    uint32_t block_size = fs.sblock.block_size;
+    uint32_t size = 500 * block_size + 14;
+    unsigned char *model = (unsigned char*) calloc(size, 1);
+
+    // write far past end takes only touched blocks
+    touch_file(&fs, "disk");
+    int32_t inode = find_entry(&fs, "disk");
+    uint32_t used_blocks = fs.sblock.used_block_count;
+    write_both(&fs, inode, model, "head", 0);
+    write_both(&fs, inode, model, "tail", 500 * block_size + 10);
+    if (fs.sblock.inode_map[inode].size != size || fs.sblock.used_block_count != used_blocks + 2 ||
+        !check_content(&fs, inode, model, size)) {
+        status = false;
+        printf("[BAD] 1 test_sparse\n");
+    }
+
+    // holes are read as zeros without io
+    minifs_set_cache_size(&fs, 0);
+    unsigned char *result = (unsigned char*) malloc(size);
+    memset(result, 'x', size);
+    uint64_t reads = minifs_io_stats.reads;
+    if (minifs_file_pread(&fs, inode, result, 100 * block_size, 2 * block_size) != 100 * block_size ||
+        minifs_io_stats.reads != reads || memcmp(result, model + 2 * block_size, 100 * block_size) != 0) {
+        status = false;
+        printf("[BAD] 2 test_sparse\n");
+    }
+
+    // data and holes are found like with lseek
+    if (minifs_seek_data(&fs, inode, 0) != 0 || minifs_seek_hole(&fs, inode, 0) != block_size ||
+        minifs_seek_data(&fs, inode, 3) != 3 || minifs_seek_data(&fs, inode, block_size) != 500 * block_size ||
+        minifs_seek_hole(&fs, inode, 500 * block_size) != size || minifs_seek_data(&fs, inode, size) != -1) {
+        status = false;
+        printf("[BAD] 3 test_sparse\n");
+    }
+
+    // writes inside hole fill it block by block, also in reverse order
+    used_blocks = fs.sblock.used_block_count;
+    for (int32_t number = 199; number >= 0; --number) {
+        write_both(&fs, inode, model, "z", (2 * number + 1) * block_size + 7);
+    }
+    uint32_t count;
+    Extent *extents = extent_list(&fs, inode, &count);
+    bool ordered = count == 202;
+    for (uint32_t index = 1; index < count; ++index) {
+        ordered &= extents[index].logical >= extents[index - 1].logical + extents[index - 1].length;
+    }
+    free(extents);
+    if (!ordered || fs.sblock.used_block_count < used_blocks + 200 ||
+        !check_content(&fs, inode, model, size)) {
+        status = false;
+        printf("[BAD] 4 test_sparse\n");
+    }
+
+    // cut inside hole keeps last block, extension adds only it
+    size = 450 * block_size + 7;
+    minifs_truncate(&fs, inode, size);
+    minifs_update_superblock(&fs);
+    if (!check_content(&fs, inode, model, size)) {
+        status = false;
+        printf("[BAD] 5 test_sparse\n");
+    }
+    used_blocks = fs.sblock.used_block_count;
+    minifs_truncate(&fs, inode, 900 * block_size);
+    minifs_update_superblock(&fs);
+    model = (unsigned char*) realloc(model, 900 * block_size);
+    memset(model + size, 0, 900 * block_size - size);
+    size = 900 * block_size;
+    if (fs.sblock.used_block_count != used_blocks + 1 || !check_content(&fs, inode, model, size)) {
+        status = false;
+        printf("[BAD] 6 test_sparse\n");
+    }
+
+    // export skips holes, content is the same
+    const char *args[] = {"export", "disk", TEST_HOST_FILE};
+    minifs_export(&fs, args, 3);
+    if (!check_host_file(model, size)) {
+        status = false;
+        printf("[BAD] 7 test_sparse\n");
+    }
+    minifs_close(&fs);
+
+    fs = minifs_open(TEST_IMAGE);
+    if (!check_content(&fs, inode, model, size) || !consistent(&fs)) {
+        status = false;
+        printf("[BAD] 8 test_sparse\n");
+    }
+    minifs_close(&fs);
+    unlink(TEST_HOST_FILE);
+    unlink(TEST_IMAGE);
+    free(result);
+    free(model);
+
+    if (status) {
+        printf("[OK] test_sparse\n");
+    } else {
+        printf("[BAD] test_sparse\n");
+    }
+
+    return status;
+}
+
+
+// lines of log, compressible like real text
+void fill_log(unsigned char *data, uint32_t size, uint32_t seed) {
+    uint32_t done = 0;
+    for (uint32_t line = seed; done < size; ++line) {
+        char buffer[128];
+        int length = snprintf(buffer, sizeof(buffer), "2026-10-18 12:%02u:%02u worker %u finished job %u, status ok\n",
+                              line / 60 % 60, line % 60, line % 7, line * 13);
+        uint32_t piece = (size - done < (uint32_t) length) ? size - done : (uint32_t) length;
+        memcpy(data + done, buffer, piece);
+        done += piece;
+    }
+}
+
+
+bool test_compressed() {
+    bool status = true;
+    Filesystem fs = open_clean_image();
+    fs.compress = true;
+    uint32_t used_blocks = fs.sblock.used_block_count;
+    const uint32_t capacity = 200 * 1024;
+    unsigned char *model = (unsigned char*) calloc(capacity, 1);
+    unsigned char *result = (unsigned char*) malloc(capacity);
+    fill_log(model, capacity, 0);
+
+    // delayed and immediate appends fill up last cluster, data takes
+    // a fraction of its size
+    touch_file(&fs, "log");
+    int32_t inode = find_entry(&fs, "log");
+    uint32_t size = 0;
+    for (uint32_t piece = 1; size + piece <= 60000; piece = piece * 3 % 4093 + 1) {
+        minifs_file_pwrite(&fs, inode, model + size, piece, size);
+        size += piece;
+    }
+    fs.delayed_limit = 0;
+    for (uint32_t round = 0; round < 100; ++round) {
+        minifs_file_pwrite(&fs, inode, model + size, 200, size);
+        size += 200;
+    }
+    minifs_update_superblock(&fs);
+    if (!(fs.sblock.inode_map[inode].flags & MINIFS_INODE_COMPRESSED) ||
+        fs.sblock.inode_map[inode].size != size || !check_content(&fs, inode, model, size) ||
+        minifs_stored_size(&fs, inode) > size / 3) {
+        status = false;
+        printf("[BAD] 1 test_compressed\n");
+    }
+
+    // ranges across clusters are decoded
+    if (minifs_file_pread(&fs, inode, result, 40000, 10000) != 40000 || memcmp(result, model + 10000, 40000) != 0 ||
+        minifs_file_pread(&fs, inode, result, 1000, size - 10) != 10 || memcmp(result, model + size - 10, 10) != 0) {
+        status = false;
+        printf("[BAD] 2 test_compressed\n");
+    }
+
+    // random data outgrows space of clusters, they are moved with all after them
+    uint32_t stored = minifs_stored_size(&fs, inode);
+    srand(5);
+    for (uint32_t index = 30000; index < 50000; ++index) {
+        model[index] = rand() & 0xFF;
+    }
+    minifs_file_pwrite(&fs, inode, model + 30000, 20000, 30000);
+    if (minifs_stored_size(&fs, inode) <= stored + 15000 || !check_content(&fs, inode, model, size)) {
+        status = false;
+        printf("[BAD] 3 test_compressed\n");
+    }
+
+    // text fits their space again, so they are coded in place
+    stored = minifs_stored_size(&fs, inode);
+    fill_log(model + 30000, 20000, 3);
+    minifs_file_pwrite(&fs, inode, model + 30000, 20000, 30000);
+    if (minifs_stored_size(&fs, inode) != stored || !check_content(&fs, inode, model, size)) {
+        status = false;
+        printf("[BAD] 4 test_compressed\n");
+    }
+
+    // cut in middle of cluster, extension reads as zeros
+    minifs_truncate(&fs, inode, 45000);
+    minifs_truncate(&fs, inode, 70000);
+    memset(model + 45000, 0, 25000);
+    size = 70000;
+    minifs_file_pwrite(&fs, inode, "end", 3, size);
+    memcpy(model + size, "end", 3);
+    size += 3;
+    minifs_update_superblock(&fs);
+    if (fs.sblock.inode_map[inode].size != size || !check_content(&fs, inode, model, size)) {
+        status = false;
+        printf("[BAD] 5 test_compressed\n");
+    }
+
+    // export and import decode and code data
+    const char *export_args[] = {"export", "log", TEST_HOST_FILE};
+    minifs_export(&fs, export_args, 3);
+    const char *import_args[] = {"import", TEST_HOST_FILE, "copy"};
+    minifs_import(&fs, import_args, 3);
+    int32_t copy = find_entry(&fs, "copy");
+    if (!check_host_file(model, size) || copy < 0 || !check_content(&fs, copy, model, size) ||
+        !(fs.sblock.inode_map[copy].flags & MINIFS_INODE_COMPRESSED)) {
+        status = false;
+        printf("[BAD] 6 test_compressed\n");
+    }
+    minifs_close(&fs);
+
+    // flag is kept in inode, reopened image decodes files without option
+    fs = minifs_open(TEST_IMAGE);
+    if (!check_content(&fs, inode, model, size) || !check_content(&fs, copy, model, size) || !consistent(&fs)) {
+        status = false;
+        printf("[BAD] 7 test_compressed\n");
+    }
+
+    // removed files give all blocks back
+    remove_file(&fs, "log");
+    remove_file(&fs, "copy");
+    if (fs.sblock.used_block_count != used_blocks) {
+        status = false;
+        printf("[BAD] 8 test_compressed\n");
+    }
+    minifs_close(&fs);
+    unlink(TEST_HOST_FILE);
+    unlink(TEST_IMAGE);
+    free(result);
+    free(model);
+
+    if (status) {
+        printf("[OK] test_compressed\n");
+    } else {
+        printf("[BAD] test_compressed\n");
+    }
+
+    return status;
+}
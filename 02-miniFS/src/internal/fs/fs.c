@@ -1,12 +1,83 @@
+#define _GNU_SOURCE  // copy_file_range
 #include <internal/fs/fs.h>
 #include <internal/debug/debug.h>
+#include <internal/extent/extent.h>
+#include <internal/lz/lz.h>
+#include <internal/dirhash/dirhash.h>
+#include <internal/dcache/dcache.h>
+#include <internal/bcache/bcache.h>
+#include <internal/journal/journal.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/sendfile.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <errno.h>
+
+
+// dirty entries closer than this are written together with clean
+// entries between them: one larger write is cheaper than two syscalls
+#define FLUSH_GAP 8
+
+// max iovec count accepted by single pwritev on linux
+#define FLUSH_IOV_MAX 1024
+#define TABLE_CHUNK_SIZE (1024 * 1024)  // large inodes are read by chunks of this size
+
+// header of images without versioned superblock: in-memory
+// superblock of that time, two pointers included
+#define LEGACY_SUPERBLOCK_SIZE 40
+
+
+IoStats minifs_io_stats;
+
+
+void minifs_dirty_init(DirtySet *set, uint32_t size) {
+    set->count = 0;
+    set->capacity = 16;
+    set->items = (uint32_t*) malloc(set->capacity * sizeof(uint32_t));
+    set->bits = (uint64_t*) calloc((size + 63) / 64, sizeof(uint64_t));
+}
+
+
+void minifs_dirty_free(DirtySet *set) {
+    free(set->items);
+    free(set->bits);
+}
+
+
+void minifs_dirty_add(DirtySet *set, uint32_t index) {
+    uint64_t mask = 1ull << (index % 64);
+    if (set->bits[index / 64] & mask) {
+        return;
+    }
+    set->bits[index / 64] |= mask;
+    if (set->count == set->capacity) {
+        set->capacity *= 2;
+        set->items = (uint32_t*) realloc(set->items, set->capacity * sizeof(uint32_t));
+    }
+    set->items[set->count++] = index;
+}
+
+
+void minifs_dirty_clear(DirtySet *set) {
+    for (uint32_t index = 0; index < set->count; ++index) {
+        set->bits[set->items[index] / 64] = 0;
+    }
+    set->count = 0;
+}
+
+
+static int compare_index(const void *lhs, const void *rhs) {
+    uint32_t a = *(const uint32_t*) lhs;
+    uint32_t b = *(const uint32_t*) rhs;
+    return (a > b) - (a < b);
+}
 
 
 bool check_exists(const char *filename) {
@@ -15,16 +86,160 @@ bool check_exists(const char *filename) {
     if (code == -1) {
         return false;
     }
-    if (info.st_size < sizeof(SuperBlock)) {
+    if (info.st_size < LEGACY_SUPERBLOCK_SIZE) {
         return false;
     }
     return true;
 }
 
 
+// places regions after header: tables, block bodies, bitmaps and journal
+static void plan_layout(SuperBlock *sblock, uint64_t header, bool align) {
+    uint64_t block_size = sblock->block_size;
+    sblock->inode_table = header;
+    sblock->block_table = sblock->inode_table + (uint64_t) sblock->inode_count * sblock->inode_size;
+    sblock->bodies = sblock->block_table + (uint64_t) sblock->block_count * sizeof(Block);
+    if (align) {  // bodies start at multiple of block size, as pages of mapped image
+        sblock->bodies = (sblock->bodies + block_size - 1) / block_size * block_size;
+    }
+    sblock->inode_bitmap = sblock->bodies + (uint64_t) sblock->block_count * block_size;
+    sblock->block_bitmap = sblock->inode_bitmap + bitmap_words(sblock->inode_count) * sizeof(uint64_t);
+    sblock->journal = sblock->block_bitmap + bitmap_words(sblock->block_count) * sizeof(uint64_t);
+}
+
+
+static void encode_superblock(const SuperBlock *sblock, DiskSuperBlock *disk) {
+    memset(disk, 0, sizeof(DiskSuperBlock));
+    disk->inode_count = sblock->inode_count;
+    disk->block_count = sblock->block_count;
+    disk->used_inode_count = sblock->used_inode_count;
+    disk->used_block_count = sblock->used_block_count;
+    disk->block_size = sblock->block_size;
+    disk->magic = MINIFS_MAGIC;
+    disk->version = sblock->version;
+    disk->inode_size = (sblock->version > 1) ? sblock->inode_size : 0;
+    disk->inode_table = sblock->inode_table;
+    disk->block_table = sblock->block_table;
+    disk->bodies = sblock->bodies;
+    disk->inode_bitmap = sblock->inode_bitmap;
+    disk->block_bitmap = sblock->block_bitmap;
+    disk->journal = sblock->journal;
+    disk->groups = sblock->groups;
+    disk->group_count = sblock->group_count;
+}
+
+
+// superblock without magic was written by older minifs: its header is
+// in-memory struct of that time and regions follow it without alignment
+static void decode_superblock(const DiskSuperBlock *disk, SuperBlock *sblock) {
+    memset(sblock, 0, sizeof(SuperBlock));
+    sblock->inode_count = disk->inode_count;
+    sblock->block_count = disk->block_count;
+    sblock->used_inode_count = disk->used_inode_count;
+    sblock->used_block_count = disk->used_block_count;
+    sblock->block_size = disk->block_size;
+    sblock->inode_size = sizeof(Inode);
+    if (disk->magic != MINIFS_MAGIC) {
+        plan_layout(sblock, LEGACY_SUPERBLOCK_SIZE, false);
+        return;
+    }
+    if (disk->version == 0 || disk->version > MINIFS_VERSION) {
+        debug(MINIFS_ERR "unsupported image version: %u", disk->version);
+        exit(-1);
+    }
+    sblock->version = disk->version;
+    if (disk->version > 1) {
+        sblock->inode_size = disk->inode_size;
+    }
+    sblock->inode_table = disk->inode_table;
+    sblock->block_table = disk->block_table;
+    sblock->bodies = disk->bodies;
+    sblock->inode_bitmap = disk->inode_bitmap;
+    sblock->block_bitmap = disk->block_bitmap;
+    sblock->journal = disk->journal;
+    sblock->groups = disk->groups;
+    sblock->group_count = disk->group_count;
+}
+
+
+// reads group table of grown image, image with one group has
+// its regions in superblock
+static void load_groups(int fd, SuperBlock *sblock) {
+    if (sblock->group_count > 1) {
+        uint64_t size = (uint64_t) sblock->group_count * sizeof(MetaGroup);
+        sblock->group_map = (MetaGroup*) malloc(size);
+        minifs_read_block(fd, sblock->group_map, size, sblock->groups);
+        return;
+    }
+    sblock->group_count = 1;
+    sblock->group_map = (MetaGroup*) malloc(sizeof(MetaGroup));
+    MetaGroup *group = &sblock->group_map[0];
+    group->first_inode = 0;
+    group->inode_count = sblock->inode_count;
+    group->first_block = 0;
+    group->block_count = sblock->block_count;
+    group->inode_table = sblock->inode_table;
+    group->block_table = sblock->block_table;
+    group->bodies = sblock->bodies;
+}
+
+
+// reads inode table slice of group, inline areas of large
+// inodes are split from them to their own map
+static void read_inodes(int fd, SuperBlock *sblock, const MetaGroup *group) {
+    Inode *inodes = sblock->inode_map + group->first_inode;
+    if (sblock->inline_map == NULL) {
+        minifs_read_block(fd, inodes, (uint64_t) group->inode_count * sizeof(Inode), group->inode_table);
+        return;
+    }
+
+    uint32_t inode_size = sblock->inode_size;
+    uint32_t inline_size = inode_size - sizeof(Inode);
+    uint32_t per_chunk = TABLE_CHUNK_SIZE / inode_size;
+    unsigned char *buffer = (unsigned char*) malloc(TABLE_CHUNK_SIZE);
+    for (uint32_t done = 0; done < group->inode_count; done += per_chunk) {
+        uint32_t count = (group->inode_count - done < per_chunk) ? group->inode_count - done : per_chunk;
+        minifs_read_block(fd, buffer, (uint64_t) count * inode_size, group->inode_table + (uint64_t) done * inode_size);
+        for (uint32_t index = 0; index < count; ++index) {
+            uint64_t number = group->first_inode + done + index;
+            memcpy(&inodes[done + index], buffer + index * inode_size, sizeof(Inode));
+            memcpy(sblock->inline_map + number * inline_size, buffer + index * inode_size + sizeof(Inode), inline_size);
+        }
+    }
+    free(buffer);
+}
+
+
 void minifs_init(const char *filename) {
-    int fd = open(filename, O_CREAT | O_RDWR, S_IWUSR | S_IRUSR);
+    Geometry geometry = {
+        .inode_count = DEFAULT_INODE_COUNT,
+        .block_count = DEFAULT_BLOCK_COUNT,
+        .block_size = DEFAULT_BLOCK_SIZE,
+    };
+    if (!minifs_format(filename, &geometry)) {
+        exit(-1);
+    }
+}
+
+
+bool minifs_format(const char *filename, const Geometry *geometry) {
+    uint32_t block_size = geometry->block_size;
+    if (block_size < MIN_BLOCK_SIZE || block_size > MAX_BLOCK_SIZE || (block_size & (block_size - 1)) != 0) {
+        debug(MINIFS_ERR "block size must be power of two from %u to %u", MIN_BLOCK_SIZE, MAX_BLOCK_SIZE);
+        return false;
+    }
+    if (geometry->inode_count == 0 || geometry->inode_count > MAX_OBJECT_COUNT ||
+        geometry->block_count == 0 || geometry->block_count > MAX_OBJECT_COUNT) {
+        debug(MINIFS_ERR "inode and block counts must be from 1 to %u", MAX_OBJECT_COUNT);
+        return false;
+    }
+    uint32_t inode_size = (geometry->inode_size > 0) ? geometry->inode_size : sizeof(Inode);
+    if (inode_size < sizeof(Inode) || inode_size > MAX_INODE_SIZE || (inode_size & (inode_size - 1)) != 0) {
+        debug(MINIFS_ERR "inode size must be power of two from %lu to %u", sizeof(Inode), MAX_INODE_SIZE);
+        return false;
+    }
 
+    int fd = open(filename, O_CREAT | O_TRUNC | O_RDWR, S_IWUSR | S_IRUSR);
     if (fd < 0) {
         debug(MINIFS_ERR "error while opening file: %s", filename);
         exit(-1);
@@ -33,39 +248,146 @@ void minifs_init(const char *filename) {
     // init superblock
 
     struct SuperBlock sblock = {
-        .inode_count = DEFAULT_INODE_COUNT,
-        .block_count = DEFAULT_BLOCK_COUNT,
-        .used_inode_count = 0,
-        .used_block_count = 0,
-        .block_size = DEFAULT_BLOCK_SIZE,
+        .inode_count = geometry->inode_count,
+        .block_count = geometry->block_count,
+        .used_inode_count = 1,  // root dir
+        .used_block_count = 1,
+        .block_size = block_size,
+        .version = MINIFS_VERSION,
+        .inode_size = inode_size,
+        .group_count = 1,
     };
+    plan_layout(&sblock, sizeof(DiskSuperBlock), true);
+
+    // image gets its full size at once, regions of zeros are holes:
+    // empty entries of tables and clear bitmap bits are zero on disk
+    if (ftruncate(fd, sblock.journal + JOURNAL_SIZE) < 0) {
+        debug(MINIFS_ERR "cannot extend image to %lu bytes", sblock.journal + JOURNAL_SIZE);
+        close(fd);
+        unlink(filename);
+        return false;
+    }
 
-    Inode *inodes = (Inode*) malloc(sizeof(Inode) * DEFAULT_INODE_COUNT);
-    memset(inodes, 0, DEFAULT_INODE_COUNT * sizeof(Inode));
+    // init root dir
 
-    Block *blocks = (Block*) malloc(sizeof(Block) * DEFAULT_BLOCK_COUNT);
-    memset(blocks, 0, DEFAULT_BLOCK_COUNT * sizeof(Block));
+    Inode root = {
+        .size = 0,
+        .root_block = 0,
+        .parent = 0,
+        .type = MINIFS_INODE_DIRECTORY,
+    };
+    Block root_block = {
+        .next_block = -1,
+        .size = 0,
+        .type = MINIFS_BLOCK_USED,
+    };
 
-    // init root dir
+    // write changes, bitmaps get root dir inode and block taken
 
-    inodes[0].root_block = 0;
-    inodes[0].size = 0;
-    inodes[0].type = MINIFS_INODE_DIRECTORY;
-    inodes[0].parent = 0;
+    DiskSuperBlock disk;
+    encode_superblock(&sblock, &disk);
+    uint64_t taken = 1;
+    minifs_write_block(fd, &disk, sizeof(disk), 0);
+    minifs_write_block(fd, &root, sizeof(root), sblock.inode_table);
+    minifs_write_block(fd, &root_block, sizeof(root_block), sblock.block_table);
+    minifs_write_block(fd, &taken, sizeof(taken), sblock.inode_bitmap);
+    minifs_write_block(fd, &taken, sizeof(taken), sblock.block_bitmap);
 
-    blocks[0].next_block = -1;
-    blocks[0].size = 0;
-    blocks[0].type = MINIFS_BLOCK_USED;
+    close(fd);
+    return true;
+}
 
-    // write changes
 
-    minifs_write_block(fd, (void*) &sblock, sizeof(struct SuperBlock), 0);
-    minifs_write_block(fd, inodes, DEFAULT_INODE_COUNT * sizeof(Inode), sizeof(SuperBlock));
-    minifs_write_block(fd, blocks, DEFAULT_BLOCK_SIZE * sizeof(Block), sizeof(SuperBlock) + DEFAULT_INODE_COUNT * sizeof(Inode));
-    free(inodes);
-    free(blocks);
+// reads allocation bitmaps or rebuilds them from inode/block maps
+// if image has no valid bitmaps (created by older minifs or torn flush)
+static void load_bitmaps(Filesystem *fs) {
+    SuperBlock *sblock = &fs->sblock;
+    bitmap_init(&fs->inode_bitmap, sblock->inode_count);
+    bitmap_init(&fs->block_bitmap, sblock->block_count);
+    minifs_dirty_init(&fs->dirty_inode_words, bitmap_words(sblock->inode_count));
+    minifs_dirty_init(&fs->dirty_block_words, bitmap_words(sblock->block_count));
 
-    close(fd);
+    uint64_t inode_bytes = bitmap_words(sblock->inode_count) * sizeof(uint64_t);
+    uint64_t block_bytes = bitmap_words(sblock->block_count) * sizeof(uint64_t);
+    struct stat info;
+    if (fstat(fs->fd, &info) == 0 && info.st_size >= minifs_block_bitmap_offset(fs) + block_bytes) {
+        minifs_read_block(fs->fd, fs->inode_bitmap.words, inode_bytes, minifs_inode_bitmap_offset(fs));
+        minifs_read_block(fs->fd, fs->block_bitmap.words, block_bytes, minifs_block_bitmap_offset(fs));
+        if (bitmap_count(&fs->inode_bitmap) == sblock->used_inode_count &&
+            bitmap_count(&fs->block_bitmap) == sblock->used_block_count) {
+            return;
+        }
+    }
+
+    debug(MINIFS_WARN "rebuilding allocation bitmaps");
+    bitmap_free(&fs->inode_bitmap);
+    bitmap_free(&fs->block_bitmap);
+    bitmap_init(&fs->inode_bitmap, sblock->inode_count);
+    bitmap_init(&fs->block_bitmap, sblock->block_count);
+    for (uint32_t index = 0; index < sblock->inode_count; ++index) {
+        if (sblock->inode_map[index].type != MINIFS_INODE_EMPTY) {
+            bitmap_set(&fs->inode_bitmap, index);
+        }
+    }
+    for (uint32_t index = 0; index < sblock->block_count; ++index) {
+        if (sblock->block_map[index].type != MINIFS_BLOCK_EMPTY) {
+            bitmap_set(&fs->block_bitmap, index);
+        }
+    }
+
+    // counters of older images do not include root dir
+    sblock->used_inode_count = bitmap_count(&fs->inode_bitmap);
+    sblock->used_block_count = bitmap_count(&fs->block_bitmap);
+    for (uint32_t index = 0; index < bitmap_words(sblock->inode_count); ++index) {
+        minifs_dirty_add(&fs->dirty_inode_words, index);
+    }
+    for (uint32_t index = 0; index < bitmap_words(sblock->block_count); ++index) {
+        minifs_dirty_add(&fs->dirty_block_words, index);
+    }
+}
+
+
+static void inode_locks_init(FsLocks *locks, uint32_t inode_count) {
+    locks->inodes = (pthread_rwlock_t*) malloc(inode_count * sizeof(pthread_rwlock_t));
+    for (uint32_t index = 0; index < inode_count; ++index) {
+        pthread_rwlock_init(&locks->inodes[index], NULL);
+    }
+}
+
+
+static void inode_locks_free(FsLocks *locks, uint32_t inode_count) {
+    for (uint32_t index = 0; index < inode_count; ++index) {
+        pthread_rwlock_destroy(&locks->inodes[index]);
+    }
+    free(locks->inodes);
+}
+
+
+static FsLocks *locks_init(uint32_t inode_count) {
+    FsLocks *locks = (FsLocks*) malloc(sizeof(FsLocks));
+    pthread_mutexattr_t recursive;
+    pthread_mutexattr_init(&recursive);
+    pthread_mutexattr_settype(&recursive, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&locks->alloc, &recursive);
+    pthread_mutexattr_destroy(&recursive);
+
+    pthread_mutex_init(&locks->bcache, NULL);
+    pthread_mutex_init(&locks->dcache, NULL);
+    pthread_mutex_init(&locks->index, NULL);
+    pthread_mutex_init(&locks->delayed, NULL);
+    inode_locks_init(locks, inode_count);
+    return locks;
+}
+
+
+static void locks_free(FsLocks *locks, uint32_t inode_count) {
+    pthread_mutex_destroy(&locks->alloc);
+    pthread_mutex_destroy(&locks->bcache);
+    pthread_mutex_destroy(&locks->dcache);
+    pthread_mutex_destroy(&locks->index);
+    pthread_mutex_destroy(&locks->delayed);
+    inode_locks_free(locks, inode_count);
+    free(locks);
 }
 
 
@@ -80,260 +402,2698 @@ struct Filesystem minifs_open(const char *filename) {
 
     // read superblock
 
+    DiskSuperBlock disk;
+    struct iovec iov = {.iov_base = &disk, .iov_len = sizeof(disk)};
+    minifs_read_vector(result.fd, &iov, 1, 0);  // older images can be shorter
     struct SuperBlock sblock;
-    minifs_read_block(result.fd, (void*) &sblock, sizeof(struct SuperBlock), 0);
+    decode_superblock(&disk, &sblock);
+    load_groups(result.fd, &sblock);
 
     // reading inode and block map
 
-    sblock.inode_map = (Inode*) malloc(sblock.inode_count * sizeof(Inode));
-    sblock.block_map = (Block*) malloc(sblock.block_count * sizeof(Block));
-    minifs_read_block(result.fd, sblock.inode_map, sblock.inode_count * sizeof(Inode), sizeof(SuperBlock));
-    minifs_read_block(result.fd, sblock.block_map, sblock.block_count * sizeof(Block), sizeof(SuperBlock) + sblock.inode_count * sizeof(Inode));
+    uint64_t inode_bytes = (uint64_t) sblock.inode_count * sizeof(Inode);
+    uint64_t block_bytes = (uint64_t) sblock.block_count * sizeof(Block);
+    sblock.inode_map = (Inode*) malloc(inode_bytes);
+    sblock.inline_map = NULL;
+    if (sblock.inode_size > sizeof(Inode)) {
+        sblock.inline_map = (unsigned char*) malloc((uint64_t) sblock.inode_count * (sblock.inode_size - sizeof(Inode)));
+    }
+    sblock.block_map = (Block*) malloc(block_bytes);
+    for (uint32_t index = 0; index < sblock.group_count; ++index) {
+        MetaGroup *group = &sblock.group_map[index];
+        read_inodes(result.fd, &sblock, group);
+        minifs_read_block(result.fd, sblock.block_map + group->first_block,
+                          (uint64_t) group->block_count * sizeof(Block), group->block_table);
+    }
 
     // setup filesystem
 
     result.sblock = sblock;
     result.current_dir = 0;
+    result.image = NULL;
+    result.image_size = 0;
+    result.dirty_begin = 0;
+    result.dirty_end = 0;
+    minifs_dirty_init(&result.dirty_inodes, sblock.inode_count);
+    minifs_dirty_init(&result.dirty_blocks, sblock.block_count);
+    load_bitmaps(&result);
+    bitmap_init(&result.reserved, sblock.block_count);
+    result.prealloc = (Prealloc*) calloc(sblock.inode_count, sizeof(Prealloc));
+    result.prealloc_blocks = PREALLOC_BLOCKS;
+    result.delayed = (DelayedBuffer*) calloc(sblock.inode_count, sizeof(DelayedBuffer));
+    minifs_dirty_init(&result.delayed_inodes, sblock.inode_count);
+    result.delayed_limit = DELAYED_BUFFER_SIZE;
+    result.delayed_blocks = 0;
+    result.compress = false;
+    result.indexes = (BlockIndex*) calloc(sblock.inode_count, sizeof(BlockIndex));
+    result.slot_hints = (uint32_t*) calloc(sblock.inode_count, sizeof(uint32_t));
+    result.dcache = (DentryCache*) malloc(sizeof(DentryCache));
+    dcache_init(result.dcache, DCACHE_DEFAULT_CAPACITY);
+    result.bcache = (BufferCache*) malloc(sizeof(BufferCache));
+    bcache_init(result.bcache, sblock.block_size, BCACHE_DEFAULT_SIZE);
+    result.locks = locks_init(sblock.inode_count);
+    result.uring = NULL;
+    result.journal = NULL;
+
+    // updates committed after last checkpoint
+    journal_replay(&result);
 
     return result;
 }
 
 
-uint32_t minifs_block_head_offset(Filesystem *fs, uint32_t index) {
-    uint32_t result = 0;
-    result += sizeof(SuperBlock);
-    result += fs->sblock.inode_count * sizeof(Inode);
-    result += index * sizeof(Block);
-    return result;
+void minifs_close(Filesystem *fs) {
+    minifs_flush_all_delayed(fs);
+    bcache_flush(fs);
+    if (fs->dirty_inodes.count > 0 || fs->dirty_blocks.count > 0 ||
+        fs->dirty_inode_words.count > 0 || fs->dirty_block_words.count > 0) {
+        minifs_update_superblock(fs);
+    }
+    if (fs->journal != NULL) {
+        journal_checkpoint(fs);
+        journal_free(fs->journal);
+        free(fs->journal);
+        fs->journal = NULL;
+    }
+    if (fs->image != NULL) {
+        minifs_sync_image(fs, true);
+        munmap(fs->image, fs->image_size);
+        fs->image = NULL;
+    }
+    free(fs->sblock.inode_map);
+    free(fs->sblock.inline_map);
+    free(fs->sblock.block_map);
+    free(fs->sblock.group_map);
+    minifs_dirty_free(&fs->dirty_inodes);
+    minifs_dirty_free(&fs->dirty_blocks);
+    minifs_dirty_free(&fs->dirty_inode_words);
+    minifs_dirty_free(&fs->dirty_block_words);
+    bitmap_free(&fs->inode_bitmap);
+    bitmap_free(&fs->block_bitmap);
+    bitmap_free(&fs->reserved);
+    free(fs->prealloc);
+    free(fs->delayed);
+    minifs_dirty_free(&fs->delayed_inodes);
+    for (uint32_t index = 0; index < fs->sblock.inode_count; ++index) {
+        free(fs->indexes[index].blocks);
+        free(fs->indexes[index].clusters);
+    }
+    free(fs->indexes);
+    free(fs->slot_hints);
+    dcache_free(fs->dcache);
+    free(fs->dcache);
+    bcache_free(fs->bcache);
+    free(fs->bcache);
+    locks_free(fs->locks, fs->sblock.inode_count);
+    if (fs->uring != NULL) {
+        uring_free(fs->uring);
+        free(fs->uring);
+    }
+    close(fs->fd);
 }
 
 
-uint32_t minifs_block_body_offset(Filesystem *fs, uint32_t index) {
-    uint32_t result = 0;
-    result += sizeof(SuperBlock);
-    result += fs->sblock.inode_count * sizeof(Inode);
-    result += fs->sblock.block_count * sizeof(Block);
-    result += fs->sblock.block_size * index;
-    return result;
+void minifs_lock_inode(Filesystem *fs, uint32_t inode_id, bool exclusive) {
+    if (exclusive) {
+        pthread_rwlock_wrlock(&fs->locks->inodes[inode_id]);
+    } else {
+        pthread_rwlock_rdlock(&fs->locks->inodes[inode_id]);
+    }
 }
 
 
-uint32_t minifs_inode_offset(Filesystem *fs, uint32_t index) {
-    uint32_t result = 0;
-    result += sizeof(SuperBlock);
-    result += index * sizeof(Inode);
-    return result;
+void minifs_unlock_inode(Filesystem *fs, uint32_t inode_id) {
+    pthread_rwlock_unlock(&fs->locks->inodes[inode_id]);
 }
 
 
-DirectoryMap *minifs_read_dir(Filesystem *fs, uint32_t dir_inode) {
-    // init map and read inode
-    DirectoryMap *result = (DirectoryMap*) malloc(sizeof(DirectoryMap));
-    Inode inode = fs->sblock.inode_map[dir_inode];
-
-    // setup array
-    result->size = 0; // used as a counter in loop
-    result->names = (char**) malloc(sizeof(char*) * inode.size);
-    result->inodes = (uint32_t*) malloc(sizeof(uint32_t) * inode.size);
-    result->used = (char*) malloc(inode.size);
+void minifs_lock_alloc(Filesystem *fs) {
+    pthread_mutex_lock(&fs->locks->alloc);
+}
 
-    // go through all blocks
-    int32_t current_block = inode.root_block;
-    while (current_block >= 0) {
-        Block block = fs->sblock.block_map[current_block];  // current block meta
-        uint32_t count = block.size / (sizeof(char) + MAX_FILENAME_SIZE + sizeof(uint32_t));   // count of entries in block
-        uint32_t current_offset = minifs_block_body_offset(fs, current_block);  // offset to current physical block
 
-        for (int index = 0; index < count; ++index) {
-            char *name = (char*) malloc(MAX_FILENAME_SIZE);
-            uint32_t inode_id;
-            char used;
-            uint32_t local_offset = current_offset + index * (sizeof(char) + MAX_FILENAME_SIZE + sizeof(uint32_t));
-            minifs_read_block(fs->fd, &used, sizeof(char), local_offset);
-            minifs_read_block(fs->fd, name, MAX_FILENAME_SIZE, local_offset + sizeof(char));
-            minifs_read_block(fs->fd, &inode_id, sizeof(uint32_t), local_offset + sizeof(char) + MAX_FILENAME_SIZE);
+void minifs_unlock_alloc(Filesystem *fs) {
+    pthread_mutex_unlock(&fs->locks->alloc);
+}
 
-            // save info
-            result->names[result->size] = name;
-            result->inodes[result->size] = inode_id;
-            result->used[result->size] = used;
-            ++result->size;
-        }
 
-        current_block = block.next_block;
+static void sync_file(Filesystem *fs) {
+    if (fsync(fs->fd) < 0) {
+        debug(MINIFS_ERR "fsync error");
+        exit(-1);
     }
+    MINIFS_IO_COUNT(syncs);
+}
 
-    return result;
+
+void minifs_sync(Filesystem *fs) {
+    minifs_flush_all_delayed(fs);
+    bcache_flush(fs);
+    minifs_update_superblock(fs);
+    if (fs->journal != NULL) {  // commit syncs mapped pages as well
+        journal_commit(fs);
+        return;
+    }
+    if (fs->image != NULL) {
+        minifs_sync_image(fs, true);
+        return;
+    }
+    sync_file(fs);
 }
 
 
-void minifs_clear_dirmap(DirectoryMap *map) {
-    for (uint32_t index = 0; index < map->size; ++index) {
-        free(map->names[index]);
+void minifs_enable_journal(Filesystem *fs) {
+    if (fs->journal != NULL) {
+        return;
     }
-    free(map->names);
-    free(map->inodes);
-    free(map);
+    // shadow tables start from state which is on disk
+    minifs_flush_all_delayed(fs);
+    bcache_flush(fs);
+    minifs_update_superblock(fs);
+    Journal *journal = (Journal*) malloc(sizeof(Journal));
+    journal_init(fs, journal);
+    fs->journal = journal;
 }
 
 
-int32_t minifs_find_free_inode(Filesystem *fs) {
-    if (fs->sblock.used_inode_count >= fs->sblock.inode_count) {
-        return -1;
+void minifs_commit(Filesystem *fs) {
+    if (fs->journal == NULL) {
+        minifs_sync(fs);
+        return;
     }
-    for (uint32_t index = 0; index < fs->sblock.inode_count; ++index) {
-        if (fs->sblock.inode_map[index].type == MINIFS_INODE_EMPTY) {
-            return index;
-        }
+    // delayed appends get blocks and are logged with their sizes
+    if (fs->delayed_inodes.count > 0) {
+        minifs_flush_all_delayed(fs);
+        minifs_update_superblock(fs);
     }
-    return -1;
+    journal_commit(fs);
 }
 
 
-int32_t minifs_find_free_block(Filesystem *fs) {
-    if (fs->sblock.used_block_count >= fs->sblock.block_count) {
-        return -1;
+// first byte after regions of image: journal of first group or bodies of last one
+static uint64_t image_end(Filesystem *fs) {
+    MetaGroup *last = &fs->sblock.group_map[fs->sblock.group_count - 1];
+    uint64_t end = last->bodies + (uint64_t) last->block_count * fs->sblock.block_size;
+    uint64_t journal_end = fs->sblock.journal + JOURNAL_SIZE;
+    return end > journal_end ? end : journal_end;
+}
+
+
+// tables and bitmaps in memory get entries of new group, bitmaps are
+// written to new group in whole, old ones are left as unused space
+static void extend_tables(Filesystem *fs, const MetaGroup *group) {
+    SuperBlock *sblock = &fs->sblock;
+    uint32_t old_inodes = sblock->inode_count;
+    uint32_t inode_count = old_inodes + group->inode_count;
+    uint32_t block_count = sblock->block_count + group->block_count;
+
+    sblock->inode_map = (Inode*) realloc(sblock->inode_map, (uint64_t) inode_count * sizeof(Inode));
+    sblock->block_map = (Block*) realloc(sblock->block_map, (uint64_t) block_count * sizeof(Block));
+    memset(sblock->inode_map + old_inodes, 0, (uint64_t) group->inode_count * sizeof(Inode));
+    memset(sblock->block_map + sblock->block_count, 0, (uint64_t) group->block_count * sizeof(Block));
+    if (sblock->inline_map != NULL) {
+        uint64_t inline_size = sblock->inode_size - sizeof(Inode);
+        sblock->inline_map = (unsigned char*) realloc(sblock->inline_map, inode_count * inline_size);
+        memset(sblock->inline_map + old_inodes * inline_size, 0, group->inode_count * inline_size);
     }
-    for (uint32_t index = 0; index < fs->sblock.block_count; ++index) {
-        if (fs->sblock.block_map[index].type == MINIFS_BLOCK_EMPTY) {
-            return index;
-        }
+    fs->indexes = (BlockIndex*) realloc(fs->indexes, (uint64_t) inode_count * sizeof(BlockIndex));
+    memset(fs->indexes + old_inodes, 0, (uint64_t) group->inode_count * sizeof(BlockIndex));
+    fs->slot_hints = (uint32_t*) realloc(fs->slot_hints, (uint64_t) inode_count * sizeof(uint32_t));
+    memset(fs->slot_hints + old_inodes, 0, (uint64_t) group->inode_count * sizeof(uint32_t));
+    inode_locks_free(fs->locks, old_inodes);
+    inode_locks_init(fs->locks, inode_count);
+
+    bitmap_resize(&fs->inode_bitmap, inode_count);
+    bitmap_resize(&fs->block_bitmap, block_count);
+    bitmap_resize(&fs->reserved, block_count);
+    fs->prealloc = (Prealloc*) realloc(fs->prealloc, (uint64_t) inode_count * sizeof(Prealloc));
+    memset(fs->prealloc + old_inodes, 0, (uint64_t) group->inode_count * sizeof(Prealloc));
+    fs->delayed = (DelayedBuffer*) realloc(fs->delayed, (uint64_t) inode_count * sizeof(DelayedBuffer));
+    memset(fs->delayed + old_inodes, 0, (uint64_t) group->inode_count * sizeof(DelayedBuffer));
+    minifs_dirty_free(&fs->delayed_inodes);
+    minifs_dirty_init(&fs->delayed_inodes, inode_count);
+    minifs_dirty_free(&fs->dirty_inodes);
+    minifs_dirty_free(&fs->dirty_blocks);
+    minifs_dirty_free(&fs->dirty_inode_words);
+    minifs_dirty_free(&fs->dirty_block_words);
+    minifs_dirty_init(&fs->dirty_inodes, inode_count);
+    minifs_dirty_init(&fs->dirty_blocks, block_count);
+    minifs_dirty_init(&fs->dirty_inode_words, bitmap_words(inode_count));
+    minifs_dirty_init(&fs->dirty_block_words, bitmap_words(block_count));
+
+    sblock->group_map = (MetaGroup*) realloc(sblock->group_map, (sblock->group_count + 1) * sizeof(MetaGroup));
+    sblock->group_map[sblock->group_count++] = *group;
+    sblock->inode_count = inode_count;
+    sblock->block_count = block_count;
+
+    // guard block: last block of previous group and first block
+    // of this one never become neighbours in extent or run
+    if (group->block_count > 0) {
+        sblock->block_map[group->first_block].type = MINIFS_BLOCK_USED;
+        sblock->block_map[group->first_block].next_block = -1;
+        bitmap_set(&fs->block_bitmap, group->first_block);
+        sblock->used_block_count++;
     }
-    return -1;
 }
 
 
-void minifs_update_superblock(Filesystem *fs) {
-    minifs_write_block(fs->fd, &fs->sblock, sizeof(SuperBlock), 0);
-    for (uint32_t index = 0; index < fs->sblock.inode_count; ++index) {
-        uint32_t offset = minifs_inode_offset(fs, index);
-        minifs_write_block(fs->fd, &fs->sblock.inode_map[index], sizeof(Inode), offset);
+bool minifs_grow(Filesystem *fs, uint32_t inodes, uint32_t blocks) {
+    SuperBlock *sblock = &fs->sblock;
+    if (sblock->version == 0) {
+        debug(MINIFS_ERR "image without versioned superblock cannot grow");
+        return false;
+    }
+    if ((uint64_t) sblock->inode_count + inodes > MAX_OBJECT_COUNT ||
+        (uint64_t) sblock->block_count + blocks > MAX_OBJECT_COUNT || (inodes == 0 && blocks == 0)) {
+        debug(MINIFS_ERR "cannot grow image by %u inodes and %u blocks", inodes, blocks);
+        return false;
+    }
+
+    // group goes after everything, its new bitmaps and
+    // group table come first, tables and bodies follow
+    uint64_t block_size = sblock->block_size;
+    uint64_t start = image_end(fs);
+    struct stat info;
+    if (fstat(fs->fd, &info) == 0 && info.st_size > start) {
+        start = info.st_size;
+    }
+    uint64_t inode_bitmap = (start + block_size - 1) / block_size * block_size;
+    uint64_t block_bitmap = inode_bitmap + bitmap_words(sblock->inode_count + inodes) * sizeof(uint64_t);
+    uint64_t groups = block_bitmap + bitmap_words(sblock->block_count + blocks) * sizeof(uint64_t);
+    MetaGroup group = {
+        .first_inode = sblock->inode_count,
+        .inode_count = inodes,
+        .first_block = sblock->block_count,
+        .block_count = blocks,
+    };
+    group.inode_table = groups + (sblock->group_count + 1) * sizeof(MetaGroup);
+    group.block_table = group.inode_table + (uint64_t) inodes * sblock->inode_size;
+    group.bodies = (group.block_table + (uint64_t) blocks * sizeof(Block) + block_size - 1) / block_size * block_size;
+
+    // tables and bodies of group are holes, zeros are empty entries
+    uint64_t end = group.bodies + blocks * block_size;
+    if (ftruncate(fs->fd, end) < 0) {
+        debug(MINIFS_ERR "cannot extend image to %lu bytes", end);
+        return false;
+    }
+
+    // everything in memory reaches image and journal is emptied,
+    // tables of new geometry start from state on disk
+    minifs_flush_all_delayed(fs);
+    bcache_flush(fs);
+    minifs_update_superblock(fs);
+    if (fs->journal != NULL) {
+        journal_checkpoint(fs);
+        journal_free(fs->journal);
+    }
+    bool mapped = fs->image != NULL;
+    if (mapped) {
+        minifs_sync_image(fs, true);
+        munmap(fs->image, fs->image_size);
+        fs->image = NULL;
+    }
+
+    minifs_lock_alloc(fs);
+    extend_tables(fs, &group);
+    sblock->inode_bitmap = inode_bitmap;
+    sblock->block_bitmap = block_bitmap;
+    sblock->groups = groups;
+
+    // new superblock is written after everything it points to is durable,
+    // crash before it leaves old geometry with unused tail of image
+    minifs_write_block(fs->fd, fs->inode_bitmap.words, bitmap_words(sblock->inode_count) * sizeof(uint64_t), inode_bitmap);
+    minifs_write_block(fs->fd, fs->block_bitmap.words, bitmap_words(sblock->block_count) * sizeof(uint64_t), block_bitmap);
+    minifs_write_block(fs->fd, sblock->group_map, sblock->group_count * sizeof(MetaGroup), groups);
+    if (blocks > 0) {
+        minifs_write_block(fs->fd, &sblock->block_map[group.first_block], sizeof(Block),
+                           minifs_block_head_offset(fs, group.first_block));
+    }
+    sync_file(fs);
+    DiskSuperBlock disk;
+    encode_superblock(sblock, &disk);
+    minifs_write_block(fs->fd, &disk, sizeof(disk), 0);
+    sync_file(fs);
+    minifs_unlock_alloc(fs);
+
+    if (fs->journal != NULL) {
+        journal_init(fs, fs->journal);
     }
-    for (uint32_t index = 0; index < fs->sblock.block_count; ++index) {
-        uint32_t offset = minifs_block_head_offset(fs, index);
-        minifs_write_block(fs->fd, &fs->sblock.block_map[index], sizeof(Block), offset);
+    if (mapped && !minifs_map_image(fs)) {
+        debug(MINIFS_WARN "cannot map grown image, using fd backend");
     }
+    return true;
 }
 
 
-void minifs_append_data(Filesystem *fs, uint32_t inode_id, const unsigned char *data, uint32_t data_size) {
-    const Inode inode = fs->sblock.inode_map[inode_id];
+void minifs_set_cache_size(Filesystem *fs, uint32_t size) {
+    bcache_flush(fs);
+    bcache_free(fs->bcache);
+    bcache_init(fs->bcache, fs->sblock.block_size, size);
+}
 
-    int32_t current_block_id = inode.root_block;  // trying to write data to root_block at first
-    Block block = fs->sblock.block_map[current_block_id];
 
-    while (block.next_block >= 0) {  // searching last block
-        current_block_id = block.next_block;
-        block = fs->sblock.block_map[current_block_id];
+bool minifs_map_image(Filesystem *fs) {
+    MetaGroup *last = &fs->sblock.group_map[fs->sblock.group_count - 1];
+    uint64_t size = last->bodies + (uint64_t) last->block_count * fs->sblock.block_size;
+    bcache_invalidate(fs);  // mapped bodies are not cached
+
+    // block bodies are written lazily, so image can be shorter than its
+    // geometry -- extend it, otherwise access past EOF would raise SIGBUS
+    struct stat info;
+    if (fstat(fs->fd, &info) < 0) {
+        debug(MINIFS_ERR "cannot stat image");
+        return false;
+    }
+    if (info.st_size < size && ftruncate(fs->fd, size) < 0) {
+        debug(MINIFS_ERR "cannot extend image to %lu bytes", size);
+        return false;
     }
 
-    if ((fs->sblock.block_size - block.size) >= data_size) { // if free space in block is enough
-        uint32_t offset = minifs_block_body_offset(fs, current_block_id);
-        offset += block.size;
-        minifs_write_block(fs->fd, (void*) data, data_size, offset);
-        fs->sblock.block_map[current_block_id].size += data_size;
-    } else { // else -- write some data to current and allocate new block
-        if (block.size < fs->sblock.block_size) {
-            uint32_t offset = minifs_block_body_offset(fs, current_block_id);
-            uint32_t delta = fs->sblock.block_size - block.size;
-            offset += block.size;
-            minifs_write_block(fs->fd, (void*) data, delta, offset);
-            fs->sblock.block_map[current_block_id].size = fs->sblock.block_size;
-            data += delta;
-            data_size -= delta;
-        }
+    void *image = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fs->fd, 0);
+    if (image == MAP_FAILED) {
+        debug(MINIFS_ERR "cannot map image");
+        return false;
+    }
 
-        while (data_size > 0) { // data can be too large for one new page
-            int32_t new_block = minifs_find_free_block(fs);
-            if (new_block < 0) {
-                fprintf(stderr, "Ran out of free blocks\n");
-                exit(-1);
-            }
+    fs->image = (unsigned char*) image;
+    fs->image_size = size;
+    fs->dirty_begin = 0;
+    fs->dirty_end = 0;
+    return true;
+}
 
-            fs->sblock.block_map[new_block].size = 0; // linking new block
-            fs->sblock.block_map[new_block].type = MINIFS_BLOCK_USED;
-            fs->sblock.block_map[new_block].next_block = -1;
-            fs->sblock.block_map[current_block_id].next_block = new_block;
-            fs->sblock.used_block_count++;
 
-            if (data_size <= fs->sblock.block_size) { // if data finally fits new block size
-                uint32_t offset = minifs_block_body_offset(fs, new_block);
-                minifs_write_block(fs->fd, (void*) data, data_size, offset);
-                fs->sblock.block_map[new_block].size = data_size;
-                return;
-            } else { // if data is still to large to fit one block
-                uint32_t offset = minifs_block_body_offset(fs, new_block);
-                minifs_write_block(fs->fd, (void*) data, fs->sblock.block_size, offset);
-                fs->sblock.block_map[new_block].size = fs->sblock.block_size;
-                data += fs->sblock.block_size;
-                data_size -= fs->sblock.block_size;
-            }
+void minifs_sync_image(Filesystem *fs, bool wait) {
+    minifs_lock_alloc(fs);
+    if (fs->image == NULL || fs->dirty_end <= fs->dirty_begin) {
+        minifs_unlock_alloc(fs);
+        return;
+    }
 
-            current_block_id = new_block;
-        }
+    // msync requires page aligned address
+    uint64_t page_size = sysconf(_SC_PAGESIZE);
+    uint64_t begin = fs->dirty_begin - fs->dirty_begin % page_size;
+    if (msync(fs->image + begin, fs->dirty_end - begin, wait ? MS_SYNC : MS_ASYNC) < 0) {
+        debug(MINIFS_ERR "msync error");
+        exit(-1);
     }
+    MINIFS_IO_COUNT(syncs);
+
+    fs->dirty_begin = 0;
+    fs->dirty_end = 0;
+    minifs_unlock_alloc(fs);
 }
 
 
-void minifs_remove_from_dir(Filesystem *fs, uint32_t dir_inode, uint32_t index) {
-    uint32_t current_block_id = fs->sblock.inode_map[dir_inode].root_block;
-    while (index * (sizeof(char) + MAX_FILENAME_SIZE + sizeof(uint32_t)) > fs->sblock.block_size) {
-        current_block_id = fs->sblock.block_map[current_block_id].next_block;
-        index -= fs->sblock.block_size / (sizeof(char) + MAX_FILENAME_SIZE + sizeof(uint32_t));
+unsigned char *minifs_block_body(Filesystem *fs, uint32_t index) {
+    if (fs->image == NULL) {
+        return NULL;
     }
-    uint32_t offset = minifs_block_body_offset(fs, current_block_id);
-    offset += index * (sizeof(char) + MAX_FILENAME_SIZE + sizeof(uint32_t));
-    char used = 0;
-    minifs_write_block(fs->fd, (void*) &used, sizeof(char), offset);
+    return fs->image + minifs_block_body_offset(fs, index);
 }
 
 
-const char* minifs_read_data(Filesystem *fs, int32_t inode_id, int32_t *size) {
-    const Inode inode = fs->sblock.inode_map[inode_id];
+// group which holds inode or block, first group is checked first
+// since images rarely grow many times
+static const MetaGroup *inode_group(Filesystem *fs, uint32_t index) {
+    const MetaGroup *group = fs->sblock.group_map;
+    while (index - group->first_inode >= group->inode_count) {
+        ++group;
+    }
+    return group;
+}
 
-    *size = inode.size;
-    char *buffer = (char*) malloc(inode.size);
-    uint32_t read_size = 0;
 
-    int32_t current_block_id = inode.root_block;
-    Block block = fs->sblock.block_map[current_block_id];
-    while (current_block_id > 0) {
-        if (block.size > 0) {
-            uint32_t offset = minifs_block_body_offset(fs, current_block_id);
-            minifs_read_block(fs->fd, buffer + read_size, block.size, offset);
-            read_size += block.size;
-        }
-        current_block_id = block.next_block;
-        block = fs->sblock.block_map[current_block_id];
+static const MetaGroup *block_group(Filesystem *fs, uint32_t index) {
+    const MetaGroup *group = fs->sblock.group_map;
+    while (index - group->first_block >= group->block_count) {
+        ++group;
     }
+    return group;
+}
 
-    return buffer;
+
+uint64_t minifs_block_head_offset(Filesystem *fs, uint32_t index) {
+    const MetaGroup *group = block_group(fs, index);
+    return group->block_table + (uint64_t) (index - group->first_block) * sizeof(Block);
 }
 
 
-void minifs_read_block(int fd, void *data, uint32_t size, uint32_t offset) {
-    lseek(fd, offset, SEEK_SET);
-    uint32_t read_size = 0;
-    while (read_size < size) {
-        uint32_t status = read(fd, data + read_size, size - read_size);
-        if (status <= 0) {
-            debug(MINIFS_ERR "read error");
-            exit(-1);
-        }
-        read_size += status;
-    }
+uint64_t minifs_block_body_offset(Filesystem *fs, uint32_t index) {
+    const MetaGroup *group = block_group(fs, index);
+    return group->bodies + (uint64_t) (index - group->first_block) * fs->sblock.block_size;
 }
 
 
-void minifs_write_block(int fd, void *data, uint32_t size, uint32_t offset) {
-    lseek(fd, offset, SEEK_SET);
-    uint32_t write_size = 0;
-    while (write_size < size) {
-        uint32_t status = write(fd, data + write_size, size - write_size);
-        if (status <= 0) {
-            debug(MINIFS_ERR "write error");
-            exit(-1);
-        }
-        write_size += status;
-    }
-}
\ No newline at end of file
+uint64_t minifs_inode_offset(Filesystem *fs, uint32_t index) {
+    const MetaGroup *group = inode_group(fs, index);
+    return group->inode_table + (uint64_t) (index - group->first_inode) * fs->sblock.inode_size;
+}
+
+
+uint32_t minifs_inline_capacity(Filesystem *fs) {
+    return fs->sblock.inode_size - sizeof(Inode);
+}
+
+
+unsigned char *minifs_inline_data(Filesystem *fs, uint32_t index) {
+    return fs->sblock.inline_map + (uint64_t) index * minifs_inline_capacity(fs);
+}
+
+
+uint64_t minifs_inode_bitmap_offset(Filesystem *fs) {
+    return fs->sblock.inode_bitmap;
+}
+
+
+uint64_t minifs_block_bitmap_offset(Filesystem *fs) {
+    return fs->sblock.block_bitmap;
+}
+
+
+uint64_t minifs_journal_offset(Filesystem *fs) {
+    return fs->sblock.journal;
+}
+
+
+void minifs_read_body(Filesystem *fs, uint32_t index, void *data, uint32_t size, uint32_t offset) {
+    unsigned char *body = minifs_block_body(fs, index);
+    if (body != NULL) {
+        memcpy(data, body + offset, size);
+        return;
+    }
+    bcache_read(fs, index, data, size, offset);
+}
+
+
+// remembers touched range of mapped image for next msync
+static void touch_image(Filesystem *fs, uint64_t begin, uint32_t size) {
+    uint64_t end = begin + size;
+    minifs_lock_alloc(fs);
+    if (fs->dirty_end <= fs->dirty_begin) {
+        fs->dirty_begin = begin;
+        fs->dirty_end = end;
+    } else {
+        fs->dirty_begin = begin < fs->dirty_begin ? begin : fs->dirty_begin;
+        fs->dirty_end = end > fs->dirty_end ? end : fs->dirty_end;
+    }
+    minifs_unlock_alloc(fs);
+}
+
+
+void minifs_write_body(Filesystem *fs, uint32_t index, const void *data, uint32_t size, uint32_t offset) {
+    unsigned char *body = minifs_block_body(fs, index);
+    if (body == NULL) {
+        bcache_write(fs, index, data, size, offset);
+        return;
+    }
+
+    memcpy(body + offset, data, size);
+    touch_image(fs, body + offset - fs->image, size);
+}
+
+
+void minifs_dir_open(Filesystem *fs, uint32_t dir_inode, DirIterator *it) {
+    it->fs = fs;
+    it->dir = dir_inode;
+    it->block = 0;
+    it->base = 0;
+    it->count = 0;
+    it->next = 0;
+    it->position = 0;
+    it->entries = NULL;
+    it->buffer = NULL;
+}
+
+
+// loads next directory block, false at the end of directory
+static bool dir_load(DirIterator *it) {
+    Filesystem *fs = it->fs;
+    int32_t block = minifs_file_block(fs, it->dir, it->block);
+    if (block < 0) {
+        return false;
+    }
+    it->block++;
+    it->base += it->count;
+    it->next = 0;
+    it->count = fs->sblock.block_map[block].size / sizeof(DirEntry);
+
+    unsigned char *body = minifs_block_body(fs, block);
+    if (body != NULL) {
+        it->entries = (DirEntry*) body;
+        return true;
+    }
+    if (it->buffer == NULL) {
+        it->buffer = (DirEntry*) malloc(fs->sblock.block_size);
+    }
+    minifs_read_body(fs, block, it->buffer, it->count * sizeof(DirEntry), 0);
+    it->entries = it->buffer;
+    return true;
+}
+
+
+const DirEntry *minifs_dir_next(DirIterator *it) {
+    while (true) {
+        while (it->next == it->count) {
+            if (!dir_load(it)) {
+                return NULL;
+            }
+        }
+        const DirEntry *entry = &it->entries[it->next++];
+        if (entry->used) {
+            it->position = it->base + it->next - 1;
+            return entry;
+        }
+    }
+}
+
+
+void minifs_dir_close(DirIterator *it) {
+    free(it->buffer);
+    it->buffer = NULL;
+    it->entries = NULL;
+}
+
+
+DirectoryMap *minifs_read_dir(Filesystem *fs, uint32_t dir_inode) {
+    // init map and read inode
+    DirectoryMap *result = (DirectoryMap*) malloc(sizeof(DirectoryMap));
+    Inode inode = fs->sblock.inode_map[dir_inode];
+
+    // setup array
+    result->size = 0; // used as a counter in loop
+    result->names = (char**) malloc(sizeof(char*) * inode.size);
+    result->inodes = (uint32_t*) malloc(sizeof(uint32_t) * inode.size);
+    result->used = (char*) malloc(inode.size);
+
+    // go through all blocks, including deleted entries
+    DirIterator it;
+    minifs_dir_open(fs, dir_inode, &it);
+    while (dir_load(&it)) {
+        for (uint32_t index = 0; index < it.count; ++index) {
+            char *name = (char*) malloc(MAX_FILENAME_SIZE);
+            memcpy(name, it.entries[index].name, MAX_FILENAME_SIZE);
+
+            // save info
+            result->names[result->size] = name;
+            result->inodes[result->size] = it.entries[index].inode;
+            result->used[result->size] = it.entries[index].used;
+            ++result->size;
+        }
+    }
+    minifs_dir_close(&it);
+
+    return result;
+}
+
+
+void minifs_clear_dirmap(DirectoryMap *map) {
+    for (uint32_t index = 0; index < map->size; ++index) {
+        free(map->names[index]);
+    }
+    free(map->names);
+    free(map->inodes);
+    free(map->used);
+    free(map);
+}
+
+
+int32_t minifs_find_free_inode(Filesystem *fs) {
+    if (fs->sblock.used_inode_count >= fs->sblock.inode_count) {
+        return -1;
+    }
+    return bitmap_find_zero(&fs->inode_bitmap);
+}
+
+
+int32_t minifs_find_free_block(Filesystem *fs) {
+    if (fs->sblock.used_block_count >= fs->sblock.block_count) {
+        return -1;
+    }
+    int64_t result = bitmap_find_run(&fs->block_bitmap, &fs->reserved, 1);
+    if (result < 0) {  // all free blocks are preallocated, windows give way
+        minifs_lock_alloc(fs);
+        for (uint32_t index = 0; index < fs->sblock.inode_count; ++index) {
+            minifs_release_prealloc(fs, index);
+        }
+        minifs_unlock_alloc(fs);
+        result = bitmap_find_zero(&fs->block_bitmap);
+    }
+    return result;
+}
+
+
+void minifs_take_inode(Filesystem *fs, uint32_t index) {
+    minifs_lock_alloc(fs);
+    bitmap_set(&fs->inode_bitmap, index);
+    fs->inode_bitmap.hint = index + 1;
+    fs->sblock.used_inode_count++;
+    minifs_dirty_add(&fs->dirty_inode_words, index / 64);
+    minifs_mark_inode(fs, index);
+    minifs_unlock_alloc(fs);
+}
+
+
+void minifs_release_inode(Filesystem *fs, uint32_t index) {
+    minifs_lock_alloc(fs);
+    bitmap_clear(&fs->inode_bitmap, index);
+    fs->sblock.used_inode_count--;
+    minifs_dirty_add(&fs->dirty_inode_words, index / 64);
+    minifs_mark_inode(fs, index);
+    minifs_unlock_alloc(fs);
+}
+
+
+void minifs_take_block(Filesystem *fs, uint32_t index) {
+    minifs_lock_alloc(fs);
+    bitmap_set(&fs->block_bitmap, index);
+    fs->block_bitmap.hint = index + 1;
+    fs->sblock.used_block_count++;
+    minifs_dirty_add(&fs->dirty_block_words, index / 64);
+    minifs_mark_block(fs, index);
+    minifs_unlock_alloc(fs);
+}
+
+
+void minifs_release_block(Filesystem *fs, uint32_t index) {
+    minifs_lock_alloc(fs);
+    bitmap_clear(&fs->block_bitmap, index);
+    fs->sblock.used_block_count--;
+    minifs_dirty_add(&fs->dirty_block_words, index / 64);
+    minifs_mark_block(fs, index);
+    minifs_unlock_alloc(fs);
+}
+
+
+void minifs_mark_inode(Filesystem *fs, uint32_t index) {
+    minifs_lock_alloc(fs);
+    minifs_dirty_add(&fs->dirty_inodes, index);
+    minifs_unlock_alloc(fs);
+}
+
+
+void minifs_mark_block(Filesystem *fs, uint32_t index) {
+    minifs_lock_alloc(fs);
+    minifs_dirty_add(&fs->dirty_blocks, index);
+    minifs_unlock_alloc(fs);
+}
+
+
+// writes iovecs to contiguous region starting at offset
+void minifs_write_vector(int fd, struct iovec *iov, int count, uint64_t offset) {
+    while (count > 0) {
+        ssize_t status = pwritev(fd, iov, count < FLUSH_IOV_MAX ? count : FLUSH_IOV_MAX, offset);
+        MINIFS_IO_COUNT(writes);
+        if (status <= 0) {
+            debug(MINIFS_ERR "write error");
+            exit(-1);
+        }
+        offset += status;
+        while (count > 0 && status >= iov->iov_len) {  // skip written iovecs
+            status -= iov->iov_len;
+            ++iov;
+            --count;
+        }
+        if (count > 0) {
+            iov->iov_base = (char*) iov->iov_base + status;
+            iov->iov_len -= status;
+        }
+    }
+}
+
+
+void minifs_read_vector(int fd, struct iovec *iov, int count, uint64_t offset) {
+    while (count > 0) {
+        ssize_t status = preadv(fd, iov, count < FLUSH_IOV_MAX ? count : FLUSH_IOV_MAX, offset);
+        MINIFS_IO_COUNT(reads);
+        if (status < 0) {
+            debug(MINIFS_ERR "read error");
+            exit(-1);
+        }
+        if (status == 0) {
+            for (int index = 0; index < count; ++index) {
+                memset(iov[index].iov_base, 0, iov[index].iov_len);
+            }
+            return;
+        }
+        offset += status;
+        while (count > 0 && status >= iov->iov_len) {  // skip filled iovecs
+            status -= iov->iov_len;
+            ++iov;
+            --count;
+        }
+        if (count > 0) {
+            iov->iov_base = (char*) iov->iov_base + status;
+            iov->iov_len -= status;
+        }
+    }
+}
+
+
+bool minifs_enable_uring(Filesystem *fs) {
+    if (fs->uring != NULL) {
+        return true;
+    }
+    Uring *ring = (Uring*) malloc(sizeof(Uring));
+    if (!uring_init(ring, URING_DEFAULT_ENTRIES)) {
+        free(ring);
+        return false;
+    }
+    fs->uring = ring;
+    return true;
+}
+
+
+void minifs_queue_read(Filesystem *fs, UringBatch *batch, struct iovec *iov, int count, uint64_t offset) {
+    if (fs->uring == NULL) {
+        minifs_read_vector(fs->fd, iov, count, offset);
+        return;
+    }
+    uring_queue(fs->uring, batch, fs->fd, false, iov, count, offset);
+}
+
+
+void minifs_queue_write(Filesystem *fs, UringBatch *batch, struct iovec *iov, int count, uint64_t offset) {
+    if (fs->uring == NULL) {
+        minifs_write_vector(fs->fd, iov, count, offset);
+        return;
+    }
+    uring_queue(fs->uring, batch, fs->fd, true, iov, count, offset);
+}
+
+
+void minifs_wait_batch(Filesystem *fs, UringBatch *batch) {
+    if (fs->uring != NULL) {
+        uring_wait(fs->uring, batch);
+    }
+}
+
+
+static uint64_t inode_word_offset(Filesystem *fs, uint32_t index) {
+    return minifs_inode_bitmap_offset(fs) + (uint64_t) index * sizeof(uint64_t);
+}
+
+
+static uint64_t block_word_offset(Filesystem *fs, uint32_t index) {
+    return minifs_block_bitmap_offset(fs) + (uint64_t) index * sizeof(uint64_t);
+}
+
+
+// turns sorted dirty indices into iovecs over table, close runs are merged
+// unless table continues in other metadata group
+static uint32_t collect_runs(Filesystem *fs, DirtySet *set, void *table, uint32_t entry_size,
+                             uint64_t (*locate)(Filesystem*, uint32_t), struct iovec *iov, uint64_t *offsets) {
+    qsort(set->items, set->count, sizeof(uint32_t), compare_index);
+    uint32_t runs = 0;
+    uint32_t index = 0;
+    while (index < set->count) {
+        uint32_t begin = set->items[index];
+        uint32_t end = begin + 1;
+        uint64_t offset = locate(fs, begin);
+        while (++index < set->count && set->items[index] <= end + FLUSH_GAP &&
+               locate(fs, set->items[index]) == offset + (uint64_t) (set->items[index] - begin) * entry_size) {
+            end = set->items[index] + 1;
+        }
+        iov[runs].iov_base = (char*) table + (uint64_t) begin * entry_size;
+        iov[runs].iov_len = (end - begin) * entry_size;
+        offsets[runs] = offset;
+        ++runs;
+    }
+    return runs;
+}
+
+
+// large inode is one record on disk, its parts come from inode
+// and inline maps, so every dirty inode gives two iovecs
+static uint32_t collect_inodes(Filesystem *fs, SuperBlock *sblock, DirtySet *set, struct iovec *iov, uint64_t *offsets) {
+    if (sblock->inline_map == NULL) {
+        return collect_runs(fs, set, sblock->inode_map, sizeof(Inode), minifs_inode_offset, iov, offsets);
+    }
+
+    qsort(set->items, set->count, sizeof(uint32_t), compare_index);
+    uint64_t inline_size = sblock->inode_size - sizeof(Inode);
+    uint32_t count = 0;
+    for (uint32_t item = 0; item < set->count; ++item) {
+        uint32_t index = set->items[item];
+        iov[count].iov_base = &sblock->inode_map[index];
+        iov[count].iov_len = sizeof(Inode);
+        offsets[count] = minifs_inode_offset(fs, index);
+        iov[count + 1].iov_base = sblock->inline_map + index * inline_size;
+        iov[count + 1].iov_len = inline_size;
+        offsets[count + 1] = offsets[count] + sizeof(Inode);
+        count += 2;
+    }
+    return count;
+}
+
+
+void minifs_write_metadata(Filesystem *fs, SuperBlock *sblock, uint64_t *inode_words, uint64_t *block_words,
+                           DirtySet *inodes, DirtySet *blocks, DirtySet *inode_set, DirtySet *block_set) {
+    // superblock goes first, inode, block and bitmap runs follow in file order
+    uint32_t total = 1 + 2 * inodes->count + blocks->count + inode_set->count + block_set->count;
+    struct iovec *iov = (struct iovec*) malloc(total * sizeof(struct iovec));
+    uint64_t *offsets = (uint64_t*) malloc(total * sizeof(uint64_t));
+
+    // older images keep only counters, their header is not rewritten
+    DiskSuperBlock disk;
+    encode_superblock(sblock, &disk);
+    iov[0].iov_base = &disk;
+    iov[0].iov_len = (sblock->version > 0) ? sizeof(disk) : offsetof(DiskSuperBlock, magic);
+    offsets[0] = 0;
+    uint32_t count = 1;
+    count += collect_inodes(fs, sblock, inodes, iov + count, offsets + count);
+    count += collect_runs(fs, blocks, sblock->block_map, sizeof(Block),
+                          minifs_block_head_offset, iov + count, offsets + count);
+    count += collect_runs(fs, inode_set, inode_words, sizeof(uint64_t),
+                          inode_word_offset, iov + count, offsets + count);
+    count += collect_runs(fs, block_set, block_words, sizeof(uint64_t),
+                          block_word_offset, iov + count, offsets + count);
+
+    // runs which touch each other on disk are written by one pwritev,
+    // all of them are submitted as one batch
+    UringBatch batch = {0};
+    uint32_t begin = 0;
+    for (uint32_t index = 1; index <= count; ++index) {
+        if (index == count || offsets[index] != offsets[index - 1] + iov[index - 1].iov_len) {
+            minifs_queue_write(fs, &batch, iov + begin, index - begin, offsets[begin]);
+            begin = index;
+        }
+    }
+    minifs_wait_batch(fs, &batch);
+    free(iov);
+    free(offsets);
+}
+
+
+// inodes with delayed appends are taken out of dirty set, so their
+// entries on disk keep size which matches their blocks; returns count
+static uint32_t hold_delayed(Filesystem *fs, uint32_t **held) {
+    *held = NULL;
+    if (fs->delayed_inodes.count == 0) {
+        return 0;
+    }
+    DirtySet *set = &fs->dirty_inodes;
+    uint32_t count = 0, kept = 0;
+    *held = (uint32_t*) malloc(set->count * sizeof(uint32_t));
+    for (uint32_t item = 0; item < set->count; ++item) {
+        uint32_t index = set->items[item];
+        if (fs->delayed[index].size > 0) {
+            (*held)[count++] = index;
+            set->bits[index / 64] &= ~(1ull << (index % 64));
+        } else {
+            set->items[kept++] = index;
+        }
+    }
+    set->count = kept;
+    return count;
+}
+
+
+void minifs_update_superblock(Filesystem *fs) {
+    minifs_lock_alloc(fs);
+    uint32_t *held;
+    uint32_t count = hold_delayed(fs, &held);
+    bool empty = fs->dirty_inodes.count == 0 && fs->dirty_blocks.count == 0 &&
+                 fs->dirty_inode_words.count == 0 && fs->dirty_block_words.count == 0;
+    if (fs->journal != NULL) {
+        journal_log(fs);
+    } else {
+        if (!empty) {  // appends held in delayed buffers may leave nothing to write
+            // entries and extent nodes go to image before tables which point to them
+            bcache_flush(fs);
+            minifs_write_metadata(fs, &fs->sblock, fs->inode_bitmap.words, fs->block_bitmap.words,
+                                  &fs->dirty_inodes, &fs->dirty_blocks, &fs->dirty_inode_words, &fs->dirty_block_words);
+        }
+        minifs_dirty_clear(&fs->dirty_inodes);
+        minifs_dirty_clear(&fs->dirty_blocks);
+        minifs_dirty_clear(&fs->dirty_inode_words);
+        minifs_dirty_clear(&fs->dirty_block_words);
+        minifs_sync_image(fs, false);
+    }
+    for (uint32_t item = 0; item < count; ++item) {
+        minifs_dirty_add(&fs->dirty_inodes, held[item]);
+    }
+    free(held);
+    minifs_unlock_alloc(fs);
+}
+
+
+// block is neither used nor preallocated
+static bool block_free(Filesystem *fs, int64_t index) {
+    return index >= 0 && index < fs->sblock.block_count &&
+           !bitmap_test(&fs->block_bitmap, index) && !bitmap_test(&fs->reserved, index);
+}
+
+
+static void take_data_block(Filesystem *fs, uint32_t index) {
+    fs->sblock.block_map[index].type = MINIFS_BLOCK_USED;
+    fs->sblock.block_map[index].next_block = -1;
+    fs->sblock.block_map[index].size = 0;
+    minifs_take_block(fs, index);
+}
+
+
+int32_t minifs_alloc_run(Filesystem *fs, int32_t goal, uint32_t want, uint32_t *length) {
+    minifs_lock_alloc(fs);
+    int64_t start = goal;
+    if (!block_free(fs, goal)) {
+        // multi-block append goes to first hole which holds it whole
+        start = (want > 1) ? bitmap_find_run(&fs->block_bitmap, &fs->reserved, want) : -1;
+        if (start < 0) {
+            start = minifs_find_free_block(fs);
+        }
+    }
+    *length = 0;
+    if (start < 0) {
+        minifs_unlock_alloc(fs);
+        return -1;
+    }
+
+    while (*length < want && block_free(fs, start + *length)) {
+        take_data_block(fs, start + *length);
+        ++(*length);
+    }
+    minifs_unlock_alloc(fs);
+    return start;
+}
+
+
+int32_t minifs_alloc_file_run(Filesystem *fs, uint32_t inode_id, int32_t goal, uint32_t want, uint32_t *length) {
+    minifs_lock_alloc(fs);
+    Prealloc *window = &fs->prealloc[inode_id];
+    if (window->length > 0 && window->start == goal) {
+        *length = (want < window->length) ? want : window->length;
+        for (uint32_t index = goal; index < goal + *length; ++index) {
+            bitmap_clear(&fs->reserved, index);
+            take_data_block(fs, index);
+        }
+        window->start += *length;
+        window->length -= *length;
+        minifs_unlock_alloc(fs);
+        return goal;
+    }
+
+    // tail has moved away from window, new one follows new tail
+    minifs_release_prealloc(fs, inode_id);
+    int32_t start = minifs_alloc_run(fs, goal, want, length);
+    if (start >= 0 && goal >= 0) {  // only files which grow get window
+        window->start = start + *length;
+        while (window->length < fs->prealloc_blocks && block_free(fs, window->start + window->length)) {
+            bitmap_set(&fs->reserved, window->start + window->length);
+            window->length++;
+        }
+    }
+    minifs_unlock_alloc(fs);
+    return start;
+}
+
+
+void minifs_release_prealloc(Filesystem *fs, uint32_t inode_id) {
+    minifs_lock_alloc(fs);
+    Prealloc *window = &fs->prealloc[inode_id];
+    for (uint32_t index = 0; index < window->length; ++index) {
+        bitmap_clear(&fs->reserved, window->start + index);
+    }
+    window->length = 0;
+    minifs_unlock_alloc(fs);
+}
+
+
+static void index_push(BlockIndex *index, int32_t block) {
+    if (index->count == index->capacity) {
+        index->capacity *= 2;
+        index->blocks = (int32_t*) realloc(index->blocks, index->capacity * sizeof(int32_t));
+    }
+    index->blocks[index->count++] = block;
+}
+
+
+static void index_build(Filesystem *fs, uint32_t inode_id, BlockIndex *index) {
+    index->count = 0;
+    index->capacity = 8;
+    index->blocks = (int32_t*) malloc(index->capacity * sizeof(int32_t));
+    index->damaged = false;
+
+    if (fs->sblock.inode_map[inode_id].flags & MINIFS_INODE_EXTENTS) {
+        uint32_t count;
+        Extent *extents = extent_list_stored(fs, inode_id, &count);
+        index->damaged = (extents == NULL);
+        for (uint32_t item = 0; item < count; ++item) {
+            while (index->count < extents[item].logical) {
+                index_push(index, -1);
+            }
+            for (uint32_t block = 0; block < extents[item].length; ++block) {
+                index_push(index, extents[item].start + block);
+            }
+        }
+        free(extents);
+        return;
+    }
+
+    int32_t current_block = fs->sblock.inode_map[inode_id].root_block;
+    while (current_block >= 0) {
+        index_push(index, current_block);
+        current_block = fs->sblock.block_map[current_block].next_block;
+    }
+}
+
+
+// block index of blocks which inode has now, delayed appends are not flushed
+static BlockIndex *stored_index(Filesystem *fs, uint32_t inode_id) {
+    BlockIndex *index = &fs->indexes[inode_id];
+    if (__atomic_load_n(&index->blocks, __ATOMIC_ACQUIRE) != NULL) {
+        return index;
+    }
+
+    // several readers of inode may come here at once, index is
+    // built aside and published by its blocks pointer
+    pthread_mutex_lock(&fs->locks->index);
+    if (index->blocks == NULL) {
+        BlockIndex built;
+        index_build(fs, inode_id, &built);
+        index->count = built.count;
+        index->capacity = built.capacity;
+        index->damaged = built.damaged;
+        __atomic_store_n(&index->blocks, built.blocks, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&fs->locks->index);
+    return index;
+}
+
+
+BlockIndex *minifs_block_index(Filesystem *fs, uint32_t inode_id) {
+    minifs_flush_delayed(fs, inode_id);
+    return stored_index(fs, inode_id);
+}
+
+
+void minifs_drop_index(Filesystem *fs, uint32_t inode_id) {
+    free(fs->indexes[inode_id].blocks);
+    fs->indexes[inode_id].blocks = NULL;
+    fs->indexes[inode_id].count = 0;
+    fs->indexes[inode_id].capacity = 0;
+    free(fs->indexes[inode_id].clusters);
+    fs->indexes[inode_id].clusters = NULL;
+    fs->indexes[inode_id].cluster_count = 0;
+    fs->indexes[inode_id].cluster_capacity = 0;
+    fs->indexes[inode_id].damaged = false;
+}
+
+
+bool minifs_file_readable(Filesystem *fs, uint32_t inode_id) {
+    if (fs->sblock.inode_map[inode_id].flags & MINIFS_INODE_INLINE) {
+        return true;
+    }
+    return !stored_index(fs, inode_id)->damaged;
+}
+
+
+uint32_t minifs_file_fragments(Filesystem *fs, uint32_t inode_id) {
+    BlockIndex *index = stored_index(fs, inode_id);
+    uint32_t result = 0;
+    for (uint32_t number = 0; number < index->count; ++number) {
+        int32_t block = index->blocks[number];
+        if (block >= 0 && (number == 0 || index->blocks[number - 1] < 0 || block != index->blocks[number - 1] + 1)) {
+            ++result;
+        }
+    }
+    return result;
+}
+
+
+uint32_t minifs_stored_size(Filesystem *fs, uint32_t inode_id) {
+    if (fs->sblock.inode_map[inode_id].flags & MINIFS_INODE_INLINE) {
+        return 0;
+    }
+    BlockIndex *index = stored_index(fs, inode_id);
+    uint32_t result = 0;
+    for (uint32_t number = 0; number < index->count; ++number) {
+        if (index->blocks[number] >= 0) {
+            result += fs->sblock.block_map[index->blocks[number]].size;
+        }
+    }
+    return result;
+}
+
+
+uint32_t minifs_file_blocks(Filesystem *fs, uint32_t inode_id) {
+    if (fs->sblock.inode_map[inode_id].flags & MINIFS_INODE_INLINE) {
+        return 0;
+    }
+    BlockIndex *index = stored_index(fs, inode_id);
+    uint32_t result = 0;
+    for (uint32_t number = 0; number < index->count; ++number) {
+        result += index->blocks[number] >= 0;  // holes take no blocks
+    }
+    return result;
+}
+
+
+int32_t minifs_file_block(Filesystem *fs, uint32_t inode_id, uint32_t number) {
+    BlockIndex *index = minifs_block_index(fs, inode_id);
+    if (number >= index->count) {
+        return -1;
+    }
+    return index->blocks[number];
+}
+
+
+void minifs_free_blocks(Filesystem *fs, uint32_t inode_id) {
+    pthread_mutex_lock(&fs->locks->delayed);  // appends of removed file are dropped
+    fs->delayed_blocks -= fs->delayed[inode_id].blocks;
+    free(fs->delayed[inode_id].data);
+    fs->delayed[inode_id] = (DelayedBuffer) {0};
+    pthread_mutex_unlock(&fs->locks->delayed);
+    minifs_drop_index(fs, inode_id);
+    minifs_release_prealloc(fs, inode_id);
+    if (fs->sblock.inode_map[inode_id].flags & MINIFS_INODE_EXTENTS) {
+        extent_free(fs, inode_id);
+        return;
+    }
+
+    int32_t current_block = fs->sblock.inode_map[inode_id].root_block;
+    while (current_block > 0) {
+        int32_t next_block = fs->sblock.block_map[current_block].next_block;
+        fs->sblock.block_map[current_block].type = MINIFS_BLOCK_EMPTY;
+        fs->sblock.block_map[current_block].size = 0;
+        fs->sblock.block_map[current_block].next_block = 0;
+        minifs_release_block(fs, current_block);
+        current_block = next_block;
+    }
+}
+
+
+// moves data of inline file to blocks before it outgrows inline area,
+// file becomes extent mapped and its inline area is cleared
+static void spill_inline(Filesystem *fs, uint32_t inode_id) {
+    Inode *inode = &fs->sblock.inode_map[inode_id];
+    minifs_lock_alloc(fs);
+    int32_t root = minifs_find_free_block(fs);
+    if (root < 0) {
+        fprintf(stderr, "Ran out of free blocks\n");
+        exit(-1);
+    }
+    fs->sblock.block_map[root].size = 0;
+    fs->sblock.block_map[root].next_block = -1;
+    fs->sblock.block_map[root].type = MINIFS_BLOCK_USED;
+    minifs_take_block(fs, root);
+    minifs_unlock_alloc(fs);
+    extent_init(fs, root);
+
+    inode->root_block = root;
+    inode->flags = (inode->flags & ~MINIFS_INODE_INLINE) | MINIFS_INODE_EXTENTS;
+    minifs_mark_inode(fs, inode_id);
+    minifs_drop_index(fs, inode_id);  // empty index of inline file
+    unsigned char *area = minifs_inline_data(fs, inode_id);
+    if (inode->size > 0) {
+        minifs_append_data(fs, inode_id, area, inode->size);
+    }
+    memset(area, 0, minifs_inline_capacity(fs));
+}
+
+
+// reserves count blocks at end of file, returns count of reserved ones
+uint32_t minifs_reserve_blocks(Filesystem *fs, uint32_t inode_id, uint32_t count) {
+    if (fs->sblock.inode_map[inode_id].flags & MINIFS_INODE_INLINE) {
+        if (count == 0) {
+            return 0;
+        }
+        spill_inline(fs, inode_id);
+    }
+    BlockIndex *index = minifs_block_index(fs, inode_id);
+    uint32_t logical = index->count;
+    int32_t goal = (index->count > 0) ? index->blocks[index->count - 1] + 1 : -1;
+    uint32_t taken = 0;
+
+    minifs_lock_alloc(fs);
+    while (taken < count) {
+        uint32_t length;
+        int32_t start = minifs_alloc_file_run(fs, inode_id, goal, count - taken, &length);
+        if (start < 0) {
+            break;
+        }
+        for (uint32_t block = 0; block < length; ++block) {
+            index_push(index, start + block);
+        }
+        extent_append(fs, inode_id, logical, start, length);
+        logical += length;
+        goal = start + length;
+        taken += length;
+    }
+    minifs_unlock_alloc(fs);
+    return taken;
+}
+
+
+bool minifs_fill_blocks(Filesystem *fs, uint32_t inode_id, uint32_t first, int fd, uint32_t size) {
+    if (fs->sblock.inode_map[inode_id].flags & MINIFS_INODE_INLINE) {
+        unsigned char *area = minifs_inline_data(fs, inode_id);
+        uint32_t done = 0;
+        while (done < size) {
+            ssize_t status = read(fd, area + done, size - done);
+            if (status <= 0) {
+                return false;
+            }
+            done += status;
+        }
+        minifs_mark_inode(fs, inode_id);
+        return true;
+    }
+
+    uint32_t block_size = fs->sblock.block_size;
+    uint32_t chunk_blocks = IMPORT_CHUNK_SIZE / block_size;
+    BlockIndex *index = minifs_block_index(fs, inode_id);
+    unsigned char *buffer = (fs->image == NULL) ? (unsigned char*) malloc(IMPORT_CHUNK_SIZE) : NULL;
+    bool result = true;
+
+    uint32_t number = first;
+    while (size > 0 && result) {
+        // run of adjacent blocks, at most one chunk long
+        int32_t start = index->blocks[number];
+        uint32_t length = 1;
+        while (number + length < index->count && length < chunk_blocks &&
+               length * block_size < size && index->blocks[number + length] == start + length) {
+            ++length;
+        }
+        uint32_t bytes = (length * block_size < size) ? length * block_size : size;
+
+        // mapped bodies are filled by read itself
+        unsigned char *body = minifs_block_body(fs, start);
+        unsigned char *target = (body != NULL) ? body : buffer;
+        uint32_t done = 0;
+        while (done < bytes) {
+            ssize_t status = read(fd, target + done, bytes - done);
+            if (status <= 0) {
+                result = false;
+                break;
+            }
+            done += status;
+        }
+        if (body != NULL) {
+            touch_image(fs, body - fs->image, done);
+        } else {
+            minifs_write_body(fs, start, buffer, done, 0);
+        }
+
+        for (uint32_t block = 0; block < length; ++block) {
+            uint32_t rest = (done > block * block_size) ? done - block * block_size : 0;
+            fs->sblock.block_map[start + block].size = (rest < block_size) ? rest : block_size;
+            minifs_mark_block(fs, start + block);
+        }
+        number += length;
+        size -= bytes;
+    }
+    free(buffer);
+    return result;
+}
+
+
+// puts data to new runs of blocks after last block of index
+static void append_runs(Filesystem *fs, uint32_t inode_id, BlockIndex *index, int32_t goal,
+                        const unsigned char *data, uint32_t data_size) {
+    uint32_t block_size = fs->sblock.block_size;
+    uint32_t logical = index->count;
+    while (data_size > 0) {
+        uint32_t length;
+        int32_t start = minifs_alloc_file_run(fs, inode_id, goal, (data_size + block_size - 1) / block_size, &length);
+        if (start < 0) {
+            fprintf(stderr, "Ran out of free blocks\n");
+            exit(-1);
+        }
+
+        // bodies of run are contiguous in image, so it is one write
+        uint32_t size = (length * block_size < data_size) ? length * block_size : data_size;
+        minifs_write_body(fs, start, data, size, 0);
+        for (uint32_t block = 0; block < length; ++block) {
+            uint32_t rest = size - block * block_size;
+            fs->sblock.block_map[start + block].size = (rest < block_size) ? rest : block_size;
+            index_push(index, start + block);
+        }
+        extent_append(fs, inode_id, logical, start, length);
+
+        logical += length;
+        goal = start + length;
+        data += size;
+        data_size -= size;
+    }
+}
+
+
+// appends data to extent mapped file: tail block is filled first,
+// then data goes to runs of blocks allocated right after the last one
+static void append_extents(Filesystem *fs, uint32_t inode_id, const unsigned char *data, uint32_t data_size) {
+    uint32_t block_size = fs->sblock.block_size;
+    BlockIndex *index = minifs_block_index(fs, inode_id);
+    int32_t goal = -1;
+
+    if (index->count > 0) {
+        int32_t tail = index->blocks[index->count - 1];
+        uint32_t fill = fs->sblock.block_map[tail].size;
+        uint32_t delta = (block_size - fill < data_size) ? block_size - fill : data_size;
+        if (delta > 0) {
+            minifs_write_body(fs, tail, data, delta, fill);
+            fs->sblock.block_map[tail].size += delta;
+            minifs_mark_block(fs, tail);
+            data += delta;
+            data_size -= delta;
+        }
+        goal = tail + 1;
+    }
+    append_runs(fs, inode_id, index, goal, data, data_size);
+}
+
+
+// file grows from "from" to "to" bytes: tail block gets zeros up to its
+// end, whole blocks after it stay holes and only block with new end is taken
+static void extend_sparse(Filesystem *fs, uint32_t inode_id, uint32_t from, uint32_t to) {
+    uint32_t block_size = fs->sblock.block_size;
+    BlockIndex *index = minifs_block_index(fs, inode_id);
+    unsigned char *zeros = (unsigned char*) calloc(block_size, 1);
+    uint32_t tail_end = (from + block_size - 1) / block_size * block_size;
+    uint32_t filled = (to < tail_end) ? to : tail_end;
+    if (filled > from) {
+        append_extents(fs, inode_id, zeros, filled - from);
+    }
+    if (to > filled) {
+        uint32_t last = (to - 1) / block_size;
+        int32_t goal = (index->count > 0) ? index->blocks[index->count - 1] + 1 : -1;
+        while (index->count < last) {
+            index_push(index, -1);
+        }
+        append_runs(fs, inode_id, index, goal, zeros, to - last * block_size);
+    }
+    free(zeros);
+    minifs_mark_inode(fs, inode_id);  // entry goes to disk with its new blocks, never delayed
+}
+
+
+// takes zeroed blocks for holes from block number on, at most length of them
+static uint32_t fill_hole(Filesystem *fs, uint32_t inode_id, BlockIndex *index, uint32_t number, uint32_t length) {
+    uint32_t block_size = fs->sblock.block_size;
+    int32_t goal = (number > 0 && index->blocks[number - 1] >= 0) ? index->blocks[number - 1] + 1 : -1;
+    uint32_t taken;
+    int32_t start = minifs_alloc_run(fs, goal, length, &taken);
+    if (start < 0) {
+        fprintf(stderr, "Ran out of free blocks\n");
+        exit(-1);
+    }
+    unsigned char *zeros = (unsigned char*) calloc(taken, block_size);
+    minifs_write_body(fs, start, zeros, taken * block_size, 0);
+    free(zeros);
+    for (uint32_t block = 0; block < taken; ++block) {
+        fs->sblock.block_map[start + block].size = block_size;  // hole is never last block
+        index->blocks[number + block] = start + block;
+    }
+    extent_insert(fs, inode_id, number, start, taken);
+    return taken;
+}
+
+
+static void cut_blocks(Filesystem *fs, uint32_t inode_id, uint32_t size);
+
+
+// reads or writes bytes of file blocks from offset as one stream,
+// runs of adjacent blocks go with one call
+static void stored_io(Filesystem *fs, BlockIndex *index, void *data, uint32_t size, uint32_t offset, bool write) {
+    uint32_t block_size = fs->sblock.block_size;
+    uint32_t number = offset / block_size;
+    uint32_t inner = offset % block_size;
+    while (size > 0) {
+        int32_t first = index->blocks[number];
+        uint32_t length = 1;
+        while (length * block_size - inner < size && number + length < index->count &&
+               index->blocks[number + length] == first + length) {
+            ++length;
+        }
+        uint32_t bytes = (length * block_size - inner < size) ? length * block_size - inner : size;
+        if (write) {
+            minifs_write_body(fs, first, data, bytes, inner);
+        } else {
+            minifs_read_body(fs, first, data, bytes, inner);
+        }
+        data = (unsigned char*) data + bytes;
+        size -= bytes;
+        number += length;
+        inner = 0;
+    }
+}
+
+
+// compressed file has no holes, every block but the last one is full
+static uint32_t stored_end(Filesystem *fs, BlockIndex *index) {
+    if (index->count == 0) {
+        return 0;
+    }
+    int32_t tail = index->blocks[index->count - 1];
+    return (index->count - 1) * fs->sblock.block_size + fs->sblock.block_map[tail].size;
+}
+
+
+static void cluster_push(BlockIndex *index, uint32_t offset) {
+    if (index->cluster_count == index->cluster_capacity) {
+        index->cluster_capacity *= 2;
+        index->clusters = (uint32_t*) realloc(index->clusters, index->cluster_capacity * sizeof(uint32_t));
+    }
+    index->clusters[index->cluster_count++] = offset;
+}
+
+
+// block index of compressed file with offsets of its clusters,
+// they are found once by walking cluster headers
+static BlockIndex *cluster_index(Filesystem *fs, uint32_t inode_id) {
+    BlockIndex *index = minifs_block_index(fs, inode_id);
+    if (__atomic_load_n(&index->clusters, __ATOMIC_ACQUIRE) != NULL) {
+        return index;
+    }
+
+    pthread_mutex_lock(&fs->locks->index);
+    if (index->clusters == NULL) {
+        BlockIndex built = {.cluster_count = 0, .cluster_capacity = 8};
+        built.clusters = (uint32_t*) malloc(built.cluster_capacity * sizeof(uint32_t));
+        uint32_t end = stored_end(fs, index);
+        for (uint32_t offset = 0; offset < end; ) {
+            ClusterHeader header;
+            stored_io(fs, index, &header, sizeof(header), offset, false);
+            cluster_push(&built, offset);
+            offset += sizeof(header) + header.space;
+        }
+        index->cluster_count = built.cluster_count;
+        index->cluster_capacity = built.cluster_capacity;
+        __atomic_store_n(&index->clusters, built.clusters, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&fs->locks->index);
+    return index;
+}
+
+
+// decodes cluster body to data which has room for COMPRESS_CLUSTER_SIZE bytes
+static uint32_t decode_cluster(const unsigned char *stored, unsigned char *data, uint32_t number) {
+    ClusterHeader header;
+    memcpy(&header, stored, sizeof(header));
+    const unsigned char *body = stored + sizeof(header);
+    if (header.raw_size > COMPRESS_CLUSTER_SIZE || header.packed_size > header.space) {
+        debug(MINIFS_ERR "cluster %u of compressed file is corrupted", number);
+        exit(-1);
+    }
+    if (header.packed_size == header.raw_size) {  // kept as is
+        memcpy(data, body, header.raw_size);
+    } else if (lz_decompress(body, header.packed_size, data, COMPRESS_CLUSTER_SIZE) != header.raw_size) {
+        debug(MINIFS_ERR "cluster %u of compressed file is corrupted", number);
+        exit(-1);
+    }
+    return header.raw_size;
+}
+
+
+// reads cluster with its header by one call and decodes it, returns its data size
+static uint32_t load_cluster(Filesystem *fs, BlockIndex *index, uint32_t number, unsigned char *data) {
+    uint32_t offset = index->clusters[number];
+    uint32_t end = (number + 1 < index->cluster_count) ? index->clusters[number + 1] : stored_end(fs, index);
+    unsigned char *stored = (unsigned char*) malloc(end - offset);
+    stored_io(fs, index, stored, end - offset, offset, false);
+    uint32_t size = decode_cluster(stored, data, number);
+    free(stored);
+    return size;
+}
+
+
+// size of file data kept in clusters
+static uint32_t clusters_size(Filesystem *fs, BlockIndex *index) {
+    if (index->cluster_count == 0) {
+        return 0;
+    }
+    ClusterHeader header;
+    stored_io(fs, index, &header, sizeof(header), index->clusters[index->cluster_count - 1], false);
+    return (index->cluster_count - 1) * COMPRESS_CLUSTER_SIZE + header.raw_size;
+}
+
+
+// puts header and coded data to packed, data which coding does not
+// shrink is kept as is; returns size of packed cluster
+static uint32_t pack_cluster(const unsigned char *data, uint32_t size, unsigned char *packed) {
+    ClusterHeader header = {.raw_size = size};
+    header.packed_size = (size > 0) ? lz_compress(data, size, packed + sizeof(header), size - 1) : 0;
+    if (header.packed_size == 0) {
+        memcpy(packed + sizeof(header), data, size);
+        header.packed_size = size;
+    }
+    header.space = header.packed_size;
+    memcpy(packed, &header, sizeof(header));
+    return sizeof(header) + header.packed_size;
+}
+
+
+// clusters from "first" on are replaced by data coded cluster by cluster,
+// new clusters are appended to file by one write
+static void write_clusters(Filesystem *fs, uint32_t inode_id, uint32_t first, const unsigned char *data, uint32_t size) {
+    BlockIndex *index = cluster_index(fs, inode_id);
+    if (first < index->cluster_count) {
+        cut_blocks(fs, inode_id, index->clusters[first]);
+        index->cluster_count = first;
+    }
+    uint32_t count = (size + COMPRESS_CLUSTER_SIZE - 1) / COMPRESS_CLUSTER_SIZE;
+    unsigned char *packed = (unsigned char*) malloc((uint64_t) count * (sizeof(ClusterHeader) + COMPRESS_CLUSTER_SIZE) + 1);
+    uint32_t offset = stored_end(fs, index);
+    uint32_t packed_size = 0;
+    for (uint32_t done = 0; done < size; done += COMPRESS_CLUSTER_SIZE) {
+        uint32_t piece = (size - done < COMPRESS_CLUSTER_SIZE) ? size - done : COMPRESS_CLUSTER_SIZE;
+        cluster_push(index, offset + packed_size);
+        packed_size += pack_cluster(data + done, piece, packed + packed_size);
+    }
+    append_extents(fs, inode_id, packed, packed_size);
+    free(packed);
+}
+
+
+// appended data fills up last cluster first, so only it is coded again
+static void append_compressed(Filesystem *fs, uint32_t inode_id, const unsigned char *data, uint32_t data_size) {
+    BlockIndex *index = cluster_index(fs, inode_id);
+    uint32_t count = index->cluster_count;
+    unsigned char *merged = NULL;
+    uint32_t tail = 0;
+    if (count > 0) {
+        merged = (unsigned char*) malloc(COMPRESS_CLUSTER_SIZE + data_size);
+        tail = load_cluster(fs, index, count - 1, merged);
+    }
+    if (tail > 0 && tail < COMPRESS_CLUSTER_SIZE) {
+        memcpy(merged + tail, data, data_size);
+        write_clusters(fs, inode_id, count - 1, merged, tail + data_size);
+    } else {
+        write_clusters(fs, inode_id, count, data, data_size);
+    }
+    free(merged);
+}
+
+
+// reads range inside compressed file, every cluster which covers it is decoded
+static void read_compressed(Filesystem *fs, uint32_t inode_id, unsigned char *data, uint32_t size, uint32_t offset) {
+    BlockIndex *index = cluster_index(fs, inode_id);
+    unsigned char *cluster = (unsigned char*) malloc(COMPRESS_CLUSTER_SIZE);
+    while (size > 0) {
+        uint32_t number = offset / COMPRESS_CLUSTER_SIZE;
+        uint32_t inner = offset % COMPRESS_CLUSTER_SIZE;
+        if (number >= index->cluster_count) {
+            break;
+        }
+        uint32_t raw = load_cluster(fs, index, number, cluster);
+        if (raw <= inner) {
+            break;
+        }
+        uint32_t bytes = (raw - inner < size) ? raw - inner : size;
+        memcpy(data, cluster + inner, bytes);
+        data += bytes;
+        offset += bytes;
+        size -= bytes;
+    }
+    free(cluster);
+}
+
+
+// overwrites data inside compressed file: touched cluster is coded again
+// and stays in place when it fits space of old one, otherwise it is
+// written again together with all clusters after it
+static void write_compressed(Filesystem *fs, uint32_t inode_id, const unsigned char *data, uint32_t size, uint32_t offset) {
+    BlockIndex *index = cluster_index(fs, inode_id);
+    unsigned char *cluster = (unsigned char*) malloc(COMPRESS_CLUSTER_SIZE);
+    unsigned char *packed = (unsigned char*) malloc(sizeof(ClusterHeader) + COMPRESS_CLUSTER_SIZE);
+    while (size > 0) {
+        uint32_t number = offset / COMPRESS_CLUSTER_SIZE;
+        uint32_t inner = offset % COMPRESS_CLUSTER_SIZE;
+        uint32_t raw = load_cluster(fs, index, number, cluster);
+        uint32_t bytes = (raw - inner < size) ? raw - inner : size;
+        memcpy(cluster + inner, data, bytes);
+        data += bytes;
+        offset += bytes;
+        size -= bytes;
+
+        ClusterHeader old;
+        stored_io(fs, index, &old, sizeof(old), index->clusters[number], false);
+        uint32_t packed_size = pack_cluster(cluster, raw, packed);
+        ClusterHeader *header = (ClusterHeader*) packed;
+        if (header->packed_size <= old.space) {
+            header->space = old.space;
+            stored_io(fs, index, packed, packed_size, index->clusters[number], true);
+            continue;
+        }
+
+        // rest of write goes to decoded tail of file, which is coded again
+        uint32_t start = number * COMPRESS_CLUSTER_SIZE;
+        uint32_t total = clusters_size(fs, index) - start;
+        unsigned char *rest = (unsigned char*) malloc(total + COMPRESS_CLUSTER_SIZE);
+        memcpy(rest, cluster, raw);
+        for (uint32_t next = number + 1; next < index->cluster_count; ++next) {
+            load_cluster(fs, index, next, rest + (next - number) * COMPRESS_CLUSTER_SIZE);
+        }
+        memcpy(rest + (offset - start), data, size);
+        write_clusters(fs, inode_id, number, rest, total);
+        free(rest);
+        break;
+    }
+    free(packed);
+    free(cluster);
+}
+
+
+// cluster with new end is coded again, clusters after it are released
+static void cut_compressed(Filesystem *fs, uint32_t inode_id, uint32_t size) {
+    BlockIndex *index = cluster_index(fs, inode_id);
+    uint32_t number = size / COMPRESS_CLUSTER_SIZE;
+    uint32_t keep = size % COMPRESS_CLUSTER_SIZE;
+    unsigned char *cluster = NULL;
+    if (keep > 0) {
+        cluster = (unsigned char*) malloc(COMPRESS_CLUSTER_SIZE);
+        load_cluster(fs, index, number, cluster);
+    }
+    write_clusters(fs, inode_id, number, cluster, keep);
+    free(cluster);
+}
+
+
+// table entry of inode has changes which are not written yet
+static bool inode_dirty(Filesystem *fs, uint32_t inode_id) {
+    minifs_lock_alloc(fs);
+    bool result = fs->dirty_inodes.bits[inode_id / 64] & (1ull << (inode_id % 64));
+    minifs_unlock_alloc(fs);
+    return result;
+}
+
+
+// keeps appended bytes in delayed buffer of inode, returns false if they
+// must be written now: inline file, directory or entry with other changes
+static bool delay_append(Filesystem *fs, uint32_t inode_id, const unsigned char *data, uint32_t data_size) {
+    const Inode inode = fs->sblock.inode_map[inode_id];
+    if (fs->delayed_limit == 0 || inode.type != MINIFS_INODE_FILE || (inode.flags & MINIFS_INODE_INLINE)) {
+        return false;
+    }
+    pthread_mutex_lock(&fs->locks->delayed);
+    DelayedBuffer *buffer = &fs->delayed[inode_id];
+    if (buffer->size == 0 && inode_dirty(fs, inode_id)) {
+        pthread_mutex_unlock(&fs->locks->delayed);
+        return false;
+    }
+    // blocks for whole buffer and tail node are promised now, so flush never runs out of them
+    uint32_t block_size = fs->sblock.block_size;
+    uint64_t bytes = (uint64_t) buffer->size + data_size;
+    if (inode.flags & MINIFS_INODE_COMPRESSED) {  // last cluster is written again, data may stay uncoded
+        bytes += COMPRESS_CLUSTER_SIZE + (bytes / COMPRESS_CLUSTER_SIZE + 2) * sizeof(ClusterHeader);
+    }
+    uint32_t blocks = (uint32_t) ((bytes + block_size - 1) / block_size) + 1;
+    if (blocks - buffer->blocks > minifs_free_block_count(fs)) {
+        pthread_mutex_unlock(&fs->locks->delayed);
+        return false;
+    }
+    fs->delayed_blocks += blocks - buffer->blocks;
+    buffer->blocks = blocks;
+    if (buffer->size + data_size > buffer->capacity) {
+        uint32_t capacity = (buffer->capacity > 0) ? buffer->capacity : 4096;
+        while (capacity < buffer->size + data_size) {
+            capacity *= 2;
+        }
+        buffer->data = (unsigned char*) realloc(buffer->data, capacity);
+        buffer->capacity = capacity;
+    }
+    memcpy(buffer->data + buffer->size, data, data_size);
+    __atomic_store_n(&buffer->size, buffer->size + data_size, __ATOMIC_RELEASE);
+    minifs_dirty_add(&fs->delayed_inodes, inode_id);
+    bool full = buffer->size >= fs->delayed_limit;
+    pthread_mutex_unlock(&fs->locks->delayed);
+    if (full) {
+        minifs_flush_delayed(fs, inode_id);
+    }
+    return true;
+}
+
+
+static void append_now(Filesystem *fs, uint32_t inode_id, const unsigned char *data, uint32_t data_size) {
+    const Inode inode = fs->sblock.inode_map[inode_id];
+    if (inode.flags & MINIFS_INODE_INLINE) {
+        if ((uint64_t) inode.size + data_size <= minifs_inline_capacity(fs)) {
+            memcpy(minifs_inline_data(fs, inode_id) + inode.size, data, data_size);
+            minifs_mark_inode(fs, inode_id);
+            return;
+        }
+        spill_inline(fs, inode_id);
+        append_extents(fs, inode_id, data, data_size);
+        return;
+    }
+    if (inode.flags & MINIFS_INODE_COMPRESSED) {
+        append_compressed(fs, inode_id, data, data_size);
+        return;
+    }
+    if (inode.flags & MINIFS_INODE_EXTENTS) {
+        append_extents(fs, inode_id, data, data_size);
+        return;
+    }
+
+    BlockIndex *index = minifs_block_index(fs, inode_id);
+    int32_t current_block_id = index->blocks[index->count - 1];  // last block of chain
+    Block block = fs->sblock.block_map[current_block_id];
+
+    if ((fs->sblock.block_size - block.size) >= data_size) { // if free space in block is enough
+        minifs_write_body(fs, current_block_id, data, data_size, block.size);
+        fs->sblock.block_map[current_block_id].size += data_size;
+        minifs_mark_block(fs, current_block_id);
+    } else { // else -- write some data to current and allocate new block
+        if (block.size < fs->sblock.block_size) {
+            uint32_t delta = fs->sblock.block_size - block.size;
+            minifs_write_body(fs, current_block_id, data, delta, block.size);
+            fs->sblock.block_map[current_block_id].size = fs->sblock.block_size;
+            minifs_mark_block(fs, current_block_id);
+            data += delta;
+            data_size -= delta;
+        }
+
+        while (data_size > 0) { // data can be too large for one new page
+            uint32_t length;
+            int32_t new_block = minifs_alloc_file_run(fs, inode_id, current_block_id + 1, 1, &length);
+            if (new_block < 0) {
+                fprintf(stderr, "Ran out of free blocks\n");
+                exit(-1);
+            }
+
+            fs->sblock.block_map[current_block_id].next_block = new_block; // linking new block
+            minifs_mark_block(fs, current_block_id);
+            index_push(index, new_block);
+
+            if (data_size <= fs->sblock.block_size) { // if data finally fits new block size
+                minifs_write_body(fs, new_block, data, data_size, 0);
+                fs->sblock.block_map[new_block].size = data_size;
+                return;
+            } else { // if data is still to large to fit one block
+                minifs_write_body(fs, new_block, data, fs->sblock.block_size, 0);
+                fs->sblock.block_map[new_block].size = fs->sblock.block_size;
+                data += fs->sblock.block_size;
+                data_size -= fs->sblock.block_size;
+            }
+
+            current_block_id = new_block;
+        }
+    }
+}
+
+
+void minifs_append_data(Filesystem *fs, uint32_t inode_id, const unsigned char *data, uint32_t data_size) {
+    if (delay_append(fs, inode_id, data, data_size)) {
+        return;
+    }
+    minifs_flush_delayed(fs, inode_id);  // earlier appends go first
+    uint32_t blocks = data_size / fs->sblock.block_size + 2;
+    if (fs->delayed_blocks > 0 && blocks > minifs_free_block_count(fs)) {
+        minifs_flush_all_delayed(fs);  // promised blocks are taken before others get them
+    }
+    append_now(fs, inode_id, data, data_size);
+}
+
+
+void minifs_flush_delayed(Filesystem *fs, uint32_t inode_id) {
+    if (__atomic_load_n(&fs->delayed[inode_id].size, __ATOMIC_ACQUIRE) == 0) {
+        return;
+    }
+    pthread_mutex_lock(&fs->locks->delayed);
+    DelayedBuffer buffer = fs->delayed[inode_id];
+    if (buffer.size == 0) {
+        pthread_mutex_unlock(&fs->locks->delayed);
+        return;
+    }
+    // size of whole buffer is known, so blocks are taken as few runs
+    fs->delayed_blocks -= buffer.blocks;
+    fs->delayed[inode_id] = (DelayedBuffer) {0};
+    append_now(fs, inode_id, buffer.data, buffer.size);
+    pthread_mutex_unlock(&fs->locks->delayed);
+    free(buffer.data);
+}
+
+
+void minifs_flush_all_delayed(Filesystem *fs) {
+    DirtySet *set = &fs->delayed_inodes;
+    pthread_mutex_lock(&fs->locks->delayed);
+    while (set->count > 0) {
+        uint32_t index = set->items[--set->count];
+        set->bits[index / 64] &= ~(1ull << (index % 64));
+        pthread_mutex_unlock(&fs->locks->delayed);
+        minifs_flush_delayed(fs, index);
+        pthread_mutex_lock(&fs->locks->delayed);
+    }
+    pthread_mutex_unlock(&fs->locks->delayed);
+}
+
+
+uint32_t minifs_free_block_count(Filesystem *fs) {
+    uint64_t taken = (uint64_t) fs->sblock.used_block_count + fs->delayed_blocks;
+    return (taken < fs->sblock.block_count) ? fs->sblock.block_count - taken : 0;
+}
+
+
+void minifs_read_entry(Filesystem *fs, uint32_t dir_inode, uint32_t index, DirEntry *entry) {
+    uint32_t per_block = fs->sblock.block_size / sizeof(DirEntry);
+    int32_t block = minifs_file_block(fs, dir_inode, index / per_block);
+    minifs_read_body(fs, block, entry, sizeof(DirEntry), (index % per_block) * sizeof(DirEntry));
+}
+
+
+void minifs_write_entry(Filesystem *fs, uint32_t dir_inode, uint32_t index, const DirEntry *entry) {
+    uint32_t per_block = fs->sblock.block_size / sizeof(DirEntry);
+    int32_t block = minifs_file_block(fs, dir_inode, index / per_block);
+    minifs_write_body(fs, block, entry, sizeof(DirEntry), (index % per_block) * sizeof(DirEntry));
+}
+
+
+uint32_t minifs_append_entry(Filesystem *fs, uint32_t dir_inode, const DirEntry *entry) {
+    minifs_append_data(fs, dir_inode, (const unsigned char*) entry, sizeof(DirEntry));
+    fs->sblock.inode_map[dir_inode].size++;
+    minifs_mark_inode(fs, dir_inode);
+    return fs->sblock.inode_map[dir_inode].size - 1;
+}
+
+
+// first dead entry at or after slot hint or size of directory, header
+// of name index looks like dead entry and is skipped
+static uint32_t find_free_slot(Filesystem *fs, uint32_t dir_inode) {
+    Inode *dir = &fs->sblock.inode_map[dir_inode];
+    uint32_t position = fs->slot_hints[dir_inode];
+    if (position == 0 && (dir->flags & MINIFS_INODE_HASHED)) {
+        position = 1;
+    }
+    if (position >= dir->size) {
+        return dir->size;
+    }
+
+    uint32_t per_block = fs->sblock.block_size / sizeof(DirEntry);
+    DirIterator it;
+    minifs_dir_open(fs, dir_inode, &it);
+    it.block = position / per_block;
+    it.base = it.block * per_block;
+    uint32_t result = dir->size;
+    while (result == dir->size && dir_load(&it)) {
+        for (uint32_t index = position - it.base; index < it.count; ++index) {
+            if (!it.entries[index].used) {
+                result = it.base + index;
+                break;
+            }
+        }
+        position = it.base + it.count;
+    }
+    minifs_dir_close(&it);
+    return result;
+}
+
+
+void minifs_add_to_dir(Filesystem *fs, uint32_t dir_inode, const char *name, uint32_t inode_id) {
+    DirEntry entry;
+    memset(&entry, 0, sizeof(entry));
+    entry.used = 1;
+    snprintf(entry.name, MAX_FILENAME_SIZE, "%s", name);
+    entry.inode = inode_id;
+    uint32_t index = find_free_slot(fs, dir_inode);
+    if (index < fs->sblock.inode_map[dir_inode].size) {
+        minifs_write_entry(fs, dir_inode, index, &entry);
+    } else {
+        index = minifs_append_entry(fs, dir_inode, &entry);
+    }
+    fs->slot_hints[dir_inode] = index + 1;
+    pthread_mutex_lock(&fs->locks->dcache);
+    dcache_insert(fs->dcache, dir_inode, entry.name, inode_id, index);
+    pthread_mutex_unlock(&fs->locks->dcache);
+
+    // directories are indexed once they outgrow one block
+    Inode *dir = &fs->sblock.inode_map[dir_inode];
+    if (dir->flags & MINIFS_INODE_HASHED) {
+        dirhash_insert(fs, dir_inode, entry.name, index);
+    } else if (dir->size > fs->sblock.block_size / sizeof(DirEntry)) {
+        dirhash_build(fs, dir_inode);
+    }
+}
+
+
+static int32_t lookup_dir(Filesystem *fs, uint32_t dir_inode, const char *name, int32_t *entry) {
+    if (fs->sblock.inode_map[dir_inode].flags & MINIFS_INODE_HASHED) {
+        return dirhash_lookup(fs, dir_inode, name, entry);
+    }
+
+    DirIterator it;
+    minifs_dir_open(fs, dir_inode, &it);
+    const DirEntry *current;
+    int32_t result = -1;
+    while ((current = minifs_dir_next(&it)) != NULL) {
+        if (strncmp(current->name, name, MAX_FILENAME_SIZE) == 0) {
+            *entry = it.position;
+            result = current->inode;
+            break;
+        }
+    }
+    minifs_dir_close(&it);
+    return result;
+}
+
+
+int32_t minifs_lookup(Filesystem *fs, uint32_t dir_inode, const char *name, int32_t *entry) {
+    // dentry may be evicted by other thread once lock is released
+    pthread_mutex_lock(&fs->locks->dcache);
+    Dentry *dentry = dcache_find(fs->dcache, dir_inode, name);
+    if (dentry != NULL) {
+        int32_t result = dentry->inode;
+        if (entry != NULL && result >= 0) {
+            *entry = dentry->entry;
+        }
+        pthread_mutex_unlock(&fs->locks->dcache);
+        return result;
+    }
+    pthread_mutex_unlock(&fs->locks->dcache);
+
+    int32_t position = -1;
+    int32_t result = lookup_dir(fs, dir_inode, name, &position);
+    pthread_mutex_lock(&fs->locks->dcache);
+    dcache_insert(fs->dcache, dir_inode, name, result, position);  // negative if not found
+    pthread_mutex_unlock(&fs->locks->dcache);
+    if (entry != NULL && result >= 0) {
+        *entry = position;
+    }
+    return result;
+}
+
+
+// copies next component of path to name, returns rest of path
+// or NULL if component is too long; empty name ends path
+static const char *next_component(const char *path, char *name) {
+    while (*path == '/') {
+        ++path;
+    }
+    size_t length = strcspn(path, "/");
+    if (length >= MAX_FILENAME_SIZE) {
+        return NULL;
+    }
+    memcpy(name, path, length);
+    name[length] = '\0';
+    return path + length;
+}
+
+
+int32_t minifs_resolve(Filesystem *fs, const char *path) {
+    int32_t current = (path[0] == '/') ? 0 : fs->current_dir;
+    char name[MAX_FILENAME_SIZE];
+    while (true) {
+        path = next_component(path, name);
+        if (path == NULL) {
+            return -1;
+        }
+        if (name[0] == '\0') {
+            return current;
+        }
+
+        Inode *inode = &fs->sblock.inode_map[current];
+        if (inode->type != MINIFS_INODE_DIRECTORY) {
+            return -1;
+        }
+        if (strcmp(name, "..") == 0) {
+            current = inode->parent;
+        } else if (strcmp(name, ".") != 0) {
+            minifs_lock_inode(fs, current, false);
+            int32_t child = minifs_lookup(fs, current, name, NULL);
+            minifs_unlock_inode(fs, current);
+            current = child;
+            if (current < 0) {
+                return -1;
+            }
+        }
+    }
+}
+
+
+int32_t minifs_resolve_parent(Filesystem *fs, const char *path, const char **name) {
+    const char *slash = strrchr(path, '/');
+    *name = (slash == NULL) ? path : slash + 1;
+    if (**name == '\0' || strcmp(*name, ".") == 0 || strcmp(*name, "..") == 0) {
+        return -1;
+    }
+    if (slash == NULL) {
+        return fs->current_dir;
+    }
+
+    // resolve everything before last slash, "/" is root
+    uint32_t length = (slash == path) ? 1 : slash - path;
+    char *prefix = strndup(path, length);
+    int32_t parent = minifs_resolve(fs, prefix);
+    free(prefix);
+    if (parent < 0 || fs->sblock.inode_map[parent].type != MINIFS_INODE_DIRECTORY) {
+        return -1;
+    }
+    return parent;
+}
+
+
+void minifs_remove_from_dir(Filesystem *fs, uint32_t dir_inode, uint32_t index) {
+    DirEntry entry;
+    minifs_read_entry(fs, dir_inode, index, &entry);
+    if (fs->sblock.inode_map[dir_inode].flags & MINIFS_INODE_HASHED) {
+        dirhash_remove(fs, dir_inode, entry.name, index);
+    }
+    entry.used = 0;
+    minifs_write_entry(fs, dir_inode, index, &entry);
+    pthread_mutex_lock(&fs->locks->dcache);
+    dcache_insert(fs->dcache, dir_inode, entry.name, -1, 0);
+    pthread_mutex_unlock(&fs->locks->dcache);
+    if (index < fs->slot_hints[dir_inode]) {
+        fs->slot_hints[dir_inode] = index;
+    }
+
+    // dead entries are compacted once they fill a block and outnumber
+    // live ones, so every compaction is paid by as many removals
+    Inode *dir = &fs->sblock.inode_map[dir_inode];
+    if (dir->flags & MINIFS_INODE_HASHED) {
+        DirHashHeader header;
+        minifs_read_entry(fs, dir_inode, 0, (DirEntry*) &header);
+        uint32_t dead = dir->size - 1 - header.live;
+        if (dead >= fs->sblock.block_size / sizeof(DirEntry) && dead > header.live) {
+            minifs_compact_dir(fs, dir_inode);
+        }
+    }
+}
+
+
+int32_t minifs_create_inode(Filesystem *fs, uint16_t type, uint16_t flags, int32_t parent) {
+    minifs_lock_alloc(fs);
+    int32_t inode_index = minifs_find_free_inode(fs);
+    if (inode_index < 0) {
+        minifs_unlock_alloc(fs);
+        fprintf(stderr, "Ran out of free inodes\n");
+        return -1;
+    }
+    bool inline_data = flags & MINIFS_INODE_INLINE;
+    int32_t block_index = inline_data ? -1 : minifs_find_free_block(fs);
+    if (block_index < 0 && !inline_data) {
+        minifs_unlock_alloc(fs);
+        fprintf(stderr, "Ran out of free blocks\n");
+        return -1;
+    }
+
+    fs->sblock.inode_map[inode_index].type = type;
+    fs->sblock.inode_map[inode_index].root_block = block_index;
+    fs->sblock.inode_map[inode_index].parent = parent;
+    fs->sblock.inode_map[inode_index].size = 0;
+    fs->sblock.inode_map[inode_index].flags = flags;
+    fs->slot_hints[inode_index] = 0;
+    minifs_take_inode(fs, inode_index);
+
+    if (inline_data) {
+        memset(minifs_inline_data(fs, inode_index), 0, minifs_inline_capacity(fs));
+    } else {
+        fs->sblock.block_map[block_index].size = 0;
+        fs->sblock.block_map[block_index].next_block = -1;
+        fs->sblock.block_map[block_index].type = MINIFS_BLOCK_USED;
+        minifs_take_block(fs, block_index);
+    }
+    minifs_unlock_alloc(fs);
+    if (flags & MINIFS_INODE_EXTENTS) {
+        extent_init(fs, block_index);
+    }
+    return inode_index;
+}
+
+
+void minifs_destroy_inode(Filesystem *fs, uint32_t inode_id) {
+    if (fs->sblock.inode_map[inode_id].flags & MINIFS_INODE_HASHED) {
+        dirhash_free(fs, inode_id);
+    }
+    if (fs->sblock.inode_map[inode_id].type == MINIFS_INODE_DIRECTORY) {
+        pthread_mutex_lock(&fs->locks->dcache);
+        dcache_remove_dir(fs->dcache, inode_id);
+        pthread_mutex_unlock(&fs->locks->dcache);
+    }
+    minifs_free_blocks(fs, inode_id);
+
+    fs->sblock.inode_map[inode_id].type = MINIFS_INODE_EMPTY;
+    fs->sblock.inode_map[inode_id].flags = 0;
+    fs->sblock.inode_map[inode_id].size = 0;
+    fs->sblock.inode_map[inode_id].parent = 0;
+    fs->sblock.inode_map[inode_id].root_block = 0;
+    minifs_release_inode(fs, inode_id);
+}
+
+
+static void queue_body_read(Filesystem *fs, UringBatch *batch, uint32_t index,
+                            void *data, uint32_t size, uint32_t offset) {
+    unsigned char *body = minifs_block_body(fs, index);
+    if (body != NULL) {
+        memcpy(data, body + offset, size);
+        return;
+    }
+    bcache_queue_read(fs, batch, index, data, size, offset);
+}
+
+
+const char* minifs_read_data(Filesystem *fs, int32_t inode_id, int32_t *size) {
+    minifs_flush_delayed(fs, inode_id);
+    const Inode inode = fs->sblock.inode_map[inode_id];
+
+    *size = inode.size;
+    char *buffer = (char*) malloc(inode.size);
+    uint32_t read_size = 0;
+    if (inode.flags & MINIFS_INODE_INLINE) {  // data is in loaded table
+        memcpy(buffer, minifs_inline_data(fs, inode_id), inode.size);
+        return buffer;
+    }
+    if (inode.flags & MINIFS_INODE_COMPRESSED) {  // all clusters are read at once and decoded in memory
+        BlockIndex *index = cluster_index(fs, inode_id);
+        uint32_t end = stored_end(fs, index);
+        unsigned char *stored = (unsigned char*) malloc(end > 0 ? end : 1);
+        stored_io(fs, index, stored, end, 0, false);
+        for (uint32_t number = 0; number < index->cluster_count && read_size < inode.size; ++number) {
+            unsigned char *cluster = (unsigned char*) buffer + number * COMPRESS_CLUSTER_SIZE;
+            if (inode.size - read_size < COMPRESS_CLUSTER_SIZE) {  // last cluster is decoded aside
+                unsigned char *tail = (unsigned char*) malloc(COMPRESS_CLUSTER_SIZE);
+                decode_cluster(stored + index->clusters[number], tail, number);
+                memcpy(cluster, tail, inode.size - read_size);
+                free(tail);
+                break;
+            }
+            read_size += decode_cluster(stored + index->clusters[number], cluster, number);
+        }
+        free(stored);
+        return buffer;
+    }
+
+    // reads of all extents or blocks of chain are submitted together
+    UringBatch batch = {0};
+    if (inode.flags & MINIFS_INODE_EXTENTS) {  // every extent is read at once, holes are zeros
+        uint32_t count;
+        Extent *extents = extent_list(fs, inode_id, &count);
+        for (uint32_t index = 0; index < count; ++index) {
+            uint32_t offset = extents[index].logical * fs->sblock.block_size;
+            memset(buffer + read_size, 0, offset - read_size);
+            uint32_t run_size = 0;
+            for (uint32_t block = 0; block < extents[index].length; ++block) {
+                run_size += fs->sblock.block_map[extents[index].start + block].size;
+            }
+            queue_body_read(fs, &batch, extents[index].start, buffer + offset, run_size, 0);
+            read_size = offset + run_size;
+        }
+        free(extents);
+        minifs_wait_batch(fs, &batch);
+        return buffer;
+    }
+
+    int32_t current_block_id = inode.root_block;
+    while (current_block_id > 0) {
+        Block block = fs->sblock.block_map[current_block_id];
+        if (block.size > 0) {
+            queue_body_read(fs, &batch, current_block_id, buffer + read_size, block.size, 0);
+            read_size += block.size;
+        }
+        current_block_id = block.next_block;
+    }
+    minifs_wait_batch(fs, &batch);
+
+    return buffer;
+}
+
+
+bool minifs_stream_data(Filesystem *fs, uint32_t inode_id, void *buffer, uint32_t capacity,
+                        MinifsStreamFunc func, void *context) {
+    const Inode *inode = &fs->sblock.inode_map[inode_id];
+    if (inode->flags & MINIFS_INODE_INLINE) {
+        return inode->size == 0 || func(context, minifs_inline_data(fs, inode_id), inode->size);
+    }
+    if (inode->flags & MINIFS_INODE_COMPRESSED) {  // clusters are decoded one by one
+        BlockIndex *index = cluster_index(fs, inode_id);
+        unsigned char *cluster = (unsigned char*) malloc(COMPRESS_CLUSTER_SIZE);
+        bool result = true;
+        for (uint32_t number = 0; number < index->cluster_count && result; ++number) {
+            uint32_t size = load_cluster(fs, index, number, cluster);
+            for (uint32_t done = 0; done < size && result; done += capacity) {
+                result = func(context, cluster + done, (size - done < capacity) ? size - done : capacity);
+            }
+        }
+        free(cluster);
+        return result;
+    }
+    uint32_t block_size = fs->sblock.block_size;
+    BlockIndex *index = minifs_block_index(fs, inode_id);
+    uint32_t number = 0;
+    while (number < index->count) {
+        // holes are passed as zeros
+        if (index->blocks[number] < 0) {
+            memset(buffer, 0, capacity);
+            uint32_t hole = 0;
+            for (; number < index->count && index->blocks[number] < 0; ++number) {
+                hole += block_size;
+            }
+            while (hole > 0) {
+                uint32_t size = (hole < capacity) ? hole : capacity;
+                if (!func(context, buffer, size)) {
+                    return false;
+                }
+                hole -= size;
+            }
+            continue;
+        }
+
+        // full blocks which follow each other on disk are read together
+        int32_t first = index->blocks[number];
+        uint32_t size = fs->sblock.block_map[first].size;
+        uint32_t length = 1;
+        while (number + length < index->count && size == length * block_size &&
+               index->blocks[number + length] == first + length &&
+               (fs->image != NULL || size + block_size <= capacity)) {
+            size += fs->sblock.block_map[first + length].size;
+            ++length;
+        }
+        number += length;
+        if (size == 0) {
+            continue;
+        }
+
+        unsigned char *body = minifs_block_body(fs, first);
+        if (body == NULL) {
+            minifs_read_body(fs, first, buffer, size, 0);
+            body = (unsigned char*) buffer;
+        }
+        if (!func(context, body, size)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+// every block of file but the last one is full, so offset maps
+// to block number by division; returns length of run (or hole) which
+// starts at block number and covers at most size bytes from offset in it
+static uint32_t covering_run(Filesystem *fs, BlockIndex *index, uint32_t number,
+                             uint32_t offset, uint32_t size, uint32_t *bytes) {
+    uint32_t block_size = fs->sblock.block_size;
+    int32_t first = index->blocks[number];
+    uint32_t length = 1;
+    while (length * block_size - offset < size && number + length < index->count &&
+           (first < 0 ? index->blocks[number + length] < 0 : index->blocks[number + length] == first + length)) {
+        ++length;
+    }
+    *bytes = (length * block_size - offset < size) ? length * block_size - offset : size;
+    return length;
+}
+
+
+uint32_t minifs_file_pread(Filesystem *fs, uint32_t inode_id, void *data, uint32_t size, uint32_t offset) {
+    uint32_t file_size = fs->sblock.inode_map[inode_id].size;
+    if (offset >= file_size) {
+        return 0;
+    }
+    if (size > file_size - offset) {
+        size = file_size - offset;
+    }
+    if (fs->sblock.inode_map[inode_id].flags & MINIFS_INODE_INLINE) {
+        memcpy(data, minifs_inline_data(fs, inode_id) + offset, size);
+        return size;
+    }
+    if (fs->sblock.inode_map[inode_id].flags & MINIFS_INODE_COMPRESSED) {
+        read_compressed(fs, inode_id, (unsigned char*) data, size, offset);
+        return size;
+    }
+
+    uint32_t block_size = fs->sblock.block_size;
+    BlockIndex *index = minifs_block_index(fs, inode_id);
+    UringBatch batch = {0};
+    uint32_t number = offset / block_size;
+    uint32_t inner = offset % block_size;
+    uint32_t done = 0;
+    while (done < size) {
+        uint32_t bytes;
+        uint32_t length = covering_run(fs, index, number, inner, size - done, &bytes);
+        if (index->blocks[number] < 0) {  // holes are read without io
+            memset((unsigned char*) data + done, 0, bytes);
+        } else {
+            queue_body_read(fs, &batch, index->blocks[number], (unsigned char*) data + done, bytes, inner);
+        }
+        number += length;
+        inner = 0;
+        done += bytes;
+    }
+    minifs_wait_batch(fs, &batch);
+    return size;
+}
+
+
+// first offset from given one which is in data block or in hole
+static int64_t seek_block(Filesystem *fs, uint32_t inode_id, uint32_t offset, bool data) {
+    uint32_t file_size = fs->sblock.inode_map[inode_id].size;
+    if (offset >= file_size) {
+        return -1;
+    }
+    uint16_t flags = fs->sblock.inode_map[inode_id].flags;
+    if (!(flags & MINIFS_INODE_EXTENTS) || (flags & MINIFS_INODE_COMPRESSED)) {  // only plain extent files have holes
+        return data ? offset : file_size;
+    }
+    uint32_t block_size = fs->sblock.block_size;
+    BlockIndex *index = minifs_block_index(fs, inode_id);
+    for (uint32_t number = offset / block_size; number < index->count; ++number) {
+        if ((index->blocks[number] >= 0) == data) {
+            uint64_t start = (uint64_t) number * block_size;
+            return (start > offset) ? start : offset;
+        }
+    }
+    return data ? -1 : file_size;
+}
+
+
+int64_t minifs_seek_data(Filesystem *fs, uint32_t inode_id, uint32_t offset) {
+    return seek_block(fs, inode_id, offset, true);
+}
+
+
+int64_t minifs_seek_hole(Filesystem *fs, uint32_t inode_id, uint32_t offset) {
+    return seek_block(fs, inode_id, offset, false);
+}
+
+
+uint32_t minifs_file_pwrite(Filesystem *fs, uint32_t inode_id, const void *data, uint32_t size, uint32_t offset) {
+    uint32_t file_size = fs->sblock.inode_map[inode_id].size;
+    uint32_t block_size = fs->sblock.block_size;
+
+    // inline area past end of file is zero, so gap needs no filling
+    if (fs->sblock.inode_map[inode_id].flags & MINIFS_INODE_INLINE) {
+        if ((uint64_t) offset + size <= minifs_inline_capacity(fs)) {
+            memcpy(minifs_inline_data(fs, inode_id) + offset, data, size);
+            if (offset + size > file_size) {
+                fs->sblock.inode_map[inode_id].size = offset + size;
+            }
+            minifs_mark_inode(fs, inode_id);
+            return size;
+        }
+        spill_inline(fs, inode_id);
+    }
+
+    // gap after end of file reads as zeros, extent mapped file keeps it as holes
+    uint16_t flags = fs->sblock.inode_map[inode_id].flags;
+    bool compressed = flags & MINIFS_INODE_COMPRESSED;
+    if (offset > file_size && (flags & MINIFS_INODE_EXTENTS) && !compressed) {
+        extend_sparse(fs, inode_id, file_size, offset);
+        file_size = offset;
+    }
+    if (offset > file_size) {
+        uint32_t gap = offset - file_size;
+        uint32_t piece = (gap < STREAM_BUFFER_SIZE) ? gap : STREAM_BUFFER_SIZE;
+        unsigned char *zeros = (unsigned char*) calloc(piece, 1);
+        while (gap > 0) {
+            uint32_t bytes = (gap < piece) ? gap : piece;
+            minifs_append_data(fs, inode_id, zeros, bytes);
+            gap -= bytes;
+        }
+        free(zeros);
+        file_size = offset;
+    }
+
+    // bytes inside file are overwritten in place
+    uint32_t inside = (offset < file_size) ? file_size - offset : 0;
+    inside = (inside < size) ? inside : size;
+    uint32_t done = 0;
+    if (inside > 0 && compressed) {
+        write_compressed(fs, inode_id, (const unsigned char*) data, inside, offset);
+        done = inside;
+    } else if (inside > 0) {  // write at end of file keeps delayed appends
+        BlockIndex *index = minifs_block_index(fs, inode_id);
+        uint32_t number = offset / block_size;
+        uint32_t inner = offset % block_size;
+        while (done < inside) {
+            uint32_t bytes;
+            uint32_t length = covering_run(fs, index, number, inner, inside - done, &bytes);
+            if (index->blocks[number] < 0) {  // written part of hole gets blocks first
+                fill_hole(fs, inode_id, index, number, length);
+                continue;
+            }
+            minifs_write_body(fs, index->blocks[number], (const unsigned char*) data + done, bytes, inner);
+            number += length;
+            inner = 0;
+            done += bytes;
+        }
+    }
+
+    if (done < size) {
+        minifs_append_data(fs, inode_id, (const unsigned char*) data + done, size - done);
+    }
+    if (offset + size > file_size) {
+        file_size = offset + size;
+    }
+    if (file_size != fs->sblock.inode_map[inode_id].size) {
+        fs->sblock.inode_map[inode_id].size = file_size;
+        minifs_mark_inode(fs, inode_id);
+    }
+    return size;
+}
+
+
+// releases blocks after first "size" bytes, size of inode is left to caller;
+// chain keeps its root block even when file becomes empty
+static void cut_blocks(Filesystem *fs, uint32_t inode_id, uint32_t size) {
+    minifs_release_prealloc(fs, inode_id);
+    uint32_t block_size = fs->sblock.block_size;
+    BlockIndex *index = minifs_block_index(fs, inode_id);
+    bool extents = fs->sblock.inode_map[inode_id].flags & MINIFS_INODE_EXTENTS;
+    uint32_t keep = (size + block_size - 1) / block_size;
+    if (keep == 0 && !extents) {
+        keep = 1;
+    }
+
+    minifs_lock_alloc(fs);
+    if (extents) {
+        extent_truncate(fs, inode_id, keep);
+    } else {
+        for (uint32_t number = keep; number < index->count; ++number) {
+            int32_t block = index->blocks[number];
+            fs->sblock.block_map[block].type = MINIFS_BLOCK_EMPTY;
+            fs->sblock.block_map[block].size = 0;
+            fs->sblock.block_map[block].next_block = 0;
+            minifs_release_block(fs, block);
+        }
+        fs->sblock.block_map[index->blocks[keep - 1]].next_block = -1;
+    }
+    minifs_unlock_alloc(fs);
+    index->count = keep;
+
+    // new last block may be in hole, it gets block as last one is never hole
+    if (keep > 0 && index->blocks[keep - 1] < 0) {
+        fill_hole(fs, inode_id, index, keep - 1, 1);
+    }
+
+    // partial tail block is cut in place
+    if (keep > 0) {
+        int32_t tail = index->blocks[keep - 1];
+        fs->sblock.block_map[tail].size = size - (keep - 1) * block_size;
+        minifs_mark_block(fs, tail);
+    }
+}
+
+
+void minifs_truncate(Filesystem *fs, uint32_t inode_id, uint32_t size) {
+    uint32_t file_size = fs->sblock.inode_map[inode_id].size;
+    if ((fs->sblock.inode_map[inode_id].flags & MINIFS_INODE_INLINE) && size <= minifs_inline_capacity(fs)) {
+        if (size < file_size) {  // cut tail keeps area past end zero
+            memset(minifs_inline_data(fs, inode_id) + size, 0, file_size - size);
+        }
+        fs->sblock.inode_map[inode_id].size = size;
+        minifs_mark_inode(fs, inode_id);
+        return;
+    }
+    if (size >= file_size) {
+        minifs_file_pwrite(fs, inode_id, "", 0, size);  // zero gap up to new end
+        return;
+    }
+    if (fs->sblock.inode_map[inode_id].flags & MINIFS_INODE_COMPRESSED) {
+        cut_compressed(fs, inode_id, size);
+    } else {
+        cut_blocks(fs, inode_id, size);
+    }
+    fs->sblock.inode_map[inode_id].size = size;
+    minifs_mark_inode(fs, inode_id);
+}
+
+
+void minifs_compact_dir(Filesystem *fs, uint32_t dir_inode) {
+    Inode *dir = &fs->sblock.inode_map[dir_inode];
+    DirEntry *entries = (DirEntry*) malloc((dir->size > 0 ? dir->size : 1) * sizeof(DirEntry));
+    uint32_t live = 0;
+    DirIterator it;
+    minifs_dir_open(fs, dir_inode, &it);
+    const DirEntry *entry;
+    while ((entry = minifs_dir_next(&it)) != NULL) {
+        entries[live++] = *entry;
+    }
+    minifs_dir_close(&it);
+
+    // positions change, index is built again for new ones
+    if (dir->flags & MINIFS_INODE_HASHED) {
+        dirhash_free(fs, dir_inode);
+    }
+    uint32_t block_size = fs->sblock.block_size;
+    uint32_t size = live * sizeof(DirEntry);
+    for (uint32_t done = 0; done < size; done += block_size) {
+        uint32_t piece = (size - done < block_size) ? size - done : block_size;
+        int32_t block = minifs_file_block(fs, dir_inode, done / block_size);
+        minifs_write_body(fs, block, (unsigned char*) entries + done, piece, 0);
+    }
+    free(entries);
+    cut_blocks(fs, dir_inode, size);
+    dir->size = live;
+    minifs_mark_inode(fs, dir_inode);
+    fs->slot_hints[dir_inode] = live;
+
+    pthread_mutex_lock(&fs->locks->dcache);
+    dcache_remove_dir(fs->dcache, dir_inode);
+    pthread_mutex_unlock(&fs->locks->dcache);
+    if (live > block_size / sizeof(DirEntry)) {
+        dirhash_build(fs, dir_inode);
+        fs->slot_hints[dir_inode] = dir->size;
+    }
+}
+
+
+enum CopyMethod {
+    COPY_FILE_RANGE = 0,
+    COPY_SENDFILE = 1,
+    COPY_USERSPACE = 2
+};
+
+
+// copies range of image to fd, method is lowered when kernel refuses it
+static bool copy_range(Filesystem *fs, int fd, uint64_t offset, uint32_t size, enum CopyMethod *method) {
+    while (size > 0) {
+        ssize_t status = -1;
+        if (*method == COPY_FILE_RANGE) {
+            loff_t from = offset;
+            status = copy_file_range(fs->fd, &from, fd, NULL, size, 0);
+            MINIFS_IO_COUNT(copies);
+        } else if (*method == COPY_SENDFILE) {
+            off_t from = offset;
+            status = sendfile(fd, fs->fd, &from, size);
+            MINIFS_IO_COUNT(copies);
+        } else {
+            unsigned char buffer[STREAM_BUFFER_SIZE];
+            struct iovec iov = {.iov_base = buffer, .iov_len = size < sizeof(buffer) ? size : sizeof(buffer)};
+            minifs_read_vector(fs->fd, &iov, 1, offset);  // zero past end of image
+            status = write(fd, buffer, iov.iov_len);
+            MINIFS_IO_COUNT(writes);
+            if (status <= 0) {
+                return false;
+            }
+        }
+
+        if (status < 0 && *method != COPY_USERSPACE &&
+            (errno == EXDEV || errno == EINVAL || errno == ENOSYS || errno == EOPNOTSUPP || errno == EBADF)) {
+            *method += 1;
+            continue;
+        }
+        if (status < 0) {
+            return false;
+        }
+        if (status == 0) {  // body past end of image was never written
+            *method = COPY_USERSPACE;
+            continue;
+        }
+        offset += status;
+        size -= status;
+    }
+    return true;
+}
+
+
+// moves position of fd over hole, output which cannot seek gets zeros
+static bool skip_hole(int fd, uint32_t size) {
+    if (lseek(fd, size, SEEK_CUR) >= 0) {
+        return true;
+    }
+    unsigned char zeros[4096] = {0};
+    while (size > 0) {
+        ssize_t status = write(fd, zeros, (size < sizeof(zeros)) ? size : sizeof(zeros));
+        if (status <= 0) {
+            return false;
+        }
+        size -= status;
+    }
+    return true;
+}
+
+
+// stream function which writes piece to fd from context
+static bool write_piece(void *context, const void *data, uint32_t size) {
+    int fd = *(int*) context;
+    while (size > 0) {
+        ssize_t status = write(fd, data, size);
+        if (status <= 0) {
+            return false;
+        }
+        data = (const unsigned char*) data + status;
+        size -= status;
+    }
+    return true;
+}
+
+
+bool minifs_export_data(Filesystem *fs, uint32_t inode_id, int fd) {
+    if (fs->sblock.inode_map[inode_id].flags & MINIFS_INODE_INLINE) {
+        return write_piece(&fd, minifs_inline_data(fs, inode_id), fs->sblock.inode_map[inode_id].size);
+    }
+    if (fs->sblock.inode_map[inode_id].flags & MINIFS_INODE_COMPRESSED) {  // kernel cannot decode clusters
+        unsigned char buffer[STREAM_BUFFER_SIZE];
+        return minifs_stream_data(fs, inode_id, buffer, sizeof(buffer), write_piece, &fd);
+    }
+
+    // kernel copies from image, so delayed appends and modified buffers go there first
+    BlockIndex *index = minifs_block_index(fs, inode_id);
+    bcache_flush(fs);
+
+    uint32_t block_size = fs->sblock.block_size;
+    enum CopyMethod method = COPY_FILE_RANGE;
+    uint32_t number = 0;
+    while (number < index->count) {
+        if (index->blocks[number] < 0) {  // hole is skipped in host file or sent as zeros
+            uint32_t hole = 0;
+            for (; number < index->count && index->blocks[number] < 0; ++number) {
+                hole += block_size;
+            }
+            if (!skip_hole(fd, hole)) {
+                return false;
+            }
+            continue;
+        }
+
+        int32_t first = index->blocks[number];
+        uint32_t size = fs->sblock.block_map[first].size;
+        uint32_t length = 1;
+        while (number + length < index->count && size == length * block_size &&
+               index->blocks[number + length] == first + length) {
+            size += fs->sblock.block_map[first + length].size;
+            ++length;
+        }
+        number += length;
+        if (size > 0 && !copy_range(fs, fd, minifs_block_body_offset(fs, first), size, &method)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+void minifs_read_block(int fd, void *data, uint64_t size, uint64_t offset) {
+    uint64_t read_size = 0;
+    while (read_size < size) {
+        ssize_t status = pread(fd, data + read_size, size - read_size, offset + read_size);
+        MINIFS_IO_COUNT(reads);
+        if (status <= 0) {
+            debug(MINIFS_ERR "read error");
+            exit(-1);
+        }
+        read_size += status;
+    }
+}
+
+
+void minifs_write_block(int fd, void *data, uint64_t size, uint64_t offset) {
+    uint64_t write_size = 0;
+    while (write_size < size) {
+        ssize_t status = pwrite(fd, data + write_size, size - write_size, offset + write_size);
+        MINIFS_IO_COUNT(writes);
+        if (status <= 0) {
+            debug(MINIFS_ERR "write error");
+            exit(-1);
+        }
+        write_size += status;
+    }
+}
@@ -3,29 +3,109 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <pthread.h>
+
+#include <internal/bitmap/bitmap.h>
+#include <internal/uring/uring.h>
 
 
 #define DEFAULT_INODE_COUNT 1024
 #define DEFAULT_BLOCK_COUNT 1024
 #define DEFAULT_BLOCK_SIZE  1024
+#define MIN_BLOCK_SIZE      512
+#define MAX_BLOCK_SIZE      (64 * 1024)
+#define MAX_OBJECT_COUNT    INT32_MAX   // inodes and blocks are linked by int32_t
+#define MAX_INODE_SIZE      1024
 #define MAX_FILENAME_SIZE   27
+#define STREAM_BUFFER_SIZE  (64 * 1024)
+#define IMPORT_CHUNK_SIZE   (1024 * 1024)
+#define PREALLOC_BLOCKS     8           // blocks kept free after tail of growing file
+#define DELAYED_BUFFER_SIZE (64 * 1024) // appends of file gathered before blocks are assigned
+#define COMPRESS_CLUSTER_SIZE (16 * 1024) // data of compressed file coded together
 
 struct Inode;
 struct Block;
+struct DentryCache;
+struct BufferCache;
+struct Uring;
+struct Journal;
+struct iovec;
+
+
+#define MINIFS_MAGIC        0x53464E4D  // "MNFS"
+#define MINIFS_VERSION      2           // 1 has no inode size, its inodes are plain
+
+
+// metadata group: slice of inode and block tables and bodies of its
+// blocks; image grows by groups appended at its end, so bodies never move
+typedef struct MetaGroup {
+    uint32_t first_inode;
+    uint32_t inode_count;
+    uint32_t first_block;
+    uint32_t block_count;
+    uint64_t inode_table;
+    uint64_t block_table;
+    uint64_t bodies;
+} MetaGroup;
 
 
-// superblock of minifs
+// superblock of minifs, kept in memory with loaded tables
 typedef struct SuperBlock {
     uint32_t inode_count;
     uint32_t block_count;
     uint32_t used_inode_count;
     uint32_t used_block_count;
     uint32_t block_size;
+    uint32_t version;           // 0 for images without versioned superblock
+    uint32_t inode_size;        // on-disk inode: Inode and inline area of file data
+    uint64_t inode_table;       // offsets of image regions
+    uint64_t block_table;
+    uint64_t bodies;
+    uint64_t inode_bitmap;
+    uint64_t block_bitmap;
+    uint64_t journal;
+    uint64_t groups;            // offset of group table, 0 while image has one group
+    uint32_t group_count;
+    MetaGroup *group_map;       // first group holds regions above
     struct Inode *inode_map;
+    unsigned char *inline_map;  // inline areas of inodes, NULL for plain inodes
     struct Block *block_map;
 } SuperBlock;
 
 
+// on-disk superblock: counters stay where older images kept them, those
+// wrote in-memory superblock with its pointers, magic takes its padding
+typedef struct DiskSuperBlock {
+    uint32_t inode_count;
+    uint32_t block_count;
+    uint32_t used_inode_count;
+    uint32_t used_block_count;
+    uint32_t block_size;
+    uint32_t magic;
+    uint32_t version;
+    uint32_t inode_size;        // 0 in version 1
+    uint64_t inode_table;
+    uint64_t block_table;
+    uint64_t bodies;
+    uint64_t inode_bitmap;
+    uint64_t block_bitmap;
+    uint64_t journal;
+    uint64_t groups;
+    uint32_t group_count;       // 0 or 1 if image never grew
+    uint32_t padding;
+    uint64_t spare[4];          // zero, room for later versions
+} DiskSuperBlock;
+
+
+// geometry of new image
+typedef struct Geometry {
+    uint32_t inode_count;
+    uint32_t block_count;
+    uint32_t block_size;        // power of two from MIN_BLOCK_SIZE to MAX_BLOCK_SIZE
+    uint32_t inode_size;        // 0 for plain inodes or power of two up to MAX_INODE_SIZE
+} Geometry;
+
+
 // block to store information and meta
 typedef struct Block {
     int32_t next_block;
@@ -37,27 +117,165 @@ typedef struct Block {
 } Block;
 
 
-// inode srtuct
+enum InodeType {
+    MINIFS_INODE_EMPTY = 0,
+    MINIFS_INODE_FILE = 1,
+    MINIFS_INODE_DIRECTORY = 2,
+    MINIFS_INODE_INDEX = 3          // hidden name index of directory
+};
+
+
+// inode flags
+#define MINIFS_INODE_EXTENTS 0x1    // root_block holds extent tree instead of block chain
+#define MINIFS_INODE_HASHED  0x2    // directory has hashed name index
+#define MINIFS_INODE_INLINE  0x4    // file data is in inline area, inode has no blocks
+#define MINIFS_INODE_COMPRESSED 0x8 // extent mapped file keeps data as compressed clusters
+
+
+// inode srtuct, type and flags share 4 bytes of old enum field,
+// so inodes of older images have no flags and use block chains
 typedef struct Inode {
     uint32_t size;      // size of file or count of objects in dir
     int32_t root_block;
     int32_t parent;
-    enum InodeType {
-        MINIFS_INODE_EMPTY = 0,
-        MINIFS_INODE_FILE = 1,
-        MINIFS_INODE_DIRECTORY = 2
-    } type;
+    uint16_t type;
+    uint16_t flags;
 } Inode;
 
 
+// set of modified table entries waiting for flush,
+// bitmap is used to skip duplicates in list
+typedef struct DirtySet {
+    uint32_t *items;
+    uint32_t count;
+    uint32_t capacity;
+    uint64_t *bits;
+} DirtySet;
+
+
+// in-memory list of data blocks of inode in file order,
+// built on first use from block chain or extent tree;
+// holes of extent mapped file are -1, last block is never hole
+typedef struct BlockIndex {
+    int32_t *blocks;    // NULL if index is not built yet
+    uint32_t count;
+    uint32_t capacity;
+    uint32_t *clusters; // compressed file: offsets of clusters in its blocks, NULL if not built
+    uint32_t cluster_count;
+    uint32_t cluster_capacity;
+    bool damaged;       // extent tree of file cannot be read, index is empty
+} BlockIndex;
+
+
+// locks of shared filesystem state, kept out of Filesystem
+// because controller block is passed around by value
+typedef struct FsLocks {
+    pthread_mutex_t alloc;      // bitmaps, used counters, dirty sets, metadata flush
+    pthread_mutex_t bcache;     // buffer cache
+    pthread_mutex_t dcache;     // dentry cache
+    pthread_mutex_t index;      // lazy block index builds
+    pthread_mutex_t delayed;    // delayed append buffers
+    pthread_rwlock_t *inodes;   // per inode: data, size and directory entries
+} FsLocks;
+
+
+// appended bytes of file which have no blocks yet, inode size
+// on disk stays without them until they are flushed
+typedef struct DelayedBuffer {
+    unsigned char *data;
+    uint32_t size;
+    uint32_t capacity;
+    uint32_t blocks;            // free blocks promised to buffer
+} DelayedBuffer;
+
+
+// blocks after tail of file reserved for its next appends, in memory only
+typedef struct Prealloc {
+    int32_t start;
+    uint32_t length;
+} Prealloc;
+
+
 // filesystem controller block
 typedef struct Filesystem {
     struct SuperBlock sblock;
     uint32_t current_dir;       // inode id
     int fd;
+    unsigned char *image;       // mapped image or NULL if fd backend is used
+    uint64_t image_size;
+    uint64_t dirty_begin;       // range of image touched since last msync
+    uint64_t dirty_end;
+    DirtySet dirty_inodes;      // inode/block map entries changed since last flush
+    DirtySet dirty_blocks;
+    Bitmap inode_bitmap;        // allocation bitmaps, stored after block bodies
+    Bitmap block_bitmap;
+    DirtySet dirty_inode_words;
+    DirtySet dirty_block_words;
+    Bitmap reserved;            // blocks of preallocation windows, never written
+    Prealloc *prealloc;         // per inode preallocation windows
+    uint32_t prealloc_blocks;   // window length, 0 disables preallocation
+    DelayedBuffer *delayed;     // per inode delayed appends
+    DirtySet delayed_inodes;    // inodes which may have delayed appends
+    uint32_t delayed_limit;     // buffer size which forces flush, 0 disables delay
+    uint32_t delayed_blocks;    // free blocks promised to all delayed buffers
+    bool compress;              // new files keep data as compressed clusters
+    BlockIndex *indexes;        // per inode block indexes
+    uint32_t *slot_hints;       // per directory: entries before hint are live
+    struct DentryCache *dcache; // (parent, name) -> inode lookups
+    struct BufferCache *bcache; // block bodies of fd backend
+    struct Uring *uring;        // NULL if block io is synchronous
+    struct Journal *journal;    // NULL if metadata is written in place
+    FsLocks *locks;
 } Filesystem;
 
 
+// counters of syscalls issued by block layer
+typedef struct IoStats {
+    uint64_t reads;
+    uint64_t writes;
+    uint64_t syncs;
+    uint64_t copies;    // copy_file_range and sendfile calls
+} IoStats;
+
+extern IoStats minifs_io_stats;
+
+// counters are bumped from many threads
+#define MINIFS_IO_COUNT(field) __atomic_fetch_add(&minifs_io_stats.field, 1, __ATOMIC_RELAXED)
+
+
+// on-disk directory entry
+typedef struct __attribute__((packed)) DirEntry {
+    char used;
+    char name[MAX_FILENAME_SIZE];
+    uint32_t inode;
+} DirEntry;
+
+
+// on-disk header of cluster of compressed file: clusters follow each other
+// in file blocks, every cluster but the last one holds COMPRESS_CLUSTER_SIZE
+// bytes of data, so offset in file maps to cluster by division
+typedef struct ClusterHeader {
+    uint32_t raw_size;      // bytes of file data in cluster
+    uint32_t packed_size;   // coded bytes after header, raw_size if data is not coded
+    uint32_t space;         // bytes after header owned by cluster, at least packed_size
+} ClusterHeader;
+
+
+// streaming reader of live directory entries: every directory block
+// is read with one call into reusable buffer or used in place on mmap
+typedef struct DirIterator {
+    struct Filesystem *fs;
+    uint32_t dir;
+    uint32_t block;         // next block number in directory
+    uint32_t base;          // position of first entry in loaded block
+    uint32_t count;         // entries in loaded block
+    uint32_t next;          // next entry in loaded block
+    uint32_t position;      // position of last returned entry
+    DirEntry *entries;      // loaded block
+    DirEntry *buffer;
+} DirIterator;
+
+
 typedef struct DirectoryMap {
     uint32_t size;
     char **names;
@@ -66,29 +284,256 @@ typedef struct DirectoryMap {
 } DirectoryMap;
 
 
+// dirty set of table with given entry count
+void minifs_dirty_init(DirtySet*, uint32_t);
+void minifs_dirty_free(DirtySet*);
+void minifs_dirty_add(DirtySet*, uint32_t);
+void minifs_dirty_clear(DirtySet*);
+
+
+// creates image with default geometry
 void minifs_init(const char *);
+
+// path, geometry: creates image, returns false if geometry is out of limits;
+// tables are left sparse, only root dir entries are written
+bool minifs_format(const char *, const Geometry *);
 struct Filesystem minifs_open(const char *);
+void minifs_close(Filesystem*);
 bool check_exists(const char *);
 
+// writes cached data and metadata and waits until image is on disk
+void minifs_sync(Filesystem*);
+
+// fs, inodes, blocks: appends metadata group with given counts at end
+// of image, nothing is moved; first block of group is kept taken, so runs
+// of adjacent blocks never cross groups. Returns false if counts exceed
+// limits, image is older than versioned superblock or cannot be extended.
+// Must not run together with other operations on fs
+bool minifs_grow(Filesystem*, uint32_t, uint32_t);
+
+// fs, bytes: replaces buffer cache, 0 disables it
+void minifs_set_cache_size(Filesystem*, uint32_t);
+
+
+// fs, inode, exclusive: data, size and entries of inode are read under
+// shared lock and changed under exclusive one, parent is locked before child
+void minifs_lock_inode(Filesystem*, uint32_t, bool);
+void minifs_unlock_inode(Filesystem*, uint32_t);
+
+// allocator lock is recursive, find and take of free object go under one lock
+void minifs_lock_alloc(Filesystem*);
+void minifs_unlock_alloc(Filesystem*);
+
+
+// mmap backend: data path works directly on mapped block bodies
+bool minifs_map_image(Filesystem*);
+void minifs_sync_image(Filesystem*, bool);
+unsigned char *minifs_block_body(Filesystem*, uint32_t);
+
 
 // fd, data, size, offset
-void minifs_write_block(int, void *, uint32_t, uint32_t);
-void minifs_read_block(int, void*, uint32_t, uint32_t);
+void minifs_write_block(int, void *, uint64_t, uint64_t);
+void minifs_read_block(int, void*, uint64_t, uint64_t);
+
+// fd, iovecs, count, offset: writes iovecs with as few pwritev calls as possible
+void minifs_write_vector(int, struct iovec*, int, uint64_t);
+
+// fd, iovecs, count, offset: fills iovecs, bytes past end of image are zero
+// since block bodies are written lazily
+void minifs_read_vector(int, struct iovec*, int, uint64_t);
+
+
+// io_uring backend: returns false and keeps synchronous io if ring is unavailable
+bool minifs_enable_uring(Filesystem*);
+
+// fs, batch, iovecs, count, offset: transfers of batch go to kernel together
+// and are done after minifs_wait_batch, without ring they are done at once
+void minifs_queue_read(Filesystem*, UringBatch*, struct iovec*, int, uint64_t);
+void minifs_queue_write(Filesystem*, UringBatch*, struct iovec*, int, uint64_t);
+void minifs_wait_batch(Filesystem*, UringBatch*);
+
+
+// journal: metadata of every update is logged to journal region as one
+// transaction, logged transactions become durable together on commit
+// and are written to tables by checkpoint when log is full or on close
+void minifs_enable_journal(Filesystem*);
 
+// waits until everything updated before call is durable, one leader
+// commits transactions of all waiting threads with one fdatasync
+void minifs_commit(Filesystem*);
 
-uint32_t minifs_block_head_offset(Filesystem*, uint32_t);
-uint32_t minifs_block_body_offset(Filesystem*, uint32_t);
-uint32_t minifs_inode_offset(Filesystem*, uint32_t);
+
+// inline area of inode: files of image with large inodes keep data there
+// while it fits, capacity is 0 for plain inodes
+uint32_t minifs_inline_capacity(Filesystem*);
+unsigned char *minifs_inline_data(Filesystem*, uint32_t);
+
+// offsets in image are 64-bit, bodies of large images lie past 4 GB
+uint64_t minifs_block_head_offset(Filesystem*, uint32_t);
+uint64_t minifs_block_body_offset(Filesystem*, uint32_t);
+uint64_t minifs_inode_offset(Filesystem*, uint32_t);
+uint64_t minifs_inode_bitmap_offset(Filesystem*);
+uint64_t minifs_block_bitmap_offset(Filesystem*);
+uint64_t minifs_journal_offset(Filesystem*);
+
+// fs, block, data, size, offset inside block body
+void minifs_read_body(Filesystem*, uint32_t, void*, uint32_t, uint32_t);
+void minifs_write_body(Filesystem*, uint32_t, const void*, uint32_t, uint32_t);
 
 DirectoryMap *minifs_read_dir(Filesystem*, uint32_t);
+
+// fs, dir, iterator: next returns live entry or NULL at the end,
+// entry stays valid until next call
+void minifs_dir_open(Filesystem*, uint32_t, DirIterator*);
+const DirEntry *minifs_dir_next(DirIterator*);
+void minifs_dir_close(DirIterator*);
 void minifs_clear_dirmap(DirectoryMap*);
 
 
 int32_t minifs_find_free_inode(Filesystem*);
 int32_t minifs_find_free_block(Filesystem*);
+
+// allocation state changes, keep bitmaps and used counters in sync
+void minifs_take_inode(Filesystem*, uint32_t);
+void minifs_release_inode(Filesystem*, uint32_t);
+void minifs_take_block(Filesystem*, uint32_t);
+void minifs_release_block(Filesystem*, uint32_t);
+
+// fs, goal block, wanted length, result length: takes run of free blocks
+// starting at goal if it is free, otherwise at first free run of wanted
+// length after allocator hint or at next free block if there is none
+int32_t minifs_alloc_run(Filesystem*, int32_t, uint32_t, uint32_t*);
+
+// fs, inode, goal block, wanted length, result length: takes run for append
+// to inode, run comes from its preallocation window when goal is there;
+// when file grows, free blocks after new tail become its window
+int32_t minifs_alloc_file_run(Filesystem*, uint32_t, int32_t, uint32_t, uint32_t*);
+
+// returns preallocation window of inode to free space
+void minifs_release_prealloc(Filesystem*, uint32_t);
+
+// false if extent tree of file cannot be read, commands
+// do not read or change such file
+bool minifs_file_readable(Filesystem*, uint32_t);
+
+// statistics of blocks which file has now, delayed appends are not
+// flushed for them: count of runs of adjacent blocks, 1 if file is not
+// fragmented, and count of blocks without holes
+uint32_t minifs_file_fragments(Filesystem*, uint32_t);
+uint32_t minifs_file_blocks(Filesystem*, uint32_t);
+
+// releases all blocks owned by inode
+void minifs_free_blocks(Filesystem*, uint32_t);
+
+// block index of inode, index is kept in sync by append and free;
+// delayed appends of inode get their blocks first
+BlockIndex *minifs_block_index(Filesystem*, uint32_t);
+void minifs_drop_index(Filesystem*, uint32_t);
+
+// fs, inode, block number in file: physical block or -1
+int32_t minifs_file_block(Filesystem*, uint32_t, uint32_t);
+void minifs_mark_inode(Filesystem*, uint32_t);
+void minifs_mark_block(Filesystem*, uint32_t);
 void minifs_update_superblock(Filesystem*);
+
+// fs, superblock with tables, inode and block bitmap words, dirty sets of
+// inodes, blocks, inode words and block words: writes dirty entries of given
+// tables and superblock to their places in image, sets are not cleared
+void minifs_write_metadata(Filesystem*, SuperBlock*, uint64_t*, uint64_t*,
+                           DirtySet*, DirtySet*, DirtySet*, DirtySet*);
+
+// appends to regular file with blocks are gathered in its delayed buffer
+// while its table entry has no other unwritten changes
 void minifs_append_data(Filesystem*, uint32_t, const unsigned char *, uint32_t);
+
+// writes delayed appends of inode or of all inodes to blocks
+void minifs_flush_delayed(Filesystem*, uint32_t);
+void minifs_flush_all_delayed(Filesystem*);
+
+// count of free blocks which are not promised to delayed appends
+uint32_t minifs_free_block_count(Filesystem*);
+
+// bytes which data of inode takes in its blocks now, delayed appends are
+// not counted; for compressed file it is size of coded clusters with headers
+uint32_t minifs_stored_size(Filesystem*, uint32_t);
+
+// fs, extent mapped inode, block count: appends free runs to inode in one
+// allocator pass, returns count of taken blocks, their size stays zero
+uint32_t minifs_reserve_blocks(Filesystem*, uint32_t, uint32_t);
+
+// fs, inode, first block number in file, fd, size: fills reserved blocks
+// with data read from fd by chunks, inline file gets data to its inline
+// area; returns false if fd ends early
+bool minifs_fill_blocks(Filesystem*, uint32_t, uint32_t, int, uint32_t);
 const char* minifs_read_data(Filesystem*, int32_t, int32_t*);
+
+// receives file content piece by piece in file order, returns false to stop
+typedef bool (*MinifsStreamFunc)(void *context, const void *data, uint32_t size);
+
+// fs, inode, buffer, buffer size, function, context: passes file to function
+// by runs of adjacent blocks which fit buffer, mapped image is passed in place;
+// buffer holds at least one block, returns false if function stopped stream
+bool minifs_stream_data(Filesystem*, uint32_t, void*, uint32_t, MinifsStreamFunc, void*);
+
+// fs, inode, data, size, offset: reads only blocks covering range,
+// returns count of bytes read, which is less than size at end of file
+uint32_t minifs_file_pread(Filesystem*, uint32_t, void*, uint32_t, uint32_t);
+
+// fs, inode, data, size, offset: overwrites blocks covering range in place
+// and appends the rest, gap after end of file reads as zeros: whole blocks
+// of gap in extent mapped file are left as holes, other gaps are filled;
+// updates file size and returns count of written bytes; cluster of compressed
+// file is coded again in place, cluster which outgrows its space is written
+// again together with all clusters after it
+uint32_t minifs_file_pwrite(Filesystem*, uint32_t, const void*, uint32_t, uint32_t);
+
+// fs, inode, offset: start of first data or hole at or after offset like
+// SEEK_DATA and SEEK_HOLE of lseek, end of file counts as hole;
+// -1 if offset is not inside file
+int64_t minifs_seek_data(Filesystem*, uint32_t, uint32_t);
+int64_t minifs_seek_hole(Filesystem*, uint32_t, uint32_t);
+
+// fs, inode, size: blocks after new end go back to free pool in one
+// allocator pass and tail block is cut in place, growing fills zeros
+void minifs_truncate(Filesystem*, uint32_t, uint32_t);
+
+// fs, inode, fd: writes file to fd at its current offset, runs of adjacent
+// blocks are copied by kernel with copy_file_range or sendfile, pread and
+// write are used when neither works for fd, compressed file is decoded by
+// clusters and written; returns false on write error
+bool minifs_export_data(Filesystem*, uint32_t, int);
 void minifs_remove_from_dir(Filesystem*, uint32_t, uint32_t);
 
+// fs, dir, entry position, entry
+void minifs_read_entry(Filesystem*, uint32_t, uint32_t, DirEntry*);
+void minifs_write_entry(Filesystem*, uint32_t, uint32_t, const DirEntry*);
+
+// appends raw entry to directory, returns its position
+uint32_t minifs_append_entry(Filesystem*, uint32_t, const DirEntry*);
+
+// fs, dir, name, inode: adds entry and keeps name index up to date,
+// dead entry found from free slot hint is reused before appending
+void minifs_add_to_dir(Filesystem*, uint32_t, const char*, uint32_t);
+
+// fs, dir: repacks live entries to the front of directory and releases
+// emptied blocks, name index is rebuilt; entry positions change
+void minifs_compact_dir(Filesystem*, uint32_t);
+
+// fs, dir, name, entry position or NULL: inode of live entry or -1
+int32_t minifs_lookup(Filesystem*, uint32_t, const char*, int32_t*);
+
+// fs, path: inode of absolute or relative path or -1
+int32_t minifs_resolve(Filesystem*, const char*);
+
+// fs, path, last component: directory which holds last component
+// of path or -1, component is pointer into path
+int32_t minifs_resolve_parent(Filesystem*, const char*, const char**);
+
+// fs, type, flags, parent: allocates inode with root block, inline file
+// gets no blocks; returns -1 on failure
+int32_t minifs_create_inode(Filesystem*, uint16_t, uint16_t, int32_t);
+
+// releases inode with its blocks and directory index
+void minifs_destroy_inode(Filesystem*, uint32_t);
+
 #endif
\ No newline at end of file
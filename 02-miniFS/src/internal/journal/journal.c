@@ -0,0 +1,568 @@
+#include <internal/journal/journal.h>
+#include <internal/bcache/bcache.h>
+#include <internal/debug/debug.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+
+// reusable window over log region
+typedef struct LogReader {
+    unsigned char *data;
+    uint32_t begin;     // region position of first loaded byte
+    uint32_t size;
+    uint32_t capacity;
+} LogReader;
+
+
+// =========== [ HELPERS ] ===========
+
+static uint32_t hash_bytes(uint32_t hash, const void *data, uint32_t size) {
+    const unsigned char *bytes = (const unsigned char*) data;
+    for (uint32_t index = 0; index < size; ++index) {  // FNV-1a
+        hash ^= bytes[index];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+
+static uint32_t header_checksum(const JournalHeader *header) {
+    return hash_bytes(2166136261u, header, offsetof(JournalHeader, checksum));
+}
+
+
+static uint32_t txn_checksum(const JournalTxn *txn, const unsigned char *records) {
+    uint32_t hash = hash_bytes(2166136261u, txn, offsetof(JournalTxn, checksum));
+    return hash_bytes(hash, records, txn->size);
+}
+
+
+static uint32_t payload_size(const SuperBlock *sblock, uint8_t type) {
+    switch (type) {
+        case JOURNAL_COUNTERS:
+            return 2 * sizeof(uint32_t);
+        case JOURNAL_INODE:
+            return sizeof(Inode);
+        case JOURNAL_BLOCK:
+            return sizeof(Block);
+        case JOURNAL_INODE_WORD:
+        case JOURNAL_BLOCK_WORD:
+            return sizeof(uint64_t);
+        case JOURNAL_INLINE:
+            return sblock->inode_size - sizeof(Inode);
+        default:
+            return 0;
+    }
+}
+
+
+static unsigned char *shadow_inline(Filesystem *fs, Journal *journal, uint32_t index) {
+    return journal->shadow.inline_map + (uint64_t) index * minifs_inline_capacity(fs);
+}
+
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+
+static void sync_image(Filesystem *fs) {
+    if (fdatasync(fs->fd) < 0) {
+        debug(MINIFS_ERR "fdatasync error");
+        exit(-1);
+    }
+    MINIFS_IO_COUNT(syncs);
+}
+
+
+static bool read_header(Filesystem *fs, JournalHeader *header) {
+    struct iovec iov = {.iov_base = header, .iov_len = sizeof(JournalHeader)};
+    minifs_read_vector(fs->fd, &iov, 1, minifs_journal_offset(fs));  // zero past end of image
+    return memcmp(header->magic, JOURNAL_MAGIC, sizeof(header->magic)) == 0 &&
+           header->checksum == header_checksum(header);
+}
+
+
+void journal_format(Filesystem *fs, uint64_t sequence) {
+    JournalHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, JOURNAL_MAGIC, sizeof(header.magic));
+    header.sequence = sequence;
+    header.checksum = header_checksum(&header);
+    minifs_write_block(fs->fd, &header, sizeof(header), minifs_journal_offset(fs));
+}
+
+
+// =========== [ REPLAY ] ===========
+
+// returns log bytes at position, region is read by big chunks
+static const unsigned char *log_read(Filesystem *fs, LogReader *reader, uint32_t position, uint32_t size) {
+    if (position + size > JOURNAL_SIZE) {
+        return NULL;
+    }
+    if (position >= reader->begin && position + size <= reader->begin + reader->size) {
+        return reader->data + (position - reader->begin);
+    }
+
+    uint32_t want = (size > JOURNAL_READ_SIZE) ? size : JOURNAL_READ_SIZE;
+    want = (want < JOURNAL_SIZE - position) ? want : JOURNAL_SIZE - position;
+    if (want > reader->capacity) {
+        reader->capacity = want;
+        reader->data = (unsigned char*) realloc(reader->data, want);
+    }
+    struct iovec iov = {.iov_base = reader->data, .iov_len = want};
+    minifs_read_vector(fs->fd, &iov, 1, minifs_journal_offset(fs) + position);
+    reader->begin = position;
+    reader->size = want;
+    return reader->data;
+}
+
+
+// puts entry images of transaction to fs tables, returns false on broken record
+static bool apply(Filesystem *fs, const unsigned char *records, uint32_t size) {
+    SuperBlock *sblock = &fs->sblock;
+    uint32_t position = 0;
+    while (position < size) {
+        JournalRecord record;
+        if (position + sizeof(record) > size) {
+            return false;
+        }
+        memcpy(&record, records + position, sizeof(record));
+        const unsigned char *image = records + position + sizeof(record);
+        uint32_t length = payload_size(sblock, record.type);
+        position += sizeof(record) + length;
+        if (length == 0 || position > size) {
+            return false;
+        }
+
+        switch (record.type) {
+            case JOURNAL_COUNTERS:
+                memcpy(&sblock->used_inode_count, image, sizeof(uint32_t));
+                memcpy(&sblock->used_block_count, image + sizeof(uint32_t), sizeof(uint32_t));
+                break;
+            case JOURNAL_INODE:
+                if (record.index >= sblock->inode_count) {
+                    return false;
+                }
+                memcpy(&sblock->inode_map[record.index], image, length);
+                minifs_mark_inode(fs, record.index);
+                break;
+            case JOURNAL_BLOCK:
+                if (record.index >= sblock->block_count) {
+                    return false;
+                }
+                memcpy(&sblock->block_map[record.index], image, length);
+                minifs_mark_block(fs, record.index);
+                break;
+            case JOURNAL_INODE_WORD:
+                if (record.index >= bitmap_words(sblock->inode_count)) {
+                    return false;
+                }
+                memcpy(&fs->inode_bitmap.words[record.index], image, length);
+                minifs_dirty_add(&fs->dirty_inode_words, record.index);
+                break;
+            case JOURNAL_BLOCK_WORD:
+                if (record.index >= bitmap_words(sblock->block_count)) {
+                    return false;
+                }
+                memcpy(&fs->block_bitmap.words[record.index], image, length);
+                minifs_dirty_add(&fs->dirty_block_words, record.index);
+                break;
+            case JOURNAL_INLINE:
+                if (record.index >= sblock->inode_count) {
+                    return false;
+                }
+                memcpy(minifs_inline_data(fs, record.index), image, length);
+                minifs_mark_inode(fs, record.index);
+                break;
+        }
+    }
+    return true;
+}
+
+
+uint64_t journal_replay(Filesystem *fs) {
+    JournalHeader header;
+    if (!read_header(fs, &header)) {  // image has no journal
+        return 0;
+    }
+
+    // log ends at first torn transaction or one left from older log
+    LogReader reader = {.data = NULL, .begin = 0, .size = 0, .capacity = 0};
+    uint64_t sequence = header.sequence;
+    uint32_t position = sizeof(JournalHeader);
+    while (true) {
+        const unsigned char *data = log_read(fs, &reader, position, sizeof(JournalTxn));
+        if (data == NULL) {
+            break;
+        }
+        JournalTxn txn;
+        memcpy(&txn, data, sizeof(txn));
+        if (txn.magic != JOURNAL_TXN_MAGIC || txn.sequence != sequence) {
+            break;
+        }
+        data = log_read(fs, &reader, position, sizeof(JournalTxn) + txn.size);
+        if (data == NULL || txn_checksum(&txn, data + sizeof(JournalTxn)) != txn.checksum) {
+            break;
+        }
+        if (!apply(fs, data + sizeof(JournalTxn), txn.size)) {
+            debug(MINIFS_WARN "broken record in journal transaction %lu", txn.sequence);
+            break;
+        }
+        position += sizeof(JournalTxn) + txn.size;
+        ++sequence;
+    }
+    free(reader.data);
+
+    uint64_t count = sequence - header.sequence;
+    if (count > 0) {  // tables are on disk before log is dropped
+        debug(MINIFS_INFO "replayed %lu journal transactions", count);
+        minifs_update_superblock(fs);
+        sync_image(fs);
+        journal_format(fs, sequence);
+    }
+    return count;
+}
+
+
+// =========== [ LOG ] ===========
+
+static void *commit_timer(void *argument);
+
+
+void journal_init(Filesystem *fs, Journal *journal) {
+    JournalHeader header;
+    journal->sequence = 1;
+    if (read_header(fs, &header)) {
+        journal->sequence = header.sequence;
+    } else {
+        journal_format(fs, journal->sequence);
+    }
+    journal->committed = journal->sequence;
+    journal->head = sizeof(JournalHeader);
+    journal->pending = NULL;
+    journal->pending_size = 0;
+    journal->pending_capacity = 0;
+    journal->committing = false;
+    journal->commit_time = now_ns();
+
+    SuperBlock *sblock = &fs->sblock;
+    uint32_t inode_bytes = bitmap_words(sblock->inode_count) * sizeof(uint64_t);
+    uint32_t block_bytes = bitmap_words(sblock->block_count) * sizeof(uint64_t);
+    journal->shadow = *sblock;
+    journal->shadow.inode_map = (Inode*) malloc(sblock->inode_count * sizeof(Inode));
+    journal->shadow.block_map = (Block*) malloc(sblock->block_count * sizeof(Block));
+    memcpy(journal->shadow.inode_map, sblock->inode_map, sblock->inode_count * sizeof(Inode));
+    memcpy(journal->shadow.block_map, sblock->block_map, sblock->block_count * sizeof(Block));
+    if (sblock->inline_map != NULL) {
+        uint64_t inline_bytes = (uint64_t) sblock->inode_count * minifs_inline_capacity(fs);
+        journal->shadow.inline_map = (unsigned char*) malloc(inline_bytes);
+        memcpy(journal->shadow.inline_map, sblock->inline_map, inline_bytes);
+    }
+    journal->inode_words = (uint64_t*) malloc(inode_bytes);
+    journal->block_words = (uint64_t*) malloc(block_bytes);
+    memcpy(journal->inode_words, fs->inode_bitmap.words, inode_bytes);
+    memcpy(journal->block_words, fs->block_bitmap.words, block_bytes);
+
+    minifs_dirty_init(&journal->inodes, sblock->inode_count);
+    minifs_dirty_init(&journal->blocks, sblock->block_count);
+    minifs_dirty_init(&journal->inode_word_set, bitmap_words(sblock->inode_count));
+    minifs_dirty_init(&journal->block_word_set, bitmap_words(sblock->block_count));
+    pthread_mutex_init(&journal->lock, NULL);
+    pthread_condattr_t attributes;  // timer waits by clock of now_ns
+    pthread_condattr_init(&attributes);
+    pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+    pthread_cond_init(&journal->done, &attributes);
+    pthread_condattr_destroy(&attributes);
+    journal->transactions = 0;
+    journal->commits = 0;
+    journal->checkpoints = 0;
+    journal->commit_interval = JOURNAL_COMMIT_INTERVAL;
+    journal->fs = fs;
+    journal->stopping = false;
+    pthread_create(&journal->timer, NULL, commit_timer, journal);
+}
+
+
+void journal_free(Journal *journal) {
+    pthread_mutex_lock(&journal->lock);
+    journal->stopping = true;
+    pthread_cond_broadcast(&journal->done);
+    pthread_mutex_unlock(&journal->lock);
+    pthread_join(journal->timer, NULL);
+
+    free(journal->pending);
+    free(journal->shadow.inode_map);
+    free(journal->shadow.block_map);
+    free(journal->shadow.inline_map);
+    free(journal->inode_words);
+    free(journal->block_words);
+    minifs_dirty_free(&journal->inodes);
+    minifs_dirty_free(&journal->blocks);
+    minifs_dirty_free(&journal->inode_word_set);
+    minifs_dirty_free(&journal->block_word_set);
+    pthread_mutex_destroy(&journal->lock);
+    pthread_cond_destroy(&journal->done);
+}
+
+
+// writes pending transactions to log, called with journal lock held;
+// lock is released during io, new transactions go to fresh buffer
+static void write_log(Filesystem *fs, Journal *journal) {
+    unsigned char *log = journal->pending;
+    uint32_t size = journal->pending_size;
+    uint32_t offset = journal->head;
+    uint64_t last = journal->sequence;
+    journal->pending = NULL;
+    journal->pending_size = 0;
+    journal->pending_capacity = 0;
+    journal->head += size;
+    journal->committing = true;
+    pthread_mutex_unlock(&journal->lock);
+
+    // bodies written by logged updates go to image first, one
+    // fdatasync makes them durable together with transactions
+    bcache_flush(fs);
+    minifs_write_block(fs->fd, log, size, minifs_journal_offset(fs) + offset);
+    sync_image(fs);
+    free(log);
+
+    pthread_mutex_lock(&journal->lock);
+    journal->committed = last;
+    journal->committing = false;
+    journal->commit_time = now_ns();
+    journal->commits++;
+    pthread_cond_broadcast(&journal->done);
+}
+
+
+// commits pending transactions once interval has passed since last commit,
+// so update after which nothing comes does not wait in memory forever
+static void *commit_timer(void *argument) {
+    Journal *journal = (Journal*) argument;
+    pthread_mutex_lock(&journal->lock);
+    while (!journal->stopping) {
+        if (journal->pending_size == 0 || journal->committing) {
+            pthread_cond_wait(&journal->done, &journal->lock);
+            continue;
+        }
+        uint64_t deadline = journal->commit_time + journal->commit_interval;
+        if (now_ns() < deadline) {
+            struct timespec until = {.tv_sec = deadline / 1000000000ull, .tv_nsec = deadline % 1000000000ull};
+            pthread_cond_timedwait(&journal->done, &journal->lock, &until);
+            continue;
+        }
+        write_log(journal->fs, journal);
+    }
+    pthread_mutex_unlock(&journal->lock);
+    return NULL;
+}
+
+
+// called with allocator and journal locks held, so nothing is logged meanwhile
+static void checkpoint(Filesystem *fs, Journal *journal) {
+    while (journal->committing) {
+        pthread_cond_wait(&journal->done, &journal->lock);
+    }
+    if (journal->pending_size > 0) {  // shadow holds only committed state after it
+        write_log(fs, journal);
+    }
+
+    minifs_write_metadata(fs, &journal->shadow, journal->inode_words, journal->block_words,
+                          &journal->inodes, &journal->blocks, &journal->inode_word_set, &journal->block_word_set);
+    sync_image(fs);
+    minifs_dirty_clear(&journal->inodes);
+    minifs_dirty_clear(&journal->blocks);
+    minifs_dirty_clear(&journal->inode_word_set);
+    minifs_dirty_clear(&journal->block_word_set);
+
+    // header becomes durable with next commit, before that replay of old
+    // log stops at first overwritten transaction, its effects are in tables
+    journal->head = sizeof(JournalHeader);
+    journal_format(fs, journal->sequence);
+    journal->checkpoints++;
+}
+
+
+// update which does not fit log (large file of large image) is written
+// in place after checkpoint, so it is durable but not atomic
+static void write_through(Filesystem *fs, Journal *journal) {
+    SuperBlock *sblock = &fs->sblock;
+    checkpoint(fs, journal);
+    bcache_flush(fs);
+    minifs_write_metadata(fs, sblock, fs->inode_bitmap.words, fs->block_bitmap.words,
+                          &fs->dirty_inodes, &fs->dirty_blocks, &fs->dirty_inode_words, &fs->dirty_block_words);
+    sync_image(fs);
+
+    journal->shadow.used_inode_count = sblock->used_inode_count;
+    journal->shadow.used_block_count = sblock->used_block_count;
+    for (uint32_t item = 0; item < fs->dirty_inodes.count; ++item) {
+        uint32_t index = fs->dirty_inodes.items[item];
+        journal->shadow.inode_map[index] = sblock->inode_map[index];
+        if (sblock->inline_map != NULL) {
+            memcpy(shadow_inline(fs, journal, index), minifs_inline_data(fs, index), minifs_inline_capacity(fs));
+        }
+    }
+    for (uint32_t item = 0; item < fs->dirty_blocks.count; ++item) {
+        uint32_t index = fs->dirty_blocks.items[item];
+        journal->shadow.block_map[index] = sblock->block_map[index];
+    }
+    for (uint32_t item = 0; item < fs->dirty_inode_words.count; ++item) {
+        uint32_t index = fs->dirty_inode_words.items[item];
+        journal->inode_words[index] = fs->inode_bitmap.words[index];
+    }
+    for (uint32_t item = 0; item < fs->dirty_block_words.count; ++item) {
+        uint32_t index = fs->dirty_block_words.items[item];
+        journal->block_words[index] = fs->block_bitmap.words[index];
+    }
+    minifs_dirty_clear(&fs->dirty_inodes);
+    minifs_dirty_clear(&fs->dirty_blocks);
+    minifs_dirty_clear(&fs->dirty_inode_words);
+    minifs_dirty_clear(&fs->dirty_block_words);
+}
+
+
+static unsigned char *reserve(Journal *journal, uint32_t size) {
+    if (journal->pending_size + size > journal->pending_capacity) {
+        uint32_t capacity = (journal->pending_capacity > 0) ? journal->pending_capacity : 4096;
+        while (capacity < journal->pending_size + size) {
+            capacity *= 2;
+        }
+        journal->pending = (unsigned char*) realloc(journal->pending, capacity);
+        journal->pending_capacity = capacity;
+    }
+    unsigned char *result = journal->pending + journal->pending_size;
+    journal->pending_size += size;
+    return result;
+}
+
+
+// appends record with image of table entry and copies it to shadow table
+static void put_record(Journal *journal, uint8_t type, uint32_t index, const void *image, void *shadow) {
+    JournalRecord record = {.type = type, .index = index};
+    uint32_t length = payload_size(&journal->shadow, type);
+    unsigned char *target = reserve(journal, sizeof(record) + length);
+    memcpy(target, &record, sizeof(record));
+    memcpy(target + sizeof(record), image, length);
+    memcpy(shadow, image, length);
+}
+
+
+void journal_log(Filesystem *fs) {
+    Journal *journal = fs->journal;
+    SuperBlock *sblock = &fs->sblock;
+    minifs_lock_alloc(fs);
+    uint32_t entries = fs->dirty_inodes.count + fs->dirty_blocks.count +
+                       fs->dirty_inode_words.count + fs->dirty_block_words.count;
+    if (entries == 0) {
+        minifs_unlock_alloc(fs);
+        return;
+    }
+
+    // inline area is logged only if it differs from logged one
+    uint32_t inline_records = 0;
+    for (uint32_t item = 0; sblock->inline_map != NULL && item < fs->dirty_inodes.count; ++item) {
+        uint32_t index = fs->dirty_inodes.items[item];
+        if (memcmp(minifs_inline_data(fs, index), shadow_inline(fs, journal, index), minifs_inline_capacity(fs)) != 0) {
+            ++inline_records;
+        }
+    }
+
+    uint32_t size = sizeof(JournalRecord) + payload_size(sblock, JOURNAL_COUNTERS);
+    size += fs->dirty_inodes.count * (sizeof(JournalRecord) + sizeof(Inode));
+    size += inline_records * (sizeof(JournalRecord) + minifs_inline_capacity(fs));
+    size += fs->dirty_blocks.count * (sizeof(JournalRecord) + sizeof(Block));
+    size += (fs->dirty_inode_words.count + fs->dirty_block_words.count) * (sizeof(JournalRecord) + sizeof(uint64_t));
+    pthread_mutex_lock(&journal->lock);
+    if (sizeof(JournalHeader) + sizeof(JournalTxn) + size > JOURNAL_SIZE) {
+        write_through(fs, journal);
+        pthread_mutex_unlock(&journal->lock);
+        minifs_unlock_alloc(fs);
+        return;
+    }
+    if (journal->head + journal->pending_size + sizeof(JournalTxn) + size > JOURNAL_SIZE) {
+        checkpoint(fs, journal);  // log is full
+    }
+
+    uint32_t start = journal->pending_size;
+    reserve(journal, sizeof(JournalTxn));
+    uint32_t counters[2] = {sblock->used_inode_count, sblock->used_block_count};
+    put_record(journal, JOURNAL_COUNTERS, 0, counters, counters);
+    journal->shadow.used_inode_count = sblock->used_inode_count;
+    journal->shadow.used_block_count = sblock->used_block_count;
+    for (uint32_t item = 0; item < fs->dirty_inodes.count; ++item) {
+        uint32_t index = fs->dirty_inodes.items[item];
+        put_record(journal, JOURNAL_INODE, index, &sblock->inode_map[index], &journal->shadow.inode_map[index]);
+        unsigned char *shadow = (sblock->inline_map != NULL) ? shadow_inline(fs, journal, index) : NULL;
+        if (shadow != NULL && memcmp(minifs_inline_data(fs, index), shadow, minifs_inline_capacity(fs)) != 0) {
+            put_record(journal, JOURNAL_INLINE, index, minifs_inline_data(fs, index), shadow);
+        }
+        minifs_dirty_add(&journal->inodes, index);
+    }
+    for (uint32_t item = 0; item < fs->dirty_blocks.count; ++item) {
+        uint32_t index = fs->dirty_blocks.items[item];
+        put_record(journal, JOURNAL_BLOCK, index, &sblock->block_map[index], &journal->shadow.block_map[index]);
+        minifs_dirty_add(&journal->blocks, index);
+    }
+    for (uint32_t item = 0; item < fs->dirty_inode_words.count; ++item) {
+        uint32_t index = fs->dirty_inode_words.items[item];
+        put_record(journal, JOURNAL_INODE_WORD, index, &fs->inode_bitmap.words[index], &journal->inode_words[index]);
+        minifs_dirty_add(&journal->inode_word_set, index);
+    }
+    for (uint32_t item = 0; item < fs->dirty_block_words.count; ++item) {
+        uint32_t index = fs->dirty_block_words.items[item];
+        put_record(journal, JOURNAL_BLOCK_WORD, index, &fs->block_bitmap.words[index], &journal->block_words[index]);
+        minifs_dirty_add(&journal->block_word_set, index);
+    }
+
+    JournalTxn txn = {.magic = JOURNAL_TXN_MAGIC, .size = size, .sequence = journal->sequence};
+    txn.checksum = txn_checksum(&txn, journal->pending + start + sizeof(JournalTxn));
+    memcpy(journal->pending + start, &txn, sizeof(txn));
+    journal->sequence++;
+    journal->transactions++;
+    if (start == 0) {  // timer starts counting interval of first pending update
+        pthread_cond_broadcast(&journal->done);
+    }
+    bool commit = journal->pending_size >= JOURNAL_COMMIT_SIZE ||
+                  now_ns() - journal->commit_time >= journal->commit_interval;
+    pthread_mutex_unlock(&journal->lock);
+
+    minifs_dirty_clear(&fs->dirty_inodes);
+    minifs_dirty_clear(&fs->dirty_blocks);
+    minifs_dirty_clear(&fs->dirty_inode_words);
+    minifs_dirty_clear(&fs->dirty_block_words);
+    minifs_unlock_alloc(fs);
+    if (commit) {
+        journal_commit(fs);
+    }
+}
+
+
+void journal_commit(Filesystem *fs) {
+    Journal *journal = fs->journal;
+    pthread_mutex_lock(&journal->lock);
+    uint64_t target = journal->sequence;
+    while (journal->committed < target) {
+        if (journal->committing) {  // next leader takes everything logged meanwhile
+            pthread_cond_wait(&journal->done, &journal->lock);
+            continue;
+        }
+        write_log(fs, journal);
+    }
+    pthread_mutex_unlock(&journal->lock);
+}
+
+
+void journal_checkpoint(Filesystem *fs) {
+    minifs_lock_alloc(fs);
+    pthread_mutex_lock(&fs->journal->lock);
+    checkpoint(fs, fs->journal);
+    pthread_mutex_unlock(&fs->journal->lock);
+    minifs_unlock_alloc(fs);
+}
@@ -0,0 +1,121 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <internal/fs/fs.h>
+#include <pthread.h>
+
+/*
+	Write-ahead journal of metadata. Region after block bitmap holds
+	header and log of transactions, every transaction carries images
+	of inode/block map entries and bitmap words changed by one update.
+	Logged state is kept in shadow tables, checkpoint writes them to
+	their places in image and log starts from region beginning again.
+	Replay on open reads only transactions written since checkpoint.
+	Block bodies are not journaled, they reach image before commit.
+	Logged update is committed by next update once 64 KB are pending
+	or commit interval has passed since last commit; timer thread
+	commits it when no update comes, so crash loses at most updates
+	of last interval (5 s by default), and nothing after commit call.
+*/
+
+#define JOURNAL_MAGIC           "MINIFSJ1"
+#define JOURNAL_TXN_MAGIC       0x4E58544A
+#define JOURNAL_SIZE            (1024 * 1024)           // region size, header included
+#define JOURNAL_COMMIT_SIZE     (64 * 1024)             // logged bytes which start commit
+#define JOURNAL_COMMIT_INTERVAL (5 * 1000000000ull)     // ns between commits of logged updates
+#define JOURNAL_READ_SIZE       (64 * 1024)             // replay reads log by chunks of this size
+
+
+typedef struct JournalHeader {
+    char magic[8];
+    uint64_t sequence;      // first transaction of log
+    uint32_t checksum;
+    uint32_t reserved;
+} JournalHeader;
+
+
+// transaction header, records follow it
+typedef struct __attribute__((packed)) JournalTxn {
+    uint32_t magic;
+    uint32_t size;          // bytes of records
+    uint64_t sequence;
+    uint32_t checksum;      // of fields above and records
+} JournalTxn;
+
+
+enum JournalRecordType {
+    JOURNAL_COUNTERS = 1,   // used inode and block counts, index is unused
+    JOURNAL_INODE = 2,
+    JOURNAL_BLOCK = 3,
+    JOURNAL_INODE_WORD = 4,
+    JOURNAL_BLOCK_WORD = 5,
+    JOURNAL_INLINE = 6      // inline area of large inode, logged when it changes
+};
+
+
+// record header, image of entry follows it
+typedef struct __attribute__((packed)) JournalRecord {
+    uint8_t type;
+    uint32_t index;
+} JournalRecord;
+
+
+typedef struct Journal {
+    uint64_t sequence;          // next transaction
+    uint64_t committed;         // transactions before this one are durable
+    uint32_t head;              // end of written log in region
+    unsigned char *pending;     // logged transactions waiting for commit
+    uint32_t pending_size;
+    uint32_t pending_capacity;
+    bool committing;            // leader writes log, other committers wait
+    uint64_t commit_time;       // ns of last commit
+    SuperBlock shadow;          // logged state of metadata
+    uint64_t *inode_words;
+    uint64_t *block_words;
+    DirtySet inodes;            // shadow entries changed since checkpoint
+    DirtySet blocks;
+    DirtySet inode_word_set;
+    DirtySet block_word_set;
+    uint64_t commit_interval;   // ns, JOURNAL_COMMIT_INTERVAL by default
+    Filesystem *fs;             // controller timer commits through, stays in place while journal runs
+    pthread_t timer;            // commits logged updates when interval passes without them
+    bool stopping;
+    pthread_mutex_t lock;       // taken after allocator lock
+    pthread_cond_t done;        // commit finished, first update logged or timer stops
+    uint64_t transactions;
+    uint64_t commits;
+    uint64_t checkpoints;
+} Journal;
+
+
+// function writes journal header with empty log to image
+void journal_format(Filesystem *fs, uint64_t sequence);
+
+
+// function applies committed transactions of log to tables of
+// opened fs and writes them in place, returns count of transactions
+uint64_t journal_replay(Filesystem *fs);
+
+
+// function starts journal with shadow copy of fs tables and its
+// commit timer, tables of fs must be written to image before
+void journal_init(Filesystem *fs, Journal *journal);
+
+
+// function stops commit timer and frees journal, log must be
+// checkpointed before
+void journal_free(Journal *journal);
+
+
+// function moves dirty metadata of fs to new transaction
+void journal_log(Filesystem *fs);
+
+
+// function waits until all transactions logged before call are durable
+void journal_commit(Filesystem *fs);
+
+
+// function commits log and writes shadow tables to image
+void journal_checkpoint(Filesystem *fs);
+
+#endif
@@ -0,0 +1,173 @@
+#include <internal/lz/lz.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+
+bool test_round_trip();
+bool test_ratio();
+bool test_limits();
+
+
+int main() {
+    bool global = true;
+    global &= test_round_trip();
+    global &= test_ratio();
+    global &= test_limits();
+
+    if (global) {
+        printf("[GLOBAL OK]\n");
+    }
+
+    return 0;
+}
+
+
+// =========== [ HELPERS ] ===========
+
+// lines of log with counters, compressible like real text
+void fill_text(unsigned char *data, uint32_t size) {
+    uint32_t done = 0;
+    for (uint32_t line = 0; done < size; ++line) {
+        char buffer[128];
+        int length = snprintf(buffer, sizeof(buffer), "2026-10-18 12:%02u:%02u worker %u finished job %u, status ok\n",
+                              line / 60 % 60, line % 60, line % 7, line * 13);
+        uint32_t piece = (size - done < (uint32_t) length) ? size - done : (uint32_t) length;
+        memcpy(data + done, buffer, piece);
+        done += piece;
+    }
+}
+
+
+// coded and decoded data is the same as source, returns coded size or 0
+uint32_t round_trip(const unsigned char *data, uint32_t size) {
+    uint32_t bound = lz_bound(size);
+    unsigned char *coded = (unsigned char*) malloc(bound);
+    unsigned char *decoded = (unsigned char*) malloc(size + 1);
+    uint32_t coded_size = lz_compress(data, size, coded, bound);
+    bool same = coded_size > 0 && lz_decompress(coded, coded_size, decoded, size) == size &&
+                memcmp(data, decoded, size) == 0;
+    free(coded);
+    free(decoded);
+    return same ? coded_size : 0;
+}
+
+
+// =========== [ TESTS ] ===========
+
+bool test_round_trip() {
+    bool status = true;
+    const uint32_t size = 100000;
+    unsigned char *data = (unsigned char*) malloc(size);
+
+    fill_text(data, size);
+    if (round_trip(data, size) == 0) {
+        status = false;
+        printf("[BAD] 1 test_round_trip\n");
+    }
+
+    // random bytes have no matches, they go as literals
+    srand(7);
+    for (uint32_t index = 0; index < size; ++index) {
+        data[index] = rand() & 0xFF;
+    }
+    if (round_trip(data, size) == 0 || round_trip(data, size) > lz_bound(size)) {
+        status = false;
+        printf("[BAD] 2 test_round_trip\n");
+    }
+
+    // run of one byte is match which overlaps itself
+    memset(data, 'a', size);
+    if (round_trip(data, size) == 0 || round_trip(data, 1) == 0 || round_trip(data, 0) == 0) {
+        status = false;
+        printf("[BAD] 3 test_round_trip\n");
+    }
+
+    // matches at distance over 64 KB are not used
+    fill_text(data, 70000);
+    memcpy(data + 70000, data, 30000);
+    if (round_trip(data, size) == 0) {
+        status = false;
+        printf("[BAD] 4 test_round_trip\n");
+    }
+    free(data);
+
+    if (status) {
+        printf("[OK] test_round_trip\n");
+    } else {
+        printf("[BAD] test_round_trip\n");
+    }
+
+    return status;
+}
+
+
+bool test_ratio() {
+    bool status = true;
+    const uint32_t size = 16384;
+    unsigned char *data = (unsigned char*) malloc(size);
+
+    fill_text(data, size);
+    if (round_trip(data, size) == 0 || round_trip(data, size) > size / 3) {
+        status = false;
+        printf("[BAD] 1 test_ratio\n");
+    }
+
+    memset(data, 0, size);
+    if (round_trip(data, size) == 0 || round_trip(data, size) > 128) {
+        status = false;
+        printf("[BAD] 2 test_ratio\n");
+    }
+    free(data);
+
+    if (status) {
+        printf("[OK] test_ratio\n");
+    } else {
+        printf("[BAD] test_ratio\n");
+    }
+
+    return status;
+}
+
+
+bool test_limits() {
+    bool status = true;
+    const uint32_t size = 4096;
+    unsigned char data[4096];
+    unsigned char coded[8192];
+    unsigned char decoded[4096];
+    srand(11);
+    for (uint32_t index = 0; index < size; ++index) {
+        data[index] = rand() & 0xFF;
+    }
+
+    // target which cannot hold coded data is reported
+    if (lz_compress(data, size, coded, size / 2) != 0) {
+        status = false;
+        printf("[BAD] 1 test_limits\n");
+    }
+
+    // decoded data larger than target and broken input are errors
+    fill_text(data, size);
+    uint32_t coded_size = lz_compress(data, size, coded, sizeof(coded));
+    if (lz_decompress(coded, coded_size, decoded, size - 1) != -1) {
+        status = false;
+        printf("[BAD] 2 test_limits\n");
+    }
+    coded[coded_size - 1] ^= 0xFF;
+    coded_size -= 2;
+    if (lz_decompress(coded, coded_size, decoded, size) == size &&
+        memcmp(data, decoded, size) == 0) {
+        status = false;
+        printf("[BAD] 3 test_limits\n");
+    }
+
+    if (status) {
+        printf("[OK] test_limits\n");
+    } else {
+        printf("[BAD] test_limits\n");
+    }
+
+    return status;
+}
@@ -0,0 +1,172 @@
+#include <internal/lz/lz.h>
+#include <string.h>
+#include <stdbool.h>
+
+
+#define HASH_BITS 12
+#define NIBBLE_MAX 15
+
+
+// sequence: token with literal and match length nibbles, extra
+// length bytes of literals, literals, 2-byte distance, extra length
+// bytes of match; last sequence has only literals
+
+static uint32_t hash(const unsigned char *data) {
+    uint32_t word;
+    memcpy(&word, data, sizeof(word));
+    return (word * 2654435761u) >> (32 - HASH_BITS);
+}
+
+
+// length over nibble goes as bytes of 255 and remainder
+static unsigned char *put_length(unsigned char *out, const unsigned char *end, uint32_t length) {
+    for (; length >= 255; length -= 255) {
+        if (out == end) {
+            return NULL;
+        }
+        *out++ = 255;
+    }
+    if (out == end) {
+        return NULL;
+    }
+    *out++ = length;
+    return out;
+}
+
+
+static unsigned char *put_sequence(unsigned char *out, const unsigned char *end, const unsigned char *literals,
+                                   uint32_t literal_length, uint32_t distance, uint32_t match_length) {
+    if (out == end) {
+        return NULL;
+    }
+    uint32_t match_code = (match_length > 0) ? match_length - LZ_MIN_MATCH : 0;
+    unsigned char *token = out++;
+    *token = ((literal_length < NIBBLE_MAX ? literal_length : NIBBLE_MAX) << 4) |
+             (match_code < NIBBLE_MAX ? match_code : NIBBLE_MAX);
+    if (literal_length >= NIBBLE_MAX && (out = put_length(out, end, literal_length - NIBBLE_MAX)) == NULL) {
+        return NULL;
+    }
+    if ((uint32_t) (end - out) < literal_length) {
+        return NULL;
+    }
+    memcpy(out, literals, literal_length);
+    out += literal_length;
+    if (match_length == 0) {
+        return out;
+    }
+
+    if (end - out < 2) {
+        return NULL;
+    }
+    *out++ = distance & 0xFF;
+    *out++ = distance >> 8;
+    if (match_code >= NIBBLE_MAX) {
+        out = put_length(out, end, match_code - NIBBLE_MAX);
+    }
+    return out;
+}
+
+
+static bool get_length(const unsigned char **in, const unsigned char *end, uint32_t *length) {
+    unsigned char byte;
+    do {
+        if (*in == end) {
+            return false;
+        }
+        byte = *(*in)++;
+        *length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+
+uint32_t lz_bound(uint32_t size) {
+    return size + size / 255 + 16;
+}
+
+
+uint32_t lz_compress(const void *source, uint32_t size, void *target, uint32_t capacity) {
+    const unsigned char *in = (const unsigned char*) source;
+    unsigned char *out = (unsigned char*) target;
+    const unsigned char *end = out + capacity;
+    uint32_t table[1 << HASH_BITS];
+    memset(table, 0, sizeof(table));
+
+    uint32_t anchor = 0;
+    uint32_t position = 0;
+    uint32_t misses = 0;
+    while (position + LZ_MIN_MATCH <= size) {
+        uint32_t slot = hash(in + position);
+        uint32_t candidate = table[slot];
+        table[slot] = position;
+        if (candidate >= position || position - candidate > LZ_MAX_DISTANCE ||
+            memcmp(in + candidate, in + position, LZ_MIN_MATCH) != 0) {
+            position += 1 + (misses++ >> 6);  // data without matches is skipped faster
+            continue;
+        }
+
+        uint32_t length = LZ_MIN_MATCH;
+        while (position + length < size && in[candidate + length] == in[position + length]) {
+            ++length;
+        }
+        out = put_sequence(out, end, in + anchor, position - anchor, position - candidate, length);
+        if (out == NULL) {
+            return 0;
+        }
+        position += length;
+        anchor = position;
+        misses = 0;
+    }
+
+    out = put_sequence(out, end, in + anchor, size - anchor, 0, 0);
+    return (out == NULL) ? 0 : out - (unsigned char*) target;
+}
+
+
+int64_t lz_decompress(const void *source, uint32_t size, void *target, uint32_t capacity) {
+    const unsigned char *in = (const unsigned char*) source;
+    const unsigned char *in_end = in + size;
+    unsigned char *out = (unsigned char*) target;
+    uint32_t done = 0;
+    while (in < in_end) {
+        unsigned char token = *in++;
+        uint32_t literal_length = token >> 4;
+        if (literal_length == NIBBLE_MAX && !get_length(&in, in_end, &literal_length)) {
+            return -1;
+        }
+        if ((uint32_t) (in_end - in) < literal_length || capacity - done < literal_length) {
+            return -1;
+        }
+        memcpy(out + done, in, literal_length);
+        in += literal_length;
+        done += literal_length;
+        if (in == in_end) {  // last sequence
+            break;
+        }
+
+        if (in_end - in < 2) {
+            return -1;
+        }
+        uint32_t distance = in[0] | (in[1] << 8);
+        in += 2;
+        uint32_t match_length = (token & NIBBLE_MAX) + LZ_MIN_MATCH;
+        if ((token & NIBBLE_MAX) == NIBBLE_MAX && !get_length(&in, in_end, &match_length)) {
+            return -1;
+        }
+        if (distance == 0 || distance > done || capacity - done < match_length) {
+            return -1;
+        }
+
+        // match may overlap bytes it produces, then it is copied byte by byte
+        unsigned char *from = out + done - distance;
+        if (distance >= match_length) {
+            memcpy(out + done, from, match_length);
+        } else {
+            for (uint32_t index = 0; index < match_length; ++index) {
+                out[done + index] = from[index];
+            }
+        }
+        done += match_length;
+    }
+    return done;
+}
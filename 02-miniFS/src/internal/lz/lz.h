@@ -0,0 +1,30 @@
+#ifndef LZ_H
+#define LZ_H
+
+#include <stdint.h>
+
+/*
+	LZ77 codec for clusters of file data: data is coded as
+	sequences of literal run and match with earlier bytes up to
+	64 KB back. Matches are found by one pass over 4-byte hashes,
+	there is no entropy coding, so decoding is plain copying.
+*/
+
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_DISTANCE 65535
+
+
+// worst case size of coded data of "size" bytes
+uint32_t lz_bound(uint32_t size);
+
+
+// function codes source to target, returns coded size
+// or 0 if it does not fit capacity
+uint32_t lz_compress(const void *source, uint32_t size, void *target, uint32_t capacity);
+
+
+// function decodes source to target, returns decoded size
+// or -1 if source is corrupted or does not fit capacity
+int64_t lz_decompress(const void *source, uint32_t size, void *target, uint32_t capacity);
+
+#endif
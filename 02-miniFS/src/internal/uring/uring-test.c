@@ -0,0 +1,213 @@
+#include <internal/uring/uring.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#define TEST_FILE "uring-test.bin"
+
+
+bool test_batch();
+bool test_many_requests();
+bool test_threads();
+
+
+int main() {
+    Uring ring;
+    if (!uring_init(&ring, 8)) {  // nothing to test without kernel support
+        printf("io_uring is unavailable\n");
+        printf("[GLOBAL OK]\n");
+        return 0;
+    }
+    uring_free(&ring);
+
+    bool global = true;
+    global &= test_batch();
+    global &= test_many_requests();
+    global &= test_threads();
+
+    if (global) {
+        printf("[GLOBAL OK]\n");
+    }
+
+    return 0;
+}
+
+
+// =========== [ TESTS ] ===========
+
+bool test_batch() {
+    bool status = true;
+    Uring ring;
+    uring_init(&ring, 8);
+    unlink(TEST_FILE);
+    int fd = open(TEST_FILE, O_RDWR | O_CREAT, 0644);
+
+    // two scattered writes in one batch
+    char first[100];
+    char second[300];
+    memset(first, 'a', sizeof(first));
+    memset(second, 'b', sizeof(second));
+    struct iovec iov[2] = {{first, sizeof(first)}, {second, sizeof(second)}};
+    UringBatch batch = {0};
+    uring_queue(&ring, &batch, fd, true, &iov[0], 1, 0);
+    uring_queue(&ring, &batch, fd, true, &iov[1], 1, 1000);
+    if (batch.pending != 2) {
+        status = false;
+        printf("[BAD] 1 test_batch\n");
+    }
+    uring_wait(&ring, &batch);
+    if (batch.pending != 0) {
+        status = false;
+        printf("[BAD] 2 test_batch\n");
+    }
+
+    // vector read, tail past end of file comes back zeroed
+    char head[50];
+    char tail[400];
+    memset(tail, 'x', sizeof(tail));
+    struct iovec parts[2] = {{head, sizeof(head)}, {tail, sizeof(tail)}};
+    uring_queue(&ring, &batch, fd, false, parts, 2, 1000);
+    uring_wait(&ring, &batch);
+    bool zero = true;
+    for (int index = 250; index < sizeof(tail); ++index) {
+        zero &= tail[index] == 0;
+    }
+    if (memcmp(head, second, sizeof(head)) != 0 || memcmp(tail, second + 50, 250) != 0 || !zero) {
+        status = false;
+        printf("[BAD] 3 test_batch\n");
+    }
+
+    close(fd);
+    unlink(TEST_FILE);
+    uring_free(&ring);
+
+    if (status) {
+        printf("[OK] test_batch\n");
+    } else {
+        printf("[BAD] test_batch\n");
+    }
+
+    return status;
+}
+
+
+bool test_many_requests() {
+    bool status = true;
+    Uring ring;
+    uring_init(&ring, 4);
+    unlink(TEST_FILE);
+    int fd = open(TEST_FILE, O_RDWR | O_CREAT, 0644);
+
+    // more requests than ring slots: slots are recycled while queueing
+    const int count = 64;
+    unsigned char data[64 * 16];
+    for (int index = 0; index < sizeof(data); ++index) {
+        data[index] = index % 253;
+    }
+    UringBatch batch = {0};
+    for (int index = 0; index < count; ++index) {
+        struct iovec iov = {data + index * 16, 16};
+        uring_queue(&ring, &batch, fd, true, &iov, 1, index * 16);
+    }
+    uring_wait(&ring, &batch);
+
+    unsigned char result[64 * 16];
+    for (int index = count - 1; index >= 0; --index) {
+        struct iovec iov = {result + index * 16, 16};
+        uring_queue(&ring, &batch, fd, false, &iov, 1, index * 16);
+    }
+    uring_wait(&ring, &batch);
+    if (memcmp(data, result, sizeof(data)) != 0) {
+        status = false;
+        printf("[BAD] 1 test_many_requests\n");
+    }
+    if (ring.enters >= count) {
+        status = false;
+        printf("[BAD] 2 test_many_requests\n");
+    }
+
+    close(fd);
+    unlink(TEST_FILE);
+    uring_free(&ring);
+
+    if (status) {
+        printf("[OK] test_many_requests\n");
+    } else {
+        printf("[BAD] test_many_requests\n");
+    }
+
+    return status;
+}
+
+
+typedef struct Reader {
+    Uring *ring;
+    int fd;
+    int id;
+    bool status;
+} Reader;
+
+
+void *reader(void *arg) {
+    Reader *self = (Reader*) arg;
+    unsigned char buffer[32][64];
+    for (int round = 0; round < 50; ++round) {
+        UringBatch batch = {0};
+        for (int index = 0; index < 32; ++index) {
+            struct iovec iov = {buffer[index], 64};
+            uring_queue(self->ring, &batch, self->fd, false, &iov, 1, index * 64);
+        }
+        uring_wait(self->ring, &batch);
+        for (int index = 0; index < 32; ++index) {
+            for (int byte = 0; byte < 64; ++byte) {
+                self->status &= buffer[index][byte] == (unsigned char) index;
+            }
+        }
+    }
+    return NULL;
+}
+
+
+bool test_threads() {
+    bool status = true;
+    Uring ring;
+    uring_init(&ring, 16);
+    unlink(TEST_FILE);
+    int fd = open(TEST_FILE, O_RDWR | O_CREAT, 0644);
+    unsigned char block[64];
+    for (int index = 0; index < 32; ++index) {
+        memset(block, index, sizeof(block));
+        pwrite(fd, block, sizeof(block), index * 64);
+    }
+
+    // batches of several threads share ring and reaper
+    pthread_t threads[4];
+    Reader readers[4];
+    for (int index = 0; index < 4; ++index) {
+        readers[index] = (Reader) {.ring = &ring, .fd = fd, .id = index, .status = true};
+        pthread_create(&threads[index], NULL, reader, &readers[index]);
+    }
+    for (int index = 0; index < 4; ++index) {
+        pthread_join(threads[index], NULL);
+        if (!readers[index].status) {
+            status = false;
+            printf("[BAD] 1 test_threads\n");
+        }
+    }
+
+    close(fd);
+    unlink(TEST_FILE);
+    uring_free(&ring);
+
+    if (status) {
+        printf("[OK] test_threads\n");
+    } else {
+        printf("[BAD] test_threads\n");
+    }
+
+    return status;
+}
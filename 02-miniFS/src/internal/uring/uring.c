@@ -0,0 +1,285 @@
+#include <internal/uring/uring.h>
+#include <internal/debug/debug.h>
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#ifndef __NR_io_uring_setup
+#define __NR_io_uring_setup 425
+#endif
+#ifndef __NR_io_uring_enter
+#define __NR_io_uring_enter 426
+#endif
+
+// max iovec count accepted by single readv/writev on linux
+#define URING_IOV_MAX 1024
+
+
+// =========== [ SYSCALLS ] ===========
+
+static int ring_setup(uint32_t entries, struct io_uring_params *params) {
+    return (int) syscall(__NR_io_uring_setup, entries, params);
+}
+
+
+static int ring_enter(Uring *ring, uint32_t submit, uint32_t complete, uint32_t flags) {
+    int status;
+    do {
+        status = (int) syscall(__NR_io_uring_enter, ring->fd, submit, complete, flags, NULL, 0);
+    } while (status < 0 && errno == EINTR);
+    __atomic_fetch_add(&ring->enters, 1, __ATOMIC_RELAXED);
+    if (status < 0) {
+        debug(MINIFS_ERR "io_uring_enter error %d", errno);
+        exit(-1);
+    }
+    return status;
+}
+
+
+// =========== [ REQUESTS ] ===========
+
+// finishes transfer with plain syscalls after short completion,
+// bytes past end of file are zero
+static void finish(UringRequest *request, uint64_t done) {
+    struct iovec *iov = request->iov;
+    int count = request->count;
+    uint64_t offset = request->offset;
+    while (count > 0) {
+        while (count > 0 && done >= iov->iov_len) {
+            done -= iov->iov_len;
+            offset += iov->iov_len;
+            ++iov;
+            --count;
+        }
+        if (count == 0) {
+            return;
+        }
+        iov->iov_base = (char*) iov->iov_base + done;
+        iov->iov_len -= done;
+        offset += done;
+
+        ssize_t status = request->write ? pwritev(request->fd, iov, count, offset)
+                                        : preadv(request->fd, iov, count, offset);
+        if (status < 0 || (status == 0 && request->write)) {
+            debug(MINIFS_ERR "%s error", request->write ? "write" : "read");
+            exit(-1);
+        }
+        if (status == 0) {
+            for (int index = 0; index < count; ++index) {
+                memset(iov[index].iov_base, 0, iov[index].iov_len);
+            }
+            return;
+        }
+        done = status;
+    }
+}
+
+
+static void complete(Uring *ring, struct io_uring_cqe *cqe) {
+    UringRequest *request = &ring->requests[cqe->user_data];
+    if (cqe->res < 0 && cqe->res != -EAGAIN && cqe->res != -EINTR) {
+        debug(MINIFS_ERR "io_uring %s error %d", request->write ? "write" : "read", -cqe->res);
+        exit(-1);
+    }
+    uint64_t done = cqe->res > 0 ? cqe->res : 0;
+    if (done < request->size) {
+        finish(request, done);
+    }
+
+    request->batch->pending--;
+    request->batch = NULL;
+    free(request->iov);
+    request->iov = NULL;
+    request->next = ring->free;
+    ring->free = request - ring->requests;
+}
+
+
+static void submit(Uring *ring) {
+    while (ring->queued > 0) {
+        ring->queued -= ring_enter(ring, ring->queued, 0, 0);
+    }
+}
+
+
+// one round of waiting, called with ring lock held: one thread
+// sleeps in kernel and reaps completions of everybody, others
+// wait until it is done
+static void reap(Uring *ring) {
+    submit(ring);
+    if (ring->reaping) {
+        pthread_cond_wait(&ring->reaped, &ring->lock);
+        return;
+    }
+
+    ring->reaping = true;
+    uint32_t head = *ring->cq_head;
+    if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+        pthread_mutex_unlock(&ring->lock);
+        ring_enter(ring, 0, 1, IORING_ENTER_GETEVENTS);
+        pthread_mutex_lock(&ring->lock);
+    }
+
+    uint32_t tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+    while (head != tail) {
+        complete(ring, &ring->cqes[head & *ring->cq_mask]);
+        ++head;
+    }
+    __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+    ring->reaping = false;
+    pthread_cond_broadcast(&ring->reaped);
+}
+
+
+static void push(Uring *ring, UringBatch *batch, int fd, bool write,
+                 const struct iovec *iov, int count, uint64_t offset) {
+    while (ring->free < 0) {  // every slot is in flight
+        reap(ring);
+    }
+    int32_t slot = ring->free;
+    UringRequest *request = &ring->requests[slot];
+    ring->free = request->next;
+
+    request->batch = batch;
+    request->fd = fd;
+    request->write = write;
+    request->count = count;
+    request->offset = offset;
+    request->iov = (struct iovec*) malloc(count * sizeof(struct iovec));
+    memcpy(request->iov, iov, count * sizeof(struct iovec));
+    request->size = 0;
+    for (int index = 0; index < count; ++index) {
+        request->size += iov[index].iov_len;
+    }
+    batch->pending++;
+
+    uint32_t tail = *ring->sq_tail;
+    uint32_t position = tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[position];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = write ? IORING_OP_WRITEV : IORING_OP_READV;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t) (uintptr_t) request->iov;
+    sqe->len = count;
+    sqe->off = offset;
+    sqe->user_data = slot;
+    ring->sq_array[position] = position;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ring->queued++;
+}
+
+
+// =========== [ RING ] ===========
+
+bool uring_init(Uring *ring, uint32_t entries) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = ring_setup(entries, &params);
+    if (ring->fd < 0) {
+        return false;
+    }
+
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {  // both rings share one mapping
+        if (ring->cq_ring_size > ring->sq_ring_size) {
+            ring->sq_ring_size = ring->cq_ring_size;
+        }
+        ring->cq_ring_size = ring->sq_ring_size;
+    }
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ring == MAP_FAILED) {
+        close(ring->fd);
+        return false;
+    }
+    ring->cq_ring = ring->sq_ring;
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP)) {
+        ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cq_ring == MAP_FAILED) {
+            munmap(ring->sq_ring, ring->sq_ring_size);
+            close(ring->fd);
+            return false;
+        }
+    }
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = (struct io_uring_sqe*) mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+                                             MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        if (ring->cq_ring != ring->sq_ring) {
+            munmap(ring->cq_ring, ring->cq_ring_size);
+        }
+        munmap(ring->sq_ring, ring->sq_ring_size);
+        close(ring->fd);
+        return false;
+    }
+
+    unsigned char *sq = (unsigned char*) ring->sq_ring;
+    unsigned char *cq = (unsigned char*) ring->cq_ring;
+    ring->sq_head = (uint32_t*) (sq + params.sq_off.head);
+    ring->sq_tail = (uint32_t*) (sq + params.sq_off.tail);
+    ring->sq_mask = (uint32_t*) (sq + params.sq_off.ring_mask);
+    ring->sq_array = (uint32_t*) (sq + params.sq_off.array);
+    ring->cq_head = (uint32_t*) (cq + params.cq_off.head);
+    ring->cq_tail = (uint32_t*) (cq + params.cq_off.tail);
+    ring->cq_mask = (uint32_t*) (cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*) (cq + params.cq_off.cqes);
+
+    // no more requests in flight than submission slots, so
+    // completion ring of twice that size never overflows
+    ring->entries = params.sq_entries;
+    ring->requests = (UringRequest*) calloc(ring->entries, sizeof(UringRequest));
+    for (uint32_t index = 0; index < ring->entries; ++index) {
+        ring->requests[index].next = (index + 1 < ring->entries) ? (int32_t) index + 1 : -1;
+    }
+    ring->free = 0;
+    pthread_mutex_init(&ring->lock, NULL);
+    pthread_cond_init(&ring->reaped, NULL);
+    return true;
+}
+
+
+void uring_free(Uring *ring) {
+    free(ring->requests);
+    munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_ring != ring->sq_ring) {
+        munmap(ring->cq_ring, ring->cq_ring_size);
+    }
+    munmap(ring->sq_ring, ring->sq_ring_size);
+    close(ring->fd);
+    pthread_mutex_destroy(&ring->lock);
+    pthread_cond_destroy(&ring->reaped);
+}
+
+
+void uring_queue(Uring *ring, UringBatch *batch, int fd, bool write,
+                 const struct iovec *iov, int count, uint64_t offset) {
+    pthread_mutex_lock(&ring->lock);
+    while (count > 0) {  // long vectors are split into several requests
+        int part = count < URING_IOV_MAX ? count : URING_IOV_MAX;
+        push(ring, batch, fd, write, iov, part, offset);
+        for (int index = 0; index < part; ++index) {
+            offset += iov[index].iov_len;
+        }
+        iov += part;
+        count -= part;
+    }
+    pthread_mutex_unlock(&ring->lock);
+}
+
+
+void uring_wait(Uring *ring, UringBatch *batch) {
+    pthread_mutex_lock(&ring->lock);
+    submit(ring);
+    while (batch->pending > 0) {
+        reap(ring);
+    }
+    pthread_mutex_unlock(&ring->lock);
+}
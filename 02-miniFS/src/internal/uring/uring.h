@@ -0,0 +1,85 @@
+#ifndef URING_H
+#define URING_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+/*
+	Minimal io_uring ring on raw syscalls, no liburing. Transfers
+	are queued into batches, queued requests go to kernel with one
+	io_uring_enter and completions are reaped together. Ring can be
+	shared by threads: one waiter reaps completions of all batches,
+	others sleep until their requests are done.
+*/
+
+#define URING_DEFAULT_ENTRIES 256
+
+struct iovec;
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+
+// requests of one caller, done when pending drops to zero
+typedef struct UringBatch {
+    uint32_t pending;
+} UringBatch;
+
+
+typedef struct UringRequest {
+    UringBatch *batch;      // NULL if slot is free
+    int fd;
+    bool write;
+    struct iovec *iov;      // own copy, kernel reads it until completion
+    int count;
+    uint64_t offset;
+    uint64_t size;
+    int32_t next;           // next free slot
+} UringRequest;
+
+
+typedef struct Uring {
+    int fd;
+    uint32_t entries;
+    uint32_t *sq_head;
+    uint32_t *sq_tail;
+    uint32_t *sq_mask;
+    uint32_t *sq_array;
+    struct io_uring_sqe *sqes;
+    uint32_t queued;        // sqes not yet passed to kernel
+    uint32_t *cq_head;
+    uint32_t *cq_tail;
+    uint32_t *cq_mask;
+    struct io_uring_cqe *cqes;
+    void *sq_ring;
+    void *cq_ring;
+    uint64_t sq_ring_size;
+    uint64_t cq_ring_size;
+    uint64_t sqes_size;
+    UringRequest *requests;
+    int32_t free;           // first free request slot or -1
+    bool reaping;           // some thread waits for completions
+    pthread_mutex_t lock;
+    pthread_cond_t reaped;
+    uint64_t enters;        // io_uring_enter calls
+} Uring;
+
+
+// function sets ring up, returns false if kernel has no io_uring
+bool uring_init(Uring *ring, uint32_t entries);
+
+
+void uring_free(Uring *ring);
+
+
+// ring, batch, fd, write, iovecs, count, offset: queues transfer,
+// memory of iovecs must stay untouched until batch is waited
+void uring_queue(Uring *ring, UringBatch *batch, int fd, bool write,
+                 const struct iovec *iov, int count, uint64_t offset);
+
+
+// function submits queued requests and returns when all
+// requests of batch are complete
+void uring_wait(Uring *ring, UringBatch *batch);
+
+#endif
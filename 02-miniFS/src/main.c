@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
 
 #include <readline/readline.h>
 #include <readline/history.h>
@@ -11,27 +12,90 @@
 #include <internal/fs/fs.h>
 
 
-struct Filesystem fs; // global fs object
-
-
 int main(int argc, char **argv) {
     char *input;      // input line
     char **tokens;    // input split lines
     int count;        // count of input split lines
+    bool use_mmap;    // use mmap backend for block data
+    bool use_uring;   // submit block io through io_uring
+    bool use_journal; // log metadata updates to journal
+    bool compress;    // new files keep compressed data
+    int cache_size;   // buffer cache size in kilobytes, -1 for default
+    Geometry geometry; // geometry of created image
+    bool custom;      // geometry is given by flags
+    Filesystem fs;    // controller of opened image
 
-    if (argc != 2) {   // check if path to fs device is given
-        printf("[Error] format: %s <path/to/file>\n", argv[0]);
+    use_mmap = false;
+    use_uring = false;
+    use_journal = false;
+    compress = false;
+    cache_size = -1;
+    geometry.inode_count = DEFAULT_INODE_COUNT;
+    geometry.block_count = DEFAULT_BLOCK_COUNT;
+    geometry.block_size = DEFAULT_BLOCK_SIZE;
+    geometry.inode_size = 0;
+    custom = false;
+    for (int index = 1; index < argc - 1; ++index) {
+        if (strcmp(argv[index], "--mmap") == 0) {
+            use_mmap = true;
+        } else if (strcmp(argv[index], "--uring") == 0) {
+            use_uring = true;
+        } else if (strcmp(argv[index], "--journal") == 0) {
+            use_journal = true;
+        } else if (strcmp(argv[index], "--compress") == 0) {
+            compress = true;
+        } else if (strcmp(argv[index], "--cache") == 0 && index + 1 < argc - 1) {
+            cache_size = atoi(argv[++index]);
+        } else if (strcmp(argv[index], "--inodes") == 0 && index + 1 < argc - 1) {
+            geometry.inode_count = strtoul(argv[++index], NULL, 10);
+            custom = true;
+        } else if (strcmp(argv[index], "--blocks") == 0 && index + 1 < argc - 1) {
+            geometry.block_count = strtoul(argv[++index], NULL, 10);
+            custom = true;
+        } else if (strcmp(argv[index], "--block-size") == 0 && index + 1 < argc - 1) {
+            geometry.block_size = strtoul(argv[++index], NULL, 10);
+            custom = true;
+        } else if (strcmp(argv[index], "--inode-size") == 0 && index + 1 < argc - 1) {
+            geometry.inode_size = strtoul(argv[++index], NULL, 10);
+            custom = true;
+        } else {
+            argc = 0;
+            break;
+        }
+    }
+    if (argc < 2) {   // check if path to fs device is given
+        printf("[Error] format: %s [--mmap] [--uring] [--journal] [--compress] [--cache <kilobytes>] "
+               "[--inodes <count>] [--blocks <count>] [--block-size <bytes>] [--inode-size <bytes>] "
+               "<path/to/file>\n", argv[0]);
         return -1;
     }
+    const char *path = argv[argc - 1];
 
-    bool exists = check_exists(argv[1]);
+    bool exists = check_exists(path);
     debug(MINIFS_INFO "status: %d", exists);
 
-    if (!exists) {
-        minifs_init(argv[1]);
+    if (!exists && !minifs_format(path, &geometry)) {
+        printf("[Error] cannot create image with given geometry\n");
+        return -1;
+    }
+    if (exists && custom) {
+        printf("[Warning] image exists, geometry flags are ignored\n");
     }
 
-    fs = minifs_open(argv[1]);
+    fs = minifs_open(path);
+    if (cache_size >= 0) {
+        minifs_set_cache_size(&fs, cache_size * 1024);
+    }
+    if (use_mmap && !minifs_map_image(&fs)) {
+        printf("[Warning] cannot map image, using fd backend\n");
+    }
+    if (use_uring && !minifs_enable_uring(&fs)) {
+        printf("[Warning] io_uring is unavailable, using synchronous io\n");
+    }
+    if (use_journal) {
+        minifs_enable_journal(&fs);
+    }
+    fs.compress = compress;
 
     while (true) {
         input = readline("$ ");